@@ -1,8 +1,13 @@
 ﻿#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <fstream>
 #include <string>
 #include <random>
 #include <functional>
 #include "LispParseTree.h"
+#include "LispParseTreeVisitor.h"
+#include "BluePassCache.h"
+#include "SerializedLispParseTree.h"
 
 namespace {
     std::string BuildDeepProgram(std::size_t n) {
@@ -203,6 +208,13 @@ namespace {
         return "(progn " + result + ")" + std::string(1, EOF);
     }
 
+    //the realistic code laid out as a source file does, every definition a top level form of its own
+    std::string BuildTopLevelRealisticCode(std::size_t complexity) {
+        const std::string wrapped = BuildRealisticCode(complexity);
+        constexpr std::string_view prefix = "(progn ";
+        return wrapped.substr(prefix.size(),wrapped.size() - prefix.size() - 2) + std::string(PaddingSize,EOF);
+    }
+
     std::string Build1GBDeeplyNestedProgram() {
         constexpr auto size = 85'000'000;
         std::string code;
@@ -628,6 +640,42 @@ BENCHMARK(BM_WarmCache_DeeplyNested)
     ->Unit(benchmark::kMillisecond)
     ->DisplayAggregatesOnly(true);
 
+//a service parsing one file after another, alternating between programs of different shapes and sizes with one parser
+static void BM_WarmCache_ResetAcrossPrograms(benchmark::State& state) {
+    const std::string programs[] = {
+        BuildDeepProgram(100'000),
+        BuildFunctionDefinitions(2'000),
+        BuildWithComments(5'000),
+        BuildRealisticCode(50)
+    };
+    for (const auto& code : programs) {
+        benchmark::DoNotOptimize(code.data());
+    }
+    benchmark::ClobberMemory();
+    std::size_t bytes = 0;
+    std::size_t next = 0;
+    const auto parser = std::make_unique<WideLips::LispParser>(std::string_view(programs[0]),false);
+    for ([[maybe_unused]]auto _ : state) {
+        const std::string& code = programs[next++ % std::size(programs)];
+        bytes += code.size();
+        parser->Reset(std::string_view(code));
+        auto parsedProgram = parser->Parse();
+        benchmark::DoNotOptimize(parsedProgram);
+    }
+    state.counters["Gigabytes"] = benchmark::Counter(
+            static_cast<double>(bytes), benchmark::Counter::kIsRate,
+            benchmark::Counter::OneK::kIs1000);
+    state.counters["Files"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_WarmCache_ResetAcrossPrograms)
+    ->Repetitions(Repetitions)
+    ->ComputeStatistics("max", [](const std::vector<double>& v) -> double {
+        return *std::ranges::max_element(v);
+    })
+    ->Unit(benchmark::kMillisecond)
+    ->DisplayAggregatesOnly(true);
+
 static void BM_Parse1GBDeeplyNested(benchmark::State& state) {
     std::string code = Build1GBDeeplyNestedProgram();
     benchmark::DoNotOptimize(code.data());
@@ -684,4 +732,589 @@ BENCHMARK(BM_Parse1GBAdjacentSExpressions)
     ->Unit(benchmark::kMillisecond)
     ->DisplayAggregatesOnly(true);
 
+//same as the 1GB benchmarks above but the classification kernel is picked by the benchmark argument, so the blue pass
+//of every kernel can be compared on the same input
+static void BM_Parse1GBDeeplyNestedPerKernel(benchmark::State& state) {
+    const WideLips::LispLexerOptions options{.Kernel = static_cast<WideLips::ClassificationKernel>(state.range(0))};
+    if (!WideLips::LispLexer::IsKernelSupported(options.Kernel)) {
+        state.SkipWithError("classification kernel is not supported by this CPU");
+        return;
+    }
+    std::string code = Build1GBDeeplyNestedProgram();
+    benchmark::DoNotOptimize(code.data());
+    benchmark::DoNotOptimize(code.size());
+    benchmark::ClobberMemory();
+    std::size_t bytes = 0;
+    const auto parser = std::make_unique<WideLips::LispParser>(std::string_view(code),false,options);
+    for ([[maybe_unused]]auto _ : state) {
+        bytes += code.size();
+        auto parsedProgram = parser->Parse();
+        benchmark::DoNotOptimize(parsedProgram);
+        parser->Reuse();
+    }
+    state.counters["Gigabytes"] = benchmark::Counter(
+            static_cast<double>(bytes), benchmark::Counter::kIsRate,
+            benchmark::Counter::OneK::kIs1000);
+    state.counters["Files"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+    state.counters["CodeSize"] = static_cast<double>(code.size());
+}
+
+BENCHMARK(BM_Parse1GBDeeplyNestedPerKernel)
+    ->ArgName("Kernel")
+    ->Arg(static_cast<int>(WideLips::ClassificationKernel::Scalar))
+    ->Arg(static_cast<int>(WideLips::ClassificationKernel::Sse42))
+    ->Arg(static_cast<int>(WideLips::ClassificationKernel::Avx2))
+    ->Arg(static_cast<int>(WideLips::ClassificationKernel::Avx512))
+    ->Repetitions(Repetitions)
+    ->ComputeStatistics("max", [](const std::vector<double>& v) -> double {
+        return *std::ranges::max_element(v);
+    })
+    ->Unit(benchmark::kMillisecond)
+    ->DisplayAggregatesOnly(true);
+
+static void BM_Parse1GBAdjacentSExpressionsPerKernel(benchmark::State& state) {
+    const WideLips::LispLexerOptions options{.Kernel = static_cast<WideLips::ClassificationKernel>(state.range(0))};
+    if (!WideLips::LispLexer::IsKernelSupported(options.Kernel)) {
+        state.SkipWithError("classification kernel is not supported by this CPU");
+        return;
+    }
+    std::string code = Build1GBAdjacentSExpressions();
+    benchmark::DoNotOptimize(code.data());
+    benchmark::DoNotOptimize(code.size());
+    benchmark::ClobberMemory();
+    std::size_t bytes = 0;
+    const auto parser = std::make_unique<WideLips::LispParser>(std::string_view(code),false,options);
+    for ([[maybe_unused]]auto _ : state) {
+        bytes += code.size();
+        auto parsedProgram = parser->Parse();
+        benchmark::DoNotOptimize(parsedProgram);
+        parser->Reuse();
+    }
+    state.counters["Gigabytes"] = benchmark::Counter(
+            static_cast<double>(bytes), benchmark::Counter::kIsRate,
+            benchmark::Counter::OneK::kIs1000);
+    state.counters["Files"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+    state.counters["CodeSize"] = static_cast<double>(code.size());
+}
+
+BENCHMARK(BM_Parse1GBAdjacentSExpressionsPerKernel)
+    ->ArgName("Kernel")
+    ->Arg(static_cast<int>(WideLips::ClassificationKernel::Scalar))
+    ->Arg(static_cast<int>(WideLips::ClassificationKernel::Sse42))
+    ->Arg(static_cast<int>(WideLips::ClassificationKernel::Avx2))
+    ->Arg(static_cast<int>(WideLips::ClassificationKernel::Avx512))
+    ->Repetitions(Repetitions)
+    ->ComputeStatistics("max", [](const std::vector<double>& v) -> double {
+        return *std::ranges::max_element(v);
+    })
+    ->Unit(benchmark::kMillisecond)
+    ->DisplayAggregatesOnly(true);
+
+//the 1GB inputs classified over 'Threads' threads, the parentheses are matched over as many with the parallel blue
+//pass engine (BlueEngine 1) while the sequential one (BlueEngine 0) walks the text on the calling thread
+static void BM_Parse1GBDeeplyNestedThreads(benchmark::State& state) {
+    std::string code = Build1GBDeeplyNestedProgram();
+    benchmark::DoNotOptimize(code.data());
+    benchmark::DoNotOptimize(code.size());
+    benchmark::ClobberMemory();
+    std::size_t bytes = 0;
+    const WideLips::LispLexerOptions options{
+        .Threads = static_cast<std::uint32_t>(state.range(0)),
+        .BlueEngine = static_cast<WideLips::BluePassEngine>(state.range(1))
+    };
+    const auto parser = std::make_unique<WideLips::LispParser>(std::string_view(code),false,options);
+    for ([[maybe_unused]]auto _ : state) {
+        bytes += code.size();
+        auto parsedProgram = parser->Parse();
+        benchmark::DoNotOptimize(parsedProgram);
+        parser->Reuse();
+    }
+    state.counters["Gigabytes"] = benchmark::Counter(
+            static_cast<double>(bytes), benchmark::Counter::kIsRate,
+            benchmark::Counter::OneK::kIs1000);
+    state.counters["Files"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+    state.counters["CodeSize"] = static_cast<double>(code.size());
+}
+
+BENCHMARK(BM_Parse1GBDeeplyNestedThreads)
+    ->ArgNames({"Threads", "BlueEngine"})
+    ->ArgsProduct({benchmark::CreateRange(1, 16, 2), {
+        static_cast<int>(WideLips::BluePassEngine::Sequential),
+        static_cast<int>(WideLips::BluePassEngine::Parallel)}})
+    ->Repetitions(Repetitions)
+    ->ComputeStatistics("max", [](const std::vector<double>& v) -> double {
+        return *std::ranges::max_element(v);
+    })
+    ->Unit(benchmark::kMillisecond)
+    ->DisplayAggregatesOnly(true);
+
+static void BM_Parse1GBAdjacentSExpressionsThreads(benchmark::State& state) {
+    std::string code = Build1GBAdjacentSExpressions();
+    benchmark::DoNotOptimize(code.data());
+    benchmark::DoNotOptimize(code.size());
+    benchmark::ClobberMemory();
+    std::size_t bytes = 0;
+    const WideLips::LispLexerOptions options{
+        .Threads = static_cast<std::uint32_t>(state.range(0)),
+        .BlueEngine = static_cast<WideLips::BluePassEngine>(state.range(1))
+    };
+    const auto parser = std::make_unique<WideLips::LispParser>(std::string_view(code),false,options);
+    for ([[maybe_unused]]auto _ : state) {
+        bytes += code.size();
+        auto parsedProgram = parser->Parse();
+        benchmark::DoNotOptimize(parsedProgram);
+        parser->Reuse();
+    }
+    state.counters["Gigabytes"] = benchmark::Counter(
+            static_cast<double>(bytes), benchmark::Counter::kIsRate,
+            benchmark::Counter::OneK::kIs1000);
+    state.counters["Files"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+    state.counters["CodeSize"] = static_cast<double>(code.size());
+}
+
+BENCHMARK(BM_Parse1GBAdjacentSExpressionsThreads)
+    ->ArgNames({"Threads", "BlueEngine"})
+    ->ArgsProduct({benchmark::CreateRange(1, 16, 2), {
+        static_cast<int>(WideLips::BluePassEngine::Sequential),
+        static_cast<int>(WideLips::BluePassEngine::Parallel)}})
+    ->Repetitions(Repetitions)
+    ->ComputeStatistics("max", [](const std::vector<double>& v) -> double {
+        return *std::ranges::max_element(v);
+    })
+    ->Unit(benchmark::kMillisecond)
+    ->DisplayAggregatesOnly(true);
+
+//the 1GB adjacent S-expressions parsed with eager (Locations 0) and lazy (Locations 1) source locations, every list is
+//materialized so the green pass runs over the whole text
+static void BM_Parse1GBAdjacentSExpressionsLocations(benchmark::State& state) {
+    std::string code = Build1GBAdjacentSExpressions();
+    benchmark::DoNotOptimize(code.data());
+    benchmark::DoNotOptimize(code.size());
+    benchmark::ClobberMemory();
+    std::size_t bytes = 0;
+    const WideLips::LispLexerOptions options{
+        .Locations = static_cast<WideLips::SourceLocations>(state.range(0))
+    };
+    const auto parser = std::make_unique<WideLips::LispParser>(std::string_view(code),false,options);
+    for ([[maybe_unused]]auto _ : state) {
+        bytes += code.size();
+        auto* node = parser->Parse();
+        while (node != nullptr && node->Kind == WideLips::LispParseNodeKind::SExpr) {
+            benchmark::DoNotOptimize(reinterpret_cast<WideLips::LispList*>(node)->GetSubExpressions());
+            node = node->NextNode();
+        }
+        parser->Reuse();
+    }
+    state.counters["Gigabytes"] = benchmark::Counter(
+            static_cast<double>(bytes), benchmark::Counter::kIsRate,
+            benchmark::Counter::OneK::kIs1000);
+    state.counters["Files"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+    state.counters["CodeSize"] = static_cast<double>(code.size());
+}
+
+BENCHMARK(BM_Parse1GBAdjacentSExpressionsLocations)
+    ->ArgName("Locations")
+    ->Arg(static_cast<int>(WideLips::SourceLocations::Eager))
+    ->Arg(static_cast<int>(WideLips::SourceLocations::Lazy))
+    ->Repetitions(Repetitions)
+    ->ComputeStatistics("max", [](const std::vector<double>& v) -> double {
+        return *std::ranges::max_element(v);
+    })
+    ->Unit(benchmark::kMillisecond)
+    ->DisplayAggregatesOnly(true);
+
+//the 1GB adjacent S-expressions parsed with the lexer arenas backed by regular (HugePages 0) and transparent huge
+//(HugePages 1) pages, every list is materialized so the green pass hops over the blocks and tokens of the whole text
+static void BM_Parse1GBAdjacentSExpressionsHugePages(benchmark::State& state) {
+    std::string code = Build1GBAdjacentSExpressions();
+    benchmark::DoNotOptimize(code.data());
+    benchmark::DoNotOptimize(code.size());
+    benchmark::ClobberMemory();
+    std::size_t bytes = 0;
+    const WideLips::LispLexerOptions options{
+        .HugePages = state.range(0) != 0
+    };
+    const auto parser = std::make_unique<WideLips::LispParser>(std::string_view(code),false,options);
+    for ([[maybe_unused]]auto _ : state) {
+        bytes += code.size();
+        auto* node = parser->Parse();
+        while (node != nullptr && node->Kind == WideLips::LispParseNodeKind::SExpr) {
+            benchmark::DoNotOptimize(reinterpret_cast<WideLips::LispList*>(node)->GetSubExpressions());
+            node = node->NextNode();
+        }
+        parser->Reuse();
+    }
+    state.counters["Gigabytes"] = benchmark::Counter(
+            static_cast<double>(bytes), benchmark::Counter::kIsRate,
+            benchmark::Counter::OneK::kIs1000);
+    state.counters["Files"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+    state.counters["CodeSize"] = static_cast<double>(code.size());
+}
+
+BENCHMARK(BM_Parse1GBAdjacentSExpressionsHugePages)
+    ->ArgName("HugePages")
+    ->Arg(0)
+    ->Arg(1)
+    ->Repetitions(Repetitions)
+    ->ComputeStatistics("max", [](const std::vector<double>& v) -> double {
+        return *std::ranges::max_element(v);
+    })
+    ->Unit(benchmark::kMillisecond)
+    ->DisplayAggregatesOnly(true);
+
+//the blue pass alone over realistic code from 64KB to 1GB, the two-phase sequential engine (BlueEngine 0) classifies
+//the whole text before walking it again while the fused one (BlueEngine 2) matches every tile right after classifying it
+static void BM_TokenizeBlueFusedVsTwoPhase(benchmark::State& state) {
+    const auto size = static_cast<std::size_t>(state.range(0));
+    std::string code = BuildRealisticCode(size / BuildRealisticCode(1).size() + 1);
+    benchmark::DoNotOptimize(code.data());
+    benchmark::DoNotOptimize(code.size());
+    benchmark::ClobberMemory();
+    std::size_t bytes = 0;
+    const WideLips::LispLexerOptions options{
+        .BlueEngine = static_cast<WideLips::BluePassEngine>(state.range(1))
+    };
+    const auto lexer = WideLips::LispLexer::Make(std::string_view(code),false,options);
+    for ([[maybe_unused]]auto _ : state) {
+        bytes += code.size();
+        benchmark::DoNotOptimize(lexer->Tokenize());
+        lexer->Reuse();
+    }
+    state.counters["Gigabytes"] = benchmark::Counter(
+            static_cast<double>(bytes), benchmark::Counter::kIsRate,
+            benchmark::Counter::OneK::kIs1000);
+    state.counters["CodeSize"] = static_cast<double>(code.size());
+}
+
+BENCHMARK(BM_TokenizeBlueFusedVsTwoPhase)
+    ->ArgNames({"Size", "BlueEngine"})
+    ->ArgsProduct({benchmark::CreateRange(64 << 10, 1 << 30, 16), {
+        static_cast<int>(WideLips::BluePassEngine::Sequential),
+        static_cast<int>(WideLips::BluePassEngine::Fused)}})
+    ->Repetitions(Repetitions)
+    ->ComputeStatistics("max", [](const std::vector<double>& v) -> double {
+        return *std::ranges::max_element(v);
+    })
+    ->Unit(benchmark::kMillisecond)
+    ->DisplayAggregatesOnly(true);
+
+//the blue pass alone over atom heavy programs, a wide list (Program 0) and mixed atoms (Program 1). the sequential
+//engine (BlueEngine 0) dispatches on every atom to move past it while the parallel (BlueEngine 1, on a single thread
+//here) and fused (BlueEngine 2) ones only visit the parentheses, quotes and comments of the classified blocks
+static void BM_TokenizeBlueAtomHeavy(benchmark::State& state) {
+    std::string code = state.range(0) == 0 ? BuildWideList(250'000) : BuildMixedAtoms(250'000);
+    benchmark::DoNotOptimize(code.data());
+    benchmark::DoNotOptimize(code.size());
+    benchmark::ClobberMemory();
+    std::size_t bytes = 0;
+    const WideLips::LispLexerOptions options{
+        .BlueEngine = static_cast<WideLips::BluePassEngine>(state.range(1))
+    };
+    const auto lexer = WideLips::LispLexer::Make(std::string_view(code),false,options);
+    for ([[maybe_unused]]auto _ : state) {
+        bytes += code.size();
+        benchmark::DoNotOptimize(lexer->Tokenize());
+        lexer->Reuse();
+    }
+    state.counters["Gigabytes"] = benchmark::Counter(
+            static_cast<double>(bytes), benchmark::Counter::kIsRate,
+            benchmark::Counter::OneK::kIs1000);
+    state.counters["CodeSize"] = static_cast<double>(code.size());
+}
+
+BENCHMARK(BM_TokenizeBlueAtomHeavy)
+    ->ArgNames({"Program", "BlueEngine"})
+    ->ArgsProduct({{0, 1}, {
+        static_cast<int>(WideLips::BluePassEngine::Sequential),
+        static_cast<int>(WideLips::BluePassEngine::Parallel),
+        static_cast<int>(WideLips::BluePassEngine::Fused)}})
+    ->Repetitions(Repetitions)
+    ->ComputeStatistics("max", [](const std::vector<double>& v) -> double {
+        return *std::ranges::max_element(v);
+    })
+    ->Unit(benchmark::kMillisecond)
+    ->DisplayAggregatesOnly(true);
+
+//an editor typing into a 4MB program, a char is inserted within a top level form in the middle and removed again on
+//the next iteration. 'ApplyEdit' (Mode 0) matches that form again and moves what follows it, resetting the parser and
+//parsing the edited program (Mode 1) runs the whole blue pass. either way the first top level form is parsed after
+static void BM_ApplyEditVsReparse(benchmark::State& state) {
+    std::string code = BuildTopLevelRealisticCode((4 << 20) / BuildRealisticCode(1).size() + 1);
+    benchmark::DoNotOptimize(code.data());
+    benchmark::ClobberMemory();
+    const auto offset = static_cast<std::uint32_t>(code.find('(',code.size() / 2) + 1);
+    const bool applyEdit = state.range(0) == 0;
+    const auto parser = std::make_unique<WideLips::LispParser>(std::string_view(code),false);
+    benchmark::DoNotOptimize(parser->Parse());
+    bool inserted = false;
+    for ([[maybe_unused]]auto _ : state) {
+        WideLips::LispParseNodeBase* root = nullptr;
+        if (applyEdit) {
+            root = inserted ? parser->ApplyEdit(offset,1,"") : parser->ApplyEdit(offset,0," ");
+        }
+        else {
+            inserted ? code.erase(offset,1) : code.insert(offset,1,' ');
+            parser->Reset(std::string_view(code));
+            root = parser->Parse();
+        }
+        inserted = !inserted;
+        benchmark::DoNotOptimize(root);
+    }
+    state.counters["Edits"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+    state.counters["CodeSize"] = static_cast<double>(code.size());
+}
+
+BENCHMARK(BM_ApplyEditVsReparse)
+    ->ArgName("Mode")
+    ->DenseRange(0, 1)
+    ->Repetitions(Repetitions)
+    ->ComputeStatistics("max", [](const std::vector<double>& v) -> double {
+        return *std::ranges::max_element(v);
+    })
+    ->Unit(benchmark::kMicrosecond)
+    ->DisplayAggregatesOnly(true);
+
+//a CI run over a 64MB program that didn't change since the last one. the blue pass runs in full without a cache
+//(Mode 0), or is copied from the file a previous run left in a 'BluePassCache' after hashing the text, which then
+//classifies the text again (Mode 1) or copies the classified blocks from the file too (Mode 2)
+static void BM_TokenizeWithBluePassCache(benchmark::State& state) {
+    std::string code = BuildRealisticCode((64 << 20) / BuildRealisticCode(1).size() + 1);
+    benchmark::DoNotOptimize(code.data());
+    benchmark::ClobberMemory();
+    const auto cacheDirectory = std::filesystem::temp_directory_path() / "widelips_bm_blue_pass_cache";
+    std::filesystem::remove_all(cacheDirectory);
+    WideLips::BluePassCache cache(cacheDirectory,state.range(0) == 2);
+    const WideLips::LispLexerOptions options{.Cache = state.range(0) != 0 ? &cache : nullptr};
+    const auto lexer = WideLips::LispLexer::Make(std::string_view(code),false,options);
+    benchmark::DoNotOptimize(lexer->Tokenize()); //leaves the file for the text behind
+    lexer->Reuse();
+    std::size_t bytes = 0;
+    for ([[maybe_unused]]auto _ : state) {
+        bytes += code.size();
+        benchmark::DoNotOptimize(lexer->Tokenize());
+        lexer->Reuse();
+    }
+    std::filesystem::remove_all(cacheDirectory);
+    state.counters["Gigabytes"] = benchmark::Counter(
+            static_cast<double>(bytes), benchmark::Counter::kIsRate,
+            benchmark::Counter::OneK::kIs1000);
+    state.counters["CodeSize"] = static_cast<double>(code.size());
+}
+
+BENCHMARK(BM_TokenizeWithBluePassCache)
+    ->ArgName("Mode")
+    ->DenseRange(0, 2)
+    ->Repetitions(Repetitions)
+    ->ComputeStatistics("max", [](const std::vector<double>& v) -> double {
+        return *std::ranges::max_element(v);
+    })
+    ->Unit(benchmark::kMillisecond)
+    ->DisplayAggregatesOnly(true);
+
+namespace {
+    //the last sub-expression of a live list is followed by whatever comes after it in the text, so a list's
+    //sub-expressions are the nodes that begin before it ends
+    std::size_t CountLiveNodes(WideLips::LispParseNodeBase* node,const char* end) {
+        std::size_t nodes = 0;
+        for (; node != nullptr && node->Kind != WideLips::LispParseNodeKind::EndOfProgram &&
+            node->GetParseNodeText().data() < end; node = node->NextNode()) {
+            ++nodes;
+            if (node->Kind == WideLips::LispParseNodeKind::SExpr) {
+                const std::string_view text = node->GetParseNodeText();
+                nodes += CountLiveNodes(reinterpret_cast<WideLips::LispList*>(node)->GetSubExpressions(),
+                    text.data() + text.size());
+            }
+        }
+        return nodes;
+    }
+
+    std::size_t CountSerializedNodes(const WideLips::SerializedLispParseNode* node) {
+        std::size_t nodes = 0;
+        for (; node != nullptr; node = node->NextNode()) {
+            ++nodes;
+            if (node->Kind == WideLips::LispParseNodeKind::SExpr) {
+                nodes += CountSerializedNodes(reinterpret_cast<const WideLips::SerializedLispList*>(node)->GetSubExpressions());
+            }
+        }
+        return nodes;
+    }
+}
+
+//a 16MB program walked node by node, either parsed from its text (Mode 0) or mapped from the file a
+//'SerializedLispParseTree' was written to after parsing it once (Mode 1)
+static void BM_WalkSerializedParseTree(benchmark::State& state) {
+    std::string code = BuildRealisticCode((16 << 20) / BuildRealisticCode(1).size() + 1);
+    benchmark::DoNotOptimize(code.data());
+    benchmark::ClobberMemory();
+    const auto filePath = std::filesystem::temp_directory_path() / "widelips_bm_serialized_tree.wlt";
+    const auto parser = std::make_unique<WideLips::LispParser>(std::string_view(code),false);
+    WideLips::SerializedLispParseTree::Write(filePath,parser->Parse());
+    parser->Reuse();
+    std::size_t bytes = 0;
+    std::size_t nodes = 0;
+    for ([[maybe_unused]]auto _ : state) {
+        bytes += code.size();
+        if (state.range(0) == 0) {
+            nodes = CountLiveNodes(parser->Parse(),code.data() + code.size());
+            parser->Reuse();
+        }
+        else {
+            const auto tree = WideLips::SerializedLispParseTree::Map(filePath);
+            nodes = CountSerializedNodes(tree->GetRoot());
+        }
+        benchmark::DoNotOptimize(nodes);
+    }
+    std::filesystem::remove(filePath);
+    state.counters["Gigabytes"] = benchmark::Counter(
+            static_cast<double>(bytes), benchmark::Counter::kIsRate,
+            benchmark::Counter::OneK::kIs1000);
+    state.counters["Nodes"] = static_cast<double>(nodes);
+    state.counters["CodeSize"] = static_cast<double>(code.size());
+}
+
+BENCHMARK(BM_WalkSerializedParseTree)
+    ->ArgName("Mode")
+    ->DenseRange(0, 1)
+    ->Repetitions(Repetitions)
+    ->ComputeStatistics("max", [](const std::vector<double>& v) -> double {
+        return *std::ranges::max_element(v);
+    })
+    ->Unit(benchmark::kMillisecond)
+    ->DisplayAggregatesOnly(true);
+
+//the top-level forms of a 16MB program walked node by node by as many threads as the benchmark argument, each one
+//materializing the forms dealt to it into a lexer shard and parse nodes pool of its own
+static void BM_ExpandFormsConcurrently(benchmark::State& state) {
+    const std::string code = BuildTopLevelRealisticCode((16 << 20) / BuildRealisticCode(1).size() + 1);
+    benchmark::DoNotOptimize(code.data());
+    benchmark::ClobberMemory();
+    const auto threads = static_cast<std::size_t>(state.range(0));
+    const auto parser = std::make_unique<WideLips::LispParser>(std::string_view(code),
+        false,
+        WideLips::LispLexerOptions{.Concurrent = true});
+    std::vector<WideLips::LispParseNodeBase*> forms;
+    std::vector<std::size_t> nodes(threads);
+    std::size_t bytes = 0;
+    for ([[maybe_unused]]auto _ : state) {
+        bytes += code.size();
+        parser->Reset(std::string_view(code));
+        forms.clear();
+        for (WideLips::LispParseNodeBase* form = parser->Parse();
+            form != nullptr && form->Kind != WideLips::LispParseNodeKind::EndOfProgram; form = form->NextNode()) {
+            forms.push_back(form);
+        }
+        WideLips::ParallelFor(threads,[&](const std::size_t chunk) {
+            nodes[chunk] = 0;
+            for (std::size_t form = chunk; form < forms.size(); form += threads) {
+                const std::string_view text = forms[form]->GetParseNodeText();
+                nodes[chunk] += CountLiveNodes(forms[form],text.data() + text.size());
+            }
+        });
+        benchmark::DoNotOptimize(nodes.data());
+    }
+    state.counters["Gigabytes"] = benchmark::Counter(
+            static_cast<double>(bytes), benchmark::Counter::kIsRate,
+            benchmark::Counter::OneK::kIs1000);
+    state.counters["Forms"] = static_cast<double>(forms.size());
+    state.counters["CodeSize"] = static_cast<double>(code.size());
+}
+
+BENCHMARK(BM_ExpandFormsConcurrently)
+    ->ArgName("Threads")
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->Repetitions(Repetitions)
+    ->ComputeStatistics("max", [](const std::vector<double>& v) -> double {
+        return *std::ranges::max_element(v);
+    })
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->DisplayAggregatesOnly(true);
+
+namespace {
+    struct NodeCountingVisitor final : WideLips::LispParseTreeVisitor<NodeCountingVisitor> {
+        std::size_t Nodes = 0;
+        void Visit(WideLips::LispAtom* const) noexcept { ++Nodes; }
+        void Visit(WideLips::LispList* const) noexcept { ++Nodes; }
+        void Visit(WideLips::LispArguments* const) noexcept { ++Nodes; }
+        void Visit(WideLips::LispParseError* const) noexcept { ++Nodes; }
+    };
+}
+
+//a whole file analysis over a 64MB program: the 'ParallelLispParseTreeWalker' hands its top-level forms straight from
+//the blue pass to as many workers as the benchmark argument, each of them materializing and visiting its own forms
+static void BM_ParallelLispParseTreeWalker(benchmark::State& state) {
+    const std::string code = BuildTopLevelRealisticCode((64 << 20) / BuildRealisticCode(1).size() + 1);
+    benchmark::DoNotOptimize(code.data());
+    benchmark::ClobberMemory();
+    const auto workers = static_cast<std::uint32_t>(state.range(0));
+    const auto parser = std::make_unique<WideLips::LispParser>(std::string_view(code),
+        false,
+        WideLips::LispLexerOptions{.Concurrent = true});
+    std::size_t bytes = 0;
+    std::size_t nodes = 0;
+    for ([[maybe_unused]]auto _ : state) {
+        bytes += code.size();
+        parser->Reset(std::string_view(code));
+        benchmark::DoNotOptimize(parser->Parse());
+        nodes = WideLips::ParallelLispParseTreeWalker<NodeCountingVisitor>::Walk(*parser,
+            workers,
+            [] { return NodeCountingVisitor{}; },
+            [](NodeCountingVisitor& into,NodeCountingVisitor&& from) { into.Nodes += from.Nodes; }).Nodes;
+        benchmark::DoNotOptimize(nodes);
+    }
+    state.counters["Gigabytes"] = benchmark::Counter(
+            static_cast<double>(bytes), benchmark::Counter::kIsRate,
+            benchmark::Counter::OneK::kIs1000);
+    state.counters["Nodes"] = static_cast<double>(nodes);
+    state.counters["CodeSize"] = static_cast<double>(code.size());
+}
+
+BENCHMARK(BM_ParallelLispParseTreeWalker)
+    ->ArgName("Workers")
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->Repetitions(Repetitions)
+    ->ComputeStatistics("max", [](const std::vector<double>& v) -> double {
+        return *std::ranges::max_element(v);
+    })
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->DisplayAggregatesOnly(true);
+
+//the 1GB adjacent S-expressions written to disk, then read back with the 'FileReadMode' given by the benchmark argument
+//and tokenized, the reading is part of the measured time so the copying and the mapping readers can be compared
+static void BM_ReadAndTokenize1GBFile(benchmark::State& state) {
+    const auto filePath = std::filesystem::temp_directory_path() / "widelips_bm_1gb.lisp";
+    {
+        const std::string code = Build1GBAdjacentSExpressions();
+        std::ofstream file(filePath,std::ios::binary);
+        file.write(code.data(),static_cast<std::streamsize>(code.size()));
+    }
+    const auto mode = static_cast<WideLips::FileReadMode>(state.range(0));
+    std::size_t bytes = 0;
+    for ([[maybe_unused]]auto _ : state) {
+        auto alignedFile = WideLips::AlignedFileReader::Read(filePath,mode);
+        const auto lexer = WideLips::LispLexer::Make(alignedFile,L"widelips_bm_1gb.lisp");
+        benchmark::DoNotOptimize(lexer->Tokenize());
+        bytes += lexer->GetFileSize();
+    }
+    std::filesystem::remove(filePath);
+    state.counters["Gigabytes"] = benchmark::Counter(
+            static_cast<double>(bytes), benchmark::Counter::kIsRate,
+            benchmark::Counter::OneK::kIs1000);
+}
+
+BENCHMARK(BM_ReadAndTokenize1GBFile)
+    ->ArgName("FileReadMode")
+    ->Arg(static_cast<int>(WideLips::FileReadMode::Copy))
+    ->Arg(static_cast<int>(WideLips::FileReadMode::Map))
+    ->Arg(static_cast<int>(WideLips::FileReadMode::MapPopulated))
+    ->Repetitions(Repetitions)
+    ->ComputeStatistics("max", [](const std::vector<double>& v) -> double {
+        return *std::ranges::max_element(v);
+    })
+    ->Unit(benchmark::kMillisecond)
+    ->DisplayAggregatesOnly(true);
+
 BENCHMARK_MAIN();
\ No newline at end of file
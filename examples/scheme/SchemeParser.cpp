@@ -44,12 +44,13 @@ namespace WideLips::Examples{
 
                 auto nameToken = currentToken + 1;
                 if (nameToken > sexprEnd) {
+                    const SourceLocation location = GetLexer()->GetSourceLocation(currentToken);
                     GetDiagnosticsInternal().EmplaceBack(
                         Diagnostic::DiagnosticFactory::UnrecognizedToken(
                             OriginFile(),
-                            currentToken->Line,
-                            currentToken->Column,
-                            *currentToken
+                            location.Line,
+                            location.ColumnChar,
+                            GetLexer()->GetTokenText(currentToken)
                         )
                     );
                     newNode = ParseNodesAllocator.new_object<LispParseError>(
@@ -59,12 +60,13 @@ namespace WideLips::Examples{
                         this
                     );
                 } else if (!nameToken->Match(LispTokenKind::Identifier)) {
+                    const SourceLocation location = GetLexer()->GetSourceLocation(nameToken);
                     GetDiagnosticsInternal().EmplaceBack(
                         Diagnostic::DiagnosticFactory::UnrecognizedToken(
                             OriginFile(),
-                            nameToken->Line,
-                            nameToken->Column,
-                            *nameToken
+                            location.Line,
+                            location.ColumnChar,
+                            GetLexer()->GetTokenText(nameToken)
                         )
                     );
                     newNode = ParseNodesAllocator.new_object<LispParseError>(
@@ -76,12 +78,13 @@ namespace WideLips::Examples{
                 } else {
                     auto paramsToken = nameToken + 1;
                     if (paramsToken > sexprEnd) {
+                        const SourceLocation location = GetLexer()->GetSourceLocation(currentToken);
                         GetDiagnosticsInternal().EmplaceBack(
                             Diagnostic::DiagnosticFactory::UnrecognizedToken(
                                 OriginFile(),
-                                currentToken->Line,
-                                currentToken->Column,
-                                *currentToken
+                                location.Line,
+                                location.ColumnChar,
+                                GetLexer()->GetTokenText(currentToken)
                             )
                         );
                         newNode = ParseNodesAllocator.new_object<LispParseError>(
@@ -91,12 +94,13 @@ namespace WideLips::Examples{
                             this
                         );
                     } else if (!paramsToken->Match(LispTokenKind::LeftParenthesis)) {
+                        const SourceLocation location = GetLexer()->GetSourceLocation(paramsToken);
                         GetDiagnosticsInternal().EmplaceBack(
                             Diagnostic::DiagnosticFactory::UnrecognizedToken(
                                 OriginFile(),
-                                paramsToken->Line,
-                                paramsToken->Column,
-                                *paramsToken
+                                location.Line,
+                                location.ColumnChar,
+                                GetLexer()->GetTokenText(paramsToken)
                             )
                         );
                         newNode = ParseNodesAllocator.new_object<LispParseError>(
@@ -121,12 +125,13 @@ namespace WideLips::Examples{
 
                 auto paramsToken = currentToken + 1;
                 if (paramsToken > sexprEnd) {
+                    const SourceLocation location = GetLexer()->GetSourceLocation(currentToken);
                     GetDiagnosticsInternal().EmplaceBack(
                         Diagnostic::DiagnosticFactory::UnrecognizedToken(
                             OriginFile(),
-                            currentToken->Line,
-                            currentToken->Column,
-                            *currentToken
+                            location.Line,
+                            location.ColumnChar,
+                            GetLexer()->GetTokenText(currentToken)
                         )
                     );
                     newNode = ParseNodesAllocator.new_object<LispParseError>(
@@ -136,12 +141,13 @@ namespace WideLips::Examples{
                         this
                     );
                 } else if (!paramsToken->Match(LispTokenKind::LeftParenthesis)) {
+                    const SourceLocation location = GetLexer()->GetSourceLocation(paramsToken);
                     GetDiagnosticsInternal().EmplaceBack(
                         Diagnostic::DiagnosticFactory::UnrecognizedToken(
                             OriginFile(),
-                            paramsToken->Line,
-                            paramsToken->Column,
-                            *paramsToken
+                            location.Line,
+                            location.ColumnChar,
+                            GetLexer()->GetTokenText(paramsToken)
                         )
                     );
                     newNode = ParseNodesAllocator.new_object<LispParseError>(
@@ -183,12 +189,13 @@ namespace WideLips::Examples{
 
                 auto bindingsToken = currentToken + 1;
                 if (bindingsToken > sexprEnd) {
+                    const SourceLocation location = GetLexer()->GetSourceLocation(currentToken);
                     GetDiagnosticsInternal().EmplaceBack(
                         Diagnostic::DiagnosticFactory::UnrecognizedToken(
                             OriginFile(),
-                            currentToken->Line,
-                            currentToken->Column,
-                            *currentToken
+                            location.Line,
+                            location.ColumnChar,
+                            GetLexer()->GetTokenText(currentToken)
                         )
                     );
                     newNode = ParseNodesAllocator.new_object<LispParseError>(
@@ -198,12 +205,13 @@ namespace WideLips::Examples{
                         this
                     );
                 } else if (!bindingsToken->Match(LispTokenKind::LeftParenthesis)) {
+                    const SourceLocation location = GetLexer()->GetSourceLocation(bindingsToken);
                     GetDiagnosticsInternal().EmplaceBack(
                         Diagnostic::DiagnosticFactory::UnrecognizedToken(
                             OriginFile(),
-                            bindingsToken->Line,
-                            bindingsToken->Column,
-                            *bindingsToken
+                            location.Line,
+                            location.ColumnChar,
+                            GetLexer()->GetTokenText(bindingsToken)
                         )
                     );
                     newNode = ParseNodesAllocator.new_object<LispParseError>(
@@ -227,12 +235,13 @@ namespace WideLips::Examples{
 
                 auto nameToken = currentToken + 1;
                 if (nameToken > sexprEnd) {
+                    const SourceLocation location = GetLexer()->GetSourceLocation(currentToken);
                     GetDiagnosticsInternal().EmplaceBack(
                         Diagnostic::DiagnosticFactory::UnrecognizedToken(
                             OriginFile(),
-                            currentToken->Line,
-                            currentToken->Column,
-                            *currentToken
+                            location.Line,
+                            location.ColumnChar,
+                            GetLexer()->GetTokenText(currentToken)
                         )
                     );
                     newNode = ParseNodesAllocator.new_object<LispParseError>(
@@ -242,11 +251,12 @@ namespace WideLips::Examples{
                         this
                     );
                 } else if (!nameToken->Match(LispTokenKind::Identifier)) {
+                    const SourceLocation location = GetLexer()->GetSourceLocation(nameToken);
                     GetDiagnosticsInternal().EmplaceBack(
                         Diagnostic::DiagnosticFactory::SyntaxError(
                             OriginFile(),
-                            nameToken->Line,
-                            nameToken->Column,
+                            location.Line,
+                            location.ColumnChar,
                             TokenKindToString(nameToken->Kind)
                         )
                     );
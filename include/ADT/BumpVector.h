@@ -3,10 +3,13 @@
 
 #include <cassert>
 #include <bit>
+#include <cstring>
 #include <new>
-#include <immintrin.h>
 #include <source_location>
 #include "Config.h"
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 
 namespace WideLips {
 
@@ -463,10 +466,12 @@ namespace WideLips {
             if constexpr (sizeof(T) == 8 or sizeof(T) == 4 or sizeof(T) == 2 or sizeof(T) == 1) {
                 *ptr = obj;
             }
+#ifdef __AVX__
             else if constexpr (sizeof(T) == 32) {
                 const __m256i temp = _mm256_load_si256(reinterpret_cast<const __m256i*>(&obj));
                 _mm256_store_si256(reinterpret_cast<__m256i*>(ptr), temp);
             }
+#endif
             else {
                 std::memcpy(ptr, &obj, sizeof(T));
             }
@@ -60,6 +60,13 @@ namespace WideLips {
             return ++_pin;
         }
 
+        //reserves 'count' uninitialized elements at once and returns the first one
+        ALWAYS_INLINE PointerType Preserve(const SizeType count) noexcept {
+            auto mem = _pin + 1;
+            _pin += count;
+            return mem;
+        }
+
         ALWAYS_INLINE PointerType At(SizeType index) noexcept {
             return _arena+index;
         }
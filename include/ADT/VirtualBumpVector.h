@@ -0,0 +1,264 @@
+﻿#ifndef WIDELIPS_VIRTUALBUMPVECTOR_H
+#define WIDELIPS_VIRTUALBUMPVECTOR_H
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include "Config.h"
+#include "ArenaPool.h"
+#include "VirtualMemory.h"
+
+namespace WideLips {
+    //same interface as 'MonoBumpVector', but its capacity is address space reserved upfront and only committed
+    //as elements are appended to it. the reservation is meant to be a hard upper bound that costs nothing while
+    //unused, so elements never move and appending only compares against the committed end before writing.
+    //made with a pool, the reservation is taken from it and handed back to it with whatever it committed. made
+    //with huge pages, the reservation is advised to be backed by them and is reserved and committed in whole huge
+    //pages, so an arena spanning gigabytes takes a TLB entry per 2MB rather than per 4KB while it's walked
+    template<typename T>
+    struct alignas(16) VirtualBumpVector final {
+        static_assert(std::is_trivially_copyable_v<T> && "element type must be trivially copyable");
+        static_assert(std::is_trivially_destructible_v<T> && "element type must be trivially destructible");
+    private:
+        using PointerType = T*;
+        using ConstPointerType = const T*;
+        using ReferenceType = T&;
+        using ConstReferenceType = const T&;
+        using SizeType = std::size_t;
+        //committing in small steps trades RSS for page faults and system calls, so it never commits less than this
+        static constexpr SizeType MinCommitSize = 64 * 1024;
+    private:
+        T* _arena;
+        T* _pin;
+        T* _committed; //one past the last element that can be written without committing more pages
+        SizeType _reservedSize;
+        SizeType _committedSize;
+        ArenaPool* _pool;
+        bool _hugePages;
+        bool _borrowed; //a view of another vector's arena, see 'Borrow'
+    public:
+        explicit VirtualBumpVector(const SizeType arenaSize,ArenaPool* pool = nullptr,const bool hugePages = false) :
+        _reservedSize(RoundToPages(arenaSize * sizeof(T),hugePages)),
+        _committedSize(0),
+        _pool(pool),
+        _hugePages(hugePages),
+        _borrowed(false) {
+            if (_pool != nullptr) {
+                const ArenaPool::Range range = _pool->Acquire(_reservedSize,_hugePages);
+                _arena = static_cast<T*>(range.Address);
+                _reservedSize = range.Size;
+                _committedSize = range.Committed;
+            }
+            else {
+                _arena = static_cast<T*>(VirtualMemory::Reserve(_reservedSize,_hugePages));
+            }
+            _pin = _arena - 1;
+            _committed = _arena + _committedSize / sizeof(T);
+        }
+        VirtualBumpVector(const VirtualBumpVector &virtualBumpVector) = delete;
+        VirtualBumpVector(VirtualBumpVector &&virtualBumpVector) noexcept :
+        _arena(virtualBumpVector._arena),
+        _pin(virtualBumpVector._pin),
+        _committed(virtualBumpVector._committed),
+        _reservedSize(virtualBumpVector._reservedSize),
+        _committedSize(virtualBumpVector._committedSize),
+        _pool(virtualBumpVector._pool),
+        _hugePages(virtualBumpVector._hugePages),
+        _borrowed(virtualBumpVector._borrowed) {
+            virtualBumpVector._arena = nullptr;
+            virtualBumpVector._pin = nullptr;
+            virtualBumpVector._committed = nullptr;
+            virtualBumpVector._reservedSize = 0;
+            virtualBumpVector._committedSize = 0;
+        }
+        VirtualBumpVector& operator=(const VirtualBumpVector &virtualBumpVector) = delete;
+        VirtualBumpVector& operator=(VirtualBumpVector &&virtualBumpVector) noexcept {
+            if (this != &virtualBumpVector) {
+                ReleaseArena();
+                _arena = virtualBumpVector._arena;
+                _pin = virtualBumpVector._pin;
+                _committed = virtualBumpVector._committed;
+                _reservedSize = virtualBumpVector._reservedSize;
+                _committedSize = virtualBumpVector._committedSize;
+                _pool = virtualBumpVector._pool;
+                _hugePages = virtualBumpVector._hugePages;
+                _borrowed = virtualBumpVector._borrowed;
+                virtualBumpVector._arena = nullptr;
+                virtualBumpVector._pin = nullptr;
+                virtualBumpVector._committed = nullptr;
+                virtualBumpVector._reservedSize = 0;
+                virtualBumpVector._committedSize = 0;
+            }
+            return *this;
+        }
+        ~VirtualBumpVector() {
+            ReleaseArena();
+        }
+    public:
+        NODISCARD PointerType begin() noexcept { return _arena; }
+        NODISCARD PointerType end() noexcept { return _pin + 1; }
+        NODISCARD ConstPointerType begin() const noexcept { return _arena; }
+        NODISCARD ConstPointerType end() const noexcept { return _pin + 1; }
+        NODISCARD ConstPointerType cbegin() const noexcept { return _arena; }
+        NODISCARD ConstPointerType cend() const noexcept { return _pin + 1; }
+
+        ALWAYS_INLINE PointerType EmplaceBack(T&& element) noexcept {
+            auto mem = ++_pin;
+            if (mem >= _committed) [[unlikely]] {
+                Commit();
+            }
+            if constexpr (!std::is_trivially_copy_assignable_v<T>) {
+                //elements with const members (such as 'TokenizationBlock') can't be assigned, they are constructed
+                ::new (static_cast<void*>(mem)) T(std::move(element));
+            }
+            else if constexpr (sizeof(T) == 8 or sizeof(T) == 4 or sizeof(T) == 2 or sizeof(T) == 1) {
+                *mem = element;
+            }
+            else {
+                std::memcpy(mem, &element, sizeof(T));
+            }
+            return mem;
+        }
+
+        ALWAYS_INLINE PointerType Preserve() noexcept {
+            auto mem = ++_pin;
+            if (mem >= _committed) [[unlikely]] {
+                Commit();
+            }
+            return mem;
+        }
+
+        //reserves 'count' uninitialized elements at once and returns the first one
+        ALWAYS_INLINE PointerType Preserve(const SizeType count) noexcept {
+            auto mem = _pin + 1;
+            _pin += count;
+            if (_pin >= _committed) [[unlikely]] {
+                Commit();
+            }
+            return mem;
+        }
+
+        ALWAYS_INLINE PointerType At(SizeType index) noexcept {
+            return _arena+index;
+        }
+
+        ALWAYS_INLINE ReferenceType operator[](SizeType index) const noexcept {
+            return _arena[index];
+        }
+
+        ALWAYS_INLINE ReferenceType operator[](SizeType index) noexcept {
+            return _arena[index];
+        }
+
+        ALWAYS_INLINE void PopBack() noexcept {
+            --_pin;
+        }
+
+        NODISCARD ALWAYS_INLINE ConstReferenceType Back() noexcept {
+            return *_pin;
+        }
+
+        NODISCARD ALWAYS_INLINE ConstReferenceType Back() const noexcept {
+            return *_pin;
+        }
+
+        NODISCARD ALWAYS_INLINE SizeType Size() const noexcept {
+            return (_pin - _arena)+1;
+        }
+
+        NODISCARD ALWAYS_INLINE bool Empty() const noexcept {
+            return _pin < _arena;
+        }
+
+        NODISCARD ALWAYS_INLINE SizeType Capacity() const noexcept {
+            return _reservedSize / sizeof(T);
+        }
+
+        //bytes backed by memory so far, committed pages are kept across 'Reuse' for the next round of appends
+        NODISCARD ALWAYS_INLINE SizeType CommittedSize() const noexcept {
+            return _committedSize;
+        }
+
+        ALWAYS_INLINE void Reuse() noexcept {
+            _pin = _arena-1;
+        }
+
+        //drops every element past the first 'count', the pages they were on stay committed
+        ALWAYS_INLINE void Truncate(const SizeType count) noexcept {
+            _pin = _arena + count - 1;
+        }
+
+        //makes room for 'arenaSize' elements, a reservation too small for them is replaced by a new one and the
+        //elements it held are gone
+        void Reserve(const SizeType arenaSize) noexcept {
+            if (arenaSize > Capacity()) {
+                *this = VirtualBumpVector(arenaSize,_pool,_hugePages);
+            }
+        }
+
+        //a view of the elements appended so far that reads them in place and releases nothing. it's meant to be read
+        //only, and only while this vector is neither reserved again nor reused
+        NODISCARD VirtualBumpVector Borrow() const noexcept {
+            return VirtualBumpVector(*this,BorrowTag{});
+        }
+
+        //commits the pages of the first 'count' elements at once, when roughly how many will be appended is known
+        //upfront. what lies past them is still committed on demand
+        void CommitFor(const SizeType count) noexcept {
+            const SizeType size = std::min(RoundToPages(count * sizeof(T),_hugePages),_reservedSize);
+            if (_arena != nullptr && size > _committedSize) {
+                CommitSize(size);
+            }
+        }
+    private:
+        struct BorrowTag final {};
+
+        VirtualBumpVector(const VirtualBumpVector &virtualBumpVector,BorrowTag) noexcept :
+        _arena(virtualBumpVector._arena),
+        _pin(virtualBumpVector._pin),
+        _committed(virtualBumpVector._pin + 1),
+        _reservedSize(virtualBumpVector._reservedSize),
+        _committedSize(virtualBumpVector._committedSize),
+        _pool(nullptr),
+        _hugePages(virtualBumpVector._hugePages),
+        _borrowed(true) {}
+
+        NODISCARD static SizeType RoundToPages(const SizeType size,const bool hugePages) noexcept {
+            const SizeType pageSize = hugePages ? VirtualMemory::HugePageSize : VirtualMemory::PageSize();
+            return (std::max(size,SizeType{1}) + pageSize - 1) / pageSize * pageSize;
+        }
+
+        //commits enough pages for the element '_pin' points to, at least doubling what was committed so far.
+        //callers check for room against Capacity(), running past the reservation anyway or out of memory aborts
+        //rather than writing through an inaccessible page
+        NOINLINE void Commit() noexcept {
+            const SizeType required = RoundToPages((_pin - _arena + 1) * sizeof(T),_hugePages);
+            if (_arena == nullptr || required > _reservedSize) {
+                std::abort();
+            }
+            CommitSize(std::min(std::max({required,_committedSize * 2,MinCommitSize}),_reservedSize));
+        }
+
+        void ReleaseArena() noexcept {
+            if (_borrowed) {
+                return;
+            }
+            if (_pool != nullptr) {
+                _pool->Release(ArenaPool::Range{_arena,_reservedSize,_committedSize,_hugePages});
+            }
+            else {
+                VirtualMemory::Release(_arena,_reservedSize);
+            }
+        }
+
+        void CommitSize(const SizeType size) noexcept {
+            if (!VirtualMemory::Commit(reinterpret_cast<char*>(_arena) + _committedSize,size - _committedSize)) {
+                std::abort();
+            }
+            _committedSize = size;
+            _committed = _arena + _committedSize / sizeof(T);
+        }
+    };
+}
+#endif //WIDELIPS_VIRTUALBUMPVECTOR_H
@@ -1,10 +1,12 @@
 ﻿#ifndef WIDEDLIPS_AVX_H
 #define WIDEDLIPS_AVX_H
 #include <cstdint>
-#include <immintrin.h>
 #include "Config.h"
 
-#ifdef __AVX2__
+#if WL_ARCH_X86
+#include <immintrin.h>
+
+WL_TARGET_REGION_BEGIN("avx2")
 namespace WideLips {
 
     class Avx2;
@@ -24,6 +26,8 @@ namespace WideLips {
     public:
         static Vector256 LoadFromAddress(const std::uint8_t * address,std::ptrdiff_t offset = 0);
 
+        static Vector256 BroadcastLane(const std::uint8_t * lane);
+
         static Vector256 CompareEqual(Vector256 lhs, Vector256 rhs);
 
         static std::uint32_t MoveMask(Vector256 vec);
@@ -67,6 +71,10 @@ namespace WideLips {
         return Vector256 {_mm256_loadu_si256(reinterpret_cast<__m256i const *>(address+offset))};
     }
 
+    NODISCARD ALWAYS_INLINE Vector256 Avx2::BroadcastLane(const std::uint8_t *const lane) {
+        return Vector256 {_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const *>(lane)))};
+    }
+
     NODISCARD ALWAYS_INLINE Vector256 Avx2::CompareEqual(const Vector256 lhs, const Vector256 rhs) {
         return Vector256 {_mm256_cmpeq_epi8(static_cast<__m256i>(lhs), static_cast<__m256i>(rhs))};
     }
@@ -126,7 +134,8 @@ namespace WideLips {
         return Vector256{combined};
     }
 }
-#endif // __AVX2__
+WL_TARGET_REGION_END
+#endif // WL_ARCH_X86
 #endif //SIMDVECTOR_H
 
 
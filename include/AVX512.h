@@ -0,0 +1,95 @@
+﻿#ifndef WIDELIPS_AVX512_H
+#define WIDELIPS_AVX512_H
+#include <cstdint>
+#include "Config.h"
+
+#if WL_ARCH_X86
+#include <immintrin.h>
+
+WL_TARGET_REGION_BEGIN("avx512f,avx512bw")
+namespace WideLips {
+
+    class Avx512;
+    struct Vector512;
+
+    class WL_INTERNAL Avx512 final{
+    public:
+        struct Custom final {
+        public:
+            ~Custom() = delete;
+        public:
+            template<std::uint8_t shift>
+            static Vector512 RightShift8(Vector512 vec) requires (shift < 8);
+        };
+    public:
+        ~Avx512() = delete;
+    public:
+        static Vector512 LoadFromAddress(const std::uint8_t * address,std::ptrdiff_t offset = 0);
+
+        static Vector512 BroadcastLane(const std::uint8_t * lane);
+
+        static std::uint64_t CompareEqual(Vector512 lhs, Vector512 rhs);
+
+        static Vector512 ShuffleBytes(Vector512 lookupTable,Vector512 vec);
+
+        static Vector512 SubtractSaturated(Vector512 lhs,Vector512 rhs);
+
+        static Vector512 Propagate(std::uint8_t value);
+    };
+
+    struct WL_INTERNAL Vector512 final {
+    private:
+        const __m512i _vec{};
+    public:
+        Vector512(const Vector512&) = default;
+        Vector512(Vector512&&) noexcept = default;
+        Vector512& operator=(const Vector512&) = delete;
+        Vector512& operator=(Vector512&&) noexcept = delete;
+    public:
+        explicit constexpr Vector512(const __m512i init) : _vec(init) {
+
+        }
+
+        explicit operator __m512i () const {
+            return _vec;
+        }
+    };
+
+    NODISCARD ALWAYS_INLINE Vector512 Avx512::LoadFromAddress(const std::uint8_t *const address, const std::ptrdiff_t offset) {
+        return Vector512 {_mm512_loadu_si512(address+offset)};
+    }
+
+    NODISCARD ALWAYS_INLINE Vector512 Avx512::BroadcastLane(const std::uint8_t *const lane) {
+        //lookup tables are 16 bytes wide since 'vpshufb' never crosses a 128-bit lane
+        return Vector512 {_mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<__m128i const *>(lane)))};
+    }
+
+    NODISCARD ALWAYS_INLINE std::uint64_t Avx512::CompareEqual(const Vector512 lhs, const Vector512 rhs) {
+        //unlike AVX2 the comparison result lands directly in a mask register, so there is no 'MoveMask' step
+        return _mm512_cmpeq_epi8_mask(static_cast<__m512i>(lhs), static_cast<__m512i>(rhs));
+    }
+
+    NODISCARD ALWAYS_INLINE Vector512 Avx512::ShuffleBytes(const Vector512 lookupTable,const Vector512 vec) {
+        return Vector512{_mm512_shuffle_epi8(static_cast<__m512i>(lookupTable),static_cast<__m512i>(vec))};
+    }
+
+    NODISCARD ALWAYS_INLINE Vector512 Avx512::SubtractSaturated(const Vector512 lhs,const Vector512 rhs) {
+        return Vector512{_mm512_subs_epu8(static_cast<__m512i>(lhs), static_cast<__m512i>(rhs))};
+    }
+
+    NODISCARD ALWAYS_INLINE Vector512 Avx512::Propagate(const std::uint8_t value) {
+        return Vector512{_mm512_set1_epi8(static_cast<char>(value))};
+    }
+
+    template<std::uint8_t shift>
+    NODISCARD ALWAYS_INLINE Vector512 Avx512::Custom::RightShift8(const Vector512 vec) requires (shift < 8){
+        //same story as AVX2 there is no per byte shift, but here a 16bit shift followed by clearing the bits that
+        //leaked from the neighbouring byte is enough
+        const auto bytes = static_cast<__m512i>(vec);
+        const __m512i shifted = _mm512_srli_epi16(bytes, shift);
+        return Vector512{_mm512_and_si512(shifted, _mm512_set1_epi8(static_cast<char>(0xFF >> shift)))};
+    }
+}
+WL_TARGET_REGION_END
+#endif // WL_ARCH_X86
+#endif //WIDELIPS_AVX512_H
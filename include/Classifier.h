@@ -0,0 +1,230 @@
+﻿#ifndef WIDELIPS_CLASSIFIER_H
+#define WIDELIPS_CLASSIFIER_H
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include "Config.h"
+
+namespace WideLips {
+
+    enum class ClassificationKernel : std::uint8_t {
+        Default, //widest kernel the host CPU supports, probed at runtime
+        Scalar, //portable SWAR kernel, runs everywhere and serves as the reference for the SIMD ones
+        Sse42,
+        Avx2,
+        Avx512
+    };
+
+    //the masks a kernel classifies a block into, 'TokenizationBlock' packs them
+    struct WL_INTERNAL TokenizationMasks final {
+        std::uint64_t FragmentsMask = 0;
+        std::uint64_t SExprAndOpsMask = 0;
+        std::uint64_t DigitsMask = 0;
+        std::uint64_t StringLiteralsMask = 0;
+        std::uint64_t NewLines = 0;
+        std::uint64_t IdentifierMask = 0;
+    };
+
+    //six masks packed in four planes, which halves what the blue pass writes and the green pass reads back. digits
+    //are identifier chars and newlines are fragments, and the classes they are told apart with never share a char
+    //otherwise: digits are set in both the fragments and the identifiers planes, newlines in both the S-expressions
+    //and the string literals planes, so every mask is decoded with a single and (not) of two planes
+    struct WL_INTERNAL alignas(32) TokenizationBlock final {
+        using MaskType = std::uint64_t;
+        static constexpr std::uint32_t Width = sizeof(MaskType) * 8;
+
+        const MaskType FragmentsPlane = 0;
+        const MaskType SExprAndOpsPlane = 0;
+        const MaskType StringLiteralsPlane = 0;
+        const MaskType IdentifierPlane = 0;
+
+        constexpr TokenizationBlock() noexcept = default;
+        constexpr explicit TokenizationBlock(const TokenizationMasks& masks) noexcept :
+        FragmentsPlane(masks.FragmentsMask | masks.DigitsMask),
+        SExprAndOpsPlane(masks.SExprAndOpsMask | masks.NewLines),
+        StringLiteralsPlane(masks.StringLiteralsMask | masks.NewLines),
+        IdentifierPlane(masks.IdentifierMask) {}
+
+        NODISCARD ALWAYS_INLINE constexpr MaskType FragmentsMask() const noexcept {
+            return FragmentsPlane & ~IdentifierPlane;
+        }
+
+        NODISCARD ALWAYS_INLINE constexpr MaskType SExprAndOpsMask() const noexcept {
+            return SExprAndOpsPlane & ~StringLiteralsPlane;
+        }
+
+        NODISCARD ALWAYS_INLINE constexpr MaskType DigitsMask() const noexcept {
+            return FragmentsPlane & IdentifierPlane;
+        }
+
+        NODISCARD ALWAYS_INLINE constexpr MaskType StringLiteralsMask() const noexcept {
+            return StringLiteralsPlane & ~SExprAndOpsPlane;
+        }
+
+        NODISCARD ALWAYS_INLINE constexpr MaskType NewLines() const noexcept {
+            return SExprAndOpsPlane & StringLiteralsPlane;
+        }
+
+        NODISCARD ALWAYS_INLINE constexpr MaskType IdentifierMask() const noexcept {
+            return IdentifierPlane;
+        }
+
+        //chars of no class at all, cheaper than or-ing the decoded masks
+        NODISCARD ALWAYS_INLINE constexpr MaskType UnclassifiedMask() const noexcept {
+            return ~(FragmentsPlane | SExprAndOpsPlane | StringLiteralsPlane | IdentifierPlane);
+        }
+    };
+    static_assert(sizeof(TokenizationBlock) == TokenizationBlock::Width / 2);
+
+    class WL_INTERNAL Classifier final {
+    public:
+        //classifies 'blocksCount' consecutive blocks of 'TokenizationBlock::Width' bytes starting at 'text',
+        //'escapeCarry' tells if the byte right before 'text' is an unescaped backslash and the carry of the last
+        //classified block is returned, so a text can be classified over several calls
+        using Kernel = std::uint64_t(*)(const std::uint8_t* text,
+            std::size_t blocksCount,
+            TokenizationBlock* blocks,
+            std::uint64_t escapeCarry) noexcept;
+        //index of the first of 'count' bytes at 'bytes' equal to 'value' or 'count' if there's none, token kinds laid
+        //out on their own are scanned with it (see LispTokenColumns)
+        using ByteFinder = std::size_t(*)(const std::uint8_t* bytes,std::size_t count,std::uint8_t value) noexcept;
+        //prefix XOR of the quotes of a block (see PrefixXor), the blue pass tells string literals apart with it
+        using PrefixXorFunction = std::uint64_t(*)(std::uint64_t mask) noexcept;
+    public:
+        //'vpshufb' looks up within 128-bit lanes, so every kernel broadcasts these 16 byte tables to its own width
+        alignas(16) static constexpr std::array<std::uint8_t,16> SExprAndOpsTable{ //not all operators are covered only those fallen within the targeted range
+            '=','/','.','-',CommaChar,'+','*',')',
+            '(','\'','&','%',DollarChar,HashChar,0,'!'
+        };
+
+        alignas(16) static constexpr std::array<std::uint8_t,16> OtherOpsAndStructTable{
+            AtChar,TildaChar,0,0,0,0,LeftBracketChar,RightBracketChar,
+            QuasiColumnChar,0,0,0,0,0,ColumnChar,'|'
+        };
+
+        alignas(16) static constexpr std::array<std::uint8_t,16> FragmentsTable{
+            ' ',0,0,0,0,0,0,0,
+            0,'\t','\n',0,0,'\r',0,0
+        };
+
+        alignas(16) static constexpr std::array<std::uint8_t,16> DigitsTable{
+            '0','1','2','3','4','5','6','7',
+            '8','9',0,0,0,0,0,0
+        };
+
+        alignas(16) static constexpr std::array<std::uint8_t,16> SmallIdentifierTable{
+            'p','a','b','c','d','e','f','g',
+            'h','i','j','k','l','m','n','o'
+        };
+
+        alignas(16) static constexpr std::array<std::uint8_t,16> SmallIdentifierTable2{
+            0,'q','r','s','t','u','v','w',
+            'x','y','z',0,0,0,0,0
+        };
+
+        alignas(16) static constexpr std::array<std::uint8_t,16> CapitalIdentifierTable{
+            'P','A','B','C','D','E','F','G',
+            'H','I','J','K','L','M','N','O'
+        };
+
+        alignas(16) static constexpr std::array<std::uint8_t,16> CapitalIdentifierTable2{
+            0,'Q','R','S','T','U','V','W',
+            'X','Y','Z',0,0,DashInId,0,'_'
+        };
+        //a chunk smaller than this (1MB of text) isn't worth a thread of its own
+        static constexpr std::size_t MinBlocksPerThread = 1U << 14;
+    public:
+        ~Classifier() = delete;
+    public:
+        //a kernel the host CPU can't run resolves to the widest one it can, so the same binary runs on any host
+        //while still using AVX-512 where it's available
+        NODISCARD static Kernel Resolve(ClassificationKernel kernel) noexcept;
+
+        //resolves just like 'Resolve' does, to the finder of the same instruction set
+        NODISCARD static ByteFinder ResolveFinder(ClassificationKernel kernel) noexcept;
+
+        //carry-less multiplication wherever the host has it, but the scalar kernel keeps to the shift ladder so that it
+        //still serves as the portable reference
+        NODISCARD static PrefixXorFunction ResolvePrefixXor(ClassificationKernel kernel) noexcept;
+
+        NODISCARD static bool IsSupported(ClassificationKernel kernel) noexcept;
+
+        NODISCARD static ClassificationKernel Widest() noexcept;
+
+        //splits the blocks into up to 'threads' chunks classified concurrently with 'kernel', every chunk but the
+        //first one starts without escape carry and is fixed up sequentially once all of them are done.
+        //returns the carry of the last block just like a kernel does
+        static std::uint64_t ClassifyParallel(Kernel kernel,
+            const std::uint8_t* text,
+            std::size_t blocksCount,
+            TokenizationBlock* blocks,
+            std::uint32_t threads) noexcept;
+
+        static std::uint64_t ClassifyScalar(const std::uint8_t* text,
+            std::size_t blocksCount,
+            TokenizationBlock* blocks,
+            std::uint64_t escapeCarry) noexcept;
+
+        static std::uint64_t ClassifySse42(const std::uint8_t* text,
+            std::size_t blocksCount,
+            TokenizationBlock* blocks,
+            std::uint64_t escapeCarry) noexcept;
+
+        static std::uint64_t ClassifyAvx2(const std::uint8_t* text,
+            std::size_t blocksCount,
+            TokenizationBlock* blocks,
+            std::uint64_t escapeCarry) noexcept;
+
+        static std::uint64_t ClassifyAvx512(const std::uint8_t* text,
+            std::size_t blocksCount,
+            TokenizationBlock* blocks,
+            std::uint64_t escapeCarry) noexcept;
+
+        static std::size_t FindByteScalar(const std::uint8_t* bytes,std::size_t count,std::uint8_t value) noexcept;
+
+        static std::size_t FindByteSse42(const std::uint8_t* bytes,std::size_t count,std::uint8_t value) noexcept;
+
+        static std::size_t FindByteAvx2(const std::uint8_t* bytes,std::size_t count,std::uint8_t value) noexcept;
+
+        static std::size_t FindByteAvx512(const std::uint8_t* bytes,std::size_t count,std::uint8_t value) noexcept;
+
+        static std::uint64_t PrefixXorLadder(std::uint64_t mask) noexcept;
+
+        static std::uint64_t PrefixXorClmul(std::uint64_t mask) noexcept;
+    };
+
+    NODISCARD ALWAYS_INLINE PURE std::uint64_t ComputeNonEscapingDoubleQuotes(const std::uint64_t backslashMask,
+       const std::uint64_t doubleQuoteMask) {
+        const auto escapeCheckMask = backslashMask << 1;
+        const auto oddEscapeCheckMask = escapeCheckMask | 0xAAAAAAAAAAAAAAAAULL;
+        const auto escapeDetectionMask = oddEscapeCheckMask - backslashMask;
+        const auto escapeAndNonEscapeMask = escapeDetectionMask ^ 0xAAAAAAAAAAAAAAAAULL;
+        return ~(escapeAndNonEscapeMask ^ backslashMask) & doubleQuoteMask;
+    }
+
+    //bit i of the result is the parity of the bits of 'mask' up to and including i, so given the unescaped quotes of a
+    //block entered outside of a string literal it marks every char from an opening quote up to its closing one
+    NODISCARD ALWAYS_INLINE constexpr std::uint64_t PrefixXor(std::uint64_t mask) noexcept {
+        mask ^= mask << 1;
+        mask ^= mask << 2;
+        mask ^= mask << 4;
+        mask ^= mask << 8;
+        mask ^= mask << 16;
+        mask ^= mask << 32;
+        return mask;
+    }
+
+    NODISCARD ALWAYS_INLINE std::uint64_t ComputeStringLiteralsMask(std::uint64_t backslashMask,
+        std::uint64_t doubleQuoteMask,
+        std::uint64_t& escapeCarry) {
+        //if the previous block ended with an odd run of backslashes then the first byte of this block is escaped,
+        //whether it's a double quote or a backslash (in which case it doesn't escape anything itself)
+        backslashMask &= ~escapeCarry;
+        doubleQuoteMask &= ~escapeCarry;
+        escapeCarry = std::countl_one(backslashMask) & 0x1U;
+        return ComputeNonEscapingDoubleQuotes(backslashMask,doubleQuoteMask);
+    }
+}
+
+#endif //WIDELIPS_CLASSIFIER_H
@@ -69,6 +69,32 @@
 #define NODISCARD [[nodiscard]]
 #define UNUSED [[maybe_unused]]
 #define FALLTHROUGH [[fallthrough]]
+#define WL_PRAGMA(x) _Pragma(#x)
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define WL_ARCH_X86 1
+#else
+    #define WL_ARCH_X86 0
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define WL_POSIX 1
+#else
+    #define WL_POSIX 0
+#endif
+
+//every function defined between these two markers is compiled for the given instruction set, which lets a kernel
+//use wider intrinsics than the rest of the library is compiled for (MSVC accepts any intrinsic regardless of /arch)
+#if defined(__clang__)
+    #define WL_TARGET_REGION_BEGIN(isa) WL_PRAGMA(clang attribute push(__attribute__((target(isa))),apply_to=function))
+    #define WL_TARGET_REGION_END WL_PRAGMA(clang attribute pop)
+#elif defined(__GNUC__)
+    #define WL_TARGET_REGION_BEGIN(isa) WL_PRAGMA(GCC push_options) WL_PRAGMA(GCC target(isa))
+    #define WL_TARGET_REGION_END WL_PRAGMA(GCC pop_options)
+#else
+    #define WL_TARGET_REGION_BEGIN(isa)
+    #define WL_TARGET_REGION_END
+#endif
 
 
 #ifdef EnableHash
@@ -2,12 +2,11 @@
 #define DIAGNOSTIC_H
 #include <format>
 #include <string>
+#include <string_view>
 
 #include "Config.h"
 
 namespace WideLips {
-    struct LispToken;
-
     namespace Diagnostic{
 
         class DiagnosticFactory;
@@ -33,7 +32,8 @@ namespace WideLips {
             NoMatchingOpenParenthesis, //1007
             NoMatchingCloseParenthesis, //1008
             FetchingAuxiliaryOfLazyToken,//1009
-            UnexpectedTopLevelToken//1010
+            UnexpectedTopLevelToken,//1010
+            ArenasExhausted//1011
         };
 
         struct DiagnosticSourceLocation final {
@@ -90,7 +90,7 @@ namespace WideLips {
             static LispDiagnostic UnexpectedToken(std::wstring_view file,
                std::uint32_t line,
                std::uint32_t col,
-               const LispToken& unexpectedToken);
+               std::string_view unexpectedToken);
 
             static LispDiagnostic EmptySExpression(std::wstring_view file,
                 std::uint32_t line,
@@ -103,7 +103,7 @@ namespace WideLips {
             static LispDiagnostic UnrecognizedToken(std::wstring_view file,
                 std::uint32_t line,
                 std::uint32_t col,
-                const LispToken& unrecognizedToken);
+                std::string_view unrecognizedToken);
 
             static LispDiagnostic MalformedFloatingPointLiteral(std::wstring_view file,
                 std::uint32_t line,
@@ -116,22 +116,24 @@ namespace WideLips {
 
             static LispDiagnostic NoMatchingOpenParenthesis(std::wstring_view file,
                 std::uint32_t line,
-                std::uint32_t column,
-                const LispToken& closingParenthesis);
+                std::uint32_t column);
 
             static LispDiagnostic NoMatchingCloseParenthesis(std::wstring_view file,
                std::uint32_t line,
-               std::uint32_t column,
-               const LispToken& openingParenthesis);
+               std::uint32_t column);
 
             static LispDiagnostic FetchingAuxiliaryOfLazyToken(std::wstring_view file,
                 std::uint32_t line,
                 std::uint32_t column,
-                const LispToken& lazyToken);
+                std::string_view lazyToken);
 
             static LispDiagnostic UnexpectedTopLevelToken(std::wstring_view file,
               std::uint32_t line,
               std::uint32_t col);
+
+            static LispDiagnostic ArenasExhausted(std::wstring_view file,
+                std::uint32_t line,
+                std::uint32_t column);
         };
 
 
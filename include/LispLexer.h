@@ -3,18 +3,37 @@
 
 #include <array>
 #include <cstdint>
+#include <limits>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 #include "ADT/BumpVector.h"
 #include "Diagnostic.h"
 #include "Utilities/AlignedFileReader.h"
-#include "AVX.h"
+#include "Classifier.h"
 #include "MonoBumpVector.h"
+#include "VirtualBumpVector.h"
+#include "Utilities/ThreadShards.h"
 
 
 namespace WideLips {
+    class BluePassCache;
 
     std::size_t ArenaSizeEstimate(std::size_t fileSize,bool conservative);
 
+    //element counts the arenas of a lexer and the parse nodes of a parser are expected to reach for a text
+    struct ArenaCapacities final {
+        std::size_t Tokens = 0;
+        std::size_t SExprIndices = 0;
+        std::size_t Auxiliaries = 0;
+    };
+
+    //classifies a few 4KB windows spread over 'text' with 'kernel', counts the token starts, opening parentheses and
+    //fragments within them and extrapolates to the whole text (texts of up to 8 windows are classified entirely).
+    //unlike 'ArenaSizeEstimate' it follows how dense the text is, but remains an estimate with some headroom
+    NODISCARD ArenaCapacities SampleArenaCapacities(std::string_view text,ClassificationKernel kernel) noexcept;
+
     enum class LispTokenKind: std::uint8_t{
         EndOfFile           = '\0', // 0
         Not                 = '!',  // 33
@@ -120,14 +139,48 @@ namespace WideLips {
         }
     }
 
+    //the compact layout (see WL_COMPACT_TOKENS) always locates lazily, so S-expression indices leave their lines and
+    //columns out and read them as zero
     struct WL_INTERNAL SExprIndex final {
         std::uint32_t Open;
+#ifdef WL_COMPACT_TOKENS
+        static constexpr std::uint32_t OpenLine = 0;
+        static constexpr std::uint32_t OpenColumn = 0;
+#else
         std::uint32_t OpenLine;
         std::uint32_t OpenColumn;
+#endif
         std::uint32_t Close;
+#ifdef WL_COMPACT_TOKENS
+        static constexpr std::uint32_t CloseLine = 0;
+        static constexpr std::uint32_t CloseColumn = 0;
+#else
         std::uint32_t CloseLine;
         std::uint32_t CloseColumn;
+#endif
         std::uint32_t Next;
+
+        NODISCARD static SExprIndex Opening(const std::uint32_t open,
+            UNUSED const std::uint32_t line,
+            UNUSED const std::uint32_t column) noexcept {
+#ifdef WL_COMPACT_TOKENS
+            return SExprIndex{open,0,0};
+#else
+            return SExprIndex{open,line,column,0,0,0,0};
+#endif
+        }
+
+        void Closing(const std::uint32_t close,
+            UNUSED const std::uint32_t line,
+            UNUSED const std::uint32_t column,
+            const std::uint32_t next) noexcept {
+            Close = close;
+#ifndef WL_COMPACT_TOKENS
+            CloseLine = line;
+            CloseColumn = column;
+#endif
+            Next = next;
+        }
     };
 
     struct WL_INTERNAL AuxiliaryIndex final {
@@ -135,15 +188,124 @@ namespace WideLips {
         std::uint32_t Length = 0;
     };
 
-    struct WL_INTERNAL alignas(32) TokenizationBlock final {
-        const std::uint32_t FragmentsMask = 0;
-        const std::uint32_t SExprAndOpsMask = 0;
-        const std::uint32_t DigitsMask = 0;
-        const std::uint32_t StringLiteralsMask = 0;
-        const std::uint32_t NewLines = 0;
-        const std::uint32_t IdentifierMask = 0;
+    enum class BluePassEngine : std::uint8_t {
+        Sequential, //walks the text token by token matching parentheses with a stack
+        //matches parentheses from the classified blocks over chunks of the text concurrently, it reports the same
+        //structure and the same structural diagnostics but leaves malformed real literals to the green pass
+        Parallel,
+        //classifies the text a tile at a time and matches the parentheses of a tile right after, while it's still in
+        //cache, instead of classifying the whole text before walking it again. it runs on the calling thread and
+        //otherwise reports just like the parallel engine does
+        Fused
+    };
+
+    enum class SourceLocations : std::uint8_t {
+        Eager, //both passes keep track of lines and columns and every token carries its own
+        //both passes only keep track of byte offsets, lines and columns are computed from a per block rank of the
+        //newlines once asked for through 'LispLexer::GetSourceLocation', the tokens' own are left 0
+        Lazy
+    };
+
+    struct LispLexerOptions final {
+        ClassificationKernel Kernel = ClassificationKernel::Default;
+        //threads classifying the text and, with the parallel blue pass engine, matching its parentheses concurrently,
+        //0 uses every hardware thread. small texts always stay on the calling thread (see Classifier::MinBlocksPerThread)
+        std::uint32_t Threads = 1;
+        BluePassEngine BlueEngine = BluePassEngine::Sequential;
+        SourceLocations Locations = SourceLocations::Eager;
+        //also lays the tokens out as a structure of arrays while they are materialized (see LispTokenColumns)
+        bool TokenColumns = false;
+        //commits the arenas for the capacities 'SampleArenaCapacities' extrapolates rather than growing them as they
+        //fill, and sizes the parse nodes pool of a parser after them too
+        bool SampleArenas = false;
+        //arenas are taken from this pool and handed back to it once the lexer (or parser) is gone, rather than
+        //mapped and unmapped for every instance (see ArenaPool)
+        ArenaPool* Pool = nullptr;
+        //backs the arenas with transparent huge pages where the system allows it (see VirtualMemory::AdviseHugePages).
+        //every arena then commits at least a huge page, which pays off for texts of many megabytes only
+        bool HugePages = false;
+        //tokenizing a text the cache holds the blue pass of (for the same path) copies it from there instead of
+        //matching the parentheses again, any other text is tokenized as usual and stored in it (see BluePassCache)
+        BluePassCache* Cache = nullptr;
+        //lets threads other than the one that tokenized the text materialize S-expressions at the same time, each into
+        //token and auxiliary arenas of its own (see 'LispLexer::Local'). the auxiliaries of closing parentheses aren't
+        //recorded then, as two threads may expand the same S-expression at once
+        bool Concurrent = false;
+    };
+
+    //how 'LispLexer::ApplyEdit' brought the lexer up to date, S-expression indices are those of the edited text
+    struct LispEdit final {
+        bool Success = false; //what 'LispLexer::Tokenize' would have returned for the edited text
+        //tokens materialized outside of the matched again S-expressions are still valid, they were moved along with
+        //the text after the edit. otherwise every token materialized before the edit is gone
+        bool KeptTokens = false;
+        std::uint32_t FirstSExprIndex = 0; //index of the first S-expression matched again
+        std::uint32_t RemovedForms = 0; //top level S-expressions the edit overlapped
+        std::uint32_t InsertedForms = 0; //top level S-expressions matched in their place
+    };
+
+    struct SourceLocation {
+    public:
+        const std::uint32_t Line;
+        const std::uint32_t ColumnChar;
+    public:
+        constexpr SourceLocation(const std::uint32_t line,const std::uint32_t column) : Line(line),ColumnChar(column) {}
+        SourceLocation(const SourceLocation& ) = delete;
+        SourceLocation(SourceLocation&&) = delete;
+        SourceLocation& operator=(const SourceLocation&) = delete;
+        SourceLocation& operator=(SourceLocation&&) = delete;
+    public:
+        NODISCARD ALWAYS_INLINE static consteval SourceLocation Default(){
+            return SourceLocation{0,0};
+        }
+    };
+
+    //newlines counted before a block (those within string literals don't count) and where the line the block starts
+    //on begins, along with the state the block is entered with so the newlines within it can be counted again
+    struct WL_INTERNAL LineRank final {
+        std::uint32_t Lines = 0;
+        std::uint32_t LineStart = 0;
+        std::uint8_t Entry = 0;
+    };
+
+    //where a window of a stream is cut, right after the last line break with no form open (0 when there's none),
+    //and the line breaks before it, those within string literals don't count like in the blue pass
+    struct WL_INTERNAL FormsBoundary final {
+        std::size_t End = 0;
+        std::uint64_t Lines = 0;
     };
 
+#ifdef WL_COMPACT_TOKENS
+    //the compact layout takes half the room, the text is referenced by its offset instead of a pointer, parentheses
+    //(always one character long) keep the index of their S-expression where other tokens keep their length, and
+    //lines and columns are only known through 'LispLexer::GetSourceLocation' as locations are always lazy then
+    struct WL_INTERNAL alignas(16) LispToken final {
+    public:
+        std::uint32_t Offset = 0;
+        std::uint32_t AuxiliaryIndex = 0;
+        union {
+            std::uint32_t Length = 1;
+            std::uint32_t IndexInSpecialStream; //parentheses only
+        };
+        LispTokenKind Kind = LispTokenKind::Invalid;
+        std::uint8_t AuxiliaryLength = 0;
+    public:
+        NODISCARD ALWAYS_INLINE std::string_view GetText(const char* textStream) const noexcept{
+            return std::string_view{textStream + Offset, GetLength()};
+        }
+
+        NODISCARD ALWAYS_INLINE std::wstring_view GetWText(const char* textStream) const noexcept{
+            return std::wstring_view{reinterpret_cast<std::wstring_view::const_pointer>(textStream + Offset), GetLength()};
+        }
+
+        NODISCARD ALWAYS_INLINE PURE std::uint32_t GetLength() const noexcept{
+            return Kind == LispTokenKind::LeftParenthesis or Kind == LispTokenKind::RightParenthesis ? 1 : Length;
+        }
+
+        NODISCARD ALWAYS_INLINE PURE std::uint32_t GetByteLocation(const char*) const noexcept{
+            return Offset;
+        }
+#else
     struct WL_INTERNAL alignas(32) LispToken final {
     public:
         const char* TextPtr = nullptr;
@@ -163,13 +325,27 @@ namespace WideLips {
             return std::wstring_view{reinterpret_cast<std::wstring_view::const_pointer>(TextPtr), Length};
         }
 
-        NODISCARD ALWAYS_INLINE PURE bool Match(const LispTokenKind kind) const noexcept{
-            return Kind == kind;
+        //the text a token lies in is only needed with the compact layout (see WL_COMPACT_TOKENS)
+        NODISCARD ALWAYS_INLINE std::string_view GetText(const char*) const noexcept{
+            return GetText();
+        }
+
+        NODISCARD ALWAYS_INLINE std::wstring_view GetWText(const char*) const noexcept{
+            return GetWText();
+        }
+
+        NODISCARD ALWAYS_INLINE PURE std::uint32_t GetLength() const noexcept{
+            return Length;
         }
 
         NODISCARD ALWAYS_INLINE PURE std::uint32_t GetByteLocation(const char* textStream) const noexcept{
             return TextPtr - textStream;
         }
+#endif
+
+        NODISCARD ALWAYS_INLINE PURE bool Match(const LispTokenKind kind) const noexcept{
+            return Kind == kind;
+        }
 
         NODISCARD ALWAYS_INLINE PURE bool IsOperator() const noexcept{
             switch (Kind) {
@@ -251,7 +427,116 @@ namespace WideLips {
         }
     };
 
+    //the tokens a lexer materialized so far as a structure of arrays, the n-th element of every column belongs to the
+    //n-th token (see 'LispLexer::GetToken'). queries that only look at one field of every token, like finding all the
+    //tokens of a kind, stream that field alone rather than whole tokens through the cache
+    class WL_INTERNAL LispTokenColumns final {
+        friend class LispLexer;
+    private:
+        VirtualBumpVector<LispTokenKind> _kinds;
+        VirtualBumpVector<std::uint32_t> _offsets;
+        VirtualBumpVector<std::uint32_t> _lengths;
+        VirtualBumpVector<std::uint32_t> _auxiliaryIndices;
+        VirtualBumpVector<std::uint8_t> _auxiliaryLengths;
+        Classifier::ByteFinder _finder;
+    public:
+        LispTokenColumns(const std::size_t capacity,
+            const ClassificationKernel kernel,
+            ArenaPool* pool = nullptr,
+            const bool hugePages = false) :
+        _kinds(capacity,pool,hugePages),
+        _offsets(capacity,pool,hugePages),
+        _lengths(capacity,pool,hugePages),
+        _auxiliaryIndices(capacity,pool,hugePages),
+        _auxiliaryLengths(capacity,pool,hugePages),
+        _finder(Classifier::ResolveFinder(kernel)) {}
+    public:
+        NODISCARD ALWAYS_INLINE std::size_t Size() const noexcept {
+            return _kinds.Size();
+        }
+
+        NODISCARD std::size_t Capacity() const noexcept {
+            return std::min({_kinds.Capacity(),
+                _offsets.Capacity(),
+                _lengths.Capacity(),
+                _auxiliaryIndices.Capacity(),
+                _auxiliaryLengths.Capacity()});
+        }
+
+        NODISCARD ALWAYS_INLINE const LispTokenKind* GetKinds() const noexcept {
+            return _kinds.begin();
+        }
+
+        NODISCARD ALWAYS_INLINE const std::uint32_t* GetOffsets() const noexcept {
+            return _offsets.begin();
+        }
+
+        NODISCARD ALWAYS_INLINE const std::uint32_t* GetLengths() const noexcept {
+            return _lengths.begin();
+        }
+
+        NODISCARD ALWAYS_INLINE const std::uint32_t* GetAuxiliaryIndices() const noexcept {
+            return _auxiliaryIndices.begin();
+        }
+
+        NODISCARD ALWAYS_INLINE const std::uint8_t* GetAuxiliaryLengths() const noexcept {
+            return _auxiliaryLengths.begin();
+        }
+
+        //index of the first token of 'kind' at or after 'from', 'Size()' if there's none
+        NODISCARD ALWAYS_INLINE std::size_t FindNext(const LispTokenKind kind,const std::size_t from) const noexcept {
+            const std::size_t size = Size();
+            if (from >= size) {
+                return size;
+            }
+            return from + _finder(reinterpret_cast<const std::uint8_t*>(GetKinds() + from),
+                size - from,
+                static_cast<std::uint8_t>(kind));
+        }
+    private:
+        ALWAYS_INLINE void Append(const LispToken& token,const std::uint32_t offset) noexcept {
+            _kinds.EmplaceBack(LispTokenKind{token.Kind});
+            _offsets.EmplaceBack(std::uint32_t{offset});
+            _lengths.EmplaceBack(token.GetLength());
+            _auxiliaryIndices.EmplaceBack(std::uint32_t{token.AuxiliaryIndex});
+            _auxiliaryLengths.EmplaceBack(std::uint8_t{token.AuxiliaryLength});
+        }
+
+        ALWAYS_INLINE void SetAuxiliary(const std::size_t index,
+            const std::uint32_t auxiliaryIndex,
+            const std::uint8_t auxiliaryLength) noexcept {
+            _auxiliaryIndices[index] = auxiliaryIndex;
+            _auxiliaryLengths[index] = auxiliaryLength;
+        }
+
+        ALWAYS_INLINE void Reuse() noexcept {
+            _kinds.Reuse();
+            _offsets.Reuse();
+            _lengths.Reuse();
+            _auxiliaryIndices.Reuse();
+            _auxiliaryLengths.Reuse();
+        }
+
+        void Reserve(const std::size_t capacity) noexcept {
+            _kinds.Reserve(capacity);
+            _offsets.Reserve(capacity);
+            _lengths.Reserve(capacity);
+            _auxiliaryIndices.Reserve(capacity);
+            _auxiliaryLengths.Reserve(capacity);
+        }
+
+        void CommitFor(const std::size_t count) noexcept {
+            _kinds.CommitFor(count);
+            _offsets.CommitFor(count);
+            _lengths.CommitFor(count);
+            _auxiliaryIndices.CommitFor(count);
+            _auxiliaryLengths.CommitFor(count);
+        }
+    };
+
     class LispLexer {
+        friend class LispStreamLexer;
+        friend class BluePassCache;
         using TokenRegion = std::pair<const std::uint32_t, const std::uint32_t>;
         using StaticTokenRegion = std::pair<const char*, const std::uint32_t>;
         using RegionOfTokens = std::pair<const LispToken * const,const LispToken * const>;
@@ -259,17 +544,37 @@ namespace WideLips {
     private:
         struct ConstructorEnabler {};
         static const ConstructorEnabler CtorEnabler;
-        static constexpr std::uint32_t TokensInBlock = sizeof(Vector256);
+        using BlockMask = TokenizationBlock::MaskType;
+        static constexpr std::uint32_t TokensInBlock = TokenizationBlock::Width;
         static constexpr std::uint32_t TokensInBlockBoundary = TokensInBlock-1;
-        static constexpr std::uint32_t TokensInBlockPopCnt = std::countr_zero(sizeof(Vector256));
+        static constexpr std::uint32_t TokensInBlockPopCnt = std::countr_zero(TokensInBlock);
+        //blocks the fused blue pass classifies before matching them, 32KB of text and its blocks fit in L2
+        static constexpr std::size_t FusedTileBlocks = 512;
+        static constexpr std::uint32_t NoSExprIndex = std::numeric_limits<std::uint32_t>::max();
     private:
-        MonoBumpVector<TokenizationBlock> _blocks;
-        MonoBumpVector<SExprIndex> _sexprIndices;
-        MonoBumpVector<LispToken> _tokens;
-        MonoBumpVector<AuxiliaryIndex> _auxiliaries;
+        VirtualBumpVector<TokenizationBlock> _blocks;
+        VirtualBumpVector<SExprIndex> _sexprIndices;
+        VirtualBumpVector<LispToken> _tokens;
+        VirtualBumpVector<AuxiliaryIndex> _auxiliaries;
+        VirtualBumpVector<LineRank> _lineRanks;
+        LispTokenColumns _tokenColumns;
         BumpVector<Diagnostic::LispDiagnostic> _diagnostics;
+        Classifier::Kernel _classifier;
+        Classifier::PrefixXorFunction _prefixXor;
+        std::uint32_t _threads;
+        BluePassEngine _blueEngine;
+        SourceLocations _locations;
+        bool _keepTokenColumns;
+        ClassificationKernel _kernel;
+        ArenaCapacities _capacities;
+        BluePassCache* _cache;
+        const LispLexer* _origin; //the lexer a shard materializes for, nullptr for the lexer itself
+        ArenaPool* _pool;
+        bool _hugePages;
+        bool _concurrent;
         std::wstring_view _filePath;
         std::string_view _text;
+        std::string _editedText; //the copy of the text edits are applied to
         std::uint32_t _currentTokenAuxiliary = 0;
         std::uint32_t _sexprIndex = 0;
         std::uint32_t _tokenStreamPos = 0;
@@ -278,8 +583,23 @@ namespace WideLips {
         std::uint32_t _column = 1;
         bool _tokenized = false;
         bool _reused = false;
+        bool _wellFormed = false; //the last blue pass reported nothing, so its S-expressions can be matched again piecewise
+        //tokens were materialized one top level S-expression after the other, the last one being
+        //'_lastMaterializedForm', so the arenas hold them in text order form by form (see 'ShiftMaterialized')
+        bool _materializedInOrder = true;
+        std::uint32_t _lastMaterializedForm = NoSExprIndex;
+        std::thread::id _tokenizingThread;
+        //the lexers other threads materialize through, they read the blue pass of this one in place and emit into
+        //arenas of their own
+        ThreadShards<LispLexer> _shards;
     public:
-        WL_API explicit LispLexer(UNUSED ConstructorEnabler enabler,std::string_view file,std::wstring_view filePath,bool conservative);
+        WL_API explicit LispLexer(UNUSED ConstructorEnabler enabler,
+            std::string_view file,
+            std::wstring_view filePath,
+            bool conservative,
+            const LispLexerOptions& options = {});
+        //a shard of 'origin', see '_shards'
+        LispLexer(UNUSED ConstructorEnabler enabler,const LispLexer& origin);
         LispLexer(const LispLexer&) = delete;
         LispLexer(LispLexer&&) = delete;
         LispLexer& operator = (LispLexer&&) = delete;
@@ -287,44 +607,132 @@ namespace WideLips {
     public:
         NODISCARD static std::unique_ptr<LispLexer> Make(AlignedFileReadResult& alignedFile,
             std::wstring_view fileName,
-            bool conservative = false);
-        NODISCARD static std::unique_ptr<LispLexer> Make(std::string_view program, bool conservative = true);
+            bool conservative = false,
+            const LispLexerOptions& options = {});
+        NODISCARD static std::unique_ptr<LispLexer> Make(std::string_view program,
+            bool conservative = true,
+            const LispLexerOptions& options = {});
+        //tells whether the host CPU can run 'kernel', requesting one it can't falls back to the widest one it can
+        NODISCARD WL_API static bool IsKernelSupported(ClassificationKernel kernel) noexcept;
     public:
         WL_API bool Tokenize() noexcept;
         WL_API OptRegionOfTokens TokenizeFirstSExpr() noexcept;
         WL_API OptRegionOfTokens TokenizeNext(const LispToken* token) noexcept;
+        //the top level S-expression following the one at 'sexprIndex', which needn't be materialized (see
+        //'GetTopLevelSExprIndices')
+        WL_API OptRegionOfTokens TokenizeAfter(std::uint32_t sexprIndex) noexcept;
         WL_API OptRegionOfTokens TokenizeSExpr(const LispToken* begin,bool csEmptySExpr=false) noexcept;
         NODISCARD WL_API OptRegionOfTokens GetTokenAuxiliary(const LispToken* token) noexcept;
+        NODISCARD WL_API SourceLocation GetSourceLocation(const LispToken* token) const noexcept;
         NODISCARD WL_API BumpVector<Diagnostic::LispDiagnostic>& GetDiagnostics() noexcept;
         NODISCARD WL_API std::wstring_view GetFilePath() const noexcept;
         NODISCARD WL_API std::size_t GetFileSize() const noexcept;
         NODISCARD WL_API const char* GetTextData() const noexcept;
+        NODISCARD ALWAYS_INLINE std::string_view GetTokenText(const LispToken* token) const noexcept {
+            return token->GetText(_text.data());
+        }
+        //all zeros unless the lexer was made with 'LispLexerOptions::SampleArenas'
+        NODISCARD WL_API const ArenaCapacities& GetArenaCapacities() const noexcept;
+        //nullptr unless the lexer was made with 'LispLexerOptions::TokenColumns'
+        NODISCARD WL_API const LispTokenColumns* GetTokenColumns() const noexcept;
+        NODISCARD ALWAYS_INLINE const LispToken* GetToken(const std::size_t index) const noexcept {
+            return &_tokens[index];
+        }
         WL_API void Reuse() noexcept;
+        //lexes another text with the same lexer, the arenas are only reserved again if they are too small for it
+        WL_API void Reset(std::string_view text,std::wstring_view filePath = L"memory") noexcept;
+        //replaces the 'removedLength' bytes at 'offset' with 'insertedText', matching again only the top level
+        //S-expressions it overlaps. the text past the edit is still moved, classified and reindexed (see 'LispEdit')
+        WL_API LispEdit ApplyEdit(std::uint32_t offset,std::uint32_t removedLength,std::string_view insertedText);
+        //the lexer the calling thread materializes through, this one unless it's concurrent and the thread isn't the
+        //one that tokenized the text (see 'LispLexerOptions::Concurrent'). its shards are gone once the text is
+        //tokenized again, reused, reset or edited
+        NODISCARD WL_API LispLexer* Local();
+        NODISCARD WL_API bool OnTokenizingThread() const noexcept;
+        NODISCARD WL_API bool IsConcurrent() const noexcept;
+        //the S-expression indices of the top level S-expressions in order, found by jumping along the blue pass
+        //without materializing any of them
+        NODISCARD WL_API std::vector<std::uint32_t> GetTopLevelSExprIndices() const;
+        //moves what the other threads' shards reported into the diagnostics of this lexer, once they are done
+        WL_API void GatherDiagnostics();
     private:
+        void Rebind(std::string_view text) noexcept;
+        void ReserveFor(std::size_t textSize) noexcept;
+        void ReserveForEdits(std::size_t textSize) noexcept;
+        LispEdit RetokenizeEdited();
+        void CommitSampledArenas() noexcept;
+        NODISCARD bool HoldsToken(const LispToken* token) const noexcept;
+        NODISCARD bool HasRoomFor(std::size_t count) const noexcept;
+        void ReportArenasExhausted(const SourceLocation& location);
+        NODISCARD const LispLexer* EmitterOf(const LispToken* token) const noexcept;
+        LispToken* EmitToken(const char* at,
+            std::uint32_t line,
+            std::uint32_t length,
+            std::uint32_t auxiliaryIndex,
+            std::uint32_t column,
+            std::uint32_t indexInSpecialStream,
+            LispTokenKind kind,
+            std::uint8_t auxiliaryLength) noexcept;
         void Classify();
+        void ClassifyBlocks(std::size_t firstBlock,std::size_t endBlock) noexcept;
+        void RankLines(std::size_t fromBlock = 0) noexcept;
+        FormsBoundary ClassifyWindow();
+        bool TokenizeWindow(std::size_t size);
+        NODISCARD SourceLocation LocationAt(std::uint32_t offset) const noexcept;
+        NODISCARD SourceLocation CurrentLocation() const noexcept;
+        NODISCARD SourceLocation OpenLocationOf(const SExprIndex& index) const noexcept;
+        template<bool LazyLocations>
         OptRegionOfTokens TokenizeSExprCore(const LispToken* begin,bool csEmptySExpr) noexcept;
+        template<bool LazyLocations = false>
         char NextChar() noexcept;
         char NextCharWithoutColumn() noexcept;
         NODISCARD char CurrentChar() const noexcept;
+        template<bool LazyLocations = false>
         NODISCARD char SkipToCharAt(std::size_t offset) noexcept;
         NODISCARD char SkipToCharAtWithoutColumn(std::size_t offset) noexcept;
-        NODISCARD TokenRegion FetchStringRegion(std::uint32_t startingBlock,std::uint8_t posInBlock) noexcept;
-        NODISCARD TokenRegion FetchCommentRegion(std::uint32_t startingBlock,std::uint8_t posInBlock) noexcept;
-        NODISCARD TokenRegion FetchFragmentRegion(std::uint32_t startingBlock,
+        NODISCARD TokenRegion FetchStringRegion(BlockMask startingBlock,std::uint8_t posInBlock) noexcept;
+        NODISCARD TokenRegion FetchCommentRegion(BlockMask startingBlock,std::uint8_t posInBlock) noexcept;
+        template<bool LazyLocations>
+        NODISCARD TokenRegion FetchFragmentRegion(BlockMask startingBlock,
             std::uint8_t posInBlock,
             const TokenizationBlock* currentBlock) noexcept;
-        NODISCARD TokenRegion FetchDigitRegion(std::uint32_t startingBlock,std::uint8_t posInBlock) noexcept;
-        NODISCARD TokenRegion FetchIdentifierRegion(std::uint32_t startingBlock,std::uint8_t posInBlock) noexcept;
+        NODISCARD TokenRegion FetchDigitRegion(BlockMask startingBlock,std::uint8_t posInBlock) noexcept;
+        NODISCARD TokenRegion FetchIdentifierRegion(BlockMask startingBlock,std::uint8_t posInBlock) noexcept;
+        template<bool LazyLocations>
         void TokenizeOperatorsOrStructural(std::uint8_t fragLength) noexcept;
         NODISCARD TokenizationBlock* TokenizationBlockAt(std::uint32_t pos) noexcept;
         NODISCARD std::uint8_t OffsetInBlock() const noexcept;
         NODISCARD bool IsEndOfFile() const noexcept;
-        bool TokenizeBlue();
-        TokenRegion TokenizeRealBlue(std::uint32_t startingBlock,
+        NODISCARD std::uint32_t ColumnAfterNewLine() const noexcept;
+        bool TokenizeBlue(bool classified = false);
+        bool TokenizeCached();
+        template<bool LazyLocations>
+        void MatchSExprSequential() noexcept;
+        void MatchSExprParallel();
+        void ClassifyAndMatchSExprFused();
+        bool MatchSExprRegion(std::uint32_t from,
+            std::uint32_t until,
+            std::uint32_t firstIndex,
+            std::vector<SExprIndex>& region,
+            std::uint32_t& forms,
+            std::uint32_t& line,
+            std::uint32_t& lineStart) const;
+        void NoteMaterialized(std::uint32_t form) noexcept;
+        void ShiftMaterialized(std::uint32_t from,
+            std::uint32_t movedFrom,
+            std::uint32_t shift,
+            std::uint32_t indexShift,
+            std::uint32_t fromLine,
+            std::uint32_t lineShift,
+            std::uint32_t columnShift,
+            std::uint32_t leadingAuxiliary,
+            std::uint8_t leadingAuxiliaryLength) noexcept;
+        TokenRegion TokenizeRealBlue(BlockMask startingBlock,
             std::uint8_t posInBlock,
             const TokenizationBlock* currentBlock) noexcept;
         StaticTokenRegion TokenizeOperatorsOrStructuralBlue() noexcept;
-        bool CheckAtomsAtTopLevelBlue() noexcept;
+        template<bool LazyLocations>
+        bool CheckAtomsAtTopLevelBlue(std::uint32_t firstIndex,std::uint32_t lastIndex) noexcept;
     private:
         NODISCARD PURE static bool IsOperator(char c) noexcept;
         NODISCARD PURE static bool IsDecimal(char c) noexcept;
@@ -337,7 +745,11 @@ namespace WideLips {
     public:
         ~PredefinedTokens() = delete;
     public:
+#ifdef WL_COMPACT_TOKENS
+        static constexpr LispToken EndOfFile {0,0,0,LispTokenKind::EndOfFile};
+#else
         static constexpr LispToken EndOfFile {nullptr,0,0,0,0,0,LispTokenKind::EndOfFile};
+#endif
     };
 
     inline const LispLexer::ConstructorEnabler LispLexer::CtorEnabler{};
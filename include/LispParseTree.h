@@ -1,10 +1,17 @@
 ﻿#ifndef LISPPARSETREE_H
 #define LISPPARSETREE_H
+#include <algorithm>
+#include <atomic>
+#include <concepts>
 #include <cstdint>
+#include <functional>
 #include <ranges>
+#include <span>
+#include <vector>
 #include "BumpVector.h"
 #include "LispParser.h"
 #include "PaddedString.h"
+#include "ParallelFor.h"
 
 namespace WideLips {
     namespace Examples {
@@ -18,10 +25,13 @@ namespace WideLips {
     struct  LispParseNode;
     template<typename TConcreteVisitor>
     struct LispParseTreeVisitor;
-    template<typename TConcreteVisitor>
+    struct LispParseNodes;
+    template<typename TConcreteVisitor,typename TNodes = LispParseNodes>
     struct ImmutableLispParseTreeVisitor;
     struct LispAtom;
     struct LispList;
+    struct LispArguments;
+    struct LispParseError;
     struct LispSentinel;
     struct LispAuxiliary;
     class LispParseTree;
@@ -53,22 +63,6 @@ namespace WideLips {
         Error,
     };
 
-    struct SourceLocation {
-    public:
-        const std::uint32_t Line;
-        const std::uint32_t ColumnChar;
-    public:
-        constexpr SourceLocation(const std::uint32_t line,const std::uint32_t column) : Line(line),ColumnChar(column) {}
-        SourceLocation(const SourceLocation& ) = delete;
-        SourceLocation(SourceLocation&&) = delete;
-        SourceLocation& operator=(const SourceLocation&) = delete;
-        SourceLocation& operator=(SourceLocation&&) = delete;
-    public:
-        NODISCARD ALWAYS_INLINE static consteval SourceLocation Default(){
-            return SourceLocation{0,0};
-        }
-    };
-
     struct LispParseNodeBase {
         template<typename T>
         friend struct LispParseNode;
@@ -78,7 +72,10 @@ namespace WideLips {
         friend struct LispAuxiliary;
         friend class LispParseTree;
         friend class LispParser;
+        friend class SerializedLispParseTree;
         friend class Examples::SchemeParser;
+        template<typename TVisitor>
+        friend class ParallelLispParseTreeWalker;
     protected:
         using LispParseNodeBasePointer = LispParseNodeBase*;
         using LispParseNodeAuxiliaryPointer = LispAuxiliary*;
@@ -112,6 +109,16 @@ namespace WideLips {
         void Accept(const ImmutableLispParseTreeVisitor<TConcreteVisitor>* visitor) const;
 
         NODISCARD const LispAuxiliary * GetNodeAuxiliary() const;
+    protected:
+        //nodes are materialized lazily by whichever thread gets to them first, so the pointers caching them are
+        //published with a CAS and threads racing for the same node all end up with the one that got there first
+        template<typename T>
+        NODISCARD static ALWAYS_INLINE T* Publish(const std::atomic_ref<T*>& slot,T* const made) noexcept {
+            T* published = nullptr;
+            return slot.compare_exchange_strong(published,made,std::memory_order_acq_rel,std::memory_order_acquire) ?
+                made :
+                published;
+        }
     };
 
     template<typename TConcreteVisitor>
@@ -148,35 +155,46 @@ namespace WideLips {
         }
     };
 
-    template<typename TConcreteVisitor>
+    //the node types an immutable visitor is handed, trees laid out otherwise name their own (see
+    //SerializedLispParseNodes) and a visitor written against 'TNodes' visits either of them
+    struct LispParseNodes final {
+        using Base = LispParseNodeBase;
+        using Atom = LispAtom;
+        using List = LispList;
+        using Arguments = LispArguments;
+        using Error = LispParseError;
+    };
+
+    template<typename TConcreteVisitor,typename TNodes>
     struct ImmutableLispParseTreeVisitor {
-        ALWAYS_INLINE void Visit(const LispAtom * const atom) const {
+        using Nodes = TNodes;
+        ALWAYS_INLINE void Visit(const typename TNodes::Atom * const atom) const {
             reinterpret_cast<const TConcreteVisitor*>(this)->Visit(atom);
         }
-        ALWAYS_INLINE void Visit(const LispList * const list) const {
+        ALWAYS_INLINE void Visit(const typename TNodes::List * const list) const {
             reinterpret_cast<const TConcreteVisitor*>(this)->Visit(list);
         }
-        ALWAYS_INLINE void Visit(const LispArguments * const arguments) const{
+        ALWAYS_INLINE void Visit(const typename TNodes::Arguments * const arguments) const{
             reinterpret_cast<const TConcreteVisitor*>(this)->Visit(arguments);
         }
-        ALWAYS_INLINE void Visit(const LispParseError * const error) const{
+        ALWAYS_INLINE void Visit(const typename TNodes::Error * const error) const{
             reinterpret_cast<const TConcreteVisitor*>(this)->Visit(error);
         }
     protected:
         template<typename MostDerivedVisitor>
-        ALWAYS_INLINE void Dispatch(const LispParseNodeBase * const node) const requires std::derived_from<MostDerivedVisitor,TConcreteVisitor>{
+        ALWAYS_INLINE void Dispatch(const typename TNodes::Base * const node) const requires std::derived_from<MostDerivedVisitor,TConcreteVisitor>{
             switch (node->Kind) {
                 case LispParseNodeKind::SExpr:
-                    reinterpret_cast<const MostDerivedVisitor*>(this)->Visit(reinterpret_cast<const LispList*>(node));
+                    reinterpret_cast<const MostDerivedVisitor*>(this)->Visit(reinterpret_cast<const typename TNodes::List*>(node));
                     break;
                 case LispParseNodeKind::Arguments:
-                    reinterpret_cast<const MostDerivedVisitor*>(this)->Visit(reinterpret_cast<const LispArguments*>(node));
+                    reinterpret_cast<const MostDerivedVisitor*>(this)->Visit(reinterpret_cast<const typename TNodes::Arguments*>(node));
                     break;
                 case LispParseNodeKind::Error:
-                    reinterpret_cast<const MostDerivedVisitor*>(this)->Visit(reinterpret_cast<const LispParseError*>(node));
+                    reinterpret_cast<const MostDerivedVisitor*>(this)->Visit(reinterpret_cast<const typename TNodes::Error*>(node));
                     break;
                 default:
-                    reinterpret_cast<const MostDerivedVisitor*>(this)->Visit(reinterpret_cast<const LispAtom*>(node));
+                    reinterpret_cast<const MostDerivedVisitor*>(this)->Visit(reinterpret_cast<const typename TNodes::Atom*>(node));
                     break;
             }
         }
@@ -207,25 +225,34 @@ namespace WideLips {
             return reinterpret_cast<const TLispNode*>(this)->GetNodeAuxiliary();
         }
     protected:
+        NODISCARD ALWAYS_INLINE SourceLocation GetSourceLocation(const LispToken* token) const {
+            return Parser->GetLexer()->GetSourceLocation(token);
+        }
+
+        NODISCARD ALWAYS_INLINE std::string_view GetText(const LispToken* token) const {
+            return Parser->GetLexer()->GetTokenText(token);
+        }
+
         NODISCARD ALWAYS_INLINE const LispAuxiliary * GetNodeAuxiliary(const LispToken* token) const {
-            if (_nodeAuxiliary != nullptr) {
-                return _nodeAuxiliary;
+            const std::atomic_ref nodeAuxiliary(_nodeAuxiliary);
+            if (const LispParseNodeAuxiliaryPointer cached = nodeAuxiliary.load(std::memory_order_acquire)) {
+                return cached;
             }
             LispLexer* const lexer = Parser->GetLexer();
             auto optAuxiliary = lexer->GetTokenAuxiliary(token);
             if (!optAuxiliary) {
                 if (token->AuxiliaryIndex == std::numeric_limits<std::uint8_t>::max()) {
+                    const SourceLocation location = lexer->GetSourceLocation(token);
                     lexer->GetDiagnostics().EmplaceBack(Diagnostic::DiagnosticFactory::FetchingAuxiliaryOfLazyToken(
                         Parser->OriginFile(),
-                        token->Line,
-                        token->Column,
-                        *token));
+                        location.Line,
+                        location.ColumnChar,
+                        lexer->GetTokenText(token)));
                 }
                 return nullptr;
             }
             const auto& [auxBeg,auxEnd] = optAuxiliary.value();
-            _nodeAuxiliary = Parser->MakeAuxiliary(auxBeg,auxEnd);
-            return _nodeAuxiliary;
+            return Publish(nodeAuxiliary,Parser->MakeAuxiliary(auxBeg,auxEnd));
         }
     };
 
@@ -247,11 +274,11 @@ namespace WideLips {
         _kind(kind){}
     public:
         NODISCARD ALWAYS_INLINE SourceLocation GetSourceLocation() const {
-            return SourceLocation{_token->Line,  _token->Column};
+            return LispParseNode::GetSourceLocation(_token);
         }
 
         NODISCARD ALWAYS_INLINE std::string_view GetParseNodeText() const {
-            return _token->GetText();
+            return LispParseNode::GetText(_token);
         }
 
         NODISCARD ALWAYS_INLINE LispTokenKind GetUnderlyingKind() const {
@@ -294,11 +321,11 @@ namespace WideLips {
         _subExpressions(subExpressions) {}
     public:
         NODISCARD ALWAYS_INLINE SourceLocation GetSourceLocation() const {
-            return {_sexprBegin->Line, _sexprBegin->Column};
+            return LispParseNode::GetSourceLocation(_sexprBegin);
         }
 
         NODISCARD ALWAYS_INLINE std::string_view GetParseNodeText() const {
-            return std::string_view{_sexprBegin->TextPtr,_sexprEnd->TextPtr};
+            return std::string_view{LispParseNode::GetText(_sexprBegin).data(),LispParseNode::GetText(_sexprEnd).data()};
         }
 
         /**
@@ -318,10 +345,11 @@ namespace WideLips {
             if (!sexprRegion) {
                 if constexpr (DisallowEmptySExpr) {
                     // ReSharper disable once CppDFAUnreachableCode
+                    const SourceLocation location = lexer->GetSourceLocation(_sexprBegin);
                     lexer->GetDiagnostics().EmplaceBack(Diagnostic::DiagnosticFactory::EmptySExpression(
                           lexer->GetFilePath(),
-                          _sexprBegin->Line,
-                          _sexprBegin->Column)
+                          location.Line,
+                          location.ColumnChar)
                           );
                 }
                 return nullptr;
@@ -345,25 +373,26 @@ namespace WideLips {
         *         or `nullptr` if the sub-expressions could not be parsed or are empty.
         */
         NODISCARD ALWAYS_INLINE LispParseNodeBase* GetSubExpressions (const bool csEmptySExpr=false) {
-            if (_subExpressions != nullptr) {
-                return _subExpressions;
+            const std::atomic_ref subExpressions(_subExpressions);
+            if (LispParseNodeBase* const parsed = subExpressions.load(std::memory_order_acquire)) {
+                return parsed;
             }
             LispLexer* const lexer = Parser->GetLexer();
             const auto sexprRegion = lexer->TokenizeSExpr(_sexprBegin,csEmptySExpr);
             if (!sexprRegion) {
                 if constexpr (DisallowEmptySExpr) {
                     // ReSharper disable once CppDFAUnreachableCode
+                    const SourceLocation location = lexer->GetSourceLocation(_sexprBegin);
                     lexer->GetDiagnostics().EmplaceBack(Diagnostic::DiagnosticFactory::EmptySExpression(
                           lexer->GetFilePath(),
-                          _sexprBegin->Line,
-                          _sexprBegin->Column)
+                          location.Line,
+                          location.ColumnChar)
                           );
                 }
                 return nullptr;
             }
             const auto& [subExprBegin,subExprEnd] = sexprRegion.value();
-            _subExpressions = Parser->Parse(subExprBegin,subExprEnd);
-            return _subExpressions;
+            return Publish(subExpressions,Parser->Parse(subExprBegin,subExprEnd));
         }
 
         NODISCARD ALWAYS_INLINE const LispAuxiliary * GetNodeAuxiliary() const {
@@ -379,6 +408,11 @@ namespace WideLips {
         void Accept(const ImmutableLispParseTreeVisitor<TConcreteVisitor>* visitor) const {
             visitor->Visit(this);
         }
+    private:
+        //an edit right before a top level S-expression changes the trivia its auxiliary is made of
+        ALWAYS_INLINE void ForgetNodeAuxiliary() const noexcept {
+            _nodeAuxiliary = nullptr;
+        }
     };
 
     struct LispArguments final : LispParseNode<LispArguments> {
@@ -401,11 +435,12 @@ namespace WideLips {
         _arguments(arguments){}
     public:
         NODISCARD ALWAYS_INLINE SourceLocation GetSourceLocation() const {
-            return {_argumentsBegin->Line, _argumentsBegin->Column};
+            return LispParseNode::GetSourceLocation(_argumentsBegin);
         }
 
         NODISCARD ALWAYS_INLINE std::string_view GetParseNodeText() const {
-            return std::string_view{&_argumentsBegin->GetText().front(),&_argumentsEnd->GetText().back()+1};
+            const std::string_view argumentsEnd = LispParseNode::GetText(_argumentsEnd);
+            return std::string_view{LispParseNode::GetText(_argumentsBegin).data(),argumentsEnd.data()+argumentsEnd.size()};
         }
 
         NODISCARD ALWAYS_INLINE const LispAuxiliary * GetNodeAuxiliary() const {
@@ -443,11 +478,11 @@ namespace WideLips {
     public:
 
         NODISCARD ALWAYS_INLINE SourceLocation GetSourceLocation() const {
-            return {_errorToken->Line, _errorToken->Column};
+            return LispParseNode::GetSourceLocation(_errorToken);
         }
 
         NODISCARD ALWAYS_INLINE std::string_view GetParseNodeText() const {
-            return std::string_view{&_errorToken->GetText().front(),&_errorToken->GetText().back()+1};
+            return LispParseNode::GetText(_errorToken);
         }
 
         NODISCARD const LispAuxiliary * GetNodeAuxiliary() const {
@@ -469,15 +504,19 @@ namespace WideLips {
     private:
         using AuxiliariesRange = const std::pair<const LispToken*,const LispToken*>;
         AuxiliariesRange _auxiliariesRange;
+        const LispLexer* const _lexer;
     public:
-        explicit LispAuxiliary(AuxiliariesRange auxiliaries_range) :_auxiliariesRange(auxiliaries_range){}
+        LispAuxiliary(AuxiliariesRange auxiliaries_range,const LispLexer* lexer) :
+        _auxiliariesRange(auxiliaries_range),
+        _lexer(lexer){}
     public:
         NODISCARD ALWAYS_INLINE SourceLocation GetSourceLocation() const {
-            return {_auxiliariesRange.first->Line, _auxiliariesRange.first->Column};
+            return _lexer->GetSourceLocation(_auxiliariesRange.first);
         }
 
         NODISCARD ALWAYS_INLINE std::string_view GetParseNodeText() const {
-            return std::string_view{&_auxiliariesRange.first->GetText().front(),&_auxiliariesRange.second->GetText().back()+1};
+            const std::string_view last = _lexer->GetTokenText(_auxiliariesRange.second);
+            return std::string_view{_lexer->GetTokenText(_auxiliariesRange.first).data(),last.data()+last.size()};
         }
     };
 
@@ -486,6 +525,14 @@ namespace WideLips {
         std::unique_ptr<LispParseTree> ParseTree;
     };
 
+    struct LispParseManyOptions final {
+        //threads parsing files concurrently, 0 uses every hardware thread
+        std::uint32_t Threads = 0;
+        bool Conservative = false;
+        //options every parser is made with
+        LispLexerOptions Lexer{};
+    };
+
     class LispParseTree final {
     private:
         using LispParseNodeBasePointer = LispParseNodeBase*;
@@ -498,7 +545,7 @@ namespace WideLips {
         std::unique_ptr<LispParser> _parser;
         LispParseNodeBasePointer _root;
         const BumpVector<Diagnostic::LispDiagnostic>& _diagnostics;
-        const bool _canBeConsumed;
+        bool _canBeConsumed;
         const PaddedString _program;
     public:
         LispParseTree(UNUSED ConstructorEnabler enabler,
@@ -536,25 +583,42 @@ namespace WideLips {
     public:
         template<WideLipsParser TParser = LispParser>
         NODISCARD static LispParseResult Parse(const std::filesystem::path& filePath,bool conservative) {
-            auto parser = std::make_unique<TParser>(filePath,conservative);
-            auto parsedProgram = parser->Parse();
-            bool success = parsedProgram != nullptr;
-            for (auto&& diagnostic : parser->GetDiagnostics()) {
-                if (diagnostic.GetSeverity() == Diagnostic::Severity::Error) {
-                    success = false;
-                    break;
+            return MakeResult(std::make_unique<TParser>(filePath,conservative),filePath);
+        }
+
+        //parses every file of 'filePaths' on worker threads stealing files from each other, largest files first so
+        //none of them is left to run alone at the end. the results are in the order of 'filePaths'
+        template<WideLipsParser TParser = LispParser>
+        NODISCARD static std::vector<LispParseResult> ParseMany(const std::span<const std::filesystem::path> filePaths,
+            const LispParseManyOptions& options = {}) {
+            std::vector<LispParseResult> results(filePaths.size());
+            ForEachLargestFirst(filePaths,options,[&](UNUSED const std::size_t worker,const std::size_t index) {
+                results[index] = MakeResult(MakeParser<TParser>(filePaths[index],options),filePaths[index]);
+            });
+            return results;
+        }
+
+        //same as above, but every parse is handed to 'onParsed(index,parser,root,success)' on the worker that made it
+        //instead of being kept. a worker parses all its files with one parser reset from a file to the next (so
+        //they share its arenas), hence the tree 'onParsed' gets is gone once it returns. 'onParsed' is called from
+        //several workers at once
+        template<WideLipsParser TParser = LispParser,typename OnParsed>
+        requires std::invocable<OnParsed&,std::size_t,TParser&,LispParseNodeBase*,bool>
+        static void ParseMany(const std::span<const std::filesystem::path> filePaths,
+            const LispParseManyOptions& options,
+            OnParsed&& onParsed) {
+            std::vector<std::unique_ptr<TParser>> parsers(WorkersOf(options));
+            ForEachLargestFirst(filePaths,options,[&](const std::size_t worker,const std::size_t index) {
+                std::unique_ptr<TParser>& parser = parsers[worker];
+                if (parser == nullptr) {
+                    parser = MakeParser<TParser>(filePaths[index],options);
                 }
-            }
-            return {
-                .Success = success,
-                .ParseTree = std::make_unique<LispParseTree>(CtorEnabler,
-                    filePath.string(),
-                    std::move(parser),
-                    parsedProgram,
-                    parser->GetDiagnostics(),
-                    success,
-                    EmptyPaddedString::GetPaddedString())
-            };
+                else {
+                    static_cast<LispParser&>(*parser).Reset(filePaths[index]);
+                }
+                LispParseNodeBase* root = static_cast<LispParser&>(*parser).Parse();
+                std::invoke(onParsed,index,*parser,root,Succeeded(*parser,root));
+            });
         }
 
         template<WideLipsParser TParser = LispParser>
@@ -584,6 +648,68 @@ namespace WideLips {
         NODISCARD static PaddedString MakeParserFriendlyString(std::string_view program) {
             return PaddedString{program,EOF,PaddingSize};
         }
+    private:
+        NODISCARD static bool Succeeded(const LispParser& parser,const LispParseNodeBase* root) {
+            if (root == nullptr) {
+                return false;
+            }
+            for (auto&& diagnostic : parser.GetDiagnostics()) {
+                if (diagnostic.GetSeverity() == Diagnostic::Severity::Error) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        template<WideLipsParser TParser>
+        NODISCARD static LispParseResult MakeResult(std::unique_ptr<TParser> parser,const std::filesystem::path& filePath) {
+            LispParseNodeBase* root = static_cast<LispParser&>(*parser).Parse();
+            const bool success = Succeeded(*parser,root);
+            const auto& diagnostics = parser->GetDiagnostics();
+            return {
+                .Success = success,
+                .ParseTree = std::make_unique<LispParseTree>(CtorEnabler,
+                    filePath.string(),
+                    std::move(parser),
+                    root,
+                    diagnostics,
+                    success,
+                    EmptyPaddedString::GetPaddedString())
+            };
+        }
+
+        //dialect parsers don't necessarily take lexer options
+        template<WideLipsParser TParser>
+        NODISCARD static std::unique_ptr<TParser> MakeParser(const std::filesystem::path& filePath,
+            const LispParseManyOptions& options) {
+            if constexpr (std::is_constructible_v<TParser,const std::filesystem::path&,bool,const LispLexerOptions&>) {
+                return std::make_unique<TParser>(filePath,options.Conservative,options.Lexer);
+            }
+            else {
+                return std::make_unique<TParser>(filePath,options.Conservative);
+            }
+        }
+
+        NODISCARD static std::size_t WorkersOf(const LispParseManyOptions& options) noexcept {
+            return options.Threads != 0 ? options.Threads : std::max(std::thread::hardware_concurrency(),1U);
+        }
+
+        template<typename Task>
+        static void ForEachLargestFirst(const std::span<const std::filesystem::path> filePaths,
+            const LispParseManyOptions& options,
+            const Task& task) {
+            std::vector<std::pair<std::uintmax_t,std::size_t>> order;
+            order.reserve(filePaths.size());
+            for (std::size_t index = 0; index < filePaths.size(); ++index) {
+                std::error_code error;
+                const std::uintmax_t size = std::filesystem::file_size(filePaths[index],error);
+                order.emplace_back(error ? 0 : size,index);
+            }
+            std::ranges::sort(order,std::greater{});
+            ParallelForStealing(order.size(),WorkersOf(options),[&](const std::size_t worker,const std::size_t item) {
+                task(worker,order[item].second);
+            });
+        }
     public:
         NODISCARD LispParseNodeBase * GetRoot() const noexcept {
             return _canBeConsumed ? _root : nullptr;
@@ -593,8 +719,17 @@ namespace WideLips {
             return _filePath;
         }
 
-        NODISCARD ALWAYS_INLINE const BumpVector<Diagnostic::LispDiagnostic>& GetDiagnostics() const noexcept {
-            return _diagnostics;
+        //applies an edit to the parsed program, see 'LispParser::ApplyEdit'. returns whether the edited program
+        //parsed cleanly, the tree can only be consumed if it did
+        bool ApplyEdit(const std::uint32_t offset,const std::uint32_t removedLength,const std::string_view insertedText) {
+            _root = _parser->ApplyEdit(offset,removedLength,insertedText);
+            _canBeConsumed = Succeeded(*_parser,_root);
+            return _canBeConsumed;
+        }
+
+        //see 'LispParser::GetDiagnostics'
+        NODISCARD ALWAYS_INLINE const BumpVector<Diagnostic::LispDiagnostic>& GetDiagnostics() const {
+            return _parser != nullptr ? _parser->GetDiagnostics() : _diagnostics;
         }
 
         template<typename TConcreteVisitor>
@@ -615,8 +750,8 @@ namespace WideLips {
     };
 
     ALWAYS_INLINE const LispParseNodeBase *LispParseNodeBase::NextNode() const noexcept {
-        if (Next) {
-            return Next;
+        if (const LispParseNodeBase* const next = std::atomic_ref(Next).load(std::memory_order_acquire)) {
+            return next;
         }
         switch (Kind) {
             case LispParseNodeKind::SExpr: {
@@ -635,20 +770,20 @@ namespace WideLips {
     }
 
     ALWAYS_INLINE LispParseNodeBase *LispParseNodeBase::NextNode() noexcept {
-        if (Next) {
-            return Next;
+        const std::atomic_ref next(Next);
+        if (LispParseNodeBase* const cached = next.load(std::memory_order_acquire)) {
+            return cached;
         }
         switch (Kind) {
             case LispParseNodeKind::SExpr: {
                 const auto parentSExpr = reinterpret_cast<const LispList*>(this);
                 LispLexer* const lexer = Parser->GetLexer();
-                auto next = lexer->TokenizeNext(parentSExpr->_sexprBegin);
-                if (!next) {
+                auto following = lexer->TokenizeNext(parentSExpr->_sexprBegin);
+                if (!following) {
                     return Parser->MakeEndOfProgram();
                 }
-                const auto& [sexprBegin,sexprEnd] = next.value();
-                Next = Parser->MakeList(sexprBegin,sexprEnd);
-                return Next;
+                const auto& [sexprBegin,sexprEnd] = following.value();
+                return Publish(next,static_cast<LispParseNodeBase*>(Parser->MakeList(sexprBegin,sexprEnd)));
             }
             default:
                 return Next;
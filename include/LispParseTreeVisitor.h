@@ -1,5 +1,9 @@
 ﻿#ifndef LISPPARSETREEVISITOR_H
 #define LISPPARSETREEVISITOR_H
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
 #include "LispParseTree.h"
 
 namespace WideLips {
@@ -75,6 +79,84 @@ namespace WideLips {
         }
 
     };
+
+    //walks the top level S-expressions of a parsed program on several threads at once, the forms are handed out
+    //straight from the blue pass in batches to a work stealing pool, and each worker materializes the forms it takes
+    //and visits them with a visitor of its own. 'TVisitor' is a 'LispParseTreeVisitor' that visits a single node per
+    //call, the walker descends into lists and arguments itself. the parser must have been made with
+    //'LispLexerOptions::Concurrent' for other threads to take part, otherwise the forms are walked on the calling
+    //thread alone. the forms get nodes of their own rather than being linked after the root 'Parse' returned
+    template<typename TVisitor>
+    class ParallelLispParseTreeWalker final {
+    public:
+        ~ParallelLispParseTreeWalker() = delete;
+    public:
+        //forms a worker takes at once, so it goes to the shared shares seldom while batches stay small enough to
+        //balance the work of files whose forms differ widely in size
+        static constexpr std::size_t FormsPerBatch = 64;
+    public:
+        //visits every node of 'parser' on up to 'workers' threads (every hardware thread when 0) and returns the
+        //visitor of the first worker once 'merge(TVisitor& into,TVisitor&& from)' folded those of the others into it.
+        //which forms a worker visits isn't known upfront, merging must not depend on it. called on the thread that
+        //parsed the program, after 'Parse'
+        template<typename MakeVisitor,typename Merge>
+        static TVisitor Walk(LispParser& parser,std::uint32_t workers,const MakeVisitor& makeVisitor,const Merge& merge) {
+            const std::vector<std::uint32_t> forms = parser.Lexer->GetTopLevelSExprIndices();
+            if (!parser.Lexer->IsConcurrent()) {
+                workers = 1;
+            }
+            else if (workers == 0) {
+                workers = std::max(std::thread::hardware_concurrency(),1U);
+            }
+            const std::size_t batches = (forms.size() + FormsPerBatch - 1) / FormsPerBatch;
+            std::vector<TVisitor> visitors;
+            visitors.reserve(workers);
+            for (std::uint32_t worker = 0; worker < workers; ++worker) {
+                visitors.push_back(makeVisitor());
+            }
+            ParallelForStealing(batches,workers,[&](const std::size_t worker,const std::size_t batch) {
+                const std::size_t end = std::min(forms.size(),(batch + 1) * FormsPerBatch);
+                for (std::size_t form = batch * FormsPerBatch; form < end; ++form) {
+                    WalkForm(parser,form == 0 ? nullptr : &forms[form - 1],visitors[worker]);
+                }
+            });
+            for (std::size_t worker = 1; worker < visitors.size(); ++worker) {
+                merge(visitors[0],std::move(visitors[worker]));
+            }
+            return std::move(visitors[0]);
+        }
+    private:
+        //the form right after the one at 'previous', or the first one. nodes are followed through their 'Next' as the
+        //parser linked them rather than through 'NextNode', which would go on from the last sub-expression of a list
+        //to the form after its own
+        static void WalkForm(LispParser& parser,const std::uint32_t* const previous,TVisitor& visitor) {
+            LispLexer* const lexer = parser.GetLexer();
+            const auto region = previous == nullptr ? lexer->TokenizeFirstSExpr() : lexer->TokenizeAfter(*previous);
+            if (!region) {
+                return;
+            }
+            std::vector<LispParseNodeBase*> pending{parser.MakeList(region->first,region->second)};
+            while (!pending.empty()) {
+                LispParseNodeBase* const node = pending.back();
+                pending.pop_back();
+                node->Accept(static_cast<LispParseTreeVisitor<TVisitor>*>(&visitor));
+                //the sub-expressions go on top of the node's next one, so they are visited first
+                Push(pending,node->Next);
+                if (node->Kind == LispParseNodeKind::SExpr) {
+                    Push(pending,reinterpret_cast<LispList*>(node)->GetSubExpressions());
+                }
+                else if (node->Kind == LispParseNodeKind::Arguments) {
+                    Push(pending,reinterpret_cast<LispArguments*>(node)->GetArguments());
+                }
+            }
+        }
+
+        static void Push(std::vector<LispParseNodeBase*>& pending,LispParseNodeBase* const node) {
+            if (node != nullptr) {
+                pending.push_back(node);
+            }
+        }
+    };
 }
 #endif //LISPPARSETREEVISITOR_H
 
@@ -8,22 +8,84 @@ namespace WideLips {
     struct LispAuxiliary;
     struct LispAtom;
 
+    //the parse nodes of the thread that tokenized the program come out of the parser's pool, those of any other thread
+    //out of a pool of its own, so threads can materialize different parts of one tree at once (see
+    //LispLexerOptions::Concurrent). nodes are never freed one by one, the pools of the other threads are released
+    //along with the parser's
+    class WL_INTERNAL ConcurrentParseNodesResource final : public std::pmr::memory_resource {
+    private:
+        std::pmr::memory_resource* _pool;
+        std::pmr::memory_resource* _upstream;
+        const LispLexer* _lexer;
+        ThreadShards<std::pmr::monotonic_buffer_resource> _pools;
+    public:
+        ConcurrentParseNodesResource(std::pmr::memory_resource* pool,
+            std::pmr::memory_resource* upstream,
+            const LispLexer* lexer) noexcept :
+        _pool(pool),
+        _upstream(upstream),
+        _lexer(lexer) {}
+    public:
+        void Release() {
+            _pools.Clear();
+        }
+    private:
+        void* do_allocate(const std::size_t bytes,const std::size_t alignment) override {
+            if (_lexer->OnTokenizingThread()) {
+                return _pool->allocate(bytes,alignment);
+            }
+            return _pools.Local([this] {
+                return std::make_unique<std::pmr::monotonic_buffer_resource>(_upstream);
+            }).allocate(bytes,alignment);
+        }
+
+        void do_deallocate(void*,std::size_t,std::size_t) override {}
+
+        NODISCARD bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
     class LispParser {
         friend struct LispParseNodeBase;
         template<typename T>
         friend struct LispParseNode;
         friend struct LispList;
         friend class LispParseTree;
+        friend class SerializedLispParseTree;
+        template<typename TVisitor>
+        friend class ParallelLispParseTreeWalker;
+    private:
+        //the first buffer of the parse nodes pool, which 'Reset' rewinds the pool to rather than freeing it
+        struct ParseNodesBuffer final {
+            std::pmr::memory_resource* Upstream;
+            std::size_t Size;
+            void* Data;
+            ParseNodesBuffer(std::pmr::memory_resource* upstream,std::size_t size);
+            ParseNodesBuffer(const ParseNodesBuffer&) = delete;
+            ParseNodesBuffer& operator=(const ParseNodesBuffer&) = delete;
+            ~ParseNodesBuffer();
+        };
     private:
         AlignedFileReadResult _optionalAlignedFile;
+        bool _conservative;
     protected:
         std::unique_ptr<LispLexer> Lexer;
+    private:
+        ParseNodesBuffer _parseNodesBuffer;
+    protected:
         std::pmr::monotonic_buffer_resource ParseNodesPool;
+    private:
+        ConcurrentParseNodesResource _concurrentParseNodes;
+    protected:
+        //allocates from 'ParseNodesPool', through '_concurrentParseNodes' with a concurrent lexer
         std::pmr::polymorphic_allocator<> ParseNodesAllocator;
         LispAtom* EndOfProgram;
+    private:
+        LispParseNodeBase* _root = nullptr; //the tree 'Parse' made, which 'ApplyEdit' keeps up to date
     public:
-        WL_API LispParser(const std::filesystem::path &filePath,bool conservative);
-        WL_API LispParser(std::string_view program,bool conservative);
+        WL_API LispParser(const std::filesystem::path &filePath,bool conservative,const LispLexerOptions& options = {});
+        WL_API LispParser(std::string_view program,bool conservative,const LispLexerOptions& options = {});
         LispParser(const LispParser&) = delete;
         LispParser(LispParser&& ) = delete;
         LispParser& operator=(const LispParser&) = delete;
@@ -32,17 +94,31 @@ namespace WideLips {
     public:
         NODISCARD WL_API LispParseNodeBase* Parse();
         NODISCARD WL_API virtual LispParseNodeBase* Parse(const LispToken* sexprBegin,const LispToken* sexprEnd);
+        //with a concurrent lexer this gathers what the other threads reported too, so it's only called once they are done
         NODISCARD WL_API const BumpVector<Diagnostic::LispDiagnostic>& GetDiagnostics() const;
         NODISCARD WL_API std::wstring_view OriginFile() const;
         WL_API void Reuse() const;
+        //parses another program with the same parser, trees parsed before are gone. the lexer arenas and the parse
+        //nodes pool are rewound and only grow if the new program needs more than they hold
+        WL_API void Reset(std::string_view program);
+        WL_API void Reset(const std::filesystem::path& filePath);
+        //applies an edit to the parsed program (see 'LispLexer::ApplyEdit') and returns the root of its tree. the
+        //nodes of the top level S-expressions the edit didn't overlap are kept along with whatever was parsed under
+        //them, the overlapped ones are parsed over again. when the lexer couldn't keep its tokens every node is gone
+        //and the tree is parsed over again from its root
+        WL_API LispParseNodeBase* ApplyEdit(std::uint32_t offset,std::uint32_t removedLength,std::string_view insertedText);
     protected:
         NODISCARD virtual LispParseNodeBase* ParseDialectSpecial(const LispToken* currentToken);
+        //the lexer the calling thread materializes through (see 'LispLexer::Local')
         NODISCARD LispLexer* GetLexer() const;
         WL_HIDDEN NODISCARD LispParseError* OnUnrecognizedToken(const LispToken* currentToken);
         WL_HIDDEN NODISCARD BumpVector<Diagnostic::LispDiagnostic>& GetDiagnosticsInternal() const;
         NODISCARD LispAuxiliary* MakeAuxiliary(const LispToken* auxBegin,const LispToken* auxEnd);
         NODISCARD LispList* MakeList(const LispToken* sexprBegin,const LispToken* sexprEnd);
         NODISCARD LispAtom * MakeEndOfProgram() const;
+    private:
+        NODISCARD LispParseNodeBase* ParseFirstSExpr();
+        void ResetParseNodes(std::size_t size);
     };
 
     template<typename TParser>
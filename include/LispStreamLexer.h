@@ -0,0 +1,57 @@
+﻿#ifndef WIDELIPS_LISPSTREAMLEXER_H
+#define WIDELIPS_LISPSTREAMLEXER_H
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <memory>
+#include "LispLexer.h"
+
+namespace WideLips {
+
+    struct LispStreamLexerOptions final {
+        //bytes read from the stream at once, windows end at a line break between top-level forms so a window that holds
+        //none grows until it does
+        std::size_t WindowSize = 64U << 20;
+        LispLexerOptions Lexer = {};
+    };
+
+    //where the window a form was lexed from lies within the stream, windows start on a line of their own so columns
+    //are the stream's while the line of a token within the stream is 'Line + token.Line - 1'
+    struct StreamWindow final {
+        std::uint64_t Offset = 0;
+        std::uint64_t Line = 1;
+    };
+
+    //lexes a stream too large to be resident at once, the stream is consumed in windows holding whole lines of whole
+    //top-level forms, each window is tokenized by the same lexer whose blocks, S-expression indices, tokens and
+    //auxiliaries are recycled once every form of the window was handed to the callback
+    class LispStreamLexer final {
+    public:
+        //a form and everything it holds stays valid until the callback returns, returning false stops the stream
+        using FormCallback = std::function<bool(LispLexer& lexer,
+            const LispToken* begin,
+            const LispToken* end,
+            const StreamWindow& window)>;
+    private:
+        std::istream& _input;
+        LispStreamLexerOptions _options;
+        AlignedFileReadResult _window;
+        std::size_t _windowCapacity = 0;
+        std::unique_ptr<LispLexer> _lexer;
+    public:
+        WL_API explicit LispStreamLexer(std::istream& input,const LispStreamLexerOptions& options = {});
+        LispStreamLexer(const LispStreamLexer&) = delete;
+        LispStreamLexer(LispStreamLexer&&) = delete;
+        LispStreamLexer& operator=(const LispStreamLexer&) = delete;
+        LispStreamLexer& operator=(LispStreamLexer&&) = delete;
+    public:
+        //returns false if a window failed to tokenize (its diagnostics are left in 'GetDiagnostics') or the callback
+        //stopped the stream
+        WL_API bool Run(const FormCallback& onForm);
+        NODISCARD WL_API BumpVector<Diagnostic::LispDiagnostic>* GetDiagnostics() noexcept;
+    private:
+        void Grow(std::size_t filled);
+    };
+}
+
+#endif //WIDELIPS_LISPSTREAMLEXER_H
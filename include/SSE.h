@@ -0,0 +1,99 @@
+﻿#ifndef WIDELIPS_SSE_H
+#define WIDELIPS_SSE_H
+#include <cstdint>
+#include "Config.h"
+
+#if WL_ARCH_X86
+#include <immintrin.h>
+
+WL_TARGET_REGION_BEGIN("sse4.2")
+namespace WideLips {
+
+    class Sse42;
+    struct Vector128;
+
+    class WL_INTERNAL Sse42 final{
+    public:
+        struct Custom final {
+        public:
+            ~Custom() = delete;
+        public:
+            template<std::uint8_t shift>
+            static Vector128 RightShift8(Vector128 vec) requires (shift < 8);
+        };
+    public:
+        ~Sse42() = delete;
+    public:
+        static Vector128 LoadFromAddress(const std::uint8_t * address,std::ptrdiff_t offset = 0);
+
+        static Vector128 CompareEqual(Vector128 lhs, Vector128 rhs);
+
+        static std::uint32_t MoveMask(Vector128 vec);
+
+        static Vector128 ShuffleBytes(Vector128 lookupTable,Vector128 vec);
+
+        static Vector128 SubtractSaturated(Vector128 lhs,Vector128 rhs);
+
+        static Vector128 Propagate(std::uint8_t value);
+
+        static Vector128 Or(Vector128 lhs,Vector128 rhs);
+    };
+
+    struct WL_INTERNAL Vector128 final {
+    private:
+        const __m128i _vec{};
+    public:
+        Vector128(const Vector128&) = default;
+        Vector128(Vector128&&) noexcept = default;
+        Vector128& operator=(const Vector128&) = delete;
+        Vector128& operator=(Vector128&&) noexcept = delete;
+    public:
+        explicit constexpr Vector128(const __m128i init) : _vec(init) {
+
+        }
+
+        explicit operator __m128i () const {
+            return _vec;
+        }
+    };
+
+    NODISCARD ALWAYS_INLINE Vector128 Sse42::LoadFromAddress(const std::uint8_t *const address, const std::ptrdiff_t offset) {
+        //lookup tables are exactly one lane wide, so they are loaded with this as well
+        return Vector128 {_mm_loadu_si128(reinterpret_cast<__m128i const *>(address+offset))};
+    }
+
+    NODISCARD ALWAYS_INLINE Vector128 Sse42::CompareEqual(const Vector128 lhs, const Vector128 rhs) {
+        return Vector128 {_mm_cmpeq_epi8(static_cast<__m128i>(lhs), static_cast<__m128i>(rhs))};
+    }
+
+    NODISCARD ALWAYS_INLINE std::uint32_t Sse42::MoveMask(const Vector128 vec) {
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(static_cast<__m128i>(vec)));
+    }
+
+    NODISCARD ALWAYS_INLINE Vector128 Sse42::ShuffleBytes(const Vector128 lookupTable,const Vector128 vec) {
+        return Vector128{_mm_shuffle_epi8(static_cast<__m128i>(lookupTable),static_cast<__m128i>(vec))};
+    }
+
+    NODISCARD ALWAYS_INLINE Vector128 Sse42::SubtractSaturated(const Vector128 lhs,const Vector128 rhs) {
+        return Vector128{_mm_subs_epu8(static_cast<__m128i>(lhs), static_cast<__m128i>(rhs))};
+    }
+
+    NODISCARD ALWAYS_INLINE Vector128 Sse42::Propagate(const std::uint8_t value) {
+        return Vector128{_mm_set1_epi8(static_cast<char>(value))};
+    }
+
+    NODISCARD ALWAYS_INLINE Vector128 Sse42::Or(const Vector128 lhs, const Vector128 rhs) {
+        return Vector128{_mm_or_si128(static_cast<__m128i>(lhs), static_cast<__m128i>(rhs))};
+    }
+
+    template<std::uint8_t shift>
+    NODISCARD ALWAYS_INLINE Vector128 Sse42::Custom::RightShift8(const Vector128 vec) requires (shift < 8){
+        //see Avx512::Custom::RightShift8
+        const auto bytes = static_cast<__m128i>(vec);
+        const __m128i shifted = _mm_srli_epi16(bytes, shift);
+        return Vector128{_mm_and_si128(shifted, _mm_set1_epi8(static_cast<char>(0xFF >> shift)))};
+    }
+}
+WL_TARGET_REGION_END
+#endif // WL_ARCH_X86
+#endif //WIDELIPS_SSE_H
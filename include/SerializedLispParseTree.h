@@ -0,0 +1,198 @@
+﻿#ifndef SERIALIZEDLISPPARSETREE_H
+#define SERIALIZEDLISPPARSETREE_H
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "LispParseTree.h"
+
+namespace WideLips {
+    class MappedFile;
+    class SerializedLispParseTree;
+    struct SerializedLispAuxiliary;
+    struct SerializedLispParseNodes;
+
+    //a node of a serialized tree is read where it lies in the serialized bytes, nothing is rebuilt from them. every
+    //reference a node holds is an offset from the node itself, so the bytes can be mapped anywhere. the nodes of a
+    //tree are laid out in preorder, the first sub-expression of a list is the node right after it.
+    //unlike 'LispParseNodeBase::NextNode', the last node of a list has no next node, and neither has the last top
+    //level S-expression (there's no end of program node)
+    class alignas(8) SerializedLispParseNode {
+        friend class SerializedLispParseTree;
+    protected:
+        std::int64_t _textOffset; //from the node to its text
+        std::int64_t _auxiliaryOffset; //from the node to its auxiliary, 0 when it has none
+        std::uint32_t _textLength;
+        std::uint32_t _next; //nodes from this one to the next, 0 when it's the last one
+        std::uint32_t _line;
+        std::uint32_t _column;
+    public:
+        const LispParseNodeKind Kind;
+    protected:
+        LispTokenKind _tokenKind;
+        bool _hasSubExpressions;
+    private:
+        SerializedLispParseNode(const std::int64_t textOffset,
+            const std::uint32_t textLength,
+            const std::uint32_t line,
+            const std::uint32_t column,
+            const LispParseNodeKind kind,
+            const LispTokenKind tokenKind,
+            const bool hasSubExpressions) noexcept :
+        _textOffset(textOffset),
+        _auxiliaryOffset(0),
+        _textLength(textLength),
+        _next(0),
+        _line(line),
+        _column(column),
+        Kind(kind),
+        _tokenKind(tokenKind),
+        _hasSubExpressions(hasSubExpressions) {}
+    public:
+        NODISCARD ALWAYS_INLINE const SerializedLispParseNode* NextNode() const noexcept {
+            return _next != 0 ? this + _next : nullptr;
+        }
+
+        NODISCARD ALWAYS_INLINE SourceLocation GetSourceLocation() const noexcept {
+            return SourceLocation{_line,_column};
+        }
+
+        NODISCARD ALWAYS_INLINE std::string_view GetParseNodeText() const noexcept {
+            return std::string_view{reinterpret_cast<const char*>(this) + _textOffset,_textLength};
+        }
+
+        NODISCARD ALWAYS_INLINE const SerializedLispAuxiliary* GetNodeAuxiliary() const noexcept {
+            return _auxiliaryOffset != 0 ?
+                reinterpret_cast<const SerializedLispAuxiliary*>(reinterpret_cast<const char*>(this) + _auxiliaryOffset) :
+                nullptr;
+        }
+
+        template<typename TConcreteVisitor>
+        void Accept(const ImmutableLispParseTreeVisitor<TConcreteVisitor,SerializedLispParseNodes>* visitor) const;
+    };
+
+    struct SerializedLispAtom final : SerializedLispParseNode {
+        NODISCARD ALWAYS_INLINE LispTokenKind GetUnderlyingKind() const noexcept {
+            return _tokenKind;
+        }
+    };
+
+    struct SerializedLispList final : SerializedLispParseNode {
+        //every list of a serialized tree was parsed entirely before it was written, nullptr when it's empty
+        NODISCARD ALWAYS_INLINE const SerializedLispParseNode* GetSubExpressions(UNUSED const bool csEmptySExpr = false) const noexcept {
+            return _hasSubExpressions ? this + 1 : nullptr;
+        }
+    };
+
+    struct SerializedLispArguments final : SerializedLispParseNode {
+        NODISCARD ALWAYS_INLINE const SerializedLispParseNode* GetArguments() const noexcept {
+            return _hasSubExpressions ? this + 1 : nullptr;
+        }
+    };
+
+    struct SerializedLispParseError final : SerializedLispParseNode {};
+
+    struct alignas(8) SerializedLispAuxiliary final {
+        friend class SerializedLispParseTree;
+    private:
+        std::int64_t _textOffset; //from the auxiliary to its text
+        std::uint32_t _textLength;
+        std::uint32_t _line;
+        std::uint32_t _column;
+    public:
+        NODISCARD ALWAYS_INLINE SourceLocation GetSourceLocation() const noexcept {
+            return SourceLocation{_line,_column};
+        }
+
+        NODISCARD ALWAYS_INLINE std::string_view GetParseNodeText() const noexcept {
+            return std::string_view{reinterpret_cast<const char*>(this) + _textOffset,_textLength};
+        }
+    };
+
+    //'ImmutableLispParseTreeVisitor<TConcreteVisitor,SerializedLispParseNodes>' visits a serialized tree
+    struct SerializedLispParseNodes final {
+        using Base = SerializedLispParseNode;
+        using Atom = SerializedLispAtom;
+        using List = SerializedLispList;
+        using Arguments = SerializedLispArguments;
+        using Error = SerializedLispParseError;
+    };
+
+    //a parse tree flattened into bytes that hold the text of the program along with it, written once a tree was
+    //parsed entirely and read back without deserializing it (see SerializedLispParseNode). 'Map' maps a file of
+    //them and 'View' reads them from wherever they already are, either way only the header is checked before the
+    //nodes are handed out, 'Verify' checks every node lies within the bytes as well
+    class SerializedLispParseTree final {
+    public:
+        static constexpr std::uint32_t Version = 1;
+    private:
+        struct ConstructorEnabler {constexpr ConstructorEnabler()= default;};
+    private:
+        static constexpr ConstructorEnabler CtorEnabler {};
+    private:
+        std::unique_ptr<MappedFile> _file;
+        std::string_view _bytes;
+        const SerializedLispParseNode* _nodes;
+        std::size_t _nodesCount;
+        std::string_view _program;
+    public:
+        SerializedLispParseTree(UNUSED ConstructorEnabler enabler,
+            std::unique_ptr<MappedFile> file,
+            std::string_view bytes,
+            const SerializedLispParseNode* nodes,
+            std::size_t nodesCount,
+            std::string_view program) noexcept;
+        SerializedLispParseTree(const SerializedLispParseTree&) = delete;
+        SerializedLispParseTree(SerializedLispParseTree&&) = delete;
+        SerializedLispParseTree& operator=(const SerializedLispParseTree&) = delete;
+        SerializedLispParseTree& operator=(SerializedLispParseTree&&) = delete;
+        WL_API ~SerializedLispParseTree();
+    public:
+        //parses whatever of the tree from 'root' on (every top level S-expression after it included) wasn't yet and
+        //flattens it, 'root' must have been made by a parser that's still alive. nullptr makes an empty tree
+        NODISCARD WL_API static std::string Serialize(LispParseNodeBase* root);
+        WL_API static bool Write(const std::filesystem::path& filePath,LispParseNodeBase* root);
+        //nullptr when the file isn't a serialized tree of this version
+        NODISCARD WL_API static std::unique_ptr<SerializedLispParseTree> Map(const std::filesystem::path& filePath);
+        //same as 'Map' for bytes that are already in memory, they must be 8 bytes aligned and outlive the tree
+        NODISCARD WL_API static std::unique_ptr<SerializedLispParseTree> View(std::string_view bytes);
+    public:
+        //the first top level S-expression, nullptr when the tree is empty
+        NODISCARD WL_API const SerializedLispParseNode* GetRoot() const noexcept;
+        NODISCARD WL_API std::size_t GetNodesCount() const noexcept;
+        NODISCARD WL_API std::string_view GetProgram() const noexcept;
+        //walks every node and auxiliary once, false if any of them points out of the bytes
+        NODISCARD WL_API bool Verify() const noexcept;
+
+        template<typename TConcreteVisitor>
+        void Accept(const ImmutableLispParseTreeVisitor<TConcreteVisitor,SerializedLispParseNodes>* visitor) const {
+            if (_nodesCount != 0) {
+                _nodes->Accept(visitor);
+            }
+        }
+    private:
+        NODISCARD static std::unique_ptr<SerializedLispParseTree> Make(std::unique_ptr<MappedFile> file,
+            std::string_view bytes);
+    };
+
+    template<typename TConcreteVisitor>
+    void SerializedLispParseNode::Accept(const ImmutableLispParseTreeVisitor<TConcreteVisitor,SerializedLispParseNodes>* visitor) const {
+        switch (Kind) {
+            case LispParseNodeKind::SExpr:
+                visitor->Visit(reinterpret_cast<const SerializedLispList*>(this));
+                break;
+            case LispParseNodeKind::Arguments:
+                visitor->Visit(reinterpret_cast<const SerializedLispArguments*>(this));
+                break;
+            case LispParseNodeKind::Error:
+                visitor->Visit(reinterpret_cast<const SerializedLispParseError*>(this));
+                break;
+            default:
+                visitor->Visit(reinterpret_cast<const SerializedLispAtom*>(this));
+                break;
+        }
+    }
+}
+
+#endif //SERIALIZEDLISPPARSETREE_H
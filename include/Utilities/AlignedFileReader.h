@@ -1,25 +1,43 @@
 ﻿#ifndef ALIGNEDFILEREADER_H
 #define ALIGNEDFILEREADER_H
+#include <cstdint>
 #include <filesystem>
+#include <memory>
+#include <string_view>
 
-#include "AVX.h"
 #include "Config.h"
 
 namespace WideLips {
     struct AlignedFileReaderDelete;
     using AlignedFileReadResult = std::unique_ptr<char[],AlignedFileReaderDelete>;
 
+    enum class FileReadMode : std::uint8_t {
+        Copy, //reads the whole file into a heap buffer
+        //maps the file read-only and copies only its last partial page next to the padding, where mapping isn't
+        //available the file is copied instead
+        Map,
+        MapPopulated //same as 'Map' but every page is faulted in upfront
+    };
+
     struct WL_INTERNAL AlignedFileReaderDelete final {
+        std::size_t MappedSize = 0; //zero when the block was allocated on the heap
+        std::size_t TextSize = 0; //the file and its padding, files may hold null characters so it isn't searched for
         void operator ()(void* block) const noexcept;
     };
 
     class WL_INTERNAL AlignedFileReader final {
     public:
-        constexpr static std::uint64_t Alignment = std::alignment_of_v<Vector256>;
+        //cache line sized, which also covers the widest vector any classification kernel loads
+        constexpr static std::uint64_t Alignment = 64;
     public:
         ~AlignedFileReader() = delete;
     public:
-        NODISCARD static AlignedFileReadResult Read(const std::filesystem::path & filePath);
+        NODISCARD static AlignedFileReadResult Read(const std::filesystem::path & filePath,
+            FileReadMode mode = FileReadMode::Map);
+        //the padded text of a block returned by 'Read'
+        NODISCARD static std::string_view TextOf(const AlignedFileReadResult& result) noexcept {
+            return {result.get(),result.get_deleter().TextSize};
+        }
     };
 }
 
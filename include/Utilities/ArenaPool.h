@@ -0,0 +1,74 @@
+﻿#ifndef WIDELIPS_ARENAPOOL_H
+#define WIDELIPS_ARENAPOOL_H
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+#include "Config.h"
+
+namespace WideLips {
+    //recycles the address space lexers and parsers reserve for their arenas across instances, so one parsing many
+    //small files in a row (or on many threads at once) stops paying for mapping, committing and faulting pages in
+    //for every file. ranges come in power of two size classes and go back to the pool with their pages still
+    //committed, up to 'retainedLimit' committed bytes, past which released ranges are unmapped instead. ranges
+    //advised to be backed by huge pages are aligned to them and kept apart from the others.
+    //a pool must outlive every lexer and parser made with it (see 'LispLexerOptions::Pool')
+    class ArenaPool final {
+    public:
+        struct Range final {
+            void* Address = nullptr;
+            std::size_t Size = 0;
+            std::size_t Committed = 0; //bytes from 'Address' on that are readable and writable
+            bool HugePages = false;
+        };
+        static constexpr std::size_t DefaultRetainedLimit = std::size_t{256} * 1024 * 1024;
+    private:
+        //hands fully committed ranges to 'std::pmr' containers, the parse nodes pool of a parser in particular
+        class PooledResource final : public std::pmr::memory_resource {
+        private:
+            ArenaPool* _pool;
+        public:
+            explicit PooledResource(ArenaPool* pool) noexcept : _pool(pool) {}
+        private:
+            void* do_allocate(std::size_t bytes,std::size_t alignment) override;
+            void do_deallocate(void* block,std::size_t bytes,std::size_t alignment) override;
+            NODISCARD bool do_is_equal(const memory_resource& other) const noexcept override;
+        };
+        static constexpr std::size_t SizeClasses = sizeof(std::size_t) * 8;
+    private:
+        mutable std::mutex _mutex;
+        std::array<std::vector<Range>,SizeClasses> _free;
+        std::array<std::vector<Range>,SizeClasses> _freeHugePages;
+        std::size_t _retained = 0;
+        std::size_t _retainedLimit;
+        PooledResource _resource;
+    public:
+        WL_API explicit ArenaPool(std::size_t retainedLimit = DefaultRetainedLimit);
+        ArenaPool(const ArenaPool&) = delete;
+        ArenaPool(ArenaPool&&) = delete;
+        ArenaPool& operator=(const ArenaPool&) = delete;
+        ArenaPool& operator=(ArenaPool&&) = delete;
+        WL_API ~ArenaPool();
+    public:
+        //a range of at least 'size' bytes, recycled if one of its size class was released before, otherwise freshly
+        //reserved with nothing committed. 'Address' is nullptr when no address space is left
+        NODISCARD WL_API Range Acquire(std::size_t size,bool hugePages = false) noexcept;
+        WL_API void Release(const Range& range) noexcept;
+        //reserves 'count' ranges of the size class of 'size', commits and faults them in, and keeps them for 'Acquire'
+        //to hand out as far as the retained limit allows. returns how many it kept
+        WL_API std::size_t Warm(std::size_t size,std::size_t count,bool hugePages = false) noexcept;
+        NODISCARD WL_API std::pmr::memory_resource* GetResource() noexcept;
+        //committed bytes held by released ranges
+        NODISCARD WL_API std::size_t GetRetainedSize() const noexcept;
+        //huge page size classes start at a huge page
+        NODISCARD WL_API static std::size_t SizeClassOf(std::size_t size,bool hugePages = false) noexcept;
+        //the pool shared by the whole process, it lives until the process exits
+        NODISCARD WL_API static ArenaPool& Process() noexcept;
+    private:
+        NODISCARD std::vector<Range>& FreeRangesOf(std::size_t classSize,bool hugePages) noexcept;
+    };
+}
+
+#endif //WIDELIPS_ARENAPOOL_H
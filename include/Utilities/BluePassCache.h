@@ -0,0 +1,55 @@
+﻿#ifndef WIDELIPS_BLUEPASSCACHE_H
+#define WIDELIPS_BLUEPASSCACHE_H
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+#include "Config.h"
+
+namespace WideLips {
+    class LispLexer;
+
+    //64-bit hash of 'text' (the XXH64 algorithm), fast enough to tell whether a text changed before lexing it
+    NODISCARD WL_API std::uint64_t ContentHash(std::string_view text,std::uint64_t seed = 0) noexcept;
+
+    //keeps what the blue pass of a lexer found out about a text (its S-expression indices, structural diagnostics,
+    //line ranks and optionally its classified blocks) in a file of 'directory' named after the hash of the text.
+    //a lexer made with a cache (see 'LispLexerOptions::Cache') hashes its text before tokenizing it and, when a file
+    //for the same text, path, dialect and options is there, maps it and copies it into its arenas instead of matching
+    //the parentheses again. otherwise it tokenizes the text and stores what it found for the next time. files that
+    //don't belong to this build or are cut short are simply missed and written over. a cache can be shared by lexers
+    //on many threads, every file is written aside first and then renamed into place
+    class BluePassCache final {
+        friend class LispLexer;
+    public:
+        static constexpr std::uint32_t Version = 1;
+    private:
+        std::filesystem::path _directory;
+        bool _keepBlocks;
+        std::atomic<std::size_t> _hits = 0;
+        std::atomic<std::size_t> _misses = 0;
+        std::atomic<std::uint64_t> _nextFile = 0;
+    public:
+        //without 'keepBlocks' files hold no blocks and a hit classifies the text again, which costs a pass of the
+        //classification kernel but leaves half the size of the text out of every file
+        WL_API explicit BluePassCache(std::filesystem::path directory,bool keepBlocks = false);
+        BluePassCache(const BluePassCache&) = delete;
+        BluePassCache(BluePassCache&&) = delete;
+        BluePassCache& operator=(const BluePassCache&) = delete;
+        BluePassCache& operator=(BluePassCache&&) = delete;
+    public:
+        NODISCARD WL_API const std::filesystem::path& GetDirectory() const noexcept;
+        NODISCARD WL_API std::size_t GetHits() const noexcept;
+        NODISCARD WL_API std::size_t GetMisses() const noexcept;
+    private:
+        NODISCARD std::filesystem::path FileOf(std::uint64_t key) const;
+        NODISCARD bool Load(LispLexer& lexer,std::uint64_t contentHash) noexcept;
+        //the cache only ever saves a blue pass, so a store that fails in any way (the file system, or running out of
+        //memory for the paths) leaves no file behind and is only reported through the result
+        NODISCARD bool Store(const LispLexer& lexer,std::uint64_t contentHash) noexcept;
+        NODISCARD bool StoreFile(const LispLexer& lexer,std::uint64_t contentHash);
+    };
+}
+
+#endif //WIDELIPS_BLUEPASSCACHE_H
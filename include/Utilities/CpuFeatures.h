@@ -0,0 +1,20 @@
+﻿#ifndef WIDELIPS_CPUFEATURES_H
+#define WIDELIPS_CPUFEATURES_H
+#include "Config.h"
+
+namespace WideLips {
+
+    //instruction sets the classification kernels care about, an extension is only reported when both the CPU
+    //implements it and the OS saves its register state on context switches
+    struct WL_INTERNAL CpuFeatures final {
+        bool Sse42 = false;
+        bool Pclmul = false;
+        bool Avx2 = false;
+        bool Avx512BW = false;
+    public:
+        //probes the host once, every later call returns the cached result
+        NODISCARD static const CpuFeatures& Host() noexcept;
+    };
+}
+
+#endif //WIDELIPS_CPUFEATURES_H
@@ -0,0 +1,36 @@
+﻿#ifndef WIDELIPS_MAPPEDFILE_H
+#define WIDELIPS_MAPPEDFILE_H
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+
+#include "Config.h"
+
+namespace WideLips {
+    //a whole file mapped read-only, or read into the heap where mapping isn't available. it's empty when the file
+    //can't be opened or has nothing in it. with 'populate' every page is faulted in upfront, which pays off when
+    //the file is read from end to end right away
+    class WL_INTERNAL MappedFile final {
+    private:
+        const char* _data = nullptr;
+        std::size_t _size = 0;
+        std::unique_ptr<char[]> _copy;
+    public:
+        explicit MappedFile(const std::filesystem::path& filePath,bool populate = false);
+        MappedFile(const MappedFile&) = delete;
+        MappedFile(MappedFile&&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile& operator=(MappedFile&&) = delete;
+        ~MappedFile();
+    public:
+        NODISCARD const char* Data() const noexcept {
+            return _data;
+        }
+
+        NODISCARD std::size_t Size() const noexcept {
+            return _size;
+        }
+    };
+}
+
+#endif //WIDELIPS_MAPPEDFILE_H
@@ -0,0 +1,74 @@
+﻿#ifndef WIDELIPS_PARALLELFOR_H
+#define WIDELIPS_PARALLELFOR_H
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "Config.h"
+
+namespace WideLips {
+
+    //runs 'task(chunk)' for every chunk in [0,chunks) concurrently and returns once all of them are done.
+    //chunk 0 runs on the calling thread, and so does any chunk that couldn't get a thread of its own
+    template<typename Task>
+    void ParallelFor(const std::size_t chunks, const Task& task) {
+        if (chunks == 0) {
+            return;
+        }
+        std::size_t spawned = 1;
+        std::vector<std::jthread> workers;
+        workers.reserve(chunks - 1);
+        try {
+            for (; spawned < chunks; ++spawned) {
+                workers.emplace_back(task,spawned);
+            }
+        }
+        catch (const std::system_error&) {
+            //out of threads
+        }
+        for (std::size_t chunk = spawned; chunk < chunks; ++chunk) {
+            task(chunk);
+        }
+        task(0);
+    }
+
+    //runs 'task(worker,item)' for every item in [0,items) on up to 'workers' threads. items are dealt out to the
+    //workers round robin, every worker runs its own share front to back (so items meant to run first should come
+    //first) and once it runs out it steals from the back of the others' shares, which holds their last items
+    template<typename Task>
+    void ParallelForStealing(const std::size_t items, std::size_t workers, const Task& task) {
+        workers = std::max<std::size_t>(std::min(workers,items),1);
+        struct Share final {
+            std::mutex Lock;
+            std::size_t Front = 0;
+            std::size_t Back = 0;
+        };
+        const auto shares = std::make_unique<Share[]>(workers);
+        for (std::size_t worker = 0; worker < workers; ++worker) {
+            shares[worker].Back = worker < items ? (items - worker + workers - 1) / workers : 0;
+        }
+        ParallelFor(workers,[&](const std::size_t worker) {
+            while (true) {
+                std::size_t item = items;
+                for (std::size_t offset = 0; offset < workers && item == items; ++offset) {
+                    const std::size_t owner = (worker + offset) % workers;
+                    Share& share = shares[owner];
+                    const std::lock_guard lock(share.Lock);
+                    if (share.Front < share.Back) {
+                        item = owner + (offset == 0 ? share.Front++ : --share.Back) * workers;
+                    }
+                }
+                //nothing is ever added back, so a round finding every share empty means all items were taken
+                if (item == items) {
+                    return;
+                }
+                task(worker,item);
+            }
+        });
+    }
+}
+
+#endif //WIDELIPS_PARALLELFOR_H
@@ -0,0 +1,87 @@
+﻿#ifndef WIDELIPS_THREADSHARDS_H
+#define WIDELIPS_THREADSHARDS_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Config.h"
+
+namespace WideLips {
+    //one 'T' per thread that asks for it, made the first time it does and kept until 'Clear'. a thread finds its own
+    //shard again without locking, through a one entry cache of the last 'ThreadShards' it used
+    template<typename T>
+    class ThreadShards final {
+    private:
+        struct Cache final {
+            std::uint64_t Owner = 0;
+            T* Shard = nullptr;
+        };
+        //every instance and every 'Clear' gets an id of its own, so a cache entry left behind by either never matches
+        inline static std::atomic<std::uint64_t> NextOwner{1};
+    private:
+        std::uint64_t _owner;
+        mutable std::mutex _lock;
+        std::vector<std::pair<std::thread::id,std::unique_ptr<T>>> _shards;
+    public:
+        ThreadShards() noexcept : _owner(NextOwner.fetch_add(1,std::memory_order_relaxed)) {}
+        ThreadShards(const ThreadShards&) = delete;
+        ThreadShards& operator=(const ThreadShards&) = delete;
+    public:
+        //the calling thread's shard, 'make()' returns a 'std::unique_ptr<T>' for a thread that has none yet
+        template<typename Make>
+        T& Local(const Make& make) {
+            thread_local Cache cache;
+            if (cache.Owner == _owner) {
+                return *cache.Shard;
+            }
+            const std::thread::id thread = std::this_thread::get_id();
+            const std::lock_guard lock(_lock);
+            T* shard = nullptr;
+            for (const auto& [owner,existing] : _shards) {
+                if (owner == thread) {
+                    shard = existing.get();
+                    break;
+                }
+            }
+            if (shard == nullptr) {
+                shard = _shards.emplace_back(thread,make()).second.get();
+            }
+            cache = Cache{_owner,shard};
+            return *shard;
+        }
+
+        //runs 'f(shard)' for every shard made so far, while none can be made
+        template<typename F>
+        void ForEach(const F& f) {
+            const std::lock_guard lock(_lock);
+            for (const auto& [owner,shard] : _shards) {
+                f(*shard);
+            }
+        }
+
+        template<typename F>
+        void ForEach(const F& f) const {
+            const std::lock_guard lock(_lock);
+            for (const auto& [owner,shard] : _shards) {
+                f(static_cast<const T&>(*shard));
+            }
+        }
+
+        NODISCARD bool Empty() const {
+            const std::lock_guard lock(_lock);
+            return _shards.empty();
+        }
+
+        //drops every shard, only once no other thread uses them or is about to
+        void Clear() {
+            const std::lock_guard lock(_lock);
+            _shards.clear();
+            _owner = NextOwner.fetch_add(1,std::memory_order_relaxed);
+        }
+    };
+}
+
+#endif //WIDELIPS_THREADSHARDS_H
@@ -0,0 +1,32 @@
+﻿#ifndef WIDELIPS_VIRTUALMEMORY_H
+#define WIDELIPS_VIRTUALMEMORY_H
+#include <cstddef>
+
+#include "Config.h"
+
+namespace WideLips {
+    //address space is reserved without being backed by memory, and parts of it are committed (made readable and
+    //writable) as they are needed. where the platform can't reserve address space alone the whole range is allocated
+    //upfront and committing is a no-op
+    class WL_INTERNAL VirtualMemory final {
+    public:
+        ~VirtualMemory() = delete;
+    public:
+        //the transparent huge page size of x86-64 and most aarch64 kernels
+        static constexpr std::size_t HugePageSize = 2 * 1024 * 1024;
+    public:
+        NODISCARD static std::size_t PageSize() noexcept;
+        //returns nullptr when 'size' bytes of address space aren't available. with 'hugePages' the range is aligned
+        //to 'HugePageSize' and advised to be backed by huge pages (see 'AdviseHugePages')
+        NODISCARD static void* Reserve(std::size_t size,bool hugePages = false) noexcept;
+        //asks for the range to be backed by transparent huge pages as its pages are committed and touched, only the
+        //huge pages lying entirely within the range can be. false where the platform or the system settings don't
+        //allow it, the range is then backed by regular pages as usual
+        static bool AdviseHugePages(void* address,std::size_t size) noexcept;
+        //'address' and 'size' must be page aligned and lie within a reserved range
+        NODISCARD static bool Commit(void* address,std::size_t size) noexcept;
+        static void Release(void* address,std::size_t size) noexcept;
+    };
+}
+
+#endif //WIDELIPS_VIRTUALMEMORY_H
@@ -1,43 +1,125 @@
 ﻿#include <fstream>
 #include "AlignedFileReader.h"
+#if WL_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace WideLips {
-    void AlignedFileReaderDelete::operator()(void *block) const noexcept {
-        operator delete [](block,std::align_val_t{AlignedFileReader::Alignment},std::nothrow);
-    }
-
-    AlignedFileReadResult AlignedFileReader::Read(const std::filesystem::path &filePath) {
-        if (!exists(filePath)) {
+    namespace {
+        AlignedFileReadResult ReadEmpty() {
             auto* block = static_cast<char*>(operator new[](PaddingSize + 1,
-                 std::align_val_t{Alignment}, std::nothrow));
+                 std::align_val_t{AlignedFileReader::Alignment}, std::nothrow));
             std::memset(block, EOF, PaddingSize);
             block[PaddingSize] = '\0';
-            return AlignedFileReadResult{block, AlignedFileReaderDelete{}};
+            return AlignedFileReadResult{block, AlignedFileReaderDelete{.TextSize = PaddingSize}};
         }
 
-        std::ifstream file(filePath,std::ios::binary|std::ios::ate);
-        if (!file) {
-            std::puts("Failed to open file");
+        AlignedFileReadResult ReadCopy(const std::filesystem::path &filePath) {
+            std::ifstream file(filePath,std::ios::binary|std::ios::ate);
+            if (!file) {
+                std::puts("Failed to open file");
+            }
+
+            const std::streamoff size = file.tellg();
+            file.seekg(0, std::ios::beg);
+
+            // Handle empty files: return a valid aligned, null-terminated block
+            if (size <= 0) {
+                return ReadEmpty();
+            }
+
+            // Allocate an extra byte to allow optional null-termination without overflow
+            const auto block = static_cast<char *>(operator new []((static_cast<std::size_t>(size) + PaddingSize + 1),
+                std::align_val_t{AlignedFileReader::Alignment},std::nothrow));
+            file.read(block,size);
+            std::memset(block + size, EOF, PaddingSize);
+            block[size+PaddingSize] = '\0'; //for string termination if needed
+            return AlignedFileReadResult{block,AlignedFileReaderDelete{.TextSize = static_cast<std::size_t>(size) + PaddingSize}};
         }
 
-        const std::streamoff size = file.tellg();
-        file.seekg(0, std::ios::beg);
+#if WL_POSIX
+        //an anonymous mapping large enough for the file and its padding is reserved first, then the file's whole pages
+        //are mapped over its beginning. the last partial page (if any) is read into the anonymous memory that follows
+        //them, so the padding lands right after the text without copying the rest of the file
+        AlignedFileReadResult ReadMapped(const std::filesystem::path &filePath,const bool populate) {
+            const int file = open(filePath.c_str(),O_RDONLY | O_CLOEXEC);
+            if (file < 0) {
+                return ReadCopy(filePath);
+            }
+            struct stat status{};
+            if (fstat(file,&status) != 0 || !S_ISREG(status.st_mode)) {
+                close(file);
+                return ReadCopy(filePath);
+            }
+            const auto size = static_cast<std::size_t>(status.st_size);
+            if (size == 0) {
+                close(file);
+                return ReadEmpty();
+            }
+            const auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+            const std::size_t wholePages = size / pageSize * pageSize;
+            const std::size_t mappedSize = (size + PaddingSize + 1 + pageSize - 1) / pageSize * pageSize;
+            void* reserved = mmap(nullptr,mappedSize,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+            if (reserved == MAP_FAILED) {
+                close(file);
+                return ReadCopy(filePath);
+            }
+            auto* block = static_cast<char*>(reserved);
+            if (wholePages != 0) {
+                int flags = MAP_PRIVATE | MAP_FIXED;
+#ifdef MAP_POPULATE
+                flags |= populate ? MAP_POPULATE : 0;
+#else
+                (void)populate;
+#endif
+                if (mmap(block,wholePages,PROT_READ,flags,file,0) == MAP_FAILED) {
+                    munmap(block,mappedSize);
+                    close(file);
+                    return ReadCopy(filePath);
+                }
+                (void)madvise(block,wholePages,MADV_SEQUENTIAL);
+            }
+            for (std::size_t tail = wholePages; tail < size;) {
+                const ssize_t count = pread(file,block + tail,size - tail,static_cast<off_t>(tail));
+                if (count <= 0) {
+                    munmap(block,mappedSize);
+                    close(file);
+                    return ReadCopy(filePath);
+                }
+                tail += static_cast<std::size_t>(count);
+            }
+            close(file);
+            std::memset(block + size, EOF, PaddingSize);
+            block[size+PaddingSize] = '\0'; //for string termination if needed
+            return AlignedFileReadResult{block,AlignedFileReaderDelete{.MappedSize = mappedSize,.TextSize = size + PaddingSize}};
+        }
+#endif
+    }
 
-        // Handle empty files: return a valid aligned, null-terminated block
-        if (size <= 0) {
-            auto* block = static_cast<char*>(operator new[](PaddingSize + 1,
-                std::align_val_t{Alignment}, std::nothrow));
-            std::memset(block, EOF, PaddingSize);
-            block[PaddingSize] = '\0';
-            return AlignedFileReadResult{block, AlignedFileReaderDelete{}};
+    void AlignedFileReaderDelete::operator()(void *block) const noexcept {
+#if WL_POSIX
+        if (MappedSize != 0) {
+            munmap(block,MappedSize);
+            return;
         }
+#endif
+        operator delete [](block,std::align_val_t{AlignedFileReader::Alignment},std::nothrow);
+    }
 
-        // Allocate an extra byte to allow optional null-termination without overflow
-        const auto block = static_cast<char *>(operator new []((static_cast<std::size_t>(size) + PaddingSize + 1),
-            std::align_val_t{Alignment},std::nothrow));
-        file.read(block,size);
-        std::memset(block + size, EOF, PaddingSize);
-        block[size+PaddingSize] = '\0'; //for string termination if needed
-        return AlignedFileReadResult{block,AlignedFileReaderDelete{}};
+    AlignedFileReadResult AlignedFileReader::Read(const std::filesystem::path &filePath,const FileReadMode mode) {
+        if (!exists(filePath)) {
+            return ReadEmpty();
+        }
+#if WL_POSIX
+        if (mode != FileReadMode::Copy) {
+            return ReadMapped(filePath,mode == FileReadMode::MapPopulated);
+        }
+#else
+        (void)mode;
+#endif
+        return ReadCopy(filePath);
     }
 }
@@ -0,0 +1,142 @@
+﻿#include <algorithm>
+#include <bit>
+#include <new>
+#include "ArenaPool.h"
+#include "VirtualMemory.h"
+
+namespace WideLips {
+    ArenaPool::ArenaPool(const std::size_t retainedLimit) :
+    _retainedLimit(retainedLimit),
+    _resource(this) {
+
+    }
+
+    ArenaPool::~ArenaPool() {
+        for (const auto* freeRanges : {&_free,&_freeHugePages}) {
+            for (const auto& ranges : *freeRanges) {
+                for (const Range& range : ranges) {
+                    VirtualMemory::Release(range.Address,range.Size);
+                }
+            }
+        }
+    }
+
+    std::size_t ArenaPool::SizeClassOf(const std::size_t size,const bool hugePages) noexcept {
+        return std::bit_ceil(std::max(size,hugePages ? VirtualMemory::HugePageSize : VirtualMemory::PageSize()));
+    }
+
+    std::vector<ArenaPool::Range>& ArenaPool::FreeRangesOf(const std::size_t classSize,const bool hugePages) noexcept {
+        return (hugePages ? _freeHugePages : _free)[std::countr_zero(classSize)];
+    }
+
+    ArenaPool::Range ArenaPool::Acquire(const std::size_t size,const bool hugePages) noexcept {
+        const std::size_t classSize = SizeClassOf(size,hugePages);
+        {
+            const std::lock_guard lock(_mutex);
+            auto& ranges = FreeRangesOf(classSize,hugePages);
+            if (!ranges.empty()) {
+                //the range released last is the likeliest to still be cached
+                const Range range = ranges.back();
+                ranges.pop_back();
+                _retained -= range.Committed;
+                return range;
+            }
+        }
+        return Range{VirtualMemory::Reserve(classSize,hugePages),classSize,0,hugePages};
+    }
+
+    void ArenaPool::Release(const Range& range) noexcept {
+        if (range.Address == nullptr) {
+            return;
+        }
+        {
+            const std::lock_guard lock(_mutex);
+            if (_retained + range.Committed <= _retainedLimit) {
+                try {
+                    FreeRangesOf(range.Size,range.HugePages).push_back(range);
+                    _retained += range.Committed;
+                    return;
+                }
+                catch (const std::bad_alloc&) {
+                    //a range the pool can't keep track of is unmapped right away
+                }
+            }
+        }
+        VirtualMemory::Release(range.Address,range.Size);
+    }
+
+    std::size_t ArenaPool::Warm(const std::size_t size,const std::size_t count,const bool hugePages) noexcept {
+        const std::size_t classSize = SizeClassOf(size,hugePages);
+        const std::size_t pageSize = VirtualMemory::PageSize();
+        std::size_t warmed = 0;
+        for (; warmed < count; ++warmed) {
+            void* const address = VirtualMemory::Reserve(classSize,hugePages);
+            if (address == nullptr) {
+                break;
+            }
+            if (!VirtualMemory::Commit(address,classSize)) {
+                VirtualMemory::Release(address,classSize);
+                break;
+            }
+            //a write per page faults it in, so the first file to get the range doesn't
+            for (std::size_t offset = 0; offset < classSize; offset += pageSize) {
+                static_cast<volatile char*>(address)[offset] = 0;
+            }
+            {
+                const std::lock_guard lock(_mutex);
+                if (_retained + classSize <= _retainedLimit) {
+                    try {
+                        FreeRangesOf(classSize,hugePages).push_back(Range{address,classSize,classSize,hugePages});
+                        _retained += classSize;
+                        continue;
+                    }
+                    catch (const std::bad_alloc&) {
+                        //unmapped below like a range released past the limit
+                    }
+                }
+            }
+            VirtualMemory::Release(address,classSize);
+            break;
+        }
+        return warmed;
+    }
+
+    std::pmr::memory_resource* ArenaPool::GetResource() noexcept {
+        return &_resource;
+    }
+
+    std::size_t ArenaPool::GetRetainedSize() const noexcept {
+        const std::lock_guard lock(_mutex);
+        return _retained;
+    }
+
+    ArenaPool& ArenaPool::Process() noexcept {
+        static ArenaPool pool;
+        return pool;
+    }
+
+    void* ArenaPool::PooledResource::do_allocate(const std::size_t bytes,const std::size_t alignment) {
+        if (alignment > VirtualMemory::PageSize()) {
+            throw std::bad_alloc();
+        }
+        const Range range = _pool->Acquire(bytes);
+        if (range.Address == nullptr) {
+            throw std::bad_alloc();
+        }
+        if (range.Committed < range.Size && !VirtualMemory::Commit(static_cast<char*>(range.Address) + range.Committed,
+            range.Size - range.Committed)) {
+            _pool->Release(range);
+            throw std::bad_alloc();
+        }
+        return range.Address;
+    }
+
+    void ArenaPool::PooledResource::do_deallocate(void* block,const std::size_t bytes,UNUSED const std::size_t alignment) {
+        const std::size_t classSize = SizeClassOf(bytes);
+        _pool->Release(Range{block,classSize,classSize});
+    }
+
+    bool ArenaPool::PooledResource::do_is_equal(const memory_resource& other) const noexcept {
+        return this == &other;
+    }
+}
@@ -0,0 +1,128 @@
+﻿#include <bit>
+#include <new>
+#include "../include/AVX.h"
+#include "../include/Classifier.h"
+#include "Config.h"
+
+#if WL_ARCH_X86
+WL_TARGET_REGION_BEGIN("avx2")
+namespace WideLips {
+    namespace {
+        std::uint64_t ClassifyBlocksAvx2(const std::uint8_t *const text,
+            const std::size_t blocksCount,
+            TokenizationBlock *const blocks,
+            std::uint64_t escapeCarry) noexcept {
+
+            const Vector256 sexprAndOpsTable = Avx2::BroadcastLane(Classifier::SExprAndOpsTable.data());
+            const Vector256 otherOpsAndStructTable = Avx2::BroadcastLane(Classifier::OtherOpsAndStructTable.data());
+            const Vector256 fragmentsTable = Avx2::BroadcastLane(Classifier::FragmentsTable.data());
+            const Vector256 digitsTable = Avx2::BroadcastLane(Classifier::DigitsTable.data());
+            const Vector256 smallIdentifierTable = Avx2::BroadcastLane(Classifier::SmallIdentifierTable.data());
+            const Vector256 smallIdentifierTable2 = Avx2::BroadcastLane(Classifier::SmallIdentifierTable2.data());
+            const Vector256 capitalIdentifierTable = Avx2::BroadcastLane(Classifier::CapitalIdentifierTable.data());
+            const Vector256 capitalIdentifierTable2 = Avx2::BroadcastLane(Classifier::CapitalIdentifierTable2.data());
+
+            for (std::size_t block = 0; block < blocksCount; ++block) {
+                std::uint64_t doubleQuoteMask = 0;
+                std::uint64_t backSlashMask = 0;
+                std::uint64_t sexprAndOpsMask = 0;
+                std::uint64_t digitsMask = 0;
+                std::uint64_t identifierMask = 0;
+                std::uint64_t fragmentMask = 0;
+                std::uint64_t newLineMask = 0;
+                //a tokenization block spans two AVX2 vectors, each one fills half of the block masks
+                for (std::uint32_t half = 0; half < TokenizationBlock::Width; half += sizeof(Vector256)) {
+                    const Vector256 fetchedChars = Avx2::LoadFromAddress(text,
+                        static_cast<std::ptrdiff_t>(block * TokenizationBlock::Width + half));
+                    //string literal matching
+                    const Vector256 doubleQuotationEquality =  Avx2::CompareEqual(fetchedChars,Avx2::Propagate('\"'));
+                    const Vector256 backwardSlashEquality = Avx2::CompareEqual(fetchedChars,Avx2::Propagate('\\'));
+                    doubleQuoteMask |= static_cast<std::uint64_t>(Avx2::MoveMask(doubleQuotationEquality)) << half;
+                    backSlashMask |= static_cast<std::uint64_t>(Avx2::MoveMask(backwardSlashEquality)) << half;
+                    //sexpr parentheses matching
+                    const Vector256 hashedSexprChars = Avx2::SubtractSaturated(Avx2::Propagate(0x30),fetchedChars);
+                    const Vector256 lookedSexprAndOpsChars = Avx2::ShuffleBytes(sexprAndOpsTable,hashedSexprChars);
+                    const Vector256 sexprAndOpsChars = Avx2::CompareEqual(lookedSexprAndOpsChars,fetchedChars);
+                    //other operators and structural matching
+                    const Vector256 hashedOtherOpsAndStructSymbols = Avx2::Custom::RightShift8<2>(fetchedChars);
+                    const Vector256 lookedOtherOpsAndStructSymbols = Avx2::ShuffleBytes(otherOpsAndStructTable,hashedOtherOpsAndStructSymbols);
+                    const Vector256 matchingOtherOpsAndStruct = Avx2::CompareEqual(lookedOtherOpsAndStructSymbols,fetchedChars);
+                    sexprAndOpsMask |= static_cast<std::uint64_t>(Avx2::MoveMask(Avx2::Or(sexprAndOpsChars,
+                        matchingOtherOpsAndStruct))) << half;
+                    //numbers
+                    const Vector256 lookedDigits = Avx2::ShuffleBytes(digitsTable,fetchedChars);
+                    const Vector256 digits = Avx2::CompareEqual(lookedDigits,fetchedChars);
+                    digitsMask |= static_cast<std::uint64_t>(Avx2::MoveMask(digits)) << half;
+                    //identifiers
+                    const Vector256 lookedSmallIdentifier = Avx2::ShuffleBytes(smallIdentifierTable,fetchedChars);
+                    const Vector256 lookedSmallIdentifier2 = Avx2::ShuffleBytes(smallIdentifierTable2,fetchedChars);
+                    const Vector256 lookedCapitalIdentifier = Avx2::ShuffleBytes(capitalIdentifierTable,fetchedChars);
+                    const Vector256 lookedCapitalIdentifier2 = Avx2::ShuffleBytes(capitalIdentifierTable2,fetchedChars);
+                    const Vector256 lookedSmallIdentifierChars = Avx2::CompareEqual(lookedSmallIdentifier,fetchedChars);
+                    const Vector256 lookedSmallIdentifier2Chars = Avx2::CompareEqual(lookedSmallIdentifier2,fetchedChars);
+                    const Vector256 lookedCapitalIdentifierChars = Avx2::CompareEqual(lookedCapitalIdentifier,fetchedChars);
+                    const Vector256 lookedCapitalIdentifier2Chars = Avx2::CompareEqual(lookedCapitalIdentifier2,fetchedChars);
+                    //lexer will match digits mask before identifier mask so it doesn't get mis-tokenized
+                    const Vector256 lookedIdentifier = Avx2::Or(digits,
+                        Avx2::Or( //balancing is important here as it optimizes data dependency
+                        Avx2::Or(lookedCapitalIdentifierChars,lookedCapitalIdentifier2Chars),
+                        Avx2::Or(lookedSmallIdentifierChars,lookedSmallIdentifier2Chars)));
+                    identifierMask |= static_cast<std::uint64_t>(Avx2::MoveMask(lookedIdentifier)) << half;
+                    //fragmentation chars matching
+                    //no need to hash anything '_mm256_shuffle_epi8' implicit bitwise-and with 0x0F is enough for classification here
+                    const Vector256 lookedFragmentChars = Avx2::ShuffleBytes(fragmentsTable,fetchedChars);
+                    const Vector256 fragmentChars = Avx2::CompareEqual(lookedFragmentChars,fetchedChars);
+                    const Vector256 newLines = Avx2::CompareEqual(fetchedChars,Avx2::Propagate('\n'));
+                    newLineMask |= static_cast<std::uint64_t>(Avx2::MoveMask(newLines)) << half;
+                    fragmentMask |= static_cast<std::uint64_t>(Avx2::MoveMask(fragmentChars)) << half;
+                }
+                //pushing result
+                new (blocks + block) TokenizationBlock{TokenizationMasks{
+                    .FragmentsMask = fragmentMask,
+                    .SExprAndOpsMask = sexprAndOpsMask,
+                    .DigitsMask = digitsMask,
+                    .StringLiteralsMask = ComputeStringLiteralsMask(backSlashMask,doubleQuoteMask,escapeCarry),
+                    .NewLines = newLineMask,
+                    .IdentifierMask = identifierMask
+                }};
+            }
+            return escapeCarry;
+        }
+
+        std::size_t FindBytesAvx2(const std::uint8_t *const bytes,
+            const std::size_t count,
+            const std::uint8_t value) noexcept {
+            const Vector256 pattern = Avx2::Propagate(value);
+            std::size_t pos = 0;
+            for (; pos + sizeof(Vector256) <= count; pos += sizeof(Vector256)) {
+                const Vector256 fetched = Avx2::LoadFromAddress(bytes,static_cast<std::ptrdiff_t>(pos));
+                if (const std::uint64_t found = Avx2::MoveMask(Avx2::CompareEqual(fetched,pattern)); found != 0) {
+                    return pos + std::countr_zero(found);
+                }
+            }
+            for (; pos < count; ++pos) {
+                if (bytes[pos] == value) {
+                    return pos;
+                }
+            }
+            return count;
+        }
+    }
+}
+WL_TARGET_REGION_END
+
+namespace WideLips {
+    std::uint64_t Classifier::ClassifyAvx2(const std::uint8_t *const text,
+        const std::size_t blocksCount,
+        TokenizationBlock *const blocks,
+        const std::uint64_t escapeCarry) noexcept {
+        return ClassifyBlocksAvx2(text,blocksCount,blocks,escapeCarry);
+    }
+
+    std::size_t Classifier::FindByteAvx2(const std::uint8_t *const bytes,
+        const std::size_t count,
+        const std::uint8_t value) noexcept {
+        return FindBytesAvx2(bytes,count,value);
+    }
+}
+#endif // WL_ARCH_X86
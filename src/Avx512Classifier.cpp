@@ -0,0 +1,110 @@
+﻿#include <bit>
+#include <new>
+#include "../include/AVX512.h"
+#include "../include/Classifier.h"
+#include "Config.h"
+
+#if WL_ARCH_X86
+WL_TARGET_REGION_BEGIN("avx512f,avx512bw")
+namespace WideLips {
+    namespace {
+        std::uint64_t ClassifyBlocksAvx512(const std::uint8_t *const text,
+            const std::size_t blocksCount,
+            TokenizationBlock *const blocks,
+            std::uint64_t escapeCarry) noexcept {
+
+            const Vector512 sexprAndOpsTable = Avx512::BroadcastLane(Classifier::SExprAndOpsTable.data());
+            const Vector512 otherOpsAndStructTable = Avx512::BroadcastLane(Classifier::OtherOpsAndStructTable.data());
+            const Vector512 fragmentsTable = Avx512::BroadcastLane(Classifier::FragmentsTable.data());
+            const Vector512 digitsTable = Avx512::BroadcastLane(Classifier::DigitsTable.data());
+            const Vector512 smallIdentifierTable = Avx512::BroadcastLane(Classifier::SmallIdentifierTable.data());
+            const Vector512 smallIdentifierTable2 = Avx512::BroadcastLane(Classifier::SmallIdentifierTable2.data());
+            const Vector512 capitalIdentifierTable = Avx512::BroadcastLane(Classifier::CapitalIdentifierTable.data());
+            const Vector512 capitalIdentifierTable2 = Avx512::BroadcastLane(Classifier::CapitalIdentifierTable2.data());
+
+            for (std::size_t block = 0; block < blocksCount; ++block) {
+                //one vector covers the whole tokenization block
+                const Vector512 fetchedChars = Avx512::LoadFromAddress(text,
+                    static_cast<std::ptrdiff_t>(block * TokenizationBlock::Width));
+                //string literal matching
+                const std::uint64_t doubleQuoteMask = Avx512::CompareEqual(fetchedChars,Avx512::Propagate('\"'));
+                const std::uint64_t backSlashMask = Avx512::CompareEqual(fetchedChars,Avx512::Propagate('\\'));
+                //sexpr parentheses matching
+                const Vector512 hashedSexprChars = Avx512::SubtractSaturated(Avx512::Propagate(0x30),fetchedChars);
+                const Vector512 lookedSexprAndOpsChars = Avx512::ShuffleBytes(sexprAndOpsTable,hashedSexprChars);
+                std::uint64_t sexprAndOpsMask = Avx512::CompareEqual(lookedSexprAndOpsChars,fetchedChars);
+                //other operators and structural matching
+                const Vector512 hashedOtherOpsAndStructSymbols = Avx512::Custom::RightShift8<2>(fetchedChars);
+                const Vector512 lookedOtherOpsAndStructSymbols = Avx512::ShuffleBytes(otherOpsAndStructTable,hashedOtherOpsAndStructSymbols);
+                sexprAndOpsMask |= Avx512::CompareEqual(lookedOtherOpsAndStructSymbols,fetchedChars);
+                //numbers
+                const Vector512 lookedDigits = Avx512::ShuffleBytes(digitsTable,fetchedChars);
+                const std::uint64_t digitsMask = Avx512::CompareEqual(lookedDigits,fetchedChars);
+                //identifiers
+                const Vector512 lookedSmallIdentifier = Avx512::ShuffleBytes(smallIdentifierTable,fetchedChars);
+                const Vector512 lookedSmallIdentifier2 = Avx512::ShuffleBytes(smallIdentifierTable2,fetchedChars);
+                const Vector512 lookedCapitalIdentifier = Avx512::ShuffleBytes(capitalIdentifierTable,fetchedChars);
+                const Vector512 lookedCapitalIdentifier2 = Avx512::ShuffleBytes(capitalIdentifierTable2,fetchedChars);
+                const std::uint64_t smallIdentifierMask = Avx512::CompareEqual(lookedSmallIdentifier,fetchedChars);
+                const std::uint64_t smallIdentifier2Mask = Avx512::CompareEqual(lookedSmallIdentifier2,fetchedChars);
+                const std::uint64_t capitalIdentifierMask = Avx512::CompareEqual(lookedCapitalIdentifier,fetchedChars);
+                const std::uint64_t capitalIdentifier2Mask = Avx512::CompareEqual(lookedCapitalIdentifier2,fetchedChars);
+                //lexer will match digits mask before identifier mask so it doesn't get mis-tokenized
+                const std::uint64_t identifierMask = digitsMask |
+                    ((capitalIdentifierMask | capitalIdentifier2Mask) | (smallIdentifierMask | smallIdentifier2Mask));
+                //fragmentation chars matching
+                const Vector512 lookedFragmentChars = Avx512::ShuffleBytes(fragmentsTable,fetchedChars);
+                const std::uint64_t fragmentMask = Avx512::CompareEqual(lookedFragmentChars,fetchedChars);
+                const std::uint64_t newLineMask = Avx512::CompareEqual(fetchedChars,Avx512::Propagate('\n'));
+                //pushing result
+                new (blocks + block) TokenizationBlock{TokenizationMasks{
+                    .FragmentsMask = fragmentMask,
+                    .SExprAndOpsMask = sexprAndOpsMask,
+                    .DigitsMask = digitsMask,
+                    .StringLiteralsMask = ComputeStringLiteralsMask(backSlashMask,doubleQuoteMask,escapeCarry),
+                    .NewLines = newLineMask,
+                    .IdentifierMask = identifierMask
+                }};
+            }
+            return escapeCarry;
+        }
+
+        std::size_t FindBytesAvx512(const std::uint8_t *const bytes,
+            const std::size_t count,
+            const std::uint8_t value) noexcept {
+            const Vector512 pattern = Avx512::Propagate(value);
+            std::size_t pos = 0;
+            for (; pos + sizeof(Vector512) <= count; pos += sizeof(Vector512)) {
+                const Vector512 fetched = Avx512::LoadFromAddress(bytes,static_cast<std::ptrdiff_t>(pos));
+                if (const std::uint64_t found = Avx512::CompareEqual(fetched,pattern); found != 0) {
+                    return pos + std::countr_zero(found);
+                }
+            }
+            for (; pos < count; ++pos) {
+                if (bytes[pos] == value) {
+                    return pos;
+                }
+            }
+            return count;
+        }
+    }
+}
+WL_TARGET_REGION_END
+
+namespace WideLips {
+    //the kernel itself lives in the AVX-512 target region, this entry point is compiled for the baseline ISA so it's
+    //safe to take its address and call it from the rest of the library
+    std::uint64_t Classifier::ClassifyAvx512(const std::uint8_t *const text,
+        const std::size_t blocksCount,
+        TokenizationBlock *const blocks,
+        const std::uint64_t escapeCarry) noexcept {
+        return ClassifyBlocksAvx512(text,blocksCount,blocks,escapeCarry);
+    }
+
+    std::size_t Classifier::FindByteAvx512(const std::uint8_t *const bytes,
+        const std::size_t count,
+        const std::uint8_t value) noexcept {
+        return FindBytesAvx512(bytes,count,value);
+    }
+}
+#endif // WL_ARCH_X86
@@ -0,0 +1,388 @@
+﻿#include <array>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BluePassCache.h"
+#include "LispLexer.h"
+#include "MappedFile.h"
+
+namespace WideLips {
+    namespace {
+        constexpr std::uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+        constexpr std::uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+        constexpr std::uint64_t Prime3 = 0x165667B19E3779F9ULL;
+        constexpr std::uint64_t Prime4 = 0x85EBCA77C2B2AE63ULL;
+        constexpr std::uint64_t Prime5 = 0x27D4EB2F165667C5ULL;
+
+        ALWAYS_INLINE std::uint64_t Load64(const char* at) noexcept {
+            std::uint64_t value;
+            std::memcpy(&value,at,sizeof(value));
+            return value;
+        }
+
+        ALWAYS_INLINE std::uint32_t Load32(const char* at) noexcept {
+            std::uint32_t value;
+            std::memcpy(&value,at,sizeof(value));
+            return value;
+        }
+
+        ALWAYS_INLINE std::uint64_t Round(const std::uint64_t accumulator,const std::uint64_t lane) noexcept {
+            return std::rotl(accumulator + lane * Prime2,31) * Prime1;
+        }
+
+        ALWAYS_INLINE std::uint64_t MergeRound(const std::uint64_t hash,const std::uint64_t accumulator) noexcept {
+            return (hash ^ Round(0,accumulator)) * Prime1 + Prime4;
+        }
+
+        //'Dialect' in a file header, a cache shared by builds of different dialects doesn't mix their files up
+        constexpr std::uint32_t DialectBits() noexcept {
+            std::uint32_t bits = 0;
+            std::uint32_t bit = 1;
+#ifdef EnableHash
+            bits |= bit;
+#endif
+            bit <<= 1;
+#ifdef EnableComma
+            bits |= bit;
+#endif
+            bit <<= 1;
+#ifdef EnableBrackets
+            bits |= bit;
+#endif
+            bit <<= 1;
+#ifdef EnableQuasiColumn
+            bits |= bit;
+#endif
+            bit <<= 1;
+#ifdef EnableColumn
+            bits |= bit;
+#endif
+            bit <<= 1;
+#ifdef EnableAtSign
+            bits |= bit;
+#endif
+            bit <<= 1;
+#ifdef EnableBenjamin
+            bits |= bit;
+#endif
+            bit <<= 1;
+#ifdef EnableDashInID
+            bits |= bit;
+#endif
+            bit <<= 1;
+#ifdef EnableTilda
+            bits |= bit;
+#endif
+            bit <<= 1;
+#ifdef InvalidateEmptySExpr
+            bits |= bit;
+#endif
+            return bits;
+        }
+
+        constexpr char Magic[8] = {'W','L','B','L','U','E','\r','\n'};
+        constexpr std::size_t SectionAlignment = 64;
+
+        //sections follow the header in this order, each one starting on a 'SectionAlignment' boundary
+        struct FileHeader final {
+            char Magic[8];
+            std::uint32_t Version;
+            std::uint32_t Dialect;
+            std::uint64_t ContentHash;
+            std::uint64_t PathHash;
+            std::uint64_t TextSize;
+            std::uint64_t SExprIndices;
+            std::uint64_t Blocks; //0 when the blocks were left out
+            std::uint64_t LineRanks; //0 unless locations are lazy
+            std::uint64_t Diagnostics;
+            std::uint64_t DiagnosticsSize; //bytes taken by the diagnostics records
+            std::uint32_t ByteOrder; //tells a file written on a host of another byte order apart
+            std::uint8_t Engine;
+            std::uint8_t Locations;
+            std::uint8_t WellFormed;
+            std::uint8_t WideCharSize;
+            std::uint16_t SExprIndexSize;
+            std::uint16_t BlockSize;
+            std::uint16_t LineRankSize;
+        };
+
+        //a diagnostic is kept as its severity and the length of its message (in wide characters) before the message
+        struct DiagnosticRecord final {
+            std::uint32_t Severity;
+            std::uint32_t Length;
+        };
+
+        constexpr std::uint32_t ByteOrderMark = 0x01020304;
+
+        constexpr std::size_t AlignSection(const std::size_t size) noexcept {
+            return (size + SectionAlignment - 1) & ~(SectionAlignment - 1);
+        }
+
+        //the layout the sections of a file with 'header' take, the size of the file included
+        struct FileLayout final {
+            std::size_t SExprIndices;
+            std::size_t Blocks;
+            std::size_t LineRanks;
+            std::size_t Diagnostics;
+            std::size_t End;
+        };
+
+        FileLayout LayoutOf(const FileHeader& header) noexcept {
+            FileLayout layout{};
+            layout.SExprIndices = AlignSection(sizeof(FileHeader));
+            layout.Blocks = AlignSection(layout.SExprIndices + header.SExprIndices * sizeof(SExprIndex));
+            layout.LineRanks = AlignSection(layout.Blocks + header.Blocks * sizeof(TokenizationBlock));
+            layout.Diagnostics = AlignSection(layout.LineRanks + header.LineRanks * sizeof(LineRank));
+            layout.End = layout.Diagnostics + header.DiagnosticsSize;
+            return layout;
+        }
+
+        std::uint64_t PathHashOf(const std::wstring_view filePath) noexcept {
+            return ContentHash(std::string_view{reinterpret_cast<const char*>(filePath.data()),
+                filePath.size() * sizeof(wchar_t)});
+        }
+    }
+
+    std::uint64_t ContentHash(const std::string_view text,const std::uint64_t seed) noexcept {
+        const char* at = text.data();
+        const char* const end = at + text.size();
+        std::uint64_t hash;
+        if (text.size() >= 32) {
+            std::uint64_t lane1 = seed + Prime1 + Prime2;
+            std::uint64_t lane2 = seed + Prime2;
+            std::uint64_t lane3 = seed;
+            std::uint64_t lane4 = seed - Prime1;
+            for (const char* const lastStripe = end - 32; at <= lastStripe; at += 32) {
+                lane1 = Round(lane1,Load64(at));
+                lane2 = Round(lane2,Load64(at + 8));
+                lane3 = Round(lane3,Load64(at + 16));
+                lane4 = Round(lane4,Load64(at + 24));
+            }
+            hash = std::rotl(lane1,1) + std::rotl(lane2,7) + std::rotl(lane3,12) + std::rotl(lane4,18);
+            hash = MergeRound(hash,lane1);
+            hash = MergeRound(hash,lane2);
+            hash = MergeRound(hash,lane3);
+            hash = MergeRound(hash,lane4);
+        }
+        else {
+            hash = seed + Prime5;
+        }
+        hash += text.size();
+        for (; at + 8 <= end; at += 8) {
+            hash = std::rotl(hash ^ Round(0,Load64(at)),27) * Prime1 + Prime4;
+        }
+        if (at + 4 <= end) {
+            hash = std::rotl(hash ^ Load32(at) * Prime1,23) * Prime2 + Prime3;
+            at += 4;
+        }
+        for (; at < end; ++at) {
+            hash = std::rotl(hash ^ static_cast<std::uint8_t>(*at) * Prime5,11) * Prime1;
+        }
+        hash ^= hash >> 33;
+        hash *= Prime2;
+        hash ^= hash >> 29;
+        hash *= Prime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    BluePassCache::BluePassCache(std::filesystem::path directory,const bool keepBlocks) :
+    _directory(std::move(directory)),
+    _keepBlocks(keepBlocks) {
+        std::error_code error;
+        std::filesystem::create_directories(_directory,error);
+    }
+
+    const std::filesystem::path& BluePassCache::GetDirectory() const noexcept {
+        return _directory;
+    }
+
+    std::size_t BluePassCache::GetHits() const noexcept {
+        return _hits.load(std::memory_order_relaxed);
+    }
+
+    std::size_t BluePassCache::GetMisses() const noexcept {
+        return _misses.load(std::memory_order_relaxed);
+    }
+
+    std::filesystem::path BluePassCache::FileOf(const std::uint64_t key) const {
+        char name[24];
+        constexpr char digits[] = "0123456789abcdef";
+        for (int digit = 0; digit < 16; ++digit) {
+            name[digit] = digits[(key >> (60 - digit * 4)) & 0xF];
+        }
+        std::memcpy(name + 16,".wlb",5);
+        return _directory / name;
+    }
+
+    bool BluePassCache::Load(LispLexer& lexer,const std::uint64_t contentHash) noexcept {
+        const std::uint64_t pathHash = PathHashOf(lexer._filePath);
+        //every byte is copied right away, so the pages are faulted in upfront
+        const MappedFile file(FileOf(contentHash ^ pathHash),true);
+        FileHeader header{};
+        if (file.Size() < sizeof(FileHeader)) {
+            _misses.fetch_add(1,std::memory_order_relaxed);
+            return false;
+        }
+        std::memcpy(&header,file.Data(),sizeof(header));
+        const FileLayout layout = LayoutOf(header);
+        const bool matches = std::memcmp(header.Magic,Magic,sizeof(Magic)) == 0 &&
+            header.Version == Version &&
+            header.Dialect == DialectBits() &&
+            header.ByteOrder == ByteOrderMark &&
+            header.ContentHash == contentHash &&
+            header.PathHash == pathHash &&
+            header.TextSize == lexer._text.size() &&
+            header.Engine == static_cast<std::uint8_t>(lexer._blueEngine) &&
+            header.Locations == static_cast<std::uint8_t>(lexer._locations) &&
+            header.WideCharSize == sizeof(wchar_t) &&
+            header.SExprIndexSize == sizeof(SExprIndex) &&
+            header.BlockSize == sizeof(TokenizationBlock) &&
+            header.LineRankSize == sizeof(LineRank) &&
+            //counts past what the text could hold would overflow the layout
+            header.SExprIndices <= lexer._text.size() &&
+            header.Blocks <= lexer._blocks.Capacity() &&
+            header.LineRanks <= lexer._lineRanks.Capacity() &&
+            header.DiagnosticsSize <= file.Size() &&
+            layout.End == file.Size();
+        if (!matches) {
+            _misses.fetch_add(1,std::memory_order_relaxed);
+            return false;
+        }
+        //diagnostics are checked for fitting in the file before anything is copied, a lexer that misses is untouched
+        std::vector<std::pair<DiagnosticRecord,std::size_t>> records;
+        records.reserve(header.Diagnostics);
+        for (std::size_t at = layout.Diagnostics,diagnostic = 0; diagnostic < header.Diagnostics; ++diagnostic) {
+            DiagnosticRecord record{};
+            if (file.Size() - at < sizeof(record)) {
+                _misses.fetch_add(1,std::memory_order_relaxed);
+                return false;
+            }
+            std::memcpy(&record,file.Data() + at,sizeof(record));
+            at += sizeof(record);
+            if ((file.Size() - at) / sizeof(wchar_t) < record.Length) {
+                _misses.fetch_add(1,std::memory_order_relaxed);
+                return false;
+            }
+            records.emplace_back(record,at);
+            at += record.Length * sizeof(wchar_t);
+        }
+
+        if (header.SExprIndices != 0) {
+            std::memcpy(lexer._sexprIndices.Preserve(header.SExprIndices),
+                file.Data() + layout.SExprIndices,
+                header.SExprIndices * sizeof(SExprIndex));
+        }
+        if (header.Blocks != 0) {
+            //the planes of a block are const, so blocks are made from their bytes instead of copied over
+            TokenizationBlock* blocks = lexer._blocks.Preserve(header.Blocks);
+            for (std::size_t block = 0; block < header.Blocks; ++block) {
+                std::array<std::byte,sizeof(TokenizationBlock)> bytes;
+                std::memcpy(bytes.data(),file.Data() + layout.Blocks + block * sizeof(TokenizationBlock),bytes.size());
+                ::new (static_cast<void*>(blocks + block)) TokenizationBlock(std::bit_cast<TokenizationBlock>(bytes));
+            }
+        }
+        if (header.LineRanks != 0) {
+            std::memcpy(lexer._lineRanks.Preserve(header.LineRanks),
+                file.Data() + layout.LineRanks,
+                header.LineRanks * sizeof(LineRank));
+        }
+        for (const auto& [record,at] : records) {
+            std::wstring message(record.Length,L'\0');
+            std::memcpy(message.data(),file.Data() + at,record.Length * sizeof(wchar_t));
+            lexer._diagnostics.EmplaceBack(Diagnostic::LispDiagnostic(std::move(message),
+                static_cast<Diagnostic::Severity>(record.Severity)));
+        }
+        lexer._wellFormed = header.WellFormed != 0;
+        _hits.fetch_add(1,std::memory_order_relaxed);
+        return true;
+    }
+
+    bool BluePassCache::Store(const LispLexer& lexer,const std::uint64_t contentHash) noexcept {
+        try {
+            return StoreFile(lexer,contentHash);
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+    }
+
+    bool BluePassCache::StoreFile(const LispLexer& lexer,const std::uint64_t contentHash) {
+        std::size_t diagnosticsSize = 0;
+        for (const auto& diagnostic : lexer._diagnostics) {
+            diagnosticsSize += sizeof(DiagnosticRecord) + diagnostic.GetFullMessage().size() * sizeof(wchar_t);
+        }
+        FileHeader header{};
+        std::memcpy(header.Magic,Magic,sizeof(Magic));
+        header.Version = Version;
+        header.Dialect = DialectBits();
+        header.ContentHash = contentHash;
+        header.PathHash = PathHashOf(lexer._filePath);
+        header.TextSize = lexer._text.size();
+        header.SExprIndices = lexer._sexprIndices.Size();
+        header.Blocks = _keepBlocks ? lexer._blocks.Size() : 0;
+        header.LineRanks = lexer._locations == SourceLocations::Lazy ? lexer._lineRanks.Size() : 0;
+        header.Diagnostics = lexer._diagnostics.Size();
+        header.DiagnosticsSize = diagnosticsSize;
+        header.ByteOrder = ByteOrderMark;
+        header.Engine = static_cast<std::uint8_t>(lexer._blueEngine);
+        header.Locations = static_cast<std::uint8_t>(lexer._locations);
+        header.WellFormed = lexer._wellFormed;
+        header.WideCharSize = sizeof(wchar_t);
+        header.SExprIndexSize = sizeof(SExprIndex);
+        header.BlockSize = sizeof(TokenizationBlock);
+        header.LineRankSize = sizeof(LineRank);
+        const FileLayout layout = LayoutOf(header);
+
+        const std::filesystem::path filePath = FileOf(contentHash ^ header.PathHash);
+        //a name no other writer picks, so concurrent stores of the same text never write the same file
+        const std::uint64_t writer = std::hash<std::thread::id>{}(std::this_thread::get_id()) ^
+            static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) ^
+            _nextFile.fetch_add(1,std::memory_order_relaxed) * Prime1;
+        std::filesystem::path temporaryPath = filePath;
+        temporaryPath += "." + std::to_string(writer) + ".tmp";
+        bool written = false;
+        {
+            std::ofstream file(temporaryPath,std::ios::binary | std::ios::trunc);
+            if (!file) {
+                return false;
+            }
+            const auto writeSection = [&file](const std::size_t at,const void* data,const std::size_t size) {
+                static constexpr char zeros[SectionAlignment] = {};
+                const auto position = static_cast<std::size_t>(file.tellp());
+                file.write(zeros,static_cast<std::streamsize>(at - position));
+                file.write(static_cast<const char*>(data),static_cast<std::streamsize>(size));
+            };
+            file.write(reinterpret_cast<const char*>(&header),sizeof(header));
+            writeSection(layout.SExprIndices,lexer._sexprIndices.begin(),header.SExprIndices * sizeof(SExprIndex));
+            writeSection(layout.Blocks,lexer._blocks.begin(),header.Blocks * sizeof(TokenizationBlock));
+            writeSection(layout.LineRanks,lexer._lineRanks.begin(),header.LineRanks * sizeof(LineRank));
+            writeSection(layout.Diagnostics,nullptr,0);
+            for (const auto& diagnostic : lexer._diagnostics) {
+                const std::wstring_view message = diagnostic.GetFullMessage();
+                const DiagnosticRecord record{static_cast<std::uint32_t>(diagnostic.GetSeverity()),
+                    static_cast<std::uint32_t>(message.size())};
+                file.write(reinterpret_cast<const char*>(&record),sizeof(record));
+                file.write(reinterpret_cast<const char*>(message.data()),
+                    static_cast<std::streamsize>(message.size() * sizeof(wchar_t)));
+            }
+            written = static_cast<bool>(file.flush());
+        }
+        std::error_code error;
+        if (written) {
+            std::filesystem::rename(temporaryPath,filePath,error);
+        }
+        if (!written || error) {
+            std::filesystem::remove(temporaryPath,error);
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,156 @@
+﻿#include <algorithm>
+#include <initializer_list>
+#include <vector>
+#include "../include/Classifier.h"
+#include "../include/Utilities/CpuFeatures.h"
+#include "../include/Utilities/ParallelFor.h"
+#if WL_ARCH_X86
+#include <wmmintrin.h>
+#endif
+
+namespace WideLips {
+    namespace {
+        //a chunk classified without its escape carry can only be wrong as far as the carry reaches, that's its first
+        //block unless the block is made of backslashes only, so re-classifying stops once the right carry matches
+        //the one the chunk was classified with. returns the corrected carry of the whole chunk
+        std::uint64_t FixupChunkHead(const Classifier::Kernel kernel,
+            const std::uint8_t *const text,
+            const std::size_t blocksCount,
+            TokenizationBlock *const blocks,
+            std::uint64_t carry,
+            const std::uint64_t chunkCarry) noexcept {
+            std::uint64_t assumedCarry = 0;
+            for (std::size_t block = 0; block < blocksCount; ++block) {
+                if (carry == assumedCarry) {
+                    return chunkCarry;
+                }
+                TokenizationBlock discarded;
+                const std::uint8_t* blockText = text + block * TokenizationBlock::Width;
+                assumedCarry = kernel(blockText,1,&discarded,assumedCarry);
+                carry = kernel(blockText,1,blocks + block,carry);
+            }
+            return carry;
+        }
+    }
+
+    Classifier::Kernel Classifier::Resolve(ClassificationKernel kernel) noexcept {
+        if (!IsSupported(kernel)) {
+            kernel = Widest();
+        }
+        switch (kernel) {
+#if WL_ARCH_X86
+            case ClassificationKernel::Sse42:
+                return ClassifySse42;
+            case ClassificationKernel::Avx2:
+                return ClassifyAvx2;
+            case ClassificationKernel::Avx512:
+                return ClassifyAvx512;
+#endif
+            case ClassificationKernel::Scalar:
+            default:
+                return ClassifyScalar;
+        }
+    }
+
+    Classifier::ByteFinder Classifier::ResolveFinder(ClassificationKernel kernel) noexcept {
+        if (!IsSupported(kernel)) {
+            kernel = Widest();
+        }
+        switch (kernel) {
+#if WL_ARCH_X86
+            case ClassificationKernel::Sse42:
+                return FindByteSse42;
+            case ClassificationKernel::Avx2:
+                return FindByteAvx2;
+            case ClassificationKernel::Avx512:
+                return FindByteAvx512;
+#endif
+            case ClassificationKernel::Scalar:
+            default:
+                return FindByteScalar;
+        }
+    }
+
+    Classifier::PrefixXorFunction Classifier::ResolvePrefixXor(const ClassificationKernel kernel) noexcept {
+#if WL_ARCH_X86
+        if (kernel != ClassificationKernel::Scalar and CpuFeatures::Host().Pclmul) {
+            return PrefixXorClmul;
+        }
+#endif
+        return PrefixXorLadder;
+    }
+
+    std::uint64_t Classifier::PrefixXorLadder(const std::uint64_t mask) noexcept {
+        return PrefixXor(mask);
+    }
+
+#if WL_ARCH_X86
+WL_TARGET_REGION_BEGIN("pclmul")
+    //multiplying by all ones without carries xors every bit into all the bits above it, in one instruction
+    std::uint64_t Classifier::PrefixXorClmul(const std::uint64_t mask) noexcept {
+        const __m128i product = _mm_clmulepi64_si128(_mm_set_epi64x(0,static_cast<long long>(mask)),
+            _mm_set1_epi8(-1),
+            0);
+        return static_cast<std::uint64_t>(_mm_cvtsi128_si64(product));
+    }
+WL_TARGET_REGION_END
+#endif
+
+    bool Classifier::IsSupported(const ClassificationKernel kernel) noexcept {
+        const CpuFeatures& host = CpuFeatures::Host();
+        switch (kernel) {
+            case ClassificationKernel::Scalar:
+                return true;
+            case ClassificationKernel::Sse42:
+                return host.Sse42;
+            case ClassificationKernel::Avx2:
+                return host.Avx2;
+            case ClassificationKernel::Avx512:
+                return host.Avx512BW;
+            case ClassificationKernel::Default:
+            default:
+                return false;
+        }
+    }
+
+    ClassificationKernel Classifier::Widest() noexcept {
+        for (const auto kernel : {ClassificationKernel::Avx512,ClassificationKernel::Avx2,ClassificationKernel::Sse42}) {
+            if (IsSupported(kernel)) {
+                return kernel;
+            }
+        }
+        return ClassificationKernel::Scalar;
+    }
+
+    std::uint64_t Classifier::ClassifyParallel(const Kernel kernel,
+        const std::uint8_t *const text,
+        const std::size_t blocksCount,
+        TokenizationBlock *const blocks,
+        const std::uint32_t threads) noexcept {
+        const std::size_t chunks = std::min<std::size_t>(threads, blocksCount / MinBlocksPerThread);
+        if (chunks <= 1) {
+            return kernel(text,blocksCount,blocks,0);
+        }
+        const std::size_t chunkBlocks = (blocksCount + chunks - 1) / chunks;
+        std::vector<std::uint64_t> carries(chunks,0);
+        const auto classifyChunk = [&](const std::size_t chunk) noexcept {
+            const std::size_t first = chunk * chunkBlocks;
+            const std::size_t count = std::min(chunkBlocks,blocksCount - first);
+            carries[chunk] = kernel(text + first * TokenizationBlock::Width,count,blocks + first,0);
+        };
+
+        ParallelFor(chunks,classifyChunk);
+
+        std::uint64_t carry = carries[0];
+        for (std::size_t chunk = 1; chunk < chunks; ++chunk) {
+            const std::size_t first = chunk * chunkBlocks;
+            carry = FixupChunkHead(kernel,
+                text + first * TokenizationBlock::Width,
+                std::min(chunkBlocks,blocksCount - first),
+                blocks + first,
+                carry,
+                carries[chunk]);
+        }
+        return carry;
+    }
+}
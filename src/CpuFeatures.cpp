@@ -0,0 +1,85 @@
+﻿#include <cstdint>
+#include "../include/Utilities/CpuFeatures.h"
+
+#if WL_ARCH_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace WideLips {
+#if WL_ARCH_X86
+    namespace {
+        struct CpuIdRegisters final {
+            std::uint32_t Eax = 0;
+            std::uint32_t Ebx = 0;
+            std::uint32_t Ecx = 0;
+            std::uint32_t Edx = 0;
+        };
+
+        CpuIdRegisters CpuId(const std::uint32_t leaf, const std::uint32_t subLeaf) noexcept {
+            CpuIdRegisters registers;
+#ifdef _MSC_VER
+            int info[4];
+            __cpuidex(info, static_cast<int>(leaf), static_cast<int>(subLeaf));
+            registers = {static_cast<std::uint32_t>(info[0]), static_cast<std::uint32_t>(info[1]),
+                static_cast<std::uint32_t>(info[2]), static_cast<std::uint32_t>(info[3])};
+#else
+            __cpuid_count(leaf, subLeaf, registers.Eax, registers.Ebx, registers.Ecx, registers.Edx);
+#endif
+            return registers;
+        }
+
+        std::uint64_t ExtendedControlRegister() noexcept {
+#ifdef _MSC_VER
+            return _xgetbv(0);
+#else
+            //'_xgetbv' needs '-mxsave' on GCC/clang, the raw instruction doesn't
+            std::uint32_t low, high;
+            __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+            return (static_cast<std::uint64_t>(high) << 32) | low;
+#endif
+        }
+
+        bool HasBit(const std::uint32_t reg, const std::uint32_t bit) noexcept {
+            return (reg >> bit) & 0x1U;
+        }
+
+        CpuFeatures ProbeHost() noexcept {
+            CpuFeatures features;
+            const std::uint32_t maxLeaf = CpuId(0, 0).Eax;
+            if (maxLeaf < 1) {
+                return features;
+            }
+            const CpuIdRegisters leaf1 = CpuId(1, 0);
+            //SSE4.2 implies SSSE3 on every shipped CPU, but 'pshufb' is what we need so both are checked
+            features.Sse42 = HasBit(leaf1.Ecx, 9) and HasBit(leaf1.Ecx, 20);
+            //carry-less multiplication only needs the XMM state, which every x86-64 OS saves
+            features.Pclmul = HasBit(leaf1.Ecx, 1);
+            //without OSXSAVE the OS won't preserve YMM/ZMM registers so AVX can't be used even if the CPU has it
+            if (!HasBit(leaf1.Ecx, 27) or !HasBit(leaf1.Ecx, 28) or maxLeaf < 7) {
+                return features;
+            }
+            const std::uint64_t xcr0 = ExtendedControlRegister();
+            const bool ymmState = (xcr0 & 0x6U) == 0x6U;
+            const bool zmmState = (xcr0 & 0xE6U) == 0xE6U;
+            const CpuIdRegisters leaf7 = CpuId(7, 0);
+            features.Avx2 = ymmState and HasBit(leaf7.Ebx, 5);
+            features.Avx512BW = zmmState and HasBit(leaf7.Ebx, 16) and HasBit(leaf7.Ebx, 30);
+            return features;
+        }
+    }
+
+    const CpuFeatures& CpuFeatures::Host() noexcept {
+        static const CpuFeatures features = ProbeHost();
+        return features;
+    }
+#else
+    const CpuFeatures& CpuFeatures::Host() noexcept {
+        static constexpr CpuFeatures features{};
+        return features;
+    }
+#endif
+}
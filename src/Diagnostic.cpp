@@ -71,6 +71,7 @@ namespace WideLips::Diagnostic {
             case ParsingErrorCode::NoMatchingCloseParenthesis: return L"LISP1008";
             case ParsingErrorCode::FetchingAuxiliaryOfLazyToken: return L"LISP1009";
             case ParsingErrorCode::UnexpectedTopLevelToken: return L"LISP1010";
+            case ParsingErrorCode::ArenasExhausted: return L"LISP1011";
             default: return L"unknown";
         }
     }
@@ -101,10 +102,10 @@ namespace WideLips::Diagnostic {
     LispDiagnostic DiagnosticFactory::UnexpectedToken(const std::wstring_view file,
         const std::uint32_t line,
         const std::uint32_t col,
-        const LispToken& unexpectedToken) {
+        const std::string_view unexpectedToken) {
         return LispDiagnostic {
             std::move(Create(file, line, col, Severity::Error, ErrorCodeToString(ParsingErrorCode::SyntaxError),
-                std::format(L"Syntax error, unexpected token '{}' ", WidenString(unexpectedToken.GetText())))),
+                std::format(L"Syntax error, unexpected token '{}' ", WidenString(unexpectedToken)))),
             Severity::Error
         };
     }
@@ -132,10 +133,10 @@ namespace WideLips::Diagnostic {
     LispDiagnostic DiagnosticFactory::UnrecognizedToken(const std::wstring_view file,
         const std::uint32_t line,
         const std::uint32_t col,
-        const LispToken& unrecognizedToken) {
+        const std::string_view unrecognizedToken) {
         return LispDiagnostic{
             Create(file, line, col, Severity::Error, ErrorCodeToString(ParsingErrorCode::UnrecognizedToken),
-                     std::format(L"Unrecognized token, '{}' ", WidenString(unrecognizedToken.GetText()))),
+                     std::format(L"Unrecognized token, '{}' ", WidenString(unrecognizedToken))),
             Severity::Error
         };
     }
@@ -163,24 +164,22 @@ namespace WideLips::Diagnostic {
 
     LispDiagnostic DiagnosticFactory::NoMatchingOpenParenthesis(const std::wstring_view file,
         const std::uint32_t line,
-        const std::uint32_t column,
-        const LispToken &closingParenthesis) {
+        const std::uint32_t column) {
         return LispDiagnostic{
             Create(file, line, column, Severity::Error, ErrorCodeToString(ParsingErrorCode::NoMatchingOpenParenthesis),
                std::format(L"closing parenthesis at ({},{}) does not have an opening parenthesis",
-                   closingParenthesis.Line,closingParenthesis.Column)),
+                   line,column)),
             Severity::Error
         };
     }
 
     LispDiagnostic DiagnosticFactory::NoMatchingCloseParenthesis(const std::wstring_view file,
         const std::uint32_t line,
-        const std::uint32_t column,
-        const LispToken &openingParenthesis) {
+        const std::uint32_t column) {
         return LispDiagnostic{
             Create(file, line, column, Severity::Error, ErrorCodeToString(ParsingErrorCode::NoMatchingCloseParenthesis),
                std::format(L"open parenthesis at ({},{}) does not have a closing parenthesis",
-                   openingParenthesis.Line,openingParenthesis.Column)),
+                   line,column)),
             Severity::Error
         };
     }
@@ -188,11 +187,11 @@ namespace WideLips::Diagnostic {
     LispDiagnostic DiagnosticFactory::FetchingAuxiliaryOfLazyToken(const std::wstring_view file,
         std::uint32_t line,
         std::uint32_t column,
-        const LispToken &lazyToken) {
+        const std::string_view lazyToken) {
         return LispDiagnostic{
             Create(file, line, column, Severity::Error, ErrorCodeToString(ParsingErrorCode::FetchingAuxiliaryOfLazyToken),
                std::format(L"getting auxiliary of lazy token '{}' at ({},{}) is prohibited",
-                   WidenString(lazyToken.GetText()),line,column)),
+                   WidenString(lazyToken),line,column)),
             Severity::Error
         };
     }
@@ -207,6 +206,17 @@ namespace WideLips::Diagnostic {
         };
     }
 
+    LispDiagnostic DiagnosticFactory::ArenasExhausted(const std::wstring_view file,
+        const std::uint32_t line,
+        const std::uint32_t column) {
+        return LispDiagnostic{
+            Create(file, line, column, Severity::Error, ErrorCodeToString(ParsingErrorCode::ArenasExhausted),
+               std::format(L"no room left to materialize the tokens at ({},{}), reuse or reset the lexer first",
+                   line,column)),
+            Severity::Error
+        };
+    }
+
     std::wstring_view DiagnosticParser::GetFilePathView(std::wstring_view diagnosticString) {
         if (const size_t openParen = diagnosticString.find('('); openParen != std::string_view::npos && openParen > 0) {
             return diagnosticString.substr(0, openParen);
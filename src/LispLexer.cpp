@@ -1,9 +1,16 @@
-﻿#include <bit>
+﻿#include <algorithm>
+#include <bit>
+#include <cstring>
 #include <memory_resource>
 #include <filesystem>
-#include "../include/AVX.h"
+#include <span>
+#include <thread>
+#include <tuple>
+#include <vector>
 #include "../include/LispLexer.h"
 #include "../include/Utilities/AlignedFileReader.h"
+#include "../include/Utilities/BluePassCache.h"
+#include "../include/Utilities/ParallelFor.h"
 #include "Config.h"
 
 namespace WideLips {
@@ -12,6 +19,35 @@ namespace WideLips {
         return 1U << ((sizeof(x)*8)-std::countl_zero(x));
     }
 
+    namespace {
+        //compact tokens don't carry lines and columns of their own, locations are always lazy with them
+        constexpr SourceLocations LocationsOf(const LispLexerOptions& options) noexcept {
+#ifdef WL_COMPACT_TOKENS
+            (void)options;
+            return SourceLocations::Lazy;
+#else
+            return options.Locations;
+#endif
+        }
+
+        //every token, S-expression and auxiliary consumes at least one byte of text (but the end of file token), so
+        //the text size bounds how many of them a pass emits. the tokens arenas reserve that much address space, but
+        //never less than the estimate they used to be allocated with since tokens pile up when a lexer is reused
+        std::size_t ReservationOf(const std::size_t fileSize) noexcept {
+            return std::max<std::size_t>(AlignToPowOfTow(ArenaSizeEstimate(fileSize,false)),fileSize + PaddingSize);
+        }
+
+        //the escape carry a block starting at 'at' is classified with, an odd run of backslashes right before it
+        //leaves the last of them unescaped
+        std::uint64_t EscapeCarryAt(const std::string_view text,const std::size_t at) noexcept {
+            std::size_t backslashes = 0;
+            while (backslashes < at && text[at - 1 - backslashes] == '\\') {
+                ++backslashes;
+            }
+            return backslashes & 1U;
+        }
+    }
+
     std::size_t ArenaSizeEstimate(const std::size_t fileSize, const bool conservative) {
         constexpr std::size_t kiloByte = 1024;
         constexpr std::size_t megaByte = 1024 * kiloByte;
@@ -43,28 +79,97 @@ namespace WideLips {
     LispLexer::LispLexer(UNUSED ConstructorEnabler enabler,
         const std::string_view file,
         const std::wstring_view filePath,
-        const bool conservative):
-    _blocks(AlignToPowOfTow(file.size() / 32 == 0 ? 1 : file.size() / 32 + 1)),
-    _sexprIndices(AlignToPowOfTow(ArenaSizeEstimate(file.size(), conservative)/2)),
-    _tokens(AlignToPowOfTow(ArenaSizeEstimate(file.size(), conservative))),
-    _auxiliaries(AlignToPowOfTow(ArenaSizeEstimate(file.size(), conservative)/2)),
+        UNUSED const bool conservative,
+        const LispLexerOptions& options):
+    _blocks(AlignToPowOfTow(file.size() / TokensInBlock + 1),options.Pool,options.HugePages),
+    _sexprIndices(ReservationOf(file.size()),options.Pool,options.HugePages),
+    _tokens(ReservationOf(file.size()),options.Pool,options.HugePages),
+    _auxiliaries(ReservationOf(file.size()),options.Pool,options.HugePages),
+    _lineRanks(LocationsOf(options) == SourceLocations::Lazy ? AlignToPowOfTow(file.size() / TokensInBlock + 1) : 1,
+        options.Pool,
+        options.HugePages),
+    _tokenColumns(options.TokenColumns ? ReservationOf(file.size()) : 1,
+        options.Kernel,
+        options.Pool,
+        options.HugePages),
     _diagnostics(1024),
+    _classifier(Classifier::Resolve(options.Kernel)),
+    _prefixXor(Classifier::ResolvePrefixXor(options.Kernel)),
+    _threads(options.Threads != 0 ? options.Threads : std::max(std::thread::hardware_concurrency(),1U)),
+    _blueEngine(options.BlueEngine),
+    _locations(LocationsOf(options)),
+    _keepTokenColumns(options.TokenColumns),
+    _kernel(options.Kernel),
+    _capacities(options.SampleArenas ? SampleArenaCapacities(file,options.Kernel) : ArenaCapacities{}),
+    _cache(options.Cache),
+    _origin(nullptr),
+    _pool(options.Pool),
+    _hugePages(options.HugePages),
+    _concurrent(options.Concurrent),
     _filePath(filePath),
-    _text(file) {
+    _text(file),
+    _tokenizingThread(std::this_thread::get_id()) {
+        if (options.SampleArenas) {
+            CommitSampledArenas();
+        }
+    }
 
+    //a shard reads the blocks, S-expressions and line ranks of its origin in place, and only ever materializes
+    //S-expressions the blue pass of its origin matched, so it starts out tokenized
+    LispLexer::LispLexer(UNUSED ConstructorEnabler enabler,const LispLexer& origin):
+    _blocks(origin._blocks.Borrow()),
+    _sexprIndices(origin._sexprIndices.Borrow()),
+    _tokens(ReservationOf(origin._text.size()),origin._pool,origin._hugePages),
+    _auxiliaries(ReservationOf(origin._text.size()),origin._pool,origin._hugePages),
+    _lineRanks(origin._lineRanks.Borrow()),
+    _tokenColumns(1,origin._kernel),
+    _diagnostics(1024),
+    _classifier(origin._classifier),
+    _prefixXor(origin._prefixXor),
+    _threads(1),
+    _blueEngine(origin._blueEngine),
+    _locations(origin._locations),
+    _keepTokenColumns(false),
+    _kernel(origin._kernel),
+    _capacities{},
+    _cache(nullptr),
+    _origin(&origin),
+    _pool(origin._pool),
+    _hugePages(origin._hugePages),
+    _concurrent(true),
+    _filePath(origin._filePath),
+    _text(origin._text),
+    _tokenized(true),
+    _wellFormed(origin._wellFormed) {
+    }
+
+    void LispLexer::CommitSampledArenas() noexcept {
+        _sexprIndices.CommitFor(_capacities.SExprIndices);
+        _tokens.CommitFor(_capacities.Tokens);
+        _auxiliaries.CommitFor(_capacities.Auxiliaries);
+        if (_keepTokenColumns) {
+            _tokenColumns.CommitFor(_capacities.Tokens);
+        }
     }
 
     std::unique_ptr<LispLexer> LispLexer::Make(AlignedFileReadResult& alignedFile,
         const std::wstring_view fileName,
-        const bool conservative) {
+        const bool conservative,
+        const LispLexerOptions& options) {
         if (!alignedFile) {
             return nullptr;
         }
-        return std::make_unique<LispLexer>(CtorEnabler,std::string_view(alignedFile.get()),fileName,conservative);
+        return std::make_unique<LispLexer>(CtorEnabler,AlignedFileReader::TextOf(alignedFile),fileName,conservative,options);
+    }
+
+    std::unique_ptr<LispLexer> LispLexer::Make(std::string_view program,
+        const bool conservative,
+        const LispLexerOptions& options) {
+        return std::make_unique<LispLexer>(CtorEnabler,program,L"memory",conservative,options);
     }
 
-    std::unique_ptr<LispLexer> LispLexer::Make(std::string_view program, const bool conservative) {
-        return std::make_unique<LispLexer>(CtorEnabler,program,L"memory",conservative);
+    bool LispLexer::IsKernelSupported(const ClassificationKernel kernel) noexcept {
+        return Classifier::IsSupported(kernel);
     }
 
     bool LispLexer::Tokenize() noexcept{
@@ -75,7 +180,9 @@ namespace WideLips {
             return false;
 #endif
         }
-        return TokenizeBlue();
+        _tokenizingThread = std::this_thread::get_id();
+        _shards.Clear();
+        return _cache != nullptr ? TokenizeCached() : TokenizeBlue();
     }
 
     LispLexer::OptRegionOfTokens LispLexer::TokenizeFirstSExpr() noexcept{
@@ -87,12 +194,17 @@ namespace WideLips {
             return std::nullopt;
         }
         const SExprIndex& firstSExpr = _sexprIndices[0];
+        if (!HasRoomFor(2)) [[unlikely]] {
+            ReportArenasExhausted(OpenLocationOf(firstSExpr));
+            return std::nullopt;
+        }
+        NoteMaterialized(0);
         const char optSegOrComment = *_text.data();
         LispToken* firstSExprBegin = nullptr;
         if (IsComment(optSegOrComment) or IsFragment(optSegOrComment)) {
             //span of first auxiliary is from 0 to first SExpr in file
             _auxiliaries.EmplaceBack({0,firstSExpr.Open});
-            firstSExprBegin = _tokens.EmplaceBack(LispToken{
+            firstSExprBegin = EmitToken(
                 _text.data()+firstSExpr.Open,
                 firstSExpr.OpenLine,
                 1,
@@ -101,10 +213,10 @@ namespace WideLips {
                 0,
                 LispTokenKind::LeftParenthesis,
                 1
-            });
+            );
         }
         else {
-            firstSExprBegin = _tokens.EmplaceBack(LispToken{
+            firstSExprBegin = EmitToken(
                 _text.data()+firstSExpr.Open,
                 firstSExpr.OpenLine,
                 1,
@@ -113,10 +225,10 @@ namespace WideLips {
                 0,
                 LispTokenKind::LeftParenthesis,
                 0
-            });
+            );
         }
 
-        const LispToken* const firstSExprEnd = _tokens.EmplaceBack(LispToken{
+        const LispToken* const firstSExprEnd = EmitToken(
                _text.data()+firstSExpr.Close,
                firstSExpr.CloseLine,
                1,
@@ -125,7 +237,7 @@ namespace WideLips {
                0,
                LispTokenKind::RightParenthesis,
             std::numeric_limits<std::uint8_t>::max() //special value indicating that auxiliary of SExpr is not yet computaed
-           });
+           );
         return std::make_optional<RegionOfTokens>(firstSExprBegin,firstSExprEnd);
     }
 
@@ -133,19 +245,29 @@ namespace WideLips {
 #ifndef NDEBUG
         assert(token->Kind == LispTokenKind::LeftParenthesis);
 #endif
-        const SExprIndex& currentSExprIndex = _sexprIndices[token->IndexInSpecialStream];
-        if (currentSExprIndex.Next >= _sexprIndices.Size()) {
+        return TokenizeAfter(token->IndexInSpecialStream);
+    }
+
+    LispLexer::OptRegionOfTokens LispLexer::TokenizeAfter(const std::uint32_t sexprIndex) noexcept {
+        const SExprIndex& currentSExprIndex = _sexprIndices[sexprIndex];
+        //the 'Next' of an unclosed S-expression doesn't move forward, no S-expression follows it
+        if (currentSExprIndex.Next >= _sexprIndices.Size() || currentSExprIndex.Next <= sexprIndex) {
             return std::nullopt;
         }
         const std::uint32_t nextSExprPos = currentSExprIndex.Next;
         const SExprIndex& nextSExpr = _sexprIndices[nextSExprPos];
+        if (!HasRoomFor(2)) [[unlikely]] {
+            ReportArenasExhausted(OpenLocationOf(nextSExpr));
+            return std::nullopt;
+        }
+        NoteMaterialized(nextSExprPos);
         const LispToken* nextSExprBegin = nullptr;
         const std::uint32_t optSegOrCommentIndex = currentSExprIndex.Close+1;
         const char optSegOrComment = *(_text.data() + optSegOrCommentIndex);
 
         if (IsComment(optSegOrComment) or IsFragment(optSegOrComment)) {
             _auxiliaries.EmplaceBack({optSegOrCommentIndex,nextSExpr.Open-optSegOrCommentIndex});
-            nextSExprBegin = _tokens.EmplaceBack(LispToken{
+            nextSExprBegin = EmitToken(
                 _text.data()+nextSExpr.Open,
                 nextSExpr.OpenLine,
                 1,
@@ -154,10 +276,10 @@ namespace WideLips {
                 nextSExprPos,
                 LispTokenKind::LeftParenthesis,
                 1
-            });
+            );
         }
         else {
-            nextSExprBegin = _tokens.EmplaceBack(LispToken{
+            nextSExprBegin = EmitToken(
                 _text.data()+nextSExpr.Open,
                 nextSExpr.OpenLine,
                 1,
@@ -166,10 +288,10 @@ namespace WideLips {
                 nextSExprPos,
                 LispTokenKind::LeftParenthesis,
                 std::numeric_limits<std::uint8_t>::max()
-            });
+            );
         }
 
-        const LispToken* const nextSExprEnd = _tokens.EmplaceBack(LispToken{
+        const LispToken* const nextSExprEnd = EmitToken(
                _text.data()+nextSExpr.Close,
                nextSExpr.CloseLine,
                1,
@@ -178,13 +300,39 @@ namespace WideLips {
                nextSExprPos,
                LispTokenKind::RightParenthesis,
                std::numeric_limits<std::uint8_t>::max()
-           });
+           );
 
         return std::make_optional<RegionOfTokens>(nextSExprBegin,nextSExprEnd);
     }
 
+    std::vector<std::uint32_t> LispLexer::GetTopLevelSExprIndices() const {
+        std::vector<std::uint32_t> forms;
+        for (std::uint32_t form = 0; form < _sexprIndices.Size(); ) {
+            forms.push_back(form);
+            //the chain ends at an unclosed S-expression, whose 'Next' doesn't move forward
+            if (_sexprIndices[form].Next <= form) {
+                break;
+            }
+            form = _sexprIndices[form].Next;
+        }
+        return forms;
+    }
+
+    //a top level S-expression materialized again or before the last one puts the arenas out of text order
+    void LispLexer::NoteMaterialized(const std::uint32_t form) noexcept {
+        _materializedInOrder &= _lastMaterializedForm == NoSExprIndex || form > _lastMaterializedForm;
+        _lastMaterializedForm = form;
+    }
+
+    bool LispLexer::IsConcurrent() const noexcept {
+        return _concurrent;
+    }
+
     LispLexer::OptRegionOfTokens LispLexer::TokenizeSExpr(const LispToken *begin,const bool csEmptySExpr) noexcept {
-        return TokenizeSExprCore(begin,csEmptySExpr);
+        if (_locations == SourceLocations::Lazy) {
+            return TokenizeSExprCore<true>(begin,csEmptySExpr);
+        }
+        return TokenizeSExprCore<false>(begin,csEmptySExpr);
     }
 
     LispLexer::OptRegionOfTokens LispLexer::GetTokenAuxiliary(const LispToken* token) noexcept {
@@ -192,11 +340,19 @@ namespace WideLips {
         if (auxiliaryLength == 0 or auxiliaryLength == std::numeric_limits<std::uint8_t>::max()) {
             return std::nullopt;
         }
+        if (!HasRoomFor(auxiliaryLength)) [[unlikely]] {
+            ReportArenasExhausted(GetSourceLocation(token));
+            return std::nullopt;
+        }
+        //the auxiliaries of a token of an S-expression before the last one materialized land out of text order
+        _materializedInOrder &= _lastMaterializedForm != NoSExprIndex &&
+            token->GetByteLocation(_text.data()) >= _sexprIndices[_lastMaterializedForm].Open;
         const auto auxiliaryIndex = token->AuxiliaryIndex;
         const auto auxiliaryTokenBegin = _tokens.Size();
+        const LispLexer* const emitter = _concurrent ? EmitterOf(token) : this;
         for (int i=0;i<auxiliaryLength;++i) {
-            const auto [at, length] = _auxiliaries[auxiliaryIndex+i];
-            _tokens.EmplaceBack(LispToken{
+            const auto [at, length] = emitter->_auxiliaries[auxiliaryIndex+i];
+            EmitToken(
                 _text.data()+at,
                 std::numeric_limits<std::uint32_t>::max(),
                 length,
@@ -205,11 +361,83 @@ namespace WideLips {
                 0,
                 LispTokenKind::Fragment,
                 0
-            });
+            );
         }
         return std::make_pair(&_tokens[auxiliaryTokenBegin],&_tokens[auxiliaryTokenBegin+auxiliaryLength-1]);
     }
 
+    //the tokens and auxiliaries materialized from a stretch of text are never more than its bytes, so that much room is
+    //checked for before it's materialized. materializing the same S-expressions over and over still piles up tokens
+    //until the lexer is reused or reset, which is reported rather than run past the reservations
+    bool LispLexer::HasRoomFor(const std::size_t count) const noexcept {
+        return _tokens.Size() + count <= _tokens.Capacity() &&
+            _auxiliaries.Size() + count <= _auxiliaries.Capacity() &&
+            (!_keepTokenColumns || _tokenColumns.Size() + count <= _tokenColumns.Capacity());
+    }
+
+    NOINLINE void LispLexer::ReportArenasExhausted(const SourceLocation& location) {
+        _diagnostics.EmplaceBack(Diagnostic::DiagnosticFactory::ArenasExhausted(_filePath,
+            location.Line,
+            location.ColumnChar));
+    }
+
+    bool LispLexer::HoldsToken(const LispToken* token) const noexcept {
+        return token >= _tokens.begin() && token < _tokens.begin() + _tokens.Capacity();
+    }
+
+    //a token's auxiliaries are indices into the auxiliaries of the lexer that emitted it, which for a concurrent
+    //lexer is any of the origin and its shards. the reservations of their arenas never overlap
+    const LispLexer* LispLexer::EmitterOf(const LispToken* token) const noexcept {
+        if (HoldsToken(token)) {
+            return this;
+        }
+        const LispLexer* const origin = _origin != nullptr ? _origin : this;
+        if (origin->HoldsToken(token)) {
+            return origin;
+        }
+        const LispLexer* emitter = this;
+        origin->_shards.ForEach([&](const LispLexer& shard) {
+            if (shard.HoldsToken(token)) {
+                emitter = &shard;
+            }
+        });
+        return emitter;
+    }
+
+    LispLexer* LispLexer::Local() {
+        if (_origin != nullptr || OnTokenizingThread()) {
+            return this;
+        }
+        return &_shards.Local([this] { return std::make_unique<LispLexer>(CtorEnabler,*this); });
+    }
+
+    bool LispLexer::OnTokenizingThread() const noexcept {
+        return !_concurrent || std::this_thread::get_id() == _tokenizingThread;
+    }
+
+    void LispLexer::GatherDiagnostics() {
+        _shards.ForEach([this](LispLexer& shard) {
+            for (const Diagnostic::LispDiagnostic& diagnostic : shard._diagnostics) {
+                _diagnostics.EmplaceBack(Diagnostic::LispDiagnostic(std::wstring(diagnostic.GetFullMessage()),
+                    diagnostic.GetSeverity()));
+            }
+            shard._diagnostics.Reuse();
+        });
+    }
+
+    SourceLocation LispLexer::GetSourceLocation(const LispToken *token) const noexcept {
+#ifndef WL_COMPACT_TOKENS
+        if (_locations == SourceLocations::Eager) {
+            return SourceLocation{token->Line,token->Column};
+        }
+#endif
+        //the end of file token doesn't point into the text, it stands right after it
+        if (token->Kind == LispTokenKind::EndOfFile) {
+            return LocationAt(static_cast<std::uint32_t>(_text.size() - PaddingSize));
+        }
+        return LocationAt(token->GetByteLocation(_text.data()));
+    }
+
     BumpVector<Diagnostic::LispDiagnostic> &LispLexer::GetDiagnostics() noexcept {
         return _diagnostics;
     }
@@ -218,164 +446,754 @@ namespace WideLips {
         return _text.size()-32;
     }
 
+    //tokens are only ever materialized through here, so neither their layout nor their columns leak into the passes
+    ALWAYS_INLINE LispToken* LispLexer::EmitToken(const char* at,
+        const std::uint32_t line,
+        const std::uint32_t length,
+        const std::uint32_t auxiliaryIndex,
+        const std::uint32_t column,
+        const std::uint32_t indexInSpecialStream,
+        const LispTokenKind kind,
+        const std::uint8_t auxiliaryLength) noexcept {
+        const auto offset = static_cast<std::uint32_t>(at - _text.data());
+#ifdef WL_COMPACT_TOKENS
+        (void)line;
+        (void)column;
+        const bool parenthesis = kind == LispTokenKind::LeftParenthesis or kind == LispTokenKind::RightParenthesis;
+#ifndef NDEBUG
+        assert(!parenthesis or length == 1);
+#endif
+        LispToken token{offset,auxiliaryIndex,parenthesis ? indexInSpecialStream : length,kind,auxiliaryLength};
+#else
+        LispToken token{at,line,length,auxiliaryIndex,column,indexInSpecialStream,kind,auxiliaryLength};
+#endif
+        if (_keepTokenColumns) {
+            _tokenColumns.Append(token,offset);
+        }
+        return _tokens.EmplaceBack(std::move(token));
+    }
+
+    const ArenaCapacities & LispLexer::GetArenaCapacities() const noexcept {
+        return _capacities;
+    }
+
+    const LispTokenColumns * LispLexer::GetTokenColumns() const noexcept {
+        return _keepTokenColumns ? &_tokenColumns : nullptr;
+    }
+
     const char * LispLexer::GetTextData() const noexcept {
         return _text.data();
     }
 
+    //the tokens go along with the S-expressions they were materialized for, a parse tree of the text is gone as well
     void LispLexer::Reuse() noexcept {
+        _shards.Clear();
         _reused = true;
+        _materializedInOrder = true;
+        _lastMaterializedForm = NoSExprIndex;
         _textStreamPos = 0;
         _blocks.Reuse();
         _sexprIndices.Reuse();
+        _tokens.Reuse();
         _auxiliaries.Reuse();
+        _lineRanks.Reuse();
+        _tokenColumns.Reuse();
     }
 
-    std::wstring_view LispLexer::GetFilePath() const noexcept {
-        return _filePath;
+    //points the lexer to another text while keeping its arenas, which were sized for a text at least as large
+    void LispLexer::Rebind(const std::string_view text) noexcept {
+        _shards.Clear();
+        _text = text;
+        _currentTokenAuxiliary = 0;
+        _sexprIndex = 0;
+        _tokenStreamPos = 0;
+        _textStreamPos = 0;
+        _line = 1;
+        _column = 1;
+        _tokenized = false;
+        _reused = false;
+        _blocks.Reuse();
+        _sexprIndices.Reuse();
+        _tokens.Reuse();
+        _auxiliaries.Reuse();
+        _lineRanks.Reuse();
+        _tokenColumns.Reuse();
+        _materializedInOrder = true;
+        _lastMaterializedForm = NoSExprIndex;
+        _diagnostics.Reuse();
     }
 
-    NODISCARD ALWAYS_INLINE PURE std::uint32_t ComputeNonEscapingDoubleQuotes(const std::uint32_t backslashMask,
-       const std::uint32_t doubleQuoteMask) {
-        const auto escapeCheckMask = backslashMask << 1;
-        const auto oddEscapeCheckMask = escapeCheckMask | 0xAAAAAAAAU;
-        const auto escapeDetectionMask = oddEscapeCheckMask - backslashMask;
-        const auto escapeAndNonEscapeMask = escapeDetectionMask ^ 0xAAAAAAAAU;
-        return ~(escapeAndNonEscapeMask ^ backslashMask) & doubleQuoteMask;
+    //makes room for a text of 'textSize' bytes, arenas too small for it are reserved again and what they held is gone
+    void LispLexer::ReserveFor(const std::size_t textSize) noexcept {
+        const std::size_t reservation = ReservationOf(textSize);
+        const std::size_t blocksCount = AlignToPowOfTow(textSize / TokensInBlock + 1);
+        _blocks.Reserve(blocksCount);
+        _sexprIndices.Reserve(reservation);
+        _tokens.Reserve(reservation);
+        _auxiliaries.Reserve(reservation);
+        if (_locations == SourceLocations::Lazy) {
+            _lineRanks.Reserve(blocksCount);
+        }
+        if (_keepTokenColumns) {
+            _tokenColumns.Reserve(reservation);
+        }
     }
 
-    ALWAYS_INLINE void LispLexer::Classify() {
-        const auto address = reinterpret_cast<const std::uint8_t*>(_text.data());
-        std::uint32_t prevTileEndWithOddBackslash = 0x0;
-        const std::size_t textSize = _text.size();
-        const std::size_t vectorAlignedSize = textSize & ~31u;
+    //an edit keeps the tokens materialized before it, so the arenas holding them are rewound and reserved for twice
+    //the text, which leaves as much room for the tokens materialized after an edit as there was before it
+    void LispLexer::ReserveForEdits(const std::size_t textSize) noexcept {
+        const std::size_t reservation = 2 * ReservationOf(textSize);
+        _materializedInOrder = true;
+        _lastMaterializedForm = NoSExprIndex;
+        _tokens.Reuse();
+        _auxiliaries.Reuse();
+        _tokenColumns.Reuse();
+        _tokens.Reserve(reservation);
+        _auxiliaries.Reserve(reservation);
+    }
 
-        alignas(32) static const Vector256 sexprAndOpsTable { //not all operators are covered only those fallen within the targeted range
-            '=','/','.','-',CommaChar,'+','*',')',
-            '(','\'','&','%',DollarChar,HashChar,0,'!',
-            '=','/','.','-',CommaChar,'+','*',')',
-            '(','\'','&','%',DollarChar,HashChar,0,'!'
-        };
+    void LispLexer::Reset(const std::string_view text,const std::wstring_view filePath) noexcept {
+        ReserveFor(text.size());
+        //sampled capacities are only ever zero when sampling is off
+        if (_capacities.Tokens != 0) {
+            _capacities = SampleArenaCapacities(text,_kernel);
+            CommitSampledArenas();
+        }
+        _filePath = filePath;
+        Rebind(text);
+    }
 
-        alignas(32) static const Vector256 otherOpsAndStructTable {
-            AtChar,TildaChar,0,0,0,0,LeftBracketChar,RightBracketChar,
-            QuasiColumnChar,0,0,0,0,0,ColumnChar,'|',
-            AtChar,TildaChar,0,0,0,0,LeftBracketChar,RightBracketChar,
-            QuasiColumnChar,0,0,0,0,0,ColumnChar,'|'
-        };
+    LispEdit LispLexer::ApplyEdit(const std::uint32_t offset,
+        const std::uint32_t removedLength,
+        const std::string_view insertedText) {
+        const std::size_t fileSize = GetFileSize();
+        if (offset > fileSize || removedLength > fileSize - offset) {
+#ifndef NDEBUG
+            assert(!"the edit must lie within the text");
+#endif
+            return LispEdit{};
+        }
+        //the shards point into the text and blue pass about to change, the tokens they materialized are gone with them
+        const bool sharded = !_shards.Empty();
+        _shards.Clear();
+        const std::size_t oldTextSize = _text.size();
+        const std::size_t textSize = oldTextSize - removedLength + insertedText.size();
+        //offsets past the edit move by it, modulo 2^32 as they are unsigned
+        const auto shift = static_cast<std::uint32_t>(insertedText.size() - removedLength);
+        const bool lazyLocations = _locations == SourceLocations::Lazy;
+        const bool piecewise = _tokenized && _wellFormed;
+        //materialized tokens point into the text, so they can only outlive an edit of the copy they point into
+        const bool inPlace = _text.data() == _editedText.data() && textSize <= _editedText.capacity();
+
+        //the top level S-expressions are chained by 'Next', the ones closing before the edit are kept and so are the
+        //ones opening after it, those in between are matched again along with the trivia around them
+        const auto sexprCount = static_cast<std::uint32_t>(_sexprIndices.Size());
+        std::uint32_t previous = NoSExprIndex;
+        std::uint32_t following = 0;
+        std::uint32_t removedForms = 0;
+        while (piecewise && following < sexprCount && _sexprIndices[following].Close < offset) {
+            previous = following;
+            following = _sexprIndices[following].Next;
+        }
+        const std::uint32_t firstIndex = following;
+        std::uint32_t lastBefore = previous;
+        while (piecewise && following < sexprCount && _sexprIndices[following].Open < offset + removedLength) {
+            ++removedForms;
+            lastBefore = following;
+            following = _sexprIndices[following].Next;
+        }
+        const bool hasFollowing = piecewise && following < sexprCount;
+        const std::uint32_t regionStart = previous != NoSExprIndex ? _sexprIndices[previous].Close + 1 : 0;
+        const std::uint32_t oldRegionEnd = hasFollowing ? _sexprIndices[following].Open : 0;
+        //where the trivia before the S-expression right after the edit starts, nothing materialized for the ones
+        //before it lies past there
+        const std::uint32_t oldGapStart = lastBefore != NoSExprIndex ? _sexprIndices[lastBefore].Close + 1 : 0;
+
+        //the blocks past the edited ones only need classifying again if they moved or their escape carry changed
+        const std::size_t firstBlock = offset >> TokensInBlockPopCnt;
+        const std::size_t editedEnd = (offset + insertedText.size() + TokensInBlockBoundary) >> TokensInBlockPopCnt;
+        const std::size_t carryAt = editedEnd << TokensInBlockPopCnt;
+        const bool sameLength = insertedText.size() == removedLength;
+        const std::uint64_t oldCarry = sameLength && carryAt < oldTextSize ? EscapeCarryAt(_text,carryAt) : 0;
+
+        if (_text.data() != _editedText.data() || textSize > _editedText.capacity()) {
+            //the copy grows ahead of the edits so that a run of small insertions doesn't move it every time
+            std::string edited;
+            edited.reserve(textSize + textSize / 8 + TokensInBlock);
+            edited.assign(_text);
+            _editedText = std::move(edited);
+        }
+        _editedText.replace(offset,removedLength,insertedText);
+        _text = _editedText;
+        _currentTokenAuxiliary = 0;
+        _sexprIndex = 0;
+        _tokenStreamPos = 0;
+        _textStreamPos = 0;
+        _line = 1;
+        _column = 1;
+        _diagnostics.Reuse();
+
+        const std::size_t blocksCount = (textSize + TokensInBlockBoundary) >> TokensInBlockPopCnt;
+        if (!piecewise || blocksCount >= _blocks.Capacity() || ReservationOf(textSize) > _sexprIndices.Capacity() ||
+            (lazyLocations && blocksCount > _lineRanks.Capacity())) {
+            return RetokenizeEdited();
+        }
+        if (sameLength && (carryAt >= textSize || EscapeCarryAt(_text,carryAt) == oldCarry)) {
+            ClassifyBlocks(firstBlock,std::min(editedEnd,blocksCount));
+        }
+        else {
+            _blocks.Truncate(firstBlock);
+            (void)_blocks.Preserve(blocksCount - firstBlock);
+            ClassifyBlocks(firstBlock,blocksCount);
+            _blocks.EmplaceBack(TokenizationBlock{TokenizationMasks{
+                .NewLines = 1U //the sentinel block, see 'Classify'
+            }});
+        }
+        if (lazyLocations) {
+            RankLines(firstBlock);
+        }
 
-        alignas(32) static const Vector256 fragmentsTable {
-            ' ',0,0,0,0,0,0,0,
-            0,'\t','\n',0,0,'\r',0,0,
-            ' ',0,0,0,0,0,0,0,
-            0,'\t','\n',0,0,'\r',0,0,
-        };
+        std::uint32_t startLine = 1;
+        std::uint32_t startLineStart = 0;
+        if (lazyLocations) {
+            const SourceLocation location = LocationAt(regionStart);
+            startLine = location.Line;
+            startLineStart = regionStart + 1 - location.ColumnChar;
+        }
+        else if (previous != NoSExprIndex) {
+            startLine = _sexprIndices[previous].CloseLine;
+            startLineStart = regionStart - _sexprIndices[previous].CloseColumn;
+        }
+        const std::uint32_t regionEnd = hasFollowing ? oldRegionEnd + shift : static_cast<std::uint32_t>(textSize);
+        std::vector<SExprIndex> region;
+        std::uint32_t insertedForms = 0;
+        std::uint32_t endLine = startLine;
+        std::uint32_t endLineStart = startLineStart;
+        if (!MatchSExprRegion(regionStart,regionEnd,firstIndex,region,insertedForms,endLine,endLineStart)) {
+            return RetokenizeEdited();
+        }
+
+        //the S-expressions matched again take the place of the ones the edit overlapped, those after them move
+        const std::uint32_t removedIndices = following - firstIndex;
+        const auto insertedIndices = static_cast<std::uint32_t>(region.size());
+        const std::uint32_t indexShift = insertedIndices - removedIndices;
+        const std::uint32_t followingIndex = firstIndex + insertedIndices;
+        if (insertedIndices > removedIndices) {
+            (void)_sexprIndices.Preserve(insertedIndices - removedIndices);
+        }
+        std::memmove(_sexprIndices.At(followingIndex),
+            _sexprIndices.At(following),
+            (sexprCount - following) * sizeof(SExprIndex));
+        if (insertedIndices < removedIndices) {
+            _sexprIndices.Truncate(sexprCount - (removedIndices - insertedIndices));
+        }
+        std::ranges::copy(region,_sexprIndices.At(firstIndex));
+        //lines and columns past the edit move as well, columns only on the line the edit ends on
+        const std::uint32_t fromLine = hasFollowing ? _sexprIndices[followingIndex].OpenLine : 0;
+        const std::uint32_t lineShift = endLine - fromLine;
+        const std::uint32_t columnShift = hasFollowing ?
+            regionEnd + 1 - endLineStart - _sexprIndices[followingIndex].OpenColumn : 0;
+        for (SExprIndex* sexpr = _sexprIndices.At(followingIndex); sexpr != _sexprIndices.end(); ++sexpr) {
+            sexpr->Open += shift;
+            sexpr->Close += shift;
+            sexpr->Next += indexShift;
+#ifndef WL_COMPACT_TOKENS
+            if (!lazyLocations) {
+                sexpr->OpenColumn += sexpr->OpenLine == fromLine ? columnShift : 0;
+                sexpr->CloseColumn += sexpr->CloseLine == fromLine ? columnShift : 0;
+                sexpr->OpenLine += lineShift;
+                sexpr->CloseLine += lineShift;
+            }
+#endif
+        }
 
-        alignas(32) static const Vector256 digitsTable {
-            '0','1','2','3','4','5','6','7',
-            '8','9',0,0,0,0,0,0,
-            '0','1','2','3','4','5','6','7',
-            '8','9',0,0,0,0,0,0,
+        //the materialized tokens past the edit move along, unless the arenas could run short of room for the ones
+        //materialized after it, token columns are never kept as they would need moving within the columns as well
+        const bool keepTokens = inPlace && !_keepTokenColumns && !sharded &&
+            _tokens.Size() + ReservationOf(textSize) <= _tokens.Capacity() &&
+            _auxiliaries.Size() + ReservationOf(textSize) <= _auxiliaries.Capacity();
+        bool appendedAuxiliary = false;
+        if (keepTokens && hasFollowing) {
+            //the trivia between the S-expression right after the edit and the one before it is the auxiliary of its
+            //opening parenthesis, 'TokenizeFirstSExpr' and 'TokenizeNext' would compute it the same way
+            std::uint32_t gapStart = regionStart;
+            for (std::uint32_t form = firstIndex; form < followingIndex; form = _sexprIndices[form].Next) {
+                gapStart = _sexprIndices[form].Close + 1;
+            }
+            const bool trivia = IsComment(_text[gapStart]) or IsFragment(_text[gapStart]);
+            const auto leadingAuxiliary = static_cast<std::uint32_t>(_auxiliaries.Size());
+            const std::uint8_t leadingAuxiliaryLength = trivia ? 1 :
+                followingIndex == 0 ? 0 : std::numeric_limits<std::uint8_t>::max();
+            ShiftMaterialized(oldRegionEnd,
+                oldGapStart,
+                shift,
+                indexShift,
+                fromLine,
+                lineShift,
+                columnShift,
+                trivia ? leadingAuxiliary : 0,
+                leadingAuxiliaryLength);
+            if (trivia) {
+                _auxiliaries.EmplaceBack({gapStart,regionEnd - gapStart});
+                appendedAuxiliary = true;
+            }
+        }
+        else if (!keepTokens) {
+            ReserveForEdits(textSize);
+        }
+        //the tokens of the S-expressions matched again are stale and the auxiliary of the one after them is appended
+        //past those of later ones, so the arenas stay in text order only when neither lies among the materialized ones
+        if (keepTokens && _lastMaterializedForm != NoSExprIndex && _lastMaterializedForm >= firstIndex) {
+            if (_lastMaterializedForm < following || appendedAuxiliary) {
+                _materializedInOrder = false;
+            }
+            _lastMaterializedForm += _lastMaterializedForm >= following ? indexShift : 0;
+        }
+
+        //the trivia between the S-expressions matched again are checked the way 'TokenizeBlue' checks them
+        _textStreamPos = regionStart;
+        if (!lazyLocations) {
+            _line = startLine;
+            _column = regionStart + 1 - startLineStart;
+        }
+        const bool atomsChecked = lazyLocations ?
+            CheckAtomsAtTopLevelBlue<true>(firstIndex,followingIndex) :
+            CheckAtomsAtTopLevelBlue<false>(firstIndex,followingIndex);
+        _textStreamPos = 0;
+        _line = 1;
+        _column = 1;
+        _wellFormed = atomsChecked && _diagnostics.Empty();
+        return LispEdit{_wellFormed,keepTokens,firstIndex,removedForms,insertedForms};
+    }
+
+    //the way out of an edit that can't be applied piecewise, the edited text goes through the whole blue pass again
+    LispEdit LispLexer::RetokenizeEdited() {
+        const std::string_view text = _text;
+        ReserveFor(text.size());
+        Rebind(text);
+        ReserveForEdits(text.size());
+        return LispEdit{TokenizeBlue(),false,0,0,0};
+    }
+
+    std::wstring_view LispLexer::GetFilePath() const noexcept {
+        return _filePath;
+    }
+
+    NODISCARD ALWAYS_INLINE PURE TokenizationBlock::MaskType LowerBitsMask(const std::uint32_t count) noexcept {
+        //shifting a mask by its own width is undefined, so a full block is handled separately
+        return count >= TokenizationBlock::Width ? ~TokenizationBlock::MaskType{0} :
+            (TokenizationBlock::MaskType{1} << count) - 1;
+    }
+
+    namespace {
+        //where the blue pass stands when it enters a block
+        enum class StructuralState : std::uint8_t {
+            Code,
+            String,
+            Comment,
+            End
         };
 
-        alignas(32) static const Vector256 smallIdentifierTable {
-            'p','a','b','c','d','e','f','g',
-            'h','i','j','k','l','m','n','o',
-            'p','a','b','c','d','e','f','g',
-            'h','i','j','k','l','m','n','o',
+        //what the blue pass makes of a block once string literals and comments are masked out of it
+        struct StructuralBlock final {
+            TokenizationBlock::MaskType Opens = 0;
+            TokenizationBlock::MaskType Closes = 0;
+            //newlines within string literals don't move the blue pass to the next line so they are left out
+            TokenizationBlock::MaskType NewLines = 0;
+            //chars of code no class matched, either the rest of the operators or unrecognized tokens
+            TokenizationBlock::MaskType Unclassified = 0;
+            StructuralState Exit = StructuralState::Code;
+            std::uint8_t LastStringStart = 0;
         };
 
-        alignas(32) static const Vector256 smallIdentifierTable2 {
-            0,'q','r','s','t','u','v','w',
-            'x','y','z',0,0,0,0,0,
-            0,'q','r','s','t','u','v','w',
-            'x','y','z',0,0,0,0,0,
+        //a parenthesis or an unrecognized char the chunk that found it couldn't resolve on its own
+        struct StructuralEvent final {
+            std::uint32_t Position;
+            std::uint32_t Line;
+            std::uint32_t Column;
+            std::uint32_t Next; //S-expressions opened before a closing parenthesis, unused by unrecognized chars
+            bool Close;
         };
 
-        alignas(32) static const Vector256 capitalIdentifierTable {
-            'P','A','B','C','D','E','F','G',
-            'H','I','J','K','L','M','N','O',
-            'P','A','B','C','D','E','F','G',
-            'H','I','J','K','L','M','N','O',
+        struct StructuralChunk final {
+            std::size_t FirstBlock = 0;
+            std::size_t EndBlock = 0;
+            StructuralState Exit = StructuralState::Code;
+            std::uint32_t Opens = 0; //opening parentheses before the chunk once prefix summed
+            std::uint32_t Line = 0; //counted newlines before the chunk once prefix summed
+            std::uint32_t LineStart = 0; //position right after the last counted newline before the chunk
+            std::vector<StructuralEvent> Dangling;
+            std::vector<std::uint32_t> Unclosed; //S-expression indices still open at the end of the chunk
         };
 
-        alignas(32) static const Vector256 capitalIdentifierTable2 {
-            0,'Q','R','S','T','U','V','W',
-            'X','Y','Z',0,0,DashInId,0,'_',
-            0,'Q','R','S','T','U','V','W',
-            'X','Y','Z',0,0,DashInId,0,'_'
+        //finds the string literals, comments and code of a block from its masks instead of walking it token by token.
+        //when neither a comment nor the end of file starts within the block (the common case) string literals are told
+        //apart from code by the parity of the quotes before every char, otherwise it jumps from one state change to
+        //the next as only a double quote, a comment or the end of file can take code to another state. 'text' points
+        //to the block and 'length' is how much of it lies within the text, the chars before 'from' are left out
+        StructuralBlock ScanStructure(const TokenizationBlock& block,
+            const char *const text,
+            const std::uint32_t length,
+            StructuralState state,
+            const Classifier::PrefixXorFunction prefixXor,
+            const std::uint32_t from = 0) noexcept {
+            using MaskType = TokenizationBlock::MaskType;
+            const MaskType inText = LowerBitsMask(length) & ~LowerBitsMask(from);
+            const MaskType quotes = block.StringLiteralsMask() & inText;
+            const MaskType unclassified = block.UnclassifiedMask() & inText;
+            //of all the chars no class matched only these take code to another state
+            MaskType breaks = 0;
+            for (MaskType rest = unclassified; rest != 0; rest &= rest - 1) {
+                const auto at = std::countr_zero(rest);
+                if (text[at] == ';' || text[at] == EOF) {
+                    breaks |= MaskType{1} << at;
+                }
+            }
+            MaskType code = 0;
+            MaskType strings = 0;
+            MaskType scanned = inText;
+            StructuralBlock result;
+            if (breaks == 0 && (state == StructuralState::Code || state == StructuralState::String)) {
+                const MaskType inString = prefixXor(quotes) ^ (state == StructuralState::String ? ~MaskType{0} : 0);
+                const MaskType openings = quotes & inString;
+                strings = (inString | quotes) & inText;
+                code = inText & ~strings;
+                state = inString >> (TokenizationBlock::Width - 1) ? StructuralState::String : StructuralState::Code;
+                if (openings != 0) {
+                    result.LastStringStart = TokenizationBlock::Width - 1 - std::countl_zero(openings);
+                }
+            }
+            else {
+                std::uint32_t pos = from;
+                while (pos < length) {
+                    const MaskType ahead = inText & ~LowerBitsMask(pos);
+                    if (state == StructuralState::Code) {
+                        const MaskType exits = (quotes | breaks) & ahead;
+                        if (exits == 0) {
+                            code |= ahead;
+                            break;
+                        }
+                        const std::uint32_t stop = std::countr_zero(exits);
+                        code |= ahead & LowerBitsMask(stop);
+                        if (quotes >> stop & 1U) {
+                            state = StructuralState::String;
+                            strings |= MaskType{1} << stop;
+                            result.LastStringStart = stop;
+                        }
+                        else if (text[stop] == ';') {
+                            state = StructuralState::Comment;
+                        }
+                        else {
+                            state = StructuralState::End;
+                            scanned = inText & LowerBitsMask(stop);
+                            break;
+                        }
+                        pos = stop + 1;
+                    }
+                    else if (state == StructuralState::String) {
+                        const MaskType closing = quotes & ahead;
+                        if (closing == 0) {
+                            strings |= ahead;
+                            break;
+                        }
+                        const std::uint32_t stop = std::countr_zero(closing);
+                        strings |= ahead & LowerBitsMask(stop + 1);
+                        state = StructuralState::Code;
+                        pos = stop + 1;
+                    }
+                    else if (state == StructuralState::Comment) {
+                        //the newline ending a comment belongs to it but still moves the blue pass to the next line
+                        const MaskType newLine = block.NewLines() & ahead;
+                        if (newLine == 0) {
+                            break;
+                        }
+                        state = StructuralState::Code;
+                        pos = std::countr_zero(newLine) + 1;
+                    }
+                    else {
+                        scanned = 0;
+                        break;
+                    }
+                }
+            }
+            //the classifier tells parentheses apart from the rest of the operators of their class only by value
+            for (MaskType parentheses = block.SExprAndOpsMask() & code; parentheses != 0; parentheses &= parentheses - 1) {
+                const auto at = std::countr_zero(parentheses);
+                if (text[at] == '(') {
+                    result.Opens |= MaskType{1} << at;
+                }
+                else if (text[at] == ')') {
+                    result.Closes |= MaskType{1} << at;
+                }
+            }
+            result.NewLines = block.NewLines() & ~strings & scanned;
+            result.Unclassified = unclassified & code;
+            result.Exit = state;
+            return result;
+        }
+    }
+
+    ArenaCapacities SampleArenaCapacities(const std::string_view text,const ClassificationKernel kernel) noexcept {
+        using MaskType = TokenizationBlock::MaskType;
+        constexpr std::size_t width = TokenizationBlock::Width;
+        constexpr std::size_t windowSize = 4096;
+        constexpr std::size_t maxWindows = 8;
+        const Classifier::Kernel classify = Classifier::Resolve(kernel);
+        const Classifier::PrefixXorFunction prefixXor = Classifier::ResolvePrefixXor(kernel);
+        const std::size_t windows = (text.size() + windowSize - 1) / windowSize;
+        //windows are spread evenly over the text, which they cover entirely when it's short enough
+        const std::size_t stride = windows <= maxWindows ? windowSize : text.size() / maxWindows / width * width;
+        alignas(width) std::uint8_t window[windowSize];
+        TokenizationBlock blocks[windowSize / width];
+        std::size_t sampledBytes = 0;
+        std::size_t tokens = 0;
+        std::size_t opens = 0;
+        std::size_t fragments = 0;
+        for (std::size_t sample = 0; sample < std::min(windows,maxWindows); ++sample) {
+            const std::size_t start = sample * stride;
+            const std::size_t length = std::min(windowSize,text.size() - start);
+            std::memset(window,EOF,windowSize);
+            std::memcpy(window,text.data() + start,length);
+            const std::size_t blocksCount = (length + width - 1) / width;
+            (void)classify(window,blocksCount,blocks,0);
+            StructuralState state = StructuralState::Code;
+            MaskType solidCarry = 0;
+            MaskType parenthesesCarry = 0;
+            MaskType fragmentsCarry = 0;
+            for (std::size_t block = 0; block < blocksCount; ++block) {
+                const auto blockLength = static_cast<std::uint32_t>(std::min(width,length - block * width));
+                const MaskType inText = LowerBitsMask(blockLength);
+                const StructuralBlock structure = ScanStructure(blocks[block],
+                    reinterpret_cast<const char*>(window) + block * width,
+                    blockLength,
+                    state,
+                    prefixXor);
+                state = structure.Exit;
+                const MaskType fragment = blocks[block].FragmentsMask() & inText;
+                const MaskType solid = ~blocks[block].FragmentsMask() & inText;
+                const MaskType parentheses = structure.Opens | structure.Closes;
+                //a token starts where a run of non-fragment chars does, at a parenthesis and right after one
+                const MaskType starts = (solid & ~(solid << 1 | solidCarry)) | parentheses |
+                    (solid & (parentheses << 1 | parenthesesCarry));
+                tokens += std::popcount(starts);
+                opens += std::popcount(structure.Opens);
+                fragments += std::popcount(fragment & ~(fragment << 1 | fragmentsCarry));
+                solidCarry = solid >> (width - 1);
+                parenthesesCarry = parentheses >> (width - 1);
+                fragmentsCarry = fragment >> (width - 1);
+            }
+            sampledBytes += length;
+        }
+        const auto extrapolate = [&text,sampledBytes](const std::size_t count) {
+            const auto scaled = sampledBytes == 0 ? std::size_t{0} : static_cast<std::size_t>(
+                static_cast<double>(count) * static_cast<double>(text.size()) / static_cast<double>(sampledBytes));
+            //the headroom covers how the rest of the text differs from the windows, the text size bounds any count
+            return std::min<std::size_t>(scaled + scaled / 4 + 64,text.size() + PaddingSize);
+        };
+        return ArenaCapacities{
+            .Tokens = extrapolate(tokens + 1), //end of file token
+            .SExprIndices = extrapolate(opens),
+            .Auxiliaries = extrapolate(fragments)
         };
+    }
 
-        std::ptrdiff_t i = 0;
-        for (; i < vectorAlignedSize ; i+=sizeof(Vector256) ) {
-            const Vector256 fetchedChars = Avx2::LoadFromAddress(address,i);
-            //string literal matching
-            const Vector256 doubleQuotationEquality =  Avx2::CompareEqual(fetchedChars,Avx2::Propagate('\"'));
-            const Vector256 backwardSlashEquality = Avx2::CompareEqual(fetchedChars,Avx2::Propagate('\\'));
-            const std::uint32_t doubleQuoteMask = Avx2::MoveMask(doubleQuotationEquality);
-            const std::uint32_t backSlashMask = Avx2::MoveMask(backwardSlashEquality);
-            //sexpr parentheses matching
-            const Vector256 hashedSexprChars = Avx2::SubtractSaturated(Avx2::Propagate(0x30),fetchedChars);
-            const Vector256 lookedSexprAndOpsChars = Avx2::ShuffleBytes(sexprAndOpsTable,hashedSexprChars);
-            const Vector256 sexprAndOpsChars = Avx2::CompareEqual(lookedSexprAndOpsChars,fetchedChars);
-            std::uint32_t sexprAndOpsMask = Avx2::MoveMask(sexprAndOpsChars);
-            //other operators and structural matching
-            const Vector256 hashedOtherOpsAndStructSymbols = Avx2::Custom::RightShift8<2>(fetchedChars);
-            const Vector256 lookedOtherOpsAndStructSymbols = Avx2::ShuffleBytes(otherOpsAndStructTable,hashedOtherOpsAndStructSymbols);
-            const Vector256 matchingOtherOpsAndStruct = Avx2::CompareEqual(lookedOtherOpsAndStructSymbols,fetchedChars);
-            sexprAndOpsMask |= Avx2::MoveMask(matchingOtherOpsAndStruct);
-            //numbers
-            const Vector256 lookedDigits = Avx2::ShuffleBytes(digitsTable,fetchedChars);
-            const Vector256 digits = Avx2::CompareEqual(lookedDigits,fetchedChars);
-            const std::uint32_t digitsMask = Avx2::MoveMask(digits);
-            //identifiers
-            const Vector256 lookedSmallIdentifier = Avx2::ShuffleBytes(smallIdentifierTable,fetchedChars);
-            const Vector256 lookedSmallIdentifier2 = Avx2::ShuffleBytes(smallIdentifierTable2,fetchedChars);
-            const Vector256 lookedCapitalIdentifier = Avx2::ShuffleBytes(capitalIdentifierTable,fetchedChars);
-            const Vector256 lookedCapitalIdentifier2 = Avx2::ShuffleBytes(capitalIdentifierTable2,fetchedChars);
-            const Vector256 lookedSmallIdentifierChars = Avx2::CompareEqual(lookedSmallIdentifier,fetchedChars);
-            const Vector256 lookedSmallIdentifier2Chars = Avx2::CompareEqual(lookedSmallIdentifier2,fetchedChars);
-            const Vector256 lookedCapitalIdentifierChars = Avx2::CompareEqual(lookedCapitalIdentifier,fetchedChars);
-            const Vector256 lookedCapitalIdentifier2Chars = Avx2::CompareEqual(lookedCapitalIdentifier2,fetchedChars);
-            //lexer will match digits mask before identifier mask so it doesn't get mis-tokenized
-            const Vector256 lookedIdentifier = Avx2::Or(digits,
-                Avx2::Or( //balancing is important here as it optimizes data dependency
-                Avx2::Or(lookedCapitalIdentifierChars,lookedCapitalIdentifier2Chars),
-                Avx2::Or(lookedSmallIdentifierChars,lookedSmallIdentifier2Chars)));
-            const std::uint32_t identifierMask = Avx2::MoveMask(lookedIdentifier);
-            //fragmentation chars matching
-            //no need to hash anything '_mm256_shuffle_epi8' implicit bitwise-and with 0x0F is enough for classification here
-            const Vector256 lookedFragmentChars = Avx2::ShuffleBytes(fragmentsTable,fetchedChars);
-            const Vector256 fragmentChars = Avx2::CompareEqual(lookedFragmentChars,fetchedChars);
-            const Vector256 newLines = Avx2::CompareEqual(fetchedChars,Avx2::Propagate('\n'));
-            const std::uint32_t newLineMask = Avx2::MoveMask(newLines);
-            const std::uint32_t fragmentMask = Avx2::MoveMask(fragmentChars);
-            //pushing result
-            const std::uint32_t nonEscapingQuotationMask = ComputeNonEscapingDoubleQuotes(backSlashMask,doubleQuoteMask^prevTileEndWithOddBackslash);
-            prevTileEndWithOddBackslash = std::countl_one(backSlashMask) & 0x00000001U;
-            _blocks.EmplaceBack(TokenizationBlock{
-                .FragmentsMask = fragmentMask,
-                .SExprAndOpsMask = sexprAndOpsMask,
-                .DigitsMask = digitsMask,
-                .StringLiteralsMask = nonEscapingQuotationMask,
-                .NewLines = newLineMask,
-                .IdentifierMask = identifierMask
-            });
+    ALWAYS_INLINE void LispLexer::Classify() {
+        const auto address = reinterpret_cast<const std::uint8_t*>(_text.data());
+        const std::size_t textSize = _text.size();
+        const std::size_t fullBlocks = textSize >> TokensInBlockPopCnt;
+        const std::size_t remainder = textSize & TokensInBlockBoundary;
+        TokenizationBlock* blocks = _blocks.Preserve(fullBlocks + (remainder != 0));
+        const std::uint64_t escapeCarry = Classifier::ClassifyParallel(_classifier,
+            address,
+            fullBlocks,
+            blocks,
+            _threads);
+        if (remainder != 0) {
+            //the padding only guarantees 'PaddingSize' readable bytes past the text, so the last partial block is
+            //classified from a copy padded with EOF
+            alignas(TokensInBlock) std::uint8_t tail[TokensInBlock];
+            std::memset(tail,EOF,TokensInBlock);
+            std::memcpy(tail,address + (fullBlocks << TokensInBlockPopCnt),remainder);
+            (void)_classifier(tail,1,blocks+fullBlocks,escapeCarry);
         }
 
-        _blocks.EmplaceBack(TokenizationBlock{
+        _blocks.EmplaceBack(TokenizationBlock{TokenizationMasks{
             .NewLines = 1U //this is a trick to remove the check that next block is not a sentinel block (NULL)
-        });
+        }});
+    }
+
+    //classifies the blocks in [firstBlock,endBlock) again where they already are, the escape carry they start
+    //with is told by the backslashes right before them
+    void LispLexer::ClassifyBlocks(const std::size_t firstBlock,const std::size_t endBlock) noexcept {
+        const auto address = reinterpret_cast<const std::uint8_t*>(_text.data());
+        const std::size_t textSize = _text.size();
+        const std::size_t fullEnd = std::clamp(textSize >> TokensInBlockPopCnt,firstBlock,endBlock);
+        std::uint64_t escapeCarry = EscapeCarryAt(_text,firstBlock << TokensInBlockPopCnt);
+        if (fullEnd > firstBlock) {
+            escapeCarry = _classifier(address + (firstBlock << TokensInBlockPopCnt),
+                fullEnd - firstBlock,
+                _blocks.At(firstBlock),
+                escapeCarry);
+        }
+        if (endBlock > fullEnd) {
+            //same as 'Classify', the last partial block is classified from a copy padded with EOF
+            alignas(TokensInBlock) std::uint8_t tail[TokensInBlock];
+            std::memset(tail,EOF,TokensInBlock);
+            std::memcpy(tail,address + (fullEnd << TokensInBlockPopCnt),textSize & TokensInBlockBoundary);
+            (void)_classifier(tail,1,_blocks.At(fullEnd),escapeCarry);
+        }
+    }
+
+    //a single pass over the classified blocks, cheaper than keeping lines and columns up to date token by token.
+    //the blocks before 'fromBlock' keep their ranks, an edit doesn't move the lines before it
+    void LispLexer::RankLines(const std::size_t fromBlock) noexcept {
+        const std::size_t textSize = _text.size();
+        const std::size_t blocksCount = (textSize + TokensInBlockBoundary) >> TokensInBlockPopCnt;
+        const LineRank first = fromBlock != 0 ? _lineRanks[fromBlock] : LineRank{};
+        _lineRanks.Truncate(fromBlock);
+        (void)_lineRanks.Preserve(blocksCount - fromBlock);
+        LineRank *const ranks = _lineRanks.begin();
+        auto state = static_cast<StructuralState>(first.Entry);
+        std::uint32_t lines = first.Lines;
+        std::uint32_t lineStart = first.LineStart;
+        for (std::size_t block = fromBlock; block < blocksCount; ++block) {
+            ranks[block] = LineRank{lines,lineStart,static_cast<std::uint8_t>(state)};
+            const std::size_t start = block << TokensInBlockPopCnt;
+            const StructuralBlock structure = ScanStructure(_blocks[block],
+                _text.data() + start,
+                static_cast<std::uint32_t>(std::min<std::size_t>(TokensInBlock,textSize - start)),
+                state,
+                _prefixXor);
+            lines += std::popcount(structure.NewLines);
+            if (structure.NewLines != 0) {
+                lineStart = static_cast<std::uint32_t>(start + TokensInBlock - std::countl_zero(structure.NewLines));
+            }
+            state = structure.Exit;
+        }
+    }
+
+    //classifies the whole text of a window and finds where to cut it from the blocks alone, the way 'RankLines'
+    //counts lines. a stray closing parenthesis is left for the blue pass to report
+    FormsBoundary LispLexer::ClassifyWindow() {
+        Classify();
+        const std::size_t textSize = _text.size();
+        const std::size_t blocksCount = (textSize + TokensInBlockBoundary) >> TokensInBlockPopCnt;
+        auto state = StructuralState::Code;
+        std::size_t depth = 0;
+        std::uint64_t lines = 0;
+        FormsBoundary boundary;
+        for (std::size_t block = 0; block < blocksCount && state != StructuralState::End; ++block) {
+            const std::size_t start = block << TokensInBlockPopCnt;
+            const StructuralBlock structure = ScanStructure(_blocks[block],
+                _text.data() + start,
+                static_cast<std::uint32_t>(std::min<std::size_t>(TokensInBlock,textSize - start)),
+                state,
+                _prefixXor);
+            state = structure.Exit;
+            const BlockMask parentheses = structure.Opens | structure.Closes;
+            if (parentheses == 0) {
+                if (depth == 0 && structure.NewLines != 0) {
+                    boundary = FormsBoundary{start + TokensInBlock - std::countl_zero(structure.NewLines),
+                        lines + std::popcount(structure.NewLines)};
+                }
+                lines += std::popcount(structure.NewLines);
+                continue;
+            }
+            for (BlockMask events = parentheses | structure.NewLines; events != 0; events &= events - 1) {
+                const auto at = std::countr_zero(events);
+                if (structure.NewLines >> at & 1U) {
+                    ++lines;
+                    if (depth == 0) {
+                        boundary = FormsBoundary{start + at + 1,lines};
+                    }
+                }
+                else if (structure.Opens >> at & 1U) {
+                    ++depth;
+                }
+                else {
+                    depth = depth != 0 ? depth - 1 : 0;
+                }
+            }
+        }
+        return boundary;
+    }
+
+    //the padding the caller wrote after the first 'size' bytes only changes the block holding them, the blocks before
+    //it keep what 'ClassifyWindow' found
+    bool LispLexer::TokenizeWindow(const std::size_t size) {
+        _text = _text.substr(0,size + PaddingSize);
+        _tokenizingThread = std::this_thread::get_id();
+        _shards.Clear();
+        if (_cache != nullptr) {
+            //the cache keys whole texts, a hit doesn't need the blocks
+            _blocks.Reuse();
+            return TokenizeCached();
+        }
+        const std::size_t blocksCount = (_text.size() + TokensInBlockBoundary) >> TokensInBlockPopCnt;
+        _blocks.Truncate(blocksCount);
+        ClassifyBlocks(size >> TokensInBlockPopCnt,blocksCount);
+        _blocks.EmplaceBack(TokenizationBlock{TokenizationMasks{
+            .NewLines = 1U
+        }});
+        return TokenizeBlue(true);
+    }
+
+    //counts lines the way the parallel blue pass engine does, only the block holding 'offset' is scanned again
+    SourceLocation LispLexer::LocationAt(std::uint32_t offset) const noexcept {
+        offset = std::min(offset,static_cast<std::uint32_t>(_text.size() - 1));
+        const std::size_t block = offset >> TokensInBlockPopCnt;
+        const LineRank& rank = _lineRanks[block];
+        const std::size_t start = block << TokensInBlockPopCnt;
+        const StructuralBlock structure = ScanStructure(_blocks[block],
+            _text.data() + start,
+            static_cast<std::uint32_t>(std::min<std::size_t>(TokensInBlock,_text.size() - start)),
+            static_cast<StructuralState>(rank.Entry),
+            _prefixXor);
+        const BlockMask newLines = structure.NewLines & LowerBitsMask(offset & TokensInBlockBoundary);
+        const std::uint32_t lineStart = newLines != 0 ?
+            static_cast<std::uint32_t>(start + TokensInBlock - std::countl_zero(newLines)) : rank.LineStart;
+        return SourceLocation{rank.Lines + 1 + std::popcount(newLines),offset + 1 - lineStart};
+    }
+
+    //S-expression indices only hold eager locations, the compact layout leaves them out altogether
+    SourceLocation LispLexer::OpenLocationOf(const SExprIndex& index) const noexcept {
+#ifdef WL_COMPACT_TOKENS
+        return LocationAt(index.Open);
+#else
+        if (_locations == SourceLocations::Lazy) {
+            return LocationAt(index.Open);
+        }
+        return SourceLocation{index.OpenLine,index.OpenColumn};
+#endif
+    }
+
+    //only diagnostics ask for it, so the lazy locations are worth computing here
+    SourceLocation LispLexer::CurrentLocation() const noexcept {
+        if (_locations == SourceLocations::Lazy) {
+            return LocationAt(_textStreamPos);
+        }
+        return SourceLocation{_line,_column};
     }
 
+    template<bool LazyLocations>
     ALWAYS_INLINE LispLexer::OptRegionOfTokens LispLexer::TokenizeSExprCore(const LispToken *begin,
         const bool csEmptySExpr) noexcept {
 #ifndef NDEBUG
         assert(begin->Kind == LispTokenKind::LeftParenthesis);
 #endif
         const SExprIndex& parentSExprIndex = _sexprIndices[begin->IndexInSpecialStream];
+        if (!HasRoomFor(parentSExprIndex.Close - parentSExprIndex.Open + 1)) [[unlikely]] {
+            ReportArenasExhausted(OpenLocationOf(parentSExprIndex));
+            return std::nullopt;
+        }
+        //an S-expression within a top level one before the last one materialized lands out of text order
+        _materializedInOrder &= _lastMaterializedForm != NoSExprIndex &&
+            begin->IndexInSpecialStream >= _lastMaterializedForm;
         _textStreamPos = parentSExprIndex.Open+1;
-        _line = begin->Line;
-        _column = begin->Column + 1;
+        if constexpr (!LazyLocations) {
+            _line = parentSExprIndex.OpenLine;
+            _column = parentSExprIndex.OpenColumn + 1;
+        }
         const std::uint32_t endPos = parentSExprIndex.Close;
         std::uint32_t peekSExprIndex = begin->IndexInSpecialStream+1;
         const auto startTokensSize = _tokens.Size();
@@ -386,7 +1204,7 @@ namespace WideLips {
         while (_textStreamPos < endPos) {
             if (ch == '(') {
                 const auto& currentSExprIndex = _sexprIndices[peekSExprIndex];
-                _tokens.EmplaceBack(LispToken{text+currentSExprIndex.Open,
+                EmitToken(text+currentSExprIndex.Open,
                     currentSExprIndex.OpenLine,
                     1U,
                     static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength),
@@ -394,8 +1212,8 @@ namespace WideLips {
                     peekSExprIndex,
                     LispTokenKind::LeftParenthesis,
                     fragLength
-                });
-                _tokens.EmplaceBack(LispToken{text+currentSExprIndex.Close,
+                );
+                EmitToken(text+currentSExprIndex.Close,
                       currentSExprIndex.CloseLine,
                       1U,
                       0,
@@ -403,11 +1221,13 @@ namespace WideLips {
                       0,
                       LispTokenKind::RightParenthesis,
                        std::numeric_limits<std::uint8_t>::max()
-                });
+                );
                 peekSExprIndex = currentSExprIndex.Next;
                 _textStreamPos = currentSExprIndex.Close+1; //skip to first char after SExpr
-                _line = currentSExprIndex.OpenLine;
-                _column = currentSExprIndex.OpenColumn;
+                if constexpr (!LazyLocations) {
+                    _line = currentSExprIndex.CloseLine;
+                    _column = currentSExprIndex.CloseColumn + 1;
+                }
                 if (_textStreamPos >= endPos) {
                     goto loopExit;
                 }
@@ -416,43 +1236,42 @@ namespace WideLips {
                 continue;
             }
 
-            const std::size_t blockIndex = _textStreamPos >> 5;
+            const std::size_t blockIndex = _textStreamPos >> TokensInBlockPopCnt;
             const TokenizationBlock& block = _blocks[blockIndex];
             const std::uint8_t posInBlock = OffsetInBlock();
             //comments
-            if (const auto targetNewlineBlock = block.NewLines >> (posInBlock + 1); IsComment(ch)){
+            if (const auto targetNewlineBlock = (block.NewLines() >> posInBlock) >> 1; IsComment(ch)){
                 const auto [startOfComment,endOfCommentOffset] = FetchCommentRegion(targetNewlineBlock,posInBlock);
                 ch = SkipToCharAtWithoutColumn(endOfCommentOffset);
-                ++_line;
-                _column = 1;
+                if constexpr (!LazyLocations) {
+                    ++_line;
+                    _column = 1;
+                }
                 _auxiliaries.EmplaceBack(AuxiliaryIndex{startOfComment,endOfCommentOffset});
                 ++fragLength;
                 continue;
             }
             //fragments
-            if (const std::uint32_t fragmentsBlock = block.FragmentsMask >> posInBlock;fragmentsBlock & 1U)[[likely]]{
+            if (const BlockMask fragmentsBlock = block.FragmentsMask() >> posInBlock;fragmentsBlock & 1U)[[likely]]{
                 const TokenizationBlock* currentBlock = &block;
-                const auto startLine = _line;
-                auto [startOfFragment,endOfFragmentOffset] = FetchFragmentRegion(fragmentsBlock,posInBlock,currentBlock);
+                [[maybe_unused]] const auto startLine = _line;
+                auto [startOfFragment,endOfFragmentOffset] = FetchFragmentRegion<LazyLocations>(fragmentsBlock,posInBlock,currentBlock);
                 ch = SkipToCharAtWithoutColumn(endOfFragmentOffset);
-                if (_line != startLine) {
-                    currentBlock = _blocks.At(_textStreamPos >> 5);
-                    const std::uint8_t offsetInBlock = OffsetInBlock(); //position where last fragment is
-                    const std::uint32_t posOfLastNewLine =
-                        (TokensInBlock- std::countl_zero(~(0xFFFFFFFFU << offsetInBlock) & currentBlock->NewLines))
-                        & TokensInBlockBoundary;
-                    _column = std::countr_one(currentBlock->FragmentsMask >> posOfLastNewLine) + 1;
-                }
-                else {
-                    _column += endOfFragmentOffset;
+                if constexpr (!LazyLocations) {
+                    if (_line != startLine) {
+                        _column = ColumnAfterNewLine();
+                    }
+                    else {
+                        _column += endOfFragmentOffset;
+                    }
                 }
                 _auxiliaries.EmplaceBack(AuxiliaryIndex{startOfFragment,endOfFragmentOffset});
                 ++fragLength;
                 continue;
             }
             //sexpr and operators (most of them)
-            if (const std::uint32_t sexprOpsBlock = block.SExprAndOpsMask >> posInBlock; sexprOpsBlock & 1U) [[likely]]{
-                _tokens.EmplaceBack(LispToken{text+_textStreamPos,
+            if (const BlockMask sexprOpsBlock = block.SExprAndOpsMask() >> posInBlock; sexprOpsBlock & 1U) [[likely]]{
+                EmitToken(text+_textStreamPos,
                     _line,
                     1U,
                     static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength),
@@ -460,13 +1279,13 @@ namespace WideLips {
                     0,
                     static_cast<LispTokenKind>(CurrentChar()),
                     fragLength
-                });
-                ch = NextChar();
+                );
+                ch = NextChar<LazyLocations>();
             }
             //reals
-            else if (const auto digitsBlock = block.DigitsMask >> posInBlock; digitsBlock & 1U) {
+            else if (const auto digitsBlock = block.DigitsMask() >> posInBlock; digitsBlock & 1U) {
                 const auto [startOfReal,endOfRealOffset] = TokenizeRealBlue(digitsBlock,posInBlock,&block);
-                _tokens.EmplaceBack(LispToken{text+startOfReal,
+                EmitToken(text+startOfReal,
                     _line,
                     endOfRealOffset,
                     static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength),
@@ -474,15 +1293,17 @@ namespace WideLips {
                     0,
                     LispTokenKind::RealLiteral,
                     fragLength
-                });
-                _column += endOfRealOffset;
+                );
+                if constexpr (!LazyLocations) {
+                    _column += endOfRealOffset;
+                }
                 ch = CurrentChar();
             }
             //identifiers
-            else if (const std::uint32_t idBlock = block.IdentifierMask >> posInBlock; idBlock & 1U) [[likely]]{
+            else if (const BlockMask idBlock = block.IdentifierMask() >> posInBlock; idBlock & 1U) [[likely]]{
                 const auto [startOfId,endOfIdOffset] = FetchIdentifierRegion(idBlock,posInBlock);
                 const LispTokenKind keywordOrId = IsKeyword(std::string_view{text+startOfId,endOfIdOffset});
-                _tokens.EmplaceBack(LispToken{text+startOfId,
+                EmitToken(text+startOfId,
                     _line,
                     endOfIdOffset,
                     static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength),
@@ -490,13 +1311,13 @@ namespace WideLips {
                     0,
                     keywordOrId,
                     fragLength
-                });
-                ch = SkipToCharAt(endOfIdOffset);
+                );
+                ch = SkipToCharAt<LazyLocations>(endOfIdOffset);
             }
             //string literals
-            else if (const auto stringBlock = block.StringLiteralsMask >> posInBlock; stringBlock & 1U) {
+            else if (const auto stringBlock = block.StringLiteralsMask() >> posInBlock; stringBlock & 1U) {
                 const auto [startOfString,endOfStringOffset] = FetchStringRegion(stringBlock,posInBlock);
-                _tokens.EmplaceBack(LispToken{text+startOfString,
+                EmitToken(text+startOfString,
                    _line,
                    endOfStringOffset,
                    static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength),
@@ -504,28 +1325,28 @@ namespace WideLips {
                    0,
                    LispTokenKind::StringLiteral,
                    fragLength
-               });
-                ch = SkipToCharAt(endOfStringOffset);
+               );
+                ch = SkipToCharAt<LazyLocations>(endOfStringOffset);
             }
             //rest of operators
             else if (IsOperator(ch)) {
-                TokenizeOperatorsOrStructural(fragLength);
+                TokenizeOperatorsOrStructural<LazyLocations>(fragLength);
                 ch = CurrentChar();
             }
             else if (IsEndOfFile()) {
-                _tokens.EmplaceBack(LispToken{"\0",
+                EmitToken(text+_textStreamPos,
                     _line,
-                    1,
+                    0,
                     static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength),
                     _column,
                     0,
                     LispTokenKind::EndOfFile,
                     fragLength
-                });
+                );
                 break;
             }
             else {
-                _tokens.EmplaceBack(LispToken{_text.data()+_textStreamPos,
+                EmitToken(_text.data()+_textStreamPos,
                     _line,
                     1U,
                     static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength),
@@ -533,8 +1354,8 @@ namespace WideLips {
                     0,
                     LispTokenKind::Invalid,
                     fragLength
-                });
-                ch = NextChar();
+                );
+                ch = NextChar<LazyLocations>();
             }
             fragLength = 0;
         }
@@ -545,14 +1366,25 @@ namespace WideLips {
         const LispToken* atomsEnd = &_tokens.Back();
         //SExpr closing parenthesis (which is always next to the opening parenthesis in the token stream);
         auto*const end = const_cast<LispToken *>(begin+1);
-        //update SExpr closing parenthesis auxiliary info because it cannot be computed before this point
-        end->AuxiliaryIndex = static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength);
-        end->AuxiliaryLength = fragLength;
+        //update SExpr closing parenthesis auxiliary info because it cannot be computed before this point. threads of a
+        //concurrent lexer may expand the same S-expression at once, each indexing auxiliaries of its own, so it's left
+        if (!_concurrent) {
+            end->AuxiliaryIndex = static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength);
+            end->AuxiliaryLength = fragLength;
+            if (_keepTokenColumns) {
+                _tokenColumns.SetAuxiliary(static_cast<std::size_t>(end - _tokens.begin()),
+                    end->AuxiliaryIndex,
+                    fragLength);
+            }
+        }
         return std::make_optional<RegionOfTokens>(atomsBegin,atomsEnd);
     }
 
+    template<bool LazyLocations>
     ALWAYS_INLINE char LispLexer::NextChar() noexcept {
-        ++_column;
+        if constexpr (!LazyLocations) {
+            ++_column;
+        }
         return _text[++_textStreamPos];
     }
 
@@ -564,8 +1396,11 @@ namespace WideLips {
         return _text[_textStreamPos];
     }
 
+    template<bool LazyLocations>
     ALWAYS_INLINE char LispLexer::SkipToCharAt(const std::size_t offset) noexcept {
-        _column += offset;
+        if constexpr (!LazyLocations) {
+            _column += offset;
+        }
         return _text[_textStreamPos += offset];
     }
 
@@ -573,17 +1408,89 @@ namespace WideLips {
         return _text[_textStreamPos += offset];
     }
 
-    ALWAYS_INLINE bool LispLexer::TokenizeBlue() {
+    ALWAYS_INLINE bool LispLexer::TokenizeBlue(const bool classified) {
+        using namespace Diagnostic;
+        const bool lazyLocations = _locations == SourceLocations::Lazy;
+        if (lazyLocations) {
+            _line = 0;
+            _column = 0;
+        }
+        if (_blueEngine == BluePassEngine::Fused && !classified) {
+            ClassifyAndMatchSExprFused(); //lines are ranked along the way
+        }
+        else {
+            //blocks classified beforehand are matched sequentially by the fused engine, there's nothing to fuse with
+            if (!classified) {
+                Classify();
+            }
+            if (lazyLocations) {
+                RankLines();
+            }
+            if (_blueEngine == BluePassEngine::Parallel) {
+                MatchSExprParallel();
+            }
+            else if (lazyLocations) {
+                MatchSExprSequential<true>();
+            }
+            else {
+                MatchSExprSequential<false>();
+            }
+        }
+
+        auto noError = std::all_of(_diagnostics.begin(),
+            _diagnostics.end(),
+            [](const LispDiagnostic& diagnostic) {return diagnostic.GetSeverity() != Severity::Error;});
+
+        //the walk starts over from the beginning of the text whichever engine matched the parentheses
+        _textStreamPos = 0;
+        if (!lazyLocations) {
+            _line = 1;
+            _column = 1;
+        }
+        noError &= lazyLocations ?
+            CheckAtomsAtTopLevelBlue<true>(0,NoSExprIndex) :
+            CheckAtomsAtTopLevelBlue<false>(0,NoSExprIndex);
+
+        _tokenized = true;
+        _reused = false;
+        _wellFormed = noError && _diagnostics.Empty();
+        return _wellFormed;
+    }
+
+    //a hit leaves the lexer where 'TokenizeBlue' does, blocks and line ranks the cache left out are made again
+    bool LispLexer::TokenizeCached() {
+        const std::uint64_t contentHash = ContentHash(_text);
+        if (!_cache->Load(*this,contentHash)) {
+            const bool success = TokenizeBlue();
+            (void)_cache->Store(*this,contentHash);
+            return success;
+        }
+        if (_blocks.Empty()) {
+            Classify();
+        }
+        const bool lazyLocations = _locations == SourceLocations::Lazy;
+        if (lazyLocations && _lineRanks.Empty()) {
+            RankLines();
+        }
+        _textStreamPos = 0;
+        _line = lazyLocations ? 0 : 1;
+        _column = lazyLocations ? 0 : 1;
+        _tokenized = true;
+        _reused = false;
+        return _wellFormed;
+    }
+
+    template<bool LazyLocations>
+    ALWAYS_INLINE void LispLexer::MatchSExprSequential() noexcept {
         using namespace Diagnostic;
-        Classify();
         MonoBumpVector<std::uint32_t> stack{static_cast<std::uint32_t>(AlignToPowOfTow(_text.size()/2))};
         char ch = CurrentChar();
         while (true) {
             switch (ch) {
                 case '(': {
                     stack.EmplaceBack(static_cast<std::uint32_t>(_sexprIndices.Size()));
-                    _sexprIndices.EmplaceBack(SExprIndex{_textStreamPos,_line,_column});
-                    ch = NextChar();
+                    _sexprIndices.EmplaceBack(SExprIndex::Opening(_textStreamPos,_line,_column));
+                    ch = NextChar<LazyLocations>();
                     continue;
                 }
                 case ')': {
@@ -591,84 +1498,83 @@ namespace WideLips {
                         const auto sexprIndexPos = stack.Back();
                         stack.PopBack();
                         auto& index = _sexprIndices[sexprIndexPos];
-                        index.Close = _textStreamPos;
-                        index.CloseLine = _line;
-                        index.CloseColumn = _column;
-                        index.Next = static_cast<std::uint32_t>(_sexprIndices.Size());
+                        index.Closing(_textStreamPos,_line,_column,static_cast<std::uint32_t>(_sexprIndices.Size()));
                     }
                     else {
-                        _diagnostics.EmplaceBack(DiagnosticFactory::NoMatchingOpenParenthesis(_filePath,_line,_column,
-                            LispToken{")",_line,1,0,_column,0,LispTokenKind::RightParenthesis}));
+                        const SourceLocation location = CurrentLocation();
+                        _diagnostics.EmplaceBack(DiagnosticFactory::NoMatchingOpenParenthesis(_filePath,
+                            location.Line,
+                            location.ColumnChar));
                     }
-                    ch = NextChar();
+                    ch = NextChar<LazyLocations>();
                     continue;
                 }
                 default:
                     break;
             }
-            const std::size_t blockIndex = _textStreamPos >> 5;
+            const std::size_t blockIndex = _textStreamPos >> TokensInBlockPopCnt;
             const TokenizationBlock& block = *_blocks.At(blockIndex);
             const std::uint8_t posInBlock = OffsetInBlock();
 
             //comments
-            if (const auto targetNewlineBlock = block.NewLines >> (posInBlock + 1); IsComment(ch)) {
+            if (const auto targetNewlineBlock = (block.NewLines() >> posInBlock) >> 1; IsComment(ch)) {
                 const auto [_,endOfCommentOffset] = FetchCommentRegion(targetNewlineBlock,posInBlock);
                 ch = SkipToCharAtWithoutColumn(endOfCommentOffset);
-                ++_line;
-                _column = 1;
+                if constexpr (!LazyLocations) {
+                    ++_line;
+                    _column = 1;
+                }
             }
             //fragments
-            else if (const std::uint32_t fragmentsBlock = block.FragmentsMask >> posInBlock;fragmentsBlock & 1U) {
+            else if (const BlockMask fragmentsBlock = block.FragmentsMask() >> posInBlock;fragmentsBlock & 1U) {
                 const TokenizationBlock* currentBlock = &block;
-                const auto startLine = _line;
-                auto [startOfRegion,lengthOfRegion] = FetchFragmentRegion(fragmentsBlock,posInBlock,currentBlock);
+                [[maybe_unused]] const auto startLine = _line;
+                auto [startOfRegion,lengthOfRegion] = FetchFragmentRegion<LazyLocations>(fragmentsBlock,posInBlock,currentBlock);
                 ch = SkipToCharAtWithoutColumn(lengthOfRegion);
-                if (_line != startLine) {
-                    currentBlock = _blocks.At(_textStreamPos >> 5);
-                    const std::uint8_t offsetInBlock = OffsetInBlock(); //position where last fragment is
-                    const std::uint32_t posOfLastNewLine =
-                        (TokensInBlock- std::countl_zero(~(0xFFFFFFFFU << offsetInBlock) & currentBlock->NewLines))
-                        & TokensInBlockBoundary;
-                    _column = std::countr_one(currentBlock->FragmentsMask >> posOfLastNewLine) + 1;
-                }
-                else {
-                    _column += lengthOfRegion;
+                if constexpr (!LazyLocations) {
+                    if (_line != startLine) {
+                        _column = ColumnAfterNewLine();
+                    }
+                    else {
+                        _column += lengthOfRegion;
+                    }
                 }
             }
             //sexpr and operators (most of them)
-            else if (const std::uint32_t sexprOpsBlock = block.SExprAndOpsMask >> posInBlock; sexprOpsBlock & 1U) {
-                ch = NextChar();
+            else if (const BlockMask sexprOpsBlock = block.SExprAndOpsMask() >> posInBlock; sexprOpsBlock & 1U) {
+                ch = NextChar<LazyLocations>();
             }
             //digits
-            else if (const auto digitsBlock = block.DigitsMask >> posInBlock; digitsBlock & 1U) [[likely]]{
+            else if (const auto digitsBlock = block.DigitsMask() >> posInBlock; digitsBlock & 1U) [[likely]]{
                 const auto [startOfDigit,endOfDigitOffset] = TokenizeRealBlue(digitsBlock,posInBlock,&block);
                 _column += endOfDigitOffset;
                 ch = CurrentChar();
             }
             //identifiers
-            else if (const std::uint32_t idBlock = block.IdentifierMask >> posInBlock; idBlock & 1U) [[likely]]{
+            else if (const BlockMask idBlock = block.IdentifierMask() >> posInBlock; idBlock & 1U) [[likely]]{
                 const auto [startOfId,endOfIdOffset] = FetchIdentifierRegion(idBlock,posInBlock);
-                ch = SkipToCharAt(endOfIdOffset);
+                ch = SkipToCharAt<LazyLocations>(endOfIdOffset);
             }
             //string literals
-            else if (const auto stringBlock = block.StringLiteralsMask >> posInBlock; stringBlock & 1U) {
+            else if (const auto stringBlock = block.StringLiteralsMask() >> posInBlock; stringBlock & 1U) {
                 const auto [startOfString,endOfStringOffset] = FetchStringRegion(stringBlock,posInBlock);
-                ch = SkipToCharAt(endOfStringOffset);
+                ch = SkipToCharAt<LazyLocations>(endOfStringOffset);
             }
             //rest of operators
             else if (IsOperator(ch)) {
                 const auto [_,opLength] = TokenizeOperatorsOrStructuralBlue();
-                ch = SkipToCharAt(opLength);
+                ch = SkipToCharAt<LazyLocations>(opLength);
             }
             else if (IsEndOfFile()) {
                 break;
             }
             else {
+                const SourceLocation location = CurrentLocation();
                 _diagnostics.EmplaceBack(DiagnosticFactory::UnrecognizedToken(_filePath,
-                    _line,
-                    _column,
-                    LispToken{_text.data()+_tokenStreamPos,_line,1,0,_column,0,LispTokenKind::Invalid}));
-                ch = NextChar();
+                    location.Line,
+                    location.ColumnChar,
+                    std::string_view{_text.data()+_tokenStreamPos,1}));
+                ch = NextChar<LazyLocations>();
             }
         }
 
@@ -676,25 +1582,423 @@ namespace WideLips {
         while (bufferSize > 0) {
             const auto sexprIndicesPos = *stack.At(--bufferSize);
             const auto sexprIndex = _sexprIndices[sexprIndicesPos];
+            if constexpr (LazyLocations) {
+                const SourceLocation location = LocationAt(sexprIndex.Open);
+                _diagnostics.EmplaceBack(DiagnosticFactory::NoMatchingCloseParenthesis(_filePath,
+                    location.Line,
+                    location.ColumnChar));
+                continue;
+            }
             _diagnostics.EmplaceBack(DiagnosticFactory::NoMatchingCloseParenthesis(_filePath,
                 sexprIndex.OpenLine,
-                sexprIndex.OpenColumn,
-                LispToken{")"}
-                ));
+                sexprIndex.OpenColumn));
         }
+    }
 
-        auto noError = std::all_of(_diagnostics.begin(),
-            _diagnostics.end(),
-            [](const LispDiagnostic& diagnostic) {return diagnostic.GetSeverity() != Severity::Error;});
+    //instead of a stack walking the whole text, every chunk matches the parentheses it can on its own while the ones
+    //left dangling (closing ones without their opening one in the chunk, opening ones still open at its end) are
+    //matched across chunks afterwards, the same carry and fix up scheme the classifier uses for escapes makes chunks
+    //agree on whether they start within a string literal or a comment
+    void LispLexer::MatchSExprParallel() {
+        using namespace Diagnostic;
+        const std::size_t textSize = _text.size();
+        const std::size_t blocksCount = (textSize + TokensInBlockBoundary) >> TokensInBlockPopCnt;
+        if (blocksCount == 0) {
+            return;
+        }
+        const char* text = _text.data();
+        const auto scanBlock = [&](const std::size_t block,const StructuralState state) noexcept {
+            const std::size_t start = block << TokensInBlockPopCnt;
+            return ScanStructure(_blocks[block],
+                text + start,
+                static_cast<std::uint32_t>(std::min<std::size_t>(TokensInBlock,textSize - start)),
+                state,
+                _prefixXor);
+        };
+        const std::size_t chunksCount = std::clamp<std::size_t>(blocksCount / Classifier::MinBlocksPerThread,1,_threads);
+        const std::size_t chunkBlocks = (blocksCount + chunksCount - 1) / chunksCount;
+        std::vector<StructuralChunk> chunks(chunksCount);
+        for (std::size_t chunk = 0; chunk < chunksCount; ++chunk) {
+            chunks[chunk].FirstBlock = chunk * chunkBlocks;
+            chunks[chunk].EndBlock = std::min(blocksCount,(chunk + 1) * chunkBlocks);
+        }
+        //state each block is entered with, every chunk assumes it starts within code until fixed up
+        std::vector<StructuralState> entries(blocksCount + 1,StructuralState::Code);
+        ParallelFor(chunksCount,[&](const std::size_t chunk) noexcept {
+            StructuralChunk& current = chunks[chunk];
+            StructuralState state = StructuralState::Code;
+            for (std::size_t block = current.FirstBlock; block < current.EndBlock; ++block) {
+                entries[block] = state;
+                state = scanBlock(block,state).Exit;
+            }
+            current.Exit = state;
+        });
+        StructuralState state = chunks[0].Exit;
+        for (std::size_t chunk = 1; chunk < chunksCount; ++chunk) {
+            std::size_t block = chunks[chunk].FirstBlock;
+            for (; block < chunks[chunk].EndBlock && entries[block] != state; ++block) {
+                entries[block] = state;
+                state = scanBlock(block,state).Exit;
+            }
+            if (block != chunks[chunk].EndBlock) {
+                state = chunks[chunk].Exit;
+            }
+            chunks[chunk].Exit = state;
+        }
+        entries[blocksCount] = state;
+
+        //per chunk totals, prefix summed below into what every chunk starts with
+        ParallelFor(chunksCount,[&](const std::size_t chunk) noexcept {
+            StructuralChunk& current = chunks[chunk];
+            for (std::size_t block = current.FirstBlock; block < current.EndBlock; ++block) {
+                const StructuralBlock structure = scanBlock(block,entries[block]);
+                current.Opens += std::popcount(structure.Opens);
+                current.Line += std::popcount(structure.NewLines);
+                if (structure.NewLines != 0) {
+                    current.LineStart = static_cast<std::uint32_t>((block << TokensInBlockPopCnt) + TokensInBlock -
+                        std::countl_zero(structure.NewLines));
+                }
+            }
+        });
+        std::uint32_t opens = 0;
+        std::uint32_t line = 1;
+        std::uint32_t lineStart = 0;
+        for (StructuralChunk& chunk : chunks) {
+            const std::uint32_t chunkOpens = chunk.Opens;
+            const std::uint32_t chunkLines = chunk.Line;
+            const std::uint32_t chunkLineStart = chunk.LineStart;
+            chunk.Opens = opens;
+            chunk.Line = line;
+            chunk.LineStart = lineStart;
+            opens += chunkOpens;
+            line += chunkLines;
+            lineStart = chunkLines != 0 ? chunkLineStart : lineStart;
+        }
+
+        SExprIndex *const indices = _sexprIndices.Preserve(opens);
+        ParallelFor(chunksCount,[&](const std::size_t chunk) noexcept {
+            StructuralChunk& current = chunks[chunk];
+            std::uint32_t index = current.Opens;
+            std::uint32_t blockLine = current.Line;
+            std::uint32_t blockLineStart = current.LineStart;
+            for (std::size_t block = current.FirstBlock; block < current.EndBlock; ++block) {
+                const StructuralBlock structure = scanBlock(block,entries[block]);
+                const auto blockStart = static_cast<std::uint32_t>(block << TokensInBlockPopCnt);
+                for (BlockMask events = structure.Opens | structure.Closes | structure.Unclassified;
+                    events != 0;
+                    events &= events - 1) {
+                    const auto at = static_cast<std::uint32_t>(std::countr_zero(events));
+                    const std::uint32_t position = blockStart + at;
+                    const BlockMask newLines = structure.NewLines & LowerBitsMask(at);
+                    const std::uint32_t eventLine = blockLine + std::popcount(newLines);
+                    const std::uint32_t eventColumn = position + 1 - (newLines != 0 ?
+                        blockStart + TokensInBlock - std::countl_zero(newLines) : blockLineStart);
+                    if (structure.Opens >> at & 1U) {
+                        current.Unclosed.push_back(index);
+                        indices[index] = SExprIndex::Opening(position,eventLine,eventColumn);
+                        ++index;
+                    }
+                    else if (structure.Closes >> at & 1U) {
+                        if (current.Unclosed.empty()) {
+                            current.Dangling.push_back(StructuralEvent{position,eventLine,eventColumn,index,true});
+                            continue;
+                        }
+                        SExprIndex& sexprIndex = indices[current.Unclosed.back()];
+                        current.Unclosed.pop_back();
+                        sexprIndex.Closing(position,eventLine,eventColumn,index);
+                    }
+                    else if (!IsOperator(text[position])) {
+                        current.Dangling.push_back(StructuralEvent{position,eventLine,eventColumn,0,false});
+                    }
+                }
+                blockLine += std::popcount(structure.NewLines);
+                if (structure.NewLines != 0) {
+                    blockLineStart = blockStart + TokensInBlock - std::countl_zero(structure.NewLines);
+                }
+            }
+        });
 
-        noError &= CheckAtomsAtTopLevelBlue();
+        //chunks are merged in text order so diagnostics come out just like the sequential engine reports them
+        std::vector<std::uint32_t> unclosed;
+        for (const StructuralChunk& chunk : chunks) {
+            for (const StructuralEvent& event : chunk.Dangling) {
+                if (!event.Close) {
+                    _diagnostics.EmplaceBack(DiagnosticFactory::UnrecognizedToken(_filePath,
+                        event.Line,
+                        event.Column,
+                        std::string_view{_text.data()+_tokenStreamPos,1}));
+                }
+                else if (!unclosed.empty()) {
+                    SExprIndex& sexprIndex = indices[unclosed.back()];
+                    unclosed.pop_back();
+                    sexprIndex.Closing(event.Position,event.Line,event.Column,event.Next);
+                }
+                else {
+                    _diagnostics.EmplaceBack(DiagnosticFactory::NoMatchingOpenParenthesis(_filePath,
+                        event.Line,
+                        event.Column));
+                }
+            }
+            unclosed.insert(unclosed.end(),chunk.Unclosed.begin(),chunk.Unclosed.end());
+        }
 
-        _tokenized = true;
-        _reused = false;
-        return noError && _diagnostics.Empty();
+        if (entries[blocksCount] == StructuralState::String) {
+            //the string literal opens in the last block entered outside of it, its position is only needed once so
+            //lines are counted again from the start of its chunk
+            std::size_t stringBlock = blocksCount - 1;
+            while (entries[stringBlock] == StructuralState::String) {
+                --stringBlock;
+            }
+            const auto chunk = std::find_if(chunks.rbegin(),chunks.rend(),
+                [stringBlock](const StructuralChunk& current) {return current.FirstBlock <= stringBlock;});
+            std::uint32_t stringLine = chunk->Line;
+            std::uint32_t stringLineStart = chunk->LineStart;
+            StructuralBlock structure;
+            for (std::size_t block = chunk->FirstBlock; block <= stringBlock; ++block) {
+                structure = scanBlock(block,entries[block]);
+                stringLine += std::popcount(structure.NewLines);
+                if (structure.NewLines != 0) {
+                    stringLineStart = static_cast<std::uint32_t>((block << TokensInBlockPopCnt) + TokensInBlock -
+                        std::countl_zero(structure.NewLines));
+                }
+            }
+            const auto position = static_cast<std::uint32_t>((stringBlock << TokensInBlockPopCnt) +
+                structure.LastStringStart);
+            _diagnostics.EmplaceBack(DiagnosticFactory::UnterminatedStringLiteral(_filePath,
+                stringLine,
+                position + 1 - stringLineStart));
+        }
+
+        for (auto pending = unclosed.rbegin(); pending != unclosed.rend(); ++pending) {
+            const SourceLocation location = OpenLocationOf(indices[*pending]);
+            _diagnostics.EmplaceBack(DiagnosticFactory::NoMatchingCloseParenthesis(_filePath,
+                location.Line,
+                location.ColumnChar));
+        }
+    }
+
+    //the parallel engine's structural matching over a single chunk, only every tile of blocks is classified right
+    //before it's scanned. the text and the blocks are then touched once while they are hot rather than streamed
+    //through the cache twice, which is what matters once the text outgrows it
+    void LispLexer::ClassifyAndMatchSExprFused() {
+        using namespace Diagnostic;
+        const auto address = reinterpret_cast<const std::uint8_t*>(_text.data());
+        const char* text = _text.data();
+        const std::size_t textSize = _text.size();
+        const std::size_t fullBlocks = textSize >> TokensInBlockPopCnt;
+        const std::size_t blocksCount = (textSize + TokensInBlockBoundary) >> TokensInBlockPopCnt;
+        TokenizationBlock *const blocks = _blocks.Preserve(blocksCount);
+        LineRank *const ranks = _locations == SourceLocations::Lazy ? _lineRanks.Preserve(blocksCount) : nullptr;
+        std::vector<std::uint32_t> unclosed;
+        std::uint64_t escapeCarry = 0;
+        StructuralState state = StructuralState::Code;
+        std::uint32_t line = 1;
+        std::uint32_t lineStart = 0;
+        std::uint32_t stringLine = 0;
+        std::uint32_t stringColumn = 0;
+        for (std::size_t tile = 0; tile < blocksCount; tile += FusedTileBlocks) {
+            const std::size_t tileEnd = std::min(blocksCount,tile + FusedTileBlocks);
+            const std::size_t tileFullEnd = std::min(tileEnd,fullBlocks);
+            if (tileFullEnd > tile) {
+                escapeCarry = _classifier(address + (tile << TokensInBlockPopCnt),
+                    tileFullEnd - tile,
+                    blocks + tile,
+                    escapeCarry);
+            }
+            if (tileEnd != tileFullEnd) {
+                //same as 'Classify', the last partial block is classified from a copy padded with EOF
+                alignas(TokensInBlock) std::uint8_t tail[TokensInBlock];
+                std::memset(tail,EOF,TokensInBlock);
+                std::memcpy(tail,address + (fullBlocks << TokensInBlockPopCnt),textSize & TokensInBlockBoundary);
+                escapeCarry = _classifier(tail,1,blocks + fullBlocks,escapeCarry);
+            }
+            for (std::size_t block = tile; block < tileEnd; ++block) {
+                if (ranks != nullptr) {
+                    ranks[block] = LineRank{line - 1,lineStart,static_cast<std::uint8_t>(state)};
+                }
+                const auto blockStart = static_cast<std::uint32_t>(block << TokensInBlockPopCnt);
+                const StructuralBlock structure = ScanStructure(blocks[block],
+                    text + blockStart,
+                    static_cast<std::uint32_t>(std::min<std::size_t>(TokensInBlock,textSize - blockStart)),
+                    state,
+                    _prefixXor);
+                const auto locate = [&](const std::uint32_t at) {
+                    const BlockMask newLines = structure.NewLines & LowerBitsMask(at);
+                    return std::pair{line + std::popcount(newLines),blockStart + at + 1 - (newLines != 0 ?
+                        blockStart + TokensInBlock - std::countl_zero(newLines) : lineStart)};
+                };
+                for (BlockMask events = structure.Opens | structure.Closes | structure.Unclassified;
+                    events != 0;
+                    events &= events - 1) {
+                    const auto at = static_cast<std::uint32_t>(std::countr_zero(events));
+                    const std::uint32_t position = blockStart + at;
+                    const auto [eventLine,eventColumn] = locate(at);
+                    if (structure.Opens >> at & 1U) {
+                        unclosed.push_back(static_cast<std::uint32_t>(_sexprIndices.Size()));
+                        _sexprIndices.EmplaceBack(SExprIndex::Opening(position,eventLine,eventColumn));
+                    }
+                    else if (structure.Closes >> at & 1U) {
+                        if (unclosed.empty()) {
+                            _diagnostics.EmplaceBack(DiagnosticFactory::NoMatchingOpenParenthesis(_filePath,
+                                eventLine,
+                                eventColumn));
+                            continue;
+                        }
+                        SExprIndex& sexprIndex = _sexprIndices[unclosed.back()];
+                        unclosed.pop_back();
+                        sexprIndex.Closing(position,eventLine,eventColumn,static_cast<std::uint32_t>(_sexprIndices.Size()));
+                    }
+                    else if (!IsOperator(text[position])) {
+                        _diagnostics.EmplaceBack(DiagnosticFactory::UnrecognizedToken(_filePath,
+                            eventLine,
+                            eventColumn,
+                            std::string_view{_text.data()+_tokenStreamPos,1}));
+                    }
+                }
+                //a string literal opened within the block unless it was entered within one that never closed,
+                //it can't be opened at the block start then so a zero start tells
+                if (structure.Exit == StructuralState::String &&
+                    (state != StructuralState::String || structure.LastStringStart != 0)) {
+                    std::tie(stringLine,stringColumn) = locate(structure.LastStringStart);
+                }
+                line += std::popcount(structure.NewLines);
+                if (structure.NewLines != 0) {
+                    lineStart = blockStart + TokensInBlock - std::countl_zero(structure.NewLines);
+                }
+                state = structure.Exit;
+            }
+        }
+        _blocks.EmplaceBack(TokenizationBlock{TokenizationMasks{
+            .NewLines = 1U //the sentinel block, see 'Classify'
+        }});
+
+        if (state == StructuralState::String) {
+            _diagnostics.EmplaceBack(DiagnosticFactory::UnterminatedStringLiteral(_filePath,stringLine,stringColumn));
+        }
+        for (auto pending = unclosed.rbegin(); pending != unclosed.rend(); ++pending) {
+            const SourceLocation location = OpenLocationOf(_sexprIndices[*pending]);
+            _diagnostics.EmplaceBack(DiagnosticFactory::NoMatchingCloseParenthesis(_filePath,
+                location.Line,
+                location.ColumnChar));
+        }
+    }
+
+    //matches the parentheses of [from,until) the way the fused engine does, the first S-expression of 'region' gets
+    //the index 'firstIndex'. 'line' and 'lineStart' locate 'from' and are left locating 'until'. anything the blue
+    //pass would report, or a region not ending in code right where the S-expression after it opens, fails the match
+    bool LispLexer::MatchSExprRegion(const std::uint32_t from,
+        const std::uint32_t until,
+        const std::uint32_t firstIndex,
+        std::vector<SExprIndex>& region,
+        std::uint32_t& forms,
+        std::uint32_t& line,
+        std::uint32_t& lineStart) const {
+        const char* text = _text.data();
+        const auto textSize = static_cast<std::uint32_t>(_text.size());
+        std::vector<std::uint32_t> unclosed;
+        StructuralState state = StructuralState::Code;
+        for (std::uint32_t blockStart = from & ~TokensInBlockBoundary; blockStart < until; blockStart += TokensInBlock) {
+            const StructuralBlock structure = ScanStructure(_blocks[blockStart >> TokensInBlockPopCnt],
+                text + blockStart,
+                std::min(TokensInBlock,until - blockStart),
+                state,
+                _prefixXor,
+                blockStart < from ? from - blockStart : 0);
+            for (BlockMask events = structure.Opens | structure.Closes | structure.Unclassified;
+                events != 0;
+                events &= events - 1) {
+                const auto at = static_cast<std::uint32_t>(std::countr_zero(events));
+                const std::uint32_t position = blockStart + at;
+                const BlockMask newLines = structure.NewLines & LowerBitsMask(at);
+                const std::uint32_t eventLine = line + std::popcount(newLines);
+                const std::uint32_t eventColumn = position + 1 - (newLines != 0 ?
+                    blockStart + TokensInBlock - std::countl_zero(newLines) : lineStart);
+                if (structure.Opens >> at & 1U) {
+                    unclosed.push_back(static_cast<std::uint32_t>(region.size()));
+                    region.push_back(SExprIndex::Opening(position,eventLine,eventColumn));
+                }
+                else if (structure.Closes >> at & 1U) {
+                    if (unclosed.empty()) {
+                        return false;
+                    }
+                    SExprIndex& sexprIndex = region[unclosed.back()];
+                    unclosed.pop_back();
+                    sexprIndex.Closing(position,eventLine,eventColumn,firstIndex + static_cast<std::uint32_t>(region.size()));
+                    forms += unclosed.empty();
+                }
+                else if (!IsOperator(text[position])) {
+                    return false;
+                }
+            }
+            line += std::popcount(structure.NewLines);
+            if (structure.NewLines != 0) {
+                lineStart = blockStart + TokensInBlock - std::countl_zero(structure.NewLines);
+            }
+            state = structure.Exit;
+        }
+        if (!unclosed.empty()) {
+            return false;
+        }
+        if (until == textSize) {
+            return state != StructuralState::String;
+        }
+        //a backslash inserted right before the S-expression after the region escapes its parenthesis
+        const BlockMask parentheses = _blocks[until >> TokensInBlockPopCnt].SExprAndOpsMask();
+        return state == StructuralState::Code && (parentheses >> (until & TokensInBlockBoundary) & 1U);
     }
 
-    ALWAYS_INLINE LispLexer::TokenRegion LispLexer::TokenizeRealBlue(std::uint32_t startingBlock,
+    //moves the tokens materialized past 'from' (the old offset of the top level S-expression right after an edit)
+    //along with the text, the opening parenthesis of that S-expression gets the auxiliary of its new neighbourhood
+    void LispLexer::ShiftMaterialized(const std::uint32_t from,
+        const std::uint32_t movedFrom,
+        const std::uint32_t shift,
+        const std::uint32_t indexShift,
+        UNUSED const std::uint32_t fromLine,
+        UNUSED const std::uint32_t lineShift,
+        UNUSED const std::uint32_t columnShift,
+        const std::uint32_t leadingAuxiliary,
+        const std::uint8_t leadingAuxiliaryLength) noexcept {
+        UNUSED const bool eagerLocations = _locations == SourceLocations::Eager;
+        //materialized in text order form by form, the tokens and auxiliaries of the S-expressions before 'movedFrom'
+        //all come first and are skipped by bisection, otherwise any of them may have to move
+        LispToken* firstToken = _tokens.begin();
+        AuxiliaryIndex* firstAuxiliary = _auxiliaries.begin();
+        if (_materializedInOrder) {
+            firstToken = std::partition_point(_tokens.begin(),_tokens.end(),[&](const LispToken& token) {
+                return token.GetByteLocation(_text.data()) < movedFrom;
+            });
+            firstAuxiliary = std::partition_point(_auxiliaries.begin(),_auxiliaries.end(),
+                [&](const AuxiliaryIndex& auxiliary) { return auxiliary.At < movedFrom; });
+        }
+        for (LispToken& token : std::span(firstToken,_tokens.end())) {
+            const std::uint32_t at = token.GetByteLocation(_text.data());
+            if (at < from) {
+                continue;
+            }
+            if (token.Kind == LispTokenKind::LeftParenthesis) {
+                token.IndexInSpecialStream += indexShift;
+                if (at == from) {
+                    token.AuxiliaryIndex = leadingAuxiliary;
+                    token.AuxiliaryLength = leadingAuxiliaryLength;
+                }
+            }
+#ifdef WL_COMPACT_TOKENS
+            token.Offset += shift;
+#else
+            token.TextPtr += static_cast<std::int32_t>(shift);
+            //auxiliary tokens have no location of their own
+            if (eagerLocations && token.Line != std::numeric_limits<std::uint32_t>::max()) {
+                token.Column += token.Line == fromLine ? columnShift : 0;
+                token.Line += lineShift;
+            }
+#endif
+        }
+        for (AuxiliaryIndex& auxiliary : std::span(firstAuxiliary,_auxiliaries.end())) {
+            auxiliary.At += auxiliary.At >= from ? shift : 0;
+        }
+    }
+
+    ALWAYS_INLINE LispLexer::TokenRegion LispLexer::TokenizeRealBlue(BlockMask startingBlock,
         std::uint8_t posInBlock,
         const TokenizationBlock* currentBlock) noexcept {
         std::uint32_t realLength = 0;
@@ -704,9 +2008,9 @@ namespace WideLips {
             return {realStart,realInitLength};
         }
         realLength += realInitLength+1;/*+1 for the floating point '.'*/
-        currentBlock = &_blocks[_textStreamPos++ >> TokensInBlockPopCnt];
-        startingBlock = currentBlock->DigitsMask;
-        posInBlock = _textStreamPos & 0x1F;
+        currentBlock = &_blocks[++_textStreamPos >> TokensInBlockPopCnt]; //the mantissa may start in the next block
+        startingBlock = currentBlock->DigitsMask();
+        posInBlock = OffsetInBlock();
         auto [mantissaStart,mantissaLength] = FetchDigitRegion(startingBlock >> posInBlock,posInBlock);
         realLength += mantissaLength;
         ch = SkipToCharAtWithoutColumn(mantissaLength);
@@ -719,13 +2023,19 @@ namespace WideLips {
                 ch = NextCharWithoutColumn();
             }
             if (!IsDecimal(ch)) {
+                if (_locations == SourceLocations::Lazy) {
+                    const SourceLocation location = LocationAt(realStart + realLength);
+                    _diagnostics.EmplaceBack(Diagnostic::DiagnosticFactory::MalformedFloatingPointLiteral(
+                        _filePath,location.Line,location.ColumnChar,_text.substr(realStart, realLength) ));
+                    return {realStart,realInitLength};
+                }
                 _diagnostics.EmplaceBack(Diagnostic::DiagnosticFactory::MalformedFloatingPointLiteral(
                     _filePath,_line,_column+realLength,_text.substr(realStart, realLength) ));
                 return {realStart,realInitLength};
             }
             currentBlock = &_blocks[_textStreamPos >> TokensInBlockPopCnt];
-            startingBlock = currentBlock->DigitsMask;
-            posInBlock = _textStreamPos & 0x1F;
+            startingBlock = currentBlock->DigitsMask();
+            posInBlock = OffsetInBlock();
             auto [_,exponentLength] = FetchDigitRegion(startingBlock >> posInBlock,posInBlock);
             realLength += exponentLength;
             (void)SkipToCharAtWithoutColumn(exponentLength);
@@ -790,14 +2100,17 @@ namespace WideLips {
         }
     }
 
-    bool LispLexer::CheckAtomsAtTopLevelBlue() noexcept {
+    template<bool LazyLocations>
+    bool LispLexer::CheckAtomsAtTopLevelBlue(const std::uint32_t firstIndex,const std::uint32_t lastIndex) noexcept {
         using namespace Diagnostic;
 
-        if (_sexprIndices.Empty())[[unlikely]]{
+        if (firstIndex >= _sexprIndices.Size())[[unlikely]]{
             return true;
         }
-        _textStreamPos = 0;
-        const auto* currentSexprIndex = &_sexprIndices[0];
+        //the walk starts wherever the stream was left, before the top level S-expression 'firstIndex', and stops
+        //right before 'lastIndex'
+        std::uint32_t currentIndex = firstIndex;
+        const auto* currentSexprIndex = &_sexprIndices[firstIndex];
         char ch = CurrentChar();
         bool result = true;
         //instead of checking that we are at program top level for each iteration in 'TokenizeBlue' instead
@@ -806,31 +2119,30 @@ namespace WideLips {
         //this improves the overall performance of the blue pass while keeping validation sound and without
         do {
             while (_textStreamPos < currentSexprIndex->Open)[[likely]]{
-                const std::size_t blockIndex = _textStreamPos >> 5;
+                const std::size_t blockIndex = _textStreamPos >> TokensInBlockPopCnt;
                 const TokenizationBlock& block = *_blocks.At(blockIndex);
                 const std::uint8_t posInBlock = OffsetInBlock();
-                if (const auto targetNewlineBlock = block.NewLines >> (posInBlock + 1); IsComment(ch)) {
+                if (const auto targetNewlineBlock = (block.NewLines() >> posInBlock) >> 1; IsComment(ch)) {
                     const auto [_,endOfCommentOffset] = FetchCommentRegion(targetNewlineBlock,posInBlock);
                     ch = SkipToCharAtWithoutColumn(endOfCommentOffset);
-                    ++_line;
-                    _column = 1;
+                    if constexpr (!LazyLocations) {
+                        ++_line;
+                        _column = 1;
+                    }
                 }
                 //fragments
-                else if (const std::uint32_t fragmentsBlock = block.FragmentsMask >> posInBlock;fragmentsBlock & 1U) {
+                else if (const BlockMask fragmentsBlock = block.FragmentsMask() >> posInBlock;fragmentsBlock & 1U) {
                     const TokenizationBlock* currentBlock = &block;
-                    const auto startLine = _line;
-                    auto [startOfRegion,lengthOfRegion] = FetchFragmentRegion(fragmentsBlock,posInBlock,currentBlock);
+                    [[maybe_unused]] const auto startLine = _line;
+                    auto [startOfRegion,lengthOfRegion] = FetchFragmentRegion<LazyLocations>(fragmentsBlock,posInBlock,currentBlock);
                     ch = SkipToCharAtWithoutColumn(lengthOfRegion);
-                    if (_line != startLine) {
-                        currentBlock = _blocks.At(_textStreamPos >> 5);
-                        const std::uint8_t offsetInBlock = OffsetInBlock(); //position where last fragment is
-                        const std::uint32_t posOfLastNewLine =
-                            (TokensInBlock- std::countl_zero(~(0xFFFFFFFFU << offsetInBlock) & currentBlock->NewLines))
-                            & TokensInBlockBoundary;
-                        _column = std::countr_one(currentBlock->FragmentsMask >> posOfLastNewLine) + 1;
-                    }
-                    else {
-                        _column += lengthOfRegion;
+                    if constexpr (!LazyLocations) {
+                        if (_line != startLine) {
+                            _column = ColumnAfterNewLine();
+                        }
+                        else {
+                            _column += lengthOfRegion;
+                        }
                     }
                 }
                 //if there are no trivia between adjacent lists, then we just jump to the next list
@@ -839,19 +2151,28 @@ namespace WideLips {
                 }
                 else {
                     //there cannot be any top level token other than S-expression tokens aka '(' and ')'
+                    const SourceLocation location = CurrentLocation();
                     _diagnostics.EmplaceBack(DiagnosticFactory::UnexpectedTopLevelToken(_filePath,
-                        _line,
-                        _column));
+                        location.Line,
+                        location.ColumnChar));
                     result = false;
                     //it's sufficient to report one 'UnexpectedTopLevelToken' then we jump to next list
                     break;
                 }
             }
+            if (currentIndex == lastIndex) {
+                break;
+            }
             _textStreamPos = currentSexprIndex->Close+1;
+            if constexpr (!LazyLocations) {
+                _line = currentSexprIndex->CloseLine;
+                _column = currentSexprIndex->CloseColumn+1;
+            }
             if (currentSexprIndex->Next >= _sexprIndices.Size() || !currentSexprIndex->Next) {
                 break;
             }
-            currentSexprIndex = &_sexprIndices[currentSexprIndex->Next];
+            currentIndex = currentSexprIndex->Next;
+            currentSexprIndex = &_sexprIndices[currentIndex];
             ch = CurrentChar();
         }while (true);
 
@@ -871,7 +2192,7 @@ namespace WideLips {
         }
     }
 
-    ALWAYS_INLINE LispLexer::TokenRegion LispLexer::FetchStringRegion(std::uint32_t startingBlock,const std::uint8_t posInBlock) noexcept {
+    ALWAYS_INLINE LispLexer::TokenRegion LispLexer::FetchStringRegion(BlockMask startingBlock,const std::uint8_t posInBlock) noexcept {
         const std::uint32_t startOfRegion = _textStreamPos;
         startingBlock = startingBlock >> 1u; //skip the start of string '"'
         std::uint32_t endOfRegion = std::countr_zero(startingBlock);//+1 due to the right shift above
@@ -890,11 +2211,12 @@ namespace WideLips {
         while ((endOfRegion & TokensInBlockBoundary) == 0 && count) {
             const TokenizationBlock* nextBlock = TokenizationBlockAt(pos);
             if (nextBlock == nullptr) { //non terminating string literal
+                const SourceLocation location = CurrentLocation();
                 _diagnostics.EmplaceBack(Diagnostic::DiagnosticFactory::UnterminatedStringLiteral(
-                       _filePath,_line,_column));
+                       _filePath,location.Line,location.ColumnChar));
                 return {startOfRegion,static_cast<std::uint32_t>(_text.size() - startOfRegion - 1)};
             }
-            count = std::countr_zero(nextBlock->StringLiteralsMask);
+            count = std::countr_zero(nextBlock->StringLiteralsMask());
             endOfRegion += count;
             pos += count;
         }
@@ -903,7 +2225,7 @@ namespace WideLips {
         return {startOfRegion,endOfRegion};
     }
 
-    ALWAYS_INLINE LispLexer::TokenRegion LispLexer::FetchCommentRegion(const std::uint32_t startingBlock,const std::uint8_t posInBlock) noexcept {
+    ALWAYS_INLINE LispLexer::TokenRegion LispLexer::FetchCommentRegion(const BlockMask startingBlock,const std::uint8_t posInBlock) noexcept {
         const std::uint32_t startOfRegion = _textStreamPos;
         std::uint32_t endOfRegion = std::countr_zero(startingBlock);
         std::uint32_t pos = startOfRegion;
@@ -918,29 +2240,35 @@ namespace WideLips {
         std::uint32_t count = 1U;
         while ((endOfRegion & TokensInBlockBoundary) == 0 && count) {
             const TokenizationBlock* nextBlock = TokenizationBlockAt(pos);
-            count = std::countr_zero(nextBlock->NewLines);
+            count = std::countr_zero(nextBlock->NewLines());
             endOfRegion += count;
             pos += count;
         }
         //+1 due to starting block skipping comment start ';'.
         //the another +1 to take \n which terminates single line comment (also help in reducing number of parse tree nodes)
         endOfRegion = endOfRegion + 2 - optionalOffset;
+        //a comment on the last line has no newline and runs until the sentinel block, which can lie past the padding
+        //when the text doesn't fill the last block, so it's capped at the last padding byte
+        endOfRegion = std::min(endOfRegion,static_cast<std::uint32_t>(_text.size() - 1 - startOfRegion));
         return {startOfRegion,endOfRegion};
     }
 
-    ALWAYS_INLINE LispLexer::TokenRegion LispLexer::FetchFragmentRegion(const std::uint32_t startingBlock,
+    template<bool LazyLocations>
+    ALWAYS_INLINE LispLexer::TokenRegion LispLexer::FetchFragmentRegion(const BlockMask startingBlock,
         std::uint8_t posInBlock,
         const TokenizationBlock* currentBlock) noexcept {
 
         const std::uint32_t startOfRegion = _textStreamPos;
-        const std::uint32_t block = startingBlock;
+        const BlockMask block = startingBlock;
         std::uint32_t offset = std::countr_one(block);
         //assuming we are at tokenization block N and position M in block, if starting from M till the end of the block
         //(let's call it E) if all bits are set/on then it's possible that tokenization block N+1... is a continuation
         //of fragments from current block (N), if this is the case then we go to the do-while loop! if bits between
         //M and E are not all set, then we don't have to fetch a tokenization block and we can return immediately
         if (offset + posInBlock < TokensInBlock) {
-            _line += std::popcount(~(0xFFFFFFFFULL << offset) & currentBlock->NewLines >> posInBlock);
+            if constexpr (!LazyLocations) {
+                _line += std::popcount(LowerBitsMask(offset) & currentBlock->NewLines() >> posInBlock);
+            }
             return {startOfRegion,offset};
         }
 
@@ -948,22 +2276,26 @@ namespace WideLips {
         std::uint32_t fragMask = offset;
         const TokenizationBlock* nextBlock = currentBlock;
         do {
-            _line += std::popcount(~(0xFFFFFFFFULL << fragMask) & nextBlock->NewLines >> posInBlock);
+            if constexpr (!LazyLocations) {
+                _line += std::popcount(LowerBitsMask(fragMask) & nextBlock->NewLines() >> posInBlock);
+            }
             nextBlock = TokenizationBlockAt(pos+offset);
-            fragMask = std::countr_one(nextBlock->FragmentsMask);
+            fragMask = std::countr_one(nextBlock->FragmentsMask());
             offset += fragMask;
             posInBlock = 0;
         }while ((fragMask & TokensInBlockBoundary) == 0 && fragMask);
 
-        _line += std::popcount(~(0xFFFFFFFFULL << fragMask) & nextBlock->NewLines >> posInBlock);
+        if constexpr (!LazyLocations) {
+            _line += std::popcount(LowerBitsMask(fragMask) & nextBlock->NewLines() >> posInBlock);
+        }
         return {startOfRegion,offset};
     }
 
-    ALWAYS_INLINE LispLexer::TokenRegion LispLexer::FetchDigitRegion(const std::uint32_t startingBlock,
+    ALWAYS_INLINE LispLexer::TokenRegion LispLexer::FetchDigitRegion(const BlockMask startingBlock,
         const std::uint8_t posInBlock) noexcept {
 
         const std::uint32_t startOfRegion = _textStreamPos;
-        const std::uint32_t block = startingBlock;
+        const BlockMask block = startingBlock;
         std::uint32_t offset = std::countr_one(block);
         if (const std::uint32_t pos = posInBlock+offset; pos < TokensInBlock) [[likely]]{
             return {startOfRegion,offset};
@@ -972,17 +2304,17 @@ namespace WideLips {
         const std::uint32_t pos = startOfRegion+posInBlock;
         do{
             const TokenizationBlock* nextBlock = TokenizationBlockAt(pos+offset);
-            digitsMask = std::countr_one(nextBlock->DigitsMask);
+            digitsMask = std::countr_one(nextBlock->DigitsMask());
             offset += digitsMask;
         }while ((digitsMask & TokensInBlockBoundary) == 0 && digitsMask);
         return {startOfRegion,offset};
     }
 
-    ALWAYS_INLINE LispLexer::TokenRegion LispLexer::FetchIdentifierRegion(const std::uint32_t startingBlock,
+    ALWAYS_INLINE LispLexer::TokenRegion LispLexer::FetchIdentifierRegion(const BlockMask startingBlock,
         const std::uint8_t posInBlock) noexcept {
 
         const std::uint32_t startOfRegion = _textStreamPos;
-        const std::uint32_t block = startingBlock;
+        const BlockMask block = startingBlock;
         std::uint32_t offset = std::countr_one(block);
         //if the last bit in pos is set then it's possible that the remaining parts of the identifier are
         //in blocks N+K (where K is >= 1)
@@ -993,20 +2325,22 @@ namespace WideLips {
         const std::uint32_t pos = startOfRegion+posInBlock;
         do{
             const TokenizationBlock* nextBlock = TokenizationBlockAt(pos+offset);
-            idMask = std::countr_one(nextBlock->IdentifierMask);
+            idMask = std::countr_one(nextBlock->IdentifierMask());
             offset += idMask;
         }while ((idMask & TokensInBlockBoundary) == 0 && idMask);
         return {startOfRegion,offset};
     }
 
+    template<bool LazyLocations>
     ALWAYS_INLINE void LispLexer::TokenizeOperatorsOrStructural(std::uint8_t fragLength) noexcept {
         const char ch = CurrentChar();
+        const char* const operatorText = _text.data() + _textStreamPos;
         const std::uint32_t column = _column;
         switch (ch) {
             case '<': {
-                switch (const char nextChar [[maybe_unused]] = NextChar()) {
+                switch (const char nextChar [[maybe_unused]] = NextChar<LazyLocations>()) {
                     case '=':
-                        _tokens.EmplaceBack(LispToken{"<=",
+                        EmitToken(operatorText,
                             _line,
                             2U,
                             static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength),
@@ -1014,11 +2348,11 @@ namespace WideLips {
                             0,
                             LispTokenKind::LessThanOrEqual,
                             fragLength
-                        });
-                        NextChar();
+                        );
+                        NextChar<LazyLocations>();
                         break;
                     case '<':
-                        _tokens.EmplaceBack(LispToken{"<<",
+                        EmitToken(operatorText,
                             _line,
                             2U,
                             static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength),
@@ -1026,11 +2360,11 @@ namespace WideLips {
                             0,
                             LispTokenKind::LeftBitShift,
                             fragLength
-                        });
-                        NextChar();
+                        );
+                        NextChar<LazyLocations>();
                         break;
                     default:
-                        _tokens.EmplaceBack(LispToken{"<",
+                        EmitToken(operatorText,
                            _line,
                            1U,
                            static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength),
@@ -1038,16 +2372,16 @@ namespace WideLips {
                             0,
                            LispTokenKind::LessThan,
                            fragLength
-                        });
+                        );
                         break;
                 }
                 break;
             }
 
             case '>':{
-                switch (const char nextChar [[maybe_unused]] = NextChar()) {
+                switch (const char nextChar [[maybe_unused]] = NextChar<LazyLocations>()) {
                     case '=':
-                        _tokens.EmplaceBack(LispToken{">=",
+                        EmitToken(operatorText,
                             _line,
                             2U,
                             static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength),
@@ -1055,11 +2389,11 @@ namespace WideLips {
                             0,
                             LispTokenKind::GreaterThanOrEqual,
                             fragLength
-                        });
-                        NextChar();
+                        );
+                        NextChar<LazyLocations>();
                         break;
                     case '>':
-                        _tokens.EmplaceBack(LispToken{">>",
+                        EmitToken(operatorText,
                             _line,
                             2U,
                             static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength),
@@ -1067,11 +2401,11 @@ namespace WideLips {
                             0,
                             LispTokenKind::RightBitShift,
                             fragLength
-                        });
-                        NextChar();
+                        );
+                        NextChar<LazyLocations>();
                         break;
                     default:
-                        _tokens.EmplaceBack(LispToken{">",
+                        EmitToken(operatorText,
                            _line,
                            1U,
                            static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength),
@@ -1079,7 +2413,7 @@ namespace WideLips {
                             0,
                            LispTokenKind::GreaterThan,
                            fragLength
-                        });
+                        );
                         break;
                 }
                 break;
@@ -1115,7 +2449,7 @@ namespace WideLips {
             case '~':
 #endif
 
-                _tokens.EmplaceBack(LispToken{_text.data()+_textStreamPos,
+                EmitToken(_text.data()+_textStreamPos,
                     _line,
                     1U,
                     static_cast<std::uint32_t>(_auxiliaries.Size()-fragLength),
@@ -1123,8 +2457,8 @@ namespace WideLips {
                     0,
                     static_cast<LispTokenKind>(ch),
                     fragLength
-                });
-                NextChar();
+                );
+                NextChar<LazyLocations>();
                 break;
             default:
                break;
@@ -1140,7 +2474,20 @@ namespace WideLips {
     }
 
     ALWAYS_INLINE std::uint8_t LispLexer::OffsetInBlock() const noexcept {
-        return _textStreamPos & 0x1Fu;
+        return _textStreamPos & TokensInBlockBoundary;
+    }
+
+    //called right after a run of fragments holding a newline, the run may have started blocks before the current one
+    //so the last newline is looked up backwards from the current position rather than within the current block only
+    ALWAYS_INLINE std::uint32_t LispLexer::ColumnAfterNewLine() const noexcept {
+        std::size_t blockIndex = _textStreamPos >> TokensInBlockPopCnt;
+        BlockMask newLines = _blocks[blockIndex].NewLines() & LowerBitsMask(OffsetInBlock());
+        while (newLines == 0) {
+            newLines = _blocks[--blockIndex].NewLines();
+        }
+        const std::uint32_t posOfLastNewLine = (blockIndex << TokensInBlockPopCnt) + TokensInBlockBoundary -
+            std::countl_zero(newLines);
+        return _textStreamPos - posOfLastNewLine;
     }
 
     ALWAYS_INLINE bool LispLexer::IsEndOfFile() const noexcept {
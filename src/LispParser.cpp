@@ -1,12 +1,40 @@
-﻿#include "LispParseTree.h"
+﻿#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include "LispParseTree.h"
 #include "LispParser.h"
 
 namespace WideLips {
-    LispParser::LispParser(const std::string_view program, const bool conservative):
+    namespace {
+        //only seeds the pool, which grows as the tree is expanded. a fully expanded parse tree has at most a node per
+        //token, so a sampled estimate bounds the seed of small texts
+        std::size_t ParseNodesPoolSize(const LispLexer& lexer,const std::size_t estimateFor,const bool conservative) {
+            const std::size_t seed = ArenaSizeEstimate(estimateFor,conservative);
+            const std::size_t tokens = lexer.GetArenaCapacities().Tokens;
+            return tokens != 0 ? std::min(seed,tokens * std::max(sizeof(LispAtom),sizeof(LispList))) : seed;
+        }
+
+        std::pmr::memory_resource* ParseNodesUpstream(const LispLexerOptions& options) noexcept {
+            return options.Pool != nullptr ? options.Pool->GetResource() : std::pmr::get_default_resource();
+        }
+
+        std::pmr::memory_resource* ParseNodesResource(const LispLexerOptions& options,
+            std::pmr::memory_resource* pool,
+            std::pmr::memory_resource* concurrent) noexcept {
+            return options.Concurrent ? concurrent : pool;
+        }
+    }
+
+    LispParser::LispParser(const std::string_view program,
+        const bool conservative,
+        const LispLexerOptions& options):
     _optionalAlignedFile(nullptr),
-    Lexer(LispLexer::Make(program,conservative)),
-    ParseNodesPool(ArenaSizeEstimate(program.size()/2,conservative)),
-    ParseNodesAllocator(&ParseNodesPool),
+    _conservative(conservative),
+    Lexer(LispLexer::Make(program,conservative,options)),
+    _parseNodesBuffer(ParseNodesUpstream(options),ParseNodesPoolSize(*Lexer,program.size()/2,conservative)),
+    ParseNodesPool(_parseNodesBuffer.Data,_parseNodesBuffer.Size,_parseNodesBuffer.Upstream),
+    _concurrentParseNodes(&ParseNodesPool,_parseNodesBuffer.Upstream,Lexer.get()),
+    ParseNodesAllocator(ParseNodesResource(options,&ParseNodesPool,&_concurrentParseNodes)),
     EndOfProgram(ParseNodesAllocator.new_object<LispAtom>(&PredefinedTokens::EndOfFile,
                 LispParseNodeKind::EndOfProgram,
                 nullptr,
@@ -15,11 +43,16 @@ namespace WideLips {
             )){
     }
 
-    LispParser::LispParser(const std::filesystem::path &filePath, const bool conservative):
+    LispParser::LispParser(const std::filesystem::path &filePath,
+        const bool conservative,
+        const LispLexerOptions& options):
     _optionalAlignedFile(AlignedFileReader::Read(filePath)),
-    Lexer(LispLexer::Make(_optionalAlignedFile,filePath.native(),conservative)),
-    ParseNodesPool(ArenaSizeEstimate(Lexer->GetFileSize(),conservative)),
-    ParseNodesAllocator(&ParseNodesPool),
+    _conservative(conservative),
+    Lexer(LispLexer::Make(_optionalAlignedFile,filePath.native(),conservative,options)),
+    _parseNodesBuffer(ParseNodesUpstream(options),ParseNodesPoolSize(*Lexer,Lexer->GetFileSize(),conservative)),
+    ParseNodesPool(_parseNodesBuffer.Data,_parseNodesBuffer.Size,_parseNodesBuffer.Upstream),
+    _concurrentParseNodes(&ParseNodesPool,_parseNodesBuffer.Upstream,Lexer.get()),
+    ParseNodesAllocator(ParseNodesResource(options,&ParseNodesPool,&_concurrentParseNodes)),
     EndOfProgram(ParseNodesAllocator.new_object<LispAtom>(&PredefinedTokens::EndOfFile,
                 LispParseNodeKind::EndOfProgram,
                 nullptr,
@@ -30,6 +63,11 @@ namespace WideLips {
 
     LispParseNodeBase* LispParser::Parse() {
         Lexer->Tokenize();
+        _root = ParseFirstSExpr();
+        return _root;
+    }
+
+    LispParseNodeBase* LispParser::ParseFirstSExpr() {
         const auto optRegion = Lexer->TokenizeFirstSExpr();
         if (!optRegion) {
             return nullptr;
@@ -45,6 +83,54 @@ namespace WideLips {
                 );
     }
 
+    LispParseNodeBase* LispParser::ApplyEdit(const std::uint32_t offset,
+        const std::uint32_t removedLength,
+        const std::string_view insertedText) {
+        const LispEdit edit = Lexer->ApplyEdit(offset,removedLength,insertedText);
+        if (!edit.KeptTokens || _root == nullptr) {
+            ResetParseNodes(_parseNodesBuffer.Size);
+            _root = ParseFirstSExpr();
+            return _root;
+        }
+        //the top level nodes are linked as far as they were walked, every one of them is a list whose opening
+        //parenthesis tells its S-expression index in the edited text, unless the edit overlapped it
+        const auto indexOf = [](const LispParseNodeBase* node) {
+            return reinterpret_cast<const LispList*>(node)->_sexprBegin->IndexInSpecialStream;
+        };
+        LispParseNodeBase* previous = nullptr;
+        LispParseNodeBase* following = _root;
+        while (following != nullptr && indexOf(following) < edit.FirstSExprIndex) {
+            previous = following;
+            following = following->Next;
+        }
+        for (std::uint32_t removed = 0; removed < edit.RemovedForms && following != nullptr; ++removed) {
+            following = following->Next;
+        }
+        if (following == nullptr) {
+            //nothing past the edit was walked yet, the nodes after 'previous' are made as they are walked
+            if (previous == nullptr) {
+                _root = ParseFirstSExpr();
+            }
+            else {
+                previous->Next = nullptr;
+            }
+            return _root;
+        }
+        //the S-expressions matched again are linked in between, the trivia before 'following' may have changed
+        LispParseNodeBase* last = previous;
+        for (std::uint32_t inserted = 0; inserted < edit.InsertedForms; ++inserted) {
+            const auto region = last == nullptr ?
+                Lexer->TokenizeFirstSExpr() :
+                Lexer->TokenizeNext(reinterpret_cast<const LispList*>(last)->_sexprBegin);
+            LispList* const list = MakeList(region->first,region->second);
+            (last == nullptr ? _root : last->Next) = list;
+            last = list;
+        }
+        (last == nullptr ? _root : last->Next) = following;
+        reinterpret_cast<const LispList*>(following)->ForgetNodeAuxiliary();
+        return _root;
+    }
+
     LispParseNodeBase* LispParser::Parse(const LispToken* sexprBegin,const LispToken* sexprEnd) {
         LispParseNodeBase* subExpressionsHead = nullptr;
         for (auto currentToken=sexprEnd; currentToken>=sexprBegin; --currentToken) [[likely]]{
@@ -98,11 +184,11 @@ namespace WideLips {
     }
 
     LispLexer * LispParser::GetLexer() const {
-        return Lexer.get();
+        return Lexer->Local();
     }
 
     LispAuxiliary * LispParser::MakeAuxiliary(const LispToken *auxBegin, const LispToken *auxEnd) {
-        return ParseNodesAllocator.new_object<LispAuxiliary>(std::pair{auxBegin,auxEnd});
+        return ParseNodesAllocator.new_object<LispAuxiliary>(std::pair{auxBegin,auxEnd},Lexer.get());
     }
 
     LispList * LispParser::MakeList(const LispToken *sexprBegin, const LispToken *sexprEnd) {
@@ -117,7 +203,59 @@ namespace WideLips {
         Lexer->Reuse();
     }
 
+    void LispParser::Reset(const std::string_view program) {
+        _root = nullptr;
+        Lexer->Reset(program);
+        _optionalAlignedFile.reset();
+        ResetParseNodes(ParseNodesPoolSize(*Lexer,program.size()/2,_conservative));
+    }
+
+    void LispParser::Reset(const std::filesystem::path &filePath) {
+        //the previous file is still viewed by the lexer until it's rebound
+        AlignedFileReadResult alignedFile = AlignedFileReader::Read(filePath);
+        _root = nullptr;
+        Lexer->Reset(AlignedFileReader::TextOf(alignedFile),filePath.native());
+        _optionalAlignedFile = std::move(alignedFile);
+        ResetParseNodes(ParseNodesPoolSize(*Lexer,Lexer->GetFileSize(),_conservative));
+    }
+
+    void LispParser::ResetParseNodes(const std::size_t size) {
+        _concurrentParseNodes.Release();
+        if (size <= _parseNodesBuffer.Size) {
+            ParseNodesPool.release();
+        }
+        else {
+            //the allocator keeps a pointer to the pool, so it's rebuilt in place around a larger initial buffer
+            void* const data = _parseNodesBuffer.Upstream->allocate(size,alignof(std::max_align_t));
+            std::destroy_at(&ParseNodesPool);
+            _parseNodesBuffer.Upstream->deallocate(_parseNodesBuffer.Data,_parseNodesBuffer.Size,alignof(std::max_align_t));
+            _parseNodesBuffer.Data = data;
+            _parseNodesBuffer.Size = size;
+            std::construct_at(&ParseNodesPool,_parseNodesBuffer.Data,_parseNodesBuffer.Size,_parseNodesBuffer.Upstream);
+        }
+        EndOfProgram = ParseNodesAllocator.new_object<LispAtom>(&PredefinedTokens::EndOfFile,
+            LispParseNodeKind::EndOfProgram,
+            nullptr,
+            nullptr,
+            this
+        );
+    }
+
+    LispParser::ParseNodesBuffer::ParseNodesBuffer(std::pmr::memory_resource* upstream,const std::size_t size) :
+    Upstream(upstream),
+    Size(size),
+    Data(upstream->allocate(size,alignof(std::max_align_t))) {
+
+    }
+
+    LispParser::ParseNodesBuffer::~ParseNodesBuffer() {
+        if (Data != nullptr) {
+            Upstream->deallocate(Data,Size,alignof(std::max_align_t));
+        }
+    }
+
     const BumpVector<Diagnostic::LispDiagnostic> &LispParser::GetDiagnostics() const {
+        Lexer->GatherDiagnostics();
         return Lexer->GetDiagnostics();
     }
 
@@ -136,17 +274,18 @@ namespace WideLips {
     }
 
     LispParseError* LispParser::OnUnrecognizedToken(const LispToken *currentToken) {
+        const SourceLocation location = Lexer->GetSourceLocation(currentToken);
         GetDiagnosticsInternal().EmplaceBack(Diagnostic::DiagnosticFactory::UnrecognizedToken(
              OriginFile(),
-             currentToken->Line,
-             currentToken->Column,
-             *currentToken));
+             location.Line,
+             location.ColumnChar,
+             Lexer->GetTokenText(currentToken)));
 
         return ParseNodesAllocator.new_object<LispParseError>(currentToken,nullptr,nullptr,this);
     }
 
     BumpVector<Diagnostic::LispDiagnostic>& LispParser::GetDiagnosticsInternal() const {
-        return Lexer->GetDiagnostics();
+        return GetLexer()->GetDiagnostics();
     }
 
 }
@@ -0,0 +1,94 @@
+﻿#include <algorithm>
+#include <cstring>
+#include "LispStreamLexer.h"
+
+namespace WideLips {
+    LispStreamLexer::LispStreamLexer(std::istream &input,const LispStreamLexerOptions &options) :
+    _input(input),
+    _options(options) {
+
+    }
+
+    bool LispStreamLexer::Run(const FormCallback &onForm) {
+        StreamWindow window;
+        std::size_t filled = 0;
+        bool exhausted = false;
+        if (_windowCapacity == 0) {
+            Grow(0);
+        }
+        while (true) {
+            if (!exhausted) {
+                _input.read(_window.get() + filled,static_cast<std::streamsize>(_windowCapacity - filled));
+                filled += static_cast<std::size_t>(_input.gcount());
+                exhausted = filled < _windowCapacity;
+            }
+            if (filled == 0) {
+                return true;
+            }
+            //windows end at a line break between top-level forms so every window starts at line 1 and column 1 just
+            //like a whole text does, the line break is found from the blocks the window is tokenized from
+            char* const text = _window.get();
+            std::memset(text + filled,EOF,PaddingSize);
+            text[filled + PaddingSize] = '\0';
+            if (!_lexer) {
+                _lexer = LispLexer::Make(std::string_view(text,_windowCapacity + PaddingSize),false,_options.Lexer);
+            }
+            _lexer->Rebind(std::string_view(text,filled + PaddingSize));
+            const FormsBoundary forms = _lexer->ClassifyWindow();
+            //the last window takes whatever is left, incomplete forms included so the lexer reports them
+            const FormsBoundary boundary = exhausted ? FormsBoundary{filled,0} : forms;
+            if (boundary.End == 0) {
+                Grow(filled);
+                continue;
+            }
+
+            //the padding overwrites the beginning of the next window, so it's stashed until the window is done
+            char stash[PaddingSize + 1];
+            std::memcpy(stash,text + boundary.End,sizeof(stash));
+            std::memset(text + boundary.End,EOF,PaddingSize);
+            text[boundary.End + PaddingSize] = '\0';
+            bool proceed = _lexer->TokenizeWindow(boundary.End);
+            if (proceed && !_lexer->_sexprIndices.Empty()) {
+                const auto first = _lexer->TokenizeFirstSExpr();
+                const LispToken* begin = first->first;
+                const LispToken* end = first->second;
+                while (proceed) {
+                    proceed = onForm(*_lexer,begin,end,window);
+                    const auto next = _lexer->TokenizeNext(begin);
+                    if (!next.has_value()) {
+                        break;
+                    }
+                    begin = next->first;
+                    end = next->second;
+                }
+            }
+            std::memcpy(text + boundary.End,stash,sizeof(stash));
+            if (!proceed) {
+                return false;
+            }
+
+            window.Offset += boundary.End;
+            window.Line += boundary.Lines;
+            filled -= boundary.End;
+            std::memmove(text,text + boundary.End,filled);
+        }
+    }
+
+    BumpVector<Diagnostic::LispDiagnostic>* LispStreamLexer::GetDiagnostics() noexcept {
+        return _lexer ? &_lexer->GetDiagnostics() : nullptr;
+    }
+
+    //the window doubles until a line break between top-level forms fits, the lexer is made again as its arenas are sized for the
+    //window it was made for. what was read is classified again, which the doubling keeps within twice the stream
+    void LispStreamLexer::Grow(const std::size_t filled) {
+        const std::size_t capacity = std::max(_options.WindowSize,_windowCapacity * 2);
+        auto* window = static_cast<char*>(operator new[](capacity + PaddingSize + 1,
+            std::align_val_t{AlignedFileReader::Alignment},std::nothrow));
+        if (filled != 0) {
+            std::memcpy(window,_window.get(),filled);
+        }
+        _window = AlignedFileReadResult{window,AlignedFileReaderDelete{}};
+        _windowCapacity = capacity;
+        _lexer.reset();
+    }
+}
@@ -0,0 +1,60 @@
+﻿#include <fstream>
+#include <new>
+#include "MappedFile.h"
+#if WL_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace WideLips {
+    MappedFile::MappedFile(const std::filesystem::path& filePath,const bool populate) {
+#if WL_POSIX
+        const int file = open(filePath.c_str(),O_RDONLY | O_CLOEXEC);
+        if (file < 0) {
+            return;
+        }
+        struct stat status{};
+        if (fstat(file,&status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+            const auto size = static_cast<std::size_t>(status.st_size);
+            int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+            flags |= populate ? MAP_POPULATE : 0;
+#else
+            (void)populate;
+#endif
+            void* mapped = mmap(nullptr,size,PROT_READ,flags,file,0);
+            if (mapped != MAP_FAILED) {
+                _data = static_cast<const char*>(mapped);
+                _size = size;
+            }
+        }
+        close(file);
+#else
+        (void)populate;
+        std::ifstream file(filePath,std::ios::binary | std::ios::ate);
+        if (!file) {
+            return;
+        }
+        const std::streamoff size = file.tellg();
+        if (size <= 0) {
+            return;
+        }
+        file.seekg(0,std::ios::beg);
+        _copy.reset(new(std::nothrow) char[static_cast<std::size_t>(size)]);
+        if (_copy && file.read(_copy.get(),size)) {
+            _data = _copy.get();
+            _size = static_cast<std::size_t>(size);
+        }
+#endif
+    }
+
+    MappedFile::~MappedFile() {
+#if WL_POSIX
+        if (_data != nullptr) {
+            munmap(const_cast<char*>(_data),_size);
+        }
+#endif
+    }
+}
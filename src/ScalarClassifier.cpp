@@ -0,0 +1,132 @@
+﻿#include <array>
+#include <bit>
+#include <cstring>
+#include <new>
+#include "../include/Classifier.h"
+#include "Config.h"
+
+namespace WideLips {
+    namespace {
+        enum ScalarClass : std::uint8_t {
+            FragmentClass = 0,
+            SExprAndOpsClass,
+            DigitClass,
+            IdentifierClass,
+            DoubleQuoteClass,
+            BackSlashClass,
+            NewLineClass
+        };
+
+        //'pshufb' semantic: an index with its MSB set yields zero, otherwise its lower nibble picks the table entry
+        constexpr std::uint8_t ShuffleByte(const std::array<std::uint8_t,16>& table, const std::uint8_t index) {
+            return (index & 0x80U) ? 0 : table[index & 0x0FU];
+        }
+
+        constexpr bool Looked(const std::array<std::uint8_t,16>& table, const std::uint8_t index, const std::uint8_t c) {
+            return ShuffleByte(table,index) == c;
+        }
+
+        //the classes of every byte value are derived from the same tables and hashing the SIMD kernels use (quirks
+        //included, e.g. '\0' counts as an identifier char), so the scalar kernel produces bit-identical blocks
+        constexpr std::array<std::uint8_t,256> BuildClassTable() {
+            std::array<std::uint8_t,256> classes{};
+            for (std::uint32_t value = 0; value < 256; ++value) {
+                const auto c = static_cast<std::uint8_t>(value);
+                const auto sexprHash = static_cast<std::uint8_t>(c >= 0x30 ? 0 : 0x30 - c);
+                const auto otherOpsHash = static_cast<std::uint8_t>(c >> 2);
+                const bool digit = Looked(Classifier::DigitsTable,c,c);
+                const bool sexprAndOps = Looked(Classifier::SExprAndOpsTable,sexprHash,c) or
+                    Looked(Classifier::OtherOpsAndStructTable,otherOpsHash,c);
+                const bool identifier = digit or
+                    Looked(Classifier::SmallIdentifierTable,c,c) or Looked(Classifier::SmallIdentifierTable2,c,c) or
+                    Looked(Classifier::CapitalIdentifierTable,c,c) or Looked(Classifier::CapitalIdentifierTable2,c,c);
+                classes[value] = static_cast<std::uint8_t>(
+                    Looked(Classifier::FragmentsTable,c,c) << FragmentClass |
+                    sexprAndOps << SExprAndOpsClass |
+                    digit << DigitClass |
+                    identifier << IdentifierClass |
+                    (c == '\"') << DoubleQuoteClass |
+                    (c == '\\') << BackSlashClass |
+                    (c == '\n') << NewLineClass);
+            }
+            return classes;
+        }
+
+        alignas(64) constexpr std::array<std::uint8_t,256> ClassTable = BuildClassTable();
+
+        //gathers bit 'cls' of 8 class bytes into an 8 bit mask (byte i lands on bit i), the multiplier places each
+        //byte's bit at 56+i without any carry between the partial products
+        template<ScalarClass cls>
+        ALWAYS_INLINE std::uint64_t MoveMask8(const std::uint64_t classes) {
+            constexpr std::uint64_t lowBits = 0x0101010101010101ULL;
+            constexpr std::uint64_t gatherMultiplier = 0x0102040810204080ULL;
+            return (((classes >> cls) & lowBits) * gatherMultiplier) >> 56;
+        }
+    }
+
+    std::uint64_t Classifier::ClassifyScalar(const std::uint8_t *const text,
+        const std::size_t blocksCount,
+        TokenizationBlock *const blocks,
+        std::uint64_t escapeCarry) noexcept {
+        for (std::size_t block = 0; block < blocksCount; ++block) {
+            const std::uint8_t* blockText = text + block * TokenizationBlock::Width;
+            std::uint64_t doubleQuoteMask = 0;
+            std::uint64_t backSlashMask = 0;
+            std::uint64_t sexprAndOpsMask = 0;
+            std::uint64_t digitsMask = 0;
+            std::uint64_t identifierMask = 0;
+            std::uint64_t fragmentMask = 0;
+            std::uint64_t newLineMask = 0;
+            //8 bytes are classified per step, their class bytes are packed in a word and every mask is then
+            //extracted out of that word at once (SWAR)
+            for (std::uint32_t lane = 0; lane < TokenizationBlock::Width; lane += 8) {
+                std::uint64_t classes = 0;
+                for (std::uint32_t i = 0; i < 8; ++i) {
+                    classes |= static_cast<std::uint64_t>(ClassTable[blockText[lane + i]]) << (i * 8);
+                }
+                fragmentMask |= MoveMask8<FragmentClass>(classes) << lane;
+                sexprAndOpsMask |= MoveMask8<SExprAndOpsClass>(classes) << lane;
+                digitsMask |= MoveMask8<DigitClass>(classes) << lane;
+                identifierMask |= MoveMask8<IdentifierClass>(classes) << lane;
+                doubleQuoteMask |= MoveMask8<DoubleQuoteClass>(classes) << lane;
+                backSlashMask |= MoveMask8<BackSlashClass>(classes) << lane;
+                newLineMask |= MoveMask8<NewLineClass>(classes) << lane;
+            }
+            //pushing result
+            new (blocks + block) TokenizationBlock{TokenizationMasks{
+                .FragmentsMask = fragmentMask,
+                .SExprAndOpsMask = sexprAndOpsMask,
+                .DigitsMask = digitsMask,
+                .StringLiteralsMask = ComputeStringLiteralsMask(backSlashMask,doubleQuoteMask,escapeCarry),
+                .NewLines = newLineMask,
+                .IdentifierMask = identifierMask
+            }};
+        }
+        return escapeCarry;
+    }
+
+    //eight bytes at once, a byte equal to 'value' becomes zero and borrowing from it sets its top bit. bytes above the
+    //first zero one may be flagged too, so only the lowest flag is exact
+    std::size_t Classifier::FindByteScalar(const std::uint8_t *const bytes,
+        const std::size_t count,
+        const std::uint8_t value) noexcept {
+        constexpr std::uint64_t ones = 0x0101010101010101ULL;
+        constexpr std::uint64_t highs = 0x8080808080808080ULL;
+        const std::uint64_t pattern = ones * value;
+        std::size_t pos = 0;
+        for (; pos + sizeof(std::uint64_t) <= count; pos += sizeof(std::uint64_t)) {
+            std::uint64_t word;
+            std::memcpy(&word,bytes + pos,sizeof(word));
+            word ^= pattern;
+            if (const std::uint64_t found = (word - ones) & ~word & highs; found != 0) {
+                return pos + std::countr_zero(found) / 8;
+            }
+        }
+        for (; pos < count; ++pos) {
+            if (bytes[pos] == value) {
+                return pos;
+            }
+        }
+        return count;
+    }
+}
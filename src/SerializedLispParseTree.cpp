@@ -0,0 +1,301 @@
+﻿#include <cstring>
+#include <fstream>
+#include <limits>
+#include <new>
+#include <vector>
+#include "SerializedLispParseTree.h"
+#include "LispParseTree.h"
+#include "MappedFile.h"
+
+namespace WideLips {
+    namespace {
+        constexpr char Magic[8] = {'W','L','T','R','E','E','\r','\n'};
+        constexpr std::uint32_t ByteOrderMark = 0x01020304;
+        constexpr std::size_t SectionAlignment = alignof(SerializedLispParseNode);
+
+        //the program, the nodes and the auxiliaries follow the header in this order
+        struct FileHeader final {
+            char Magic[8];
+            std::uint32_t Version;
+            std::uint32_t ByteOrder; //tells bytes written on a host of another byte order apart
+            std::uint64_t ProgramSize;
+            std::uint64_t Nodes;
+            std::uint64_t Auxiliaries;
+            std::uint16_t NodeSize;
+            std::uint16_t AuxiliarySize;
+        };
+
+        constexpr std::size_t AlignSection(const std::size_t size) noexcept {
+            return (size + SectionAlignment - 1) & ~(SectionAlignment - 1);
+        }
+
+        struct FileLayout final {
+            std::size_t Program;
+            std::size_t Nodes;
+            std::size_t Auxiliaries;
+            std::size_t End;
+        };
+
+        FileLayout LayoutOf(const FileHeader& header) noexcept {
+            FileLayout layout{};
+            layout.Program = AlignSection(sizeof(FileHeader));
+            layout.Nodes = AlignSection(layout.Program + header.ProgramSize);
+            layout.Auxiliaries = layout.Nodes + header.Nodes * sizeof(SerializedLispParseNode);
+            layout.End = layout.Auxiliaries + header.Auxiliaries * sizeof(SerializedLispAuxiliary);
+            return layout;
+        }
+
+        //a node as it's gathered from the tree, before its place in the bytes is known
+        struct NodeRecord final {
+            std::size_t TextOffset; //from the start of the program
+            std::uint32_t TextLength;
+            std::uint32_t Line;
+            std::uint32_t Column;
+            std::uint32_t Next;
+            std::size_t Auxiliary; //auxiliary index + 1, 0 when it has none
+            LispParseNodeKind Kind;
+            LispTokenKind TokenKind;
+            bool HasSubExpressions;
+        };
+
+        struct AuxiliaryRecord final {
+            std::size_t TextOffset;
+            std::uint32_t TextLength;
+            std::uint32_t Line;
+            std::uint32_t Column;
+        };
+
+        //texts of nodes always lie within the program, anything else is kept as an empty text at its start
+        std::pair<std::size_t,std::uint32_t> SpanOf(const std::string_view text,const std::string_view program) noexcept {
+            if (text.data() < program.data() || text.data() + text.size() > program.data() + program.size()) {
+                return {0,0};
+            }
+            return {static_cast<std::size_t>(text.data() - program.data()),static_cast<std::uint32_t>(text.size())};
+        }
+    }
+
+    SerializedLispParseTree::SerializedLispParseTree(UNUSED ConstructorEnabler enabler,
+        std::unique_ptr<MappedFile> file,
+        const std::string_view bytes,
+        const SerializedLispParseNode* nodes,
+        const std::size_t nodesCount,
+        const std::string_view program) noexcept :
+    _file(std::move(file)),
+    _bytes(bytes),
+    _nodes(nodes),
+    _nodesCount(nodesCount),
+    _program(program) {}
+
+    SerializedLispParseTree::~SerializedLispParseTree() = default;
+
+    std::string SerializedLispParseTree::Serialize(LispParseNodeBase* root) {
+        std::string_view program;
+        std::vector<NodeRecord> nodes;
+        std::vector<AuxiliaryRecord> auxiliaries;
+        if (root != nullptr) {
+            const LispLexer* const lexer = root->Parser->GetLexer();
+            program = std::string_view{lexer->GetTextData(),lexer->GetFileSize()};
+        }
+        //nodes are laid out in preorder: a node's sub-expressions are walked before its next node, which is pushed
+        //first so it's popped once they are all done. top level S-expressions are only chained through 'NextNode'
+        struct Pending final {
+            LispParseNodeBase* Node;
+            std::size_t Previous; //the node this one is next of, 'NoPrevious' for the first of a list
+            bool TopLevel;
+        };
+        constexpr std::size_t NoPrevious = std::numeric_limits<std::size_t>::max();
+        std::vector<Pending> pending;
+        if (root != nullptr && root->Kind != LispParseNodeKind::EndOfProgram) {
+            pending.push_back({root,NoPrevious,true});
+        }
+        while (!pending.empty()) {
+            const auto [node,previous,topLevel] = pending.back();
+            pending.pop_back();
+            const std::size_t index = nodes.size();
+            if (previous != NoPrevious) {
+                nodes[previous].Next = static_cast<std::uint32_t>(index - previous);
+            }
+            const SourceLocation location = node->GetSourceLocation();
+            const auto [textOffset,textLength] = SpanOf(node->GetParseNodeText(),program);
+            NodeRecord& record = nodes.emplace_back(NodeRecord{textOffset,textLength,location.Line,location.ColumnChar,
+                0,0,node->Kind,LispTokenKind{},false});
+            if (const LispAuxiliary* const auxiliary = node->GetNodeAuxiliary()) {
+                const SourceLocation auxiliaryLocation = auxiliary->GetSourceLocation();
+                const auto [auxiliaryOffset,auxiliaryLength] = SpanOf(auxiliary->GetParseNodeText(),program);
+                auxiliaries.push_back({auxiliaryOffset,auxiliaryLength,auxiliaryLocation.Line,auxiliaryLocation.ColumnChar});
+                record.Auxiliary = auxiliaries.size();
+            }
+
+            LispParseNodeBase* next = node->Next;
+            if (topLevel) {
+                next = node->NextNode();
+                if (next != nullptr && next->Kind == LispParseNodeKind::EndOfProgram) {
+                    next = nullptr;
+                }
+            }
+            if (next != nullptr) {
+                pending.push_back({next,index,topLevel});
+            }
+            LispParseNodeBase* subExpressions = nullptr;
+            switch (node->Kind) {
+                case LispParseNodeKind::SExpr:
+                    subExpressions = reinterpret_cast<LispList*>(node)->GetSubExpressions();
+                    break;
+                case LispParseNodeKind::Arguments:
+                    subExpressions = reinterpret_cast<LispArguments*>(node)->GetArguments();
+                    break;
+                case LispParseNodeKind::Error:
+                    break;
+                default:
+                    record.TokenKind = reinterpret_cast<LispAtom*>(node)->GetUnderlyingKind();
+                    break;
+            }
+            if (subExpressions != nullptr && subExpressions->Kind != LispParseNodeKind::EndOfProgram) {
+                record.HasSubExpressions = true;
+                pending.push_back({subExpressions,NoPrevious,false});
+            }
+        }
+
+        FileHeader header{};
+        std::memcpy(header.Magic,Magic,sizeof(Magic));
+        header.Version = Version;
+        header.ByteOrder = ByteOrderMark;
+        header.ProgramSize = program.size();
+        header.Nodes = nodes.size();
+        header.Auxiliaries = auxiliaries.size();
+        header.NodeSize = sizeof(SerializedLispParseNode);
+        header.AuxiliarySize = sizeof(SerializedLispAuxiliary);
+        const FileLayout layout = LayoutOf(header);
+
+        std::string bytes(layout.End,'\0');
+        char* const data = bytes.data();
+        std::memcpy(data,&header,sizeof(header));
+        if (!program.empty()) {
+            std::memcpy(data + layout.Program,program.data(),program.size());
+        }
+        for (std::size_t index = 0; index < nodes.size(); ++index) {
+            const NodeRecord& record = nodes[index];
+            const std::size_t at = layout.Nodes + index * sizeof(SerializedLispParseNode);
+            auto* const node = new (data + at) SerializedLispParseNode(
+                static_cast<std::int64_t>(layout.Program + record.TextOffset) - static_cast<std::int64_t>(at),
+                record.TextLength,
+                record.Line,
+                record.Column,
+                record.Kind,
+                record.TokenKind,
+                record.HasSubExpressions);
+            node->_next = record.Next;
+            if (record.Auxiliary != 0) {
+                node->_auxiliaryOffset = static_cast<std::int64_t>(layout.Auxiliaries +
+                    (record.Auxiliary - 1) * sizeof(SerializedLispAuxiliary)) - static_cast<std::int64_t>(at);
+            }
+        }
+        for (std::size_t index = 0; index < auxiliaries.size(); ++index) {
+            const AuxiliaryRecord& record = auxiliaries[index];
+            const std::size_t at = layout.Auxiliaries + index * sizeof(SerializedLispAuxiliary);
+            auto* const auxiliary = new (data + at) SerializedLispAuxiliary();
+            auxiliary->_textOffset = static_cast<std::int64_t>(layout.Program + record.TextOffset) -
+                static_cast<std::int64_t>(at);
+            auxiliary->_textLength = record.TextLength;
+            auxiliary->_line = record.Line;
+            auxiliary->_column = record.Column;
+        }
+        return bytes;
+    }
+
+    bool SerializedLispParseTree::Write(const std::filesystem::path& filePath,LispParseNodeBase* root) {
+        const std::string bytes = Serialize(root);
+        std::ofstream file(filePath,std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return false;
+        }
+        file.write(bytes.data(),static_cast<std::streamsize>(bytes.size()));
+        return static_cast<bool>(file.flush());
+    }
+
+    std::unique_ptr<SerializedLispParseTree> SerializedLispParseTree::Map(const std::filesystem::path& filePath) {
+        //nodes are only touched once they are walked, so nothing is faulted in upfront
+        auto file = std::make_unique<MappedFile>(filePath);
+        const std::string_view bytes{file->Data(),file->Size()};
+        return Make(std::move(file),bytes);
+    }
+
+    std::unique_ptr<SerializedLispParseTree> SerializedLispParseTree::View(const std::string_view bytes) {
+        return Make(nullptr,bytes);
+    }
+
+    std::unique_ptr<SerializedLispParseTree> SerializedLispParseTree::Make(std::unique_ptr<MappedFile> file,
+        const std::string_view bytes) {
+        if (bytes.size() < sizeof(FileHeader) ||
+            reinterpret_cast<std::uintptr_t>(bytes.data()) % alignof(SerializedLispParseNode) != 0) {
+            return nullptr;
+        }
+        FileHeader header{};
+        std::memcpy(&header,bytes.data(),sizeof(header));
+        const bool matches = std::memcmp(header.Magic,Magic,sizeof(Magic)) == 0 &&
+            header.Version == Version &&
+            header.ByteOrder == ByteOrderMark &&
+            header.NodeSize == sizeof(SerializedLispParseNode) &&
+            header.AuxiliarySize == sizeof(SerializedLispAuxiliary) &&
+            //counts past what the bytes could hold would overflow the layout
+            header.ProgramSize <= bytes.size() &&
+            header.Nodes <= bytes.size() / sizeof(SerializedLispParseNode) &&
+            header.Auxiliaries <= bytes.size() / sizeof(SerializedLispAuxiliary) &&
+            LayoutOf(header).End == bytes.size();
+        if (!matches) {
+            return nullptr;
+        }
+        const FileLayout layout = LayoutOf(header);
+        return std::make_unique<SerializedLispParseTree>(CtorEnabler,
+            std::move(file),
+            bytes,
+            reinterpret_cast<const SerializedLispParseNode*>(bytes.data() + layout.Nodes),
+            header.Nodes,
+            bytes.substr(layout.Program,header.ProgramSize));
+    }
+
+    const SerializedLispParseNode* SerializedLispParseTree::GetRoot() const noexcept {
+        return _nodesCount != 0 ? _nodes : nullptr;
+    }
+
+    std::size_t SerializedLispParseTree::GetNodesCount() const noexcept {
+        return _nodesCount;
+    }
+
+    std::string_view SerializedLispParseTree::GetProgram() const noexcept {
+        return _program;
+    }
+
+    bool SerializedLispParseTree::Verify() const noexcept {
+        const auto withinProgram = [this](const char* from,const std::int64_t offset,const std::uint32_t length) {
+            const std::int64_t begin = from - _program.data() + offset;
+            return begin >= 0 && static_cast<std::uint64_t>(begin) + length <= _program.size();
+        };
+        const char* const auxiliariesBegin = reinterpret_cast<const char*>(_nodes + _nodesCount);
+        const char* const auxiliariesEnd = _bytes.data() + _bytes.size();
+        for (std::size_t index = 0; index < _nodesCount; ++index) {
+            const SerializedLispParseNode& node = _nodes[index];
+            const auto at = reinterpret_cast<const char*>(&node);
+            if (node._next >= _nodesCount - index ||
+                (node._hasSubExpressions && index + 1 == _nodesCount) ||
+                !withinProgram(at,node._textOffset,node._textLength)) {
+                return false;
+            }
+            if (node._auxiliaryOffset != 0) {
+                const std::int64_t auxiliary = at - auxiliariesBegin + node._auxiliaryOffset;
+                if (auxiliary < 0 ||
+                    static_cast<std::uint64_t>(auxiliary) % sizeof(SerializedLispAuxiliary) != 0 ||
+                    static_cast<std::uint64_t>(auxiliary) >= static_cast<std::uint64_t>(auxiliariesEnd - auxiliariesBegin)) {
+                    return false;
+                }
+            }
+        }
+        for (auto at = auxiliariesBegin; at < auxiliariesEnd; at += sizeof(SerializedLispAuxiliary)) {
+            const auto& auxiliary = *reinterpret_cast<const SerializedLispAuxiliary*>(at);
+            if (!withinProgram(at,auxiliary._textOffset,auxiliary._textLength)) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
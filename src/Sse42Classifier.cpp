@@ -0,0 +1,127 @@
+﻿#include <bit>
+#include <new>
+#include "../include/SSE.h"
+#include "../include/Classifier.h"
+#include "Config.h"
+
+#if WL_ARCH_X86
+WL_TARGET_REGION_BEGIN("sse4.2")
+namespace WideLips {
+    namespace {
+        std::uint64_t ClassifyBlocksSse42(const std::uint8_t *const text,
+            const std::size_t blocksCount,
+            TokenizationBlock *const blocks,
+            std::uint64_t escapeCarry) noexcept {
+
+            const Vector128 sexprAndOpsTable = Sse42::LoadFromAddress(Classifier::SExprAndOpsTable.data());
+            const Vector128 otherOpsAndStructTable = Sse42::LoadFromAddress(Classifier::OtherOpsAndStructTable.data());
+            const Vector128 fragmentsTable = Sse42::LoadFromAddress(Classifier::FragmentsTable.data());
+            const Vector128 digitsTable = Sse42::LoadFromAddress(Classifier::DigitsTable.data());
+            const Vector128 smallIdentifierTable = Sse42::LoadFromAddress(Classifier::SmallIdentifierTable.data());
+            const Vector128 smallIdentifierTable2 = Sse42::LoadFromAddress(Classifier::SmallIdentifierTable2.data());
+            const Vector128 capitalIdentifierTable = Sse42::LoadFromAddress(Classifier::CapitalIdentifierTable.data());
+            const Vector128 capitalIdentifierTable2 = Sse42::LoadFromAddress(Classifier::CapitalIdentifierTable2.data());
+
+            for (std::size_t block = 0; block < blocksCount; ++block) {
+                std::uint64_t doubleQuoteMask = 0;
+                std::uint64_t backSlashMask = 0;
+                std::uint64_t sexprAndOpsMask = 0;
+                std::uint64_t digitsMask = 0;
+                std::uint64_t identifierMask = 0;
+                std::uint64_t fragmentMask = 0;
+                std::uint64_t newLineMask = 0;
+                //a tokenization block spans four SSE vectors, each one fills a quarter of the block masks
+                for (std::uint32_t quarter = 0; quarter < TokenizationBlock::Width; quarter += sizeof(Vector128)) {
+                    const Vector128 fetchedChars = Sse42::LoadFromAddress(text,
+                        static_cast<std::ptrdiff_t>(block * TokenizationBlock::Width + quarter));
+                    //string literal matching
+                    const Vector128 doubleQuotationEquality = Sse42::CompareEqual(fetchedChars,Sse42::Propagate('\"'));
+                    const Vector128 backwardSlashEquality = Sse42::CompareEqual(fetchedChars,Sse42::Propagate('\\'));
+                    doubleQuoteMask |= static_cast<std::uint64_t>(Sse42::MoveMask(doubleQuotationEquality)) << quarter;
+                    backSlashMask |= static_cast<std::uint64_t>(Sse42::MoveMask(backwardSlashEquality)) << quarter;
+                    //sexpr parentheses matching
+                    const Vector128 hashedSexprChars = Sse42::SubtractSaturated(Sse42::Propagate(0x30),fetchedChars);
+                    const Vector128 lookedSexprAndOpsChars = Sse42::ShuffleBytes(sexprAndOpsTable,hashedSexprChars);
+                    const Vector128 sexprAndOpsChars = Sse42::CompareEqual(lookedSexprAndOpsChars,fetchedChars);
+                    //other operators and structural matching
+                    const Vector128 hashedOtherOpsAndStructSymbols = Sse42::Custom::RightShift8<2>(fetchedChars);
+                    const Vector128 lookedOtherOpsAndStructSymbols = Sse42::ShuffleBytes(otherOpsAndStructTable,hashedOtherOpsAndStructSymbols);
+                    const Vector128 matchingOtherOpsAndStruct = Sse42::CompareEqual(lookedOtherOpsAndStructSymbols,fetchedChars);
+                    sexprAndOpsMask |= static_cast<std::uint64_t>(Sse42::MoveMask(Sse42::Or(sexprAndOpsChars,
+                        matchingOtherOpsAndStruct))) << quarter;
+                    //numbers
+                    const Vector128 lookedDigits = Sse42::ShuffleBytes(digitsTable,fetchedChars);
+                    const Vector128 digits = Sse42::CompareEqual(lookedDigits,fetchedChars);
+                    digitsMask |= static_cast<std::uint64_t>(Sse42::MoveMask(digits)) << quarter;
+                    //identifiers
+                    const Vector128 lookedSmallIdentifier = Sse42::ShuffleBytes(smallIdentifierTable,fetchedChars);
+                    const Vector128 lookedSmallIdentifier2 = Sse42::ShuffleBytes(smallIdentifierTable2,fetchedChars);
+                    const Vector128 lookedCapitalIdentifier = Sse42::ShuffleBytes(capitalIdentifierTable,fetchedChars);
+                    const Vector128 lookedCapitalIdentifier2 = Sse42::ShuffleBytes(capitalIdentifierTable2,fetchedChars);
+                    const Vector128 lookedSmallIdentifierChars = Sse42::CompareEqual(lookedSmallIdentifier,fetchedChars);
+                    const Vector128 lookedSmallIdentifier2Chars = Sse42::CompareEqual(lookedSmallIdentifier2,fetchedChars);
+                    const Vector128 lookedCapitalIdentifierChars = Sse42::CompareEqual(lookedCapitalIdentifier,fetchedChars);
+                    const Vector128 lookedCapitalIdentifier2Chars = Sse42::CompareEqual(lookedCapitalIdentifier2,fetchedChars);
+                    //lexer will match digits mask before identifier mask so it doesn't get mis-tokenized
+                    const Vector128 lookedIdentifier = Sse42::Or(digits,
+                        Sse42::Or(
+                        Sse42::Or(lookedCapitalIdentifierChars,lookedCapitalIdentifier2Chars),
+                        Sse42::Or(lookedSmallIdentifierChars,lookedSmallIdentifier2Chars)));
+                    identifierMask |= static_cast<std::uint64_t>(Sse42::MoveMask(lookedIdentifier)) << quarter;
+                    //fragmentation chars matching
+                    const Vector128 lookedFragmentChars = Sse42::ShuffleBytes(fragmentsTable,fetchedChars);
+                    const Vector128 fragmentChars = Sse42::CompareEqual(lookedFragmentChars,fetchedChars);
+                    const Vector128 newLines = Sse42::CompareEqual(fetchedChars,Sse42::Propagate('\n'));
+                    newLineMask |= static_cast<std::uint64_t>(Sse42::MoveMask(newLines)) << quarter;
+                    fragmentMask |= static_cast<std::uint64_t>(Sse42::MoveMask(fragmentChars)) << quarter;
+                }
+                //pushing result
+                new (blocks + block) TokenizationBlock{TokenizationMasks{
+                    .FragmentsMask = fragmentMask,
+                    .SExprAndOpsMask = sexprAndOpsMask,
+                    .DigitsMask = digitsMask,
+                    .StringLiteralsMask = ComputeStringLiteralsMask(backSlashMask,doubleQuoteMask,escapeCarry),
+                    .NewLines = newLineMask,
+                    .IdentifierMask = identifierMask
+                }};
+            }
+            return escapeCarry;
+        }
+
+        std::size_t FindBytesSse42(const std::uint8_t *const bytes,
+            const std::size_t count,
+            const std::uint8_t value) noexcept {
+            const Vector128 pattern = Sse42::Propagate(value);
+            std::size_t pos = 0;
+            for (; pos + sizeof(Vector128) <= count; pos += sizeof(Vector128)) {
+                const Vector128 fetched = Sse42::LoadFromAddress(bytes,static_cast<std::ptrdiff_t>(pos));
+                if (const std::uint64_t found = Sse42::MoveMask(Sse42::CompareEqual(fetched,pattern)); found != 0) {
+                    return pos + std::countr_zero(found);
+                }
+            }
+            for (; pos < count; ++pos) {
+                if (bytes[pos] == value) {
+                    return pos;
+                }
+            }
+            return count;
+        }
+    }
+}
+WL_TARGET_REGION_END
+
+namespace WideLips {
+    std::uint64_t Classifier::ClassifySse42(const std::uint8_t *const text,
+        const std::size_t blocksCount,
+        TokenizationBlock *const blocks,
+        const std::uint64_t escapeCarry) noexcept {
+        return ClassifyBlocksSse42(text,blocksCount,blocks,escapeCarry);
+    }
+
+    std::size_t Classifier::FindByteSse42(const std::uint8_t *const bytes,
+        const std::size_t count,
+        const std::uint8_t value) noexcept {
+        return FindBytesSse42(bytes,count,value);
+    }
+}
+#endif // WL_ARCH_X86
@@ -0,0 +1,103 @@
+﻿#include <cstdint>
+#include <new>
+#include "VirtualMemory.h"
+#if WL_POSIX
+#include <sys/mman.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace WideLips {
+    std::size_t VirtualMemory::PageSize() noexcept {
+#if WL_POSIX
+        static const auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        return pageSize;
+#elif defined(_WIN32)
+        static const std::size_t pageSize = [] {
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            return static_cast<std::size_t>(info.dwPageSize);
+        }();
+        return pageSize;
+#else
+        return 4096;
+#endif
+    }
+
+    void* VirtualMemory::Reserve(const std::size_t size,const bool hugePages) noexcept {
+#if WL_POSIX
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+        flags |= MAP_NORESERVE; //nothing is charged against the commit limit until pages are made writable
+#endif
+        if (!hugePages) {
+            void* reserved = mmap(nullptr,size,PROT_NONE,flags,-1,0);
+            return reserved == MAP_FAILED ? nullptr : reserved;
+        }
+        //mmap only aligns to regular pages, so a huge page more is reserved and whatever lies around the aligned
+        //range is unmapped again
+        void* reserved = mmap(nullptr,size + HugePageSize,PROT_NONE,flags,-1,0);
+        if (reserved == MAP_FAILED) {
+            return nullptr;
+        }
+        const auto begin = reinterpret_cast<std::uintptr_t>(reserved);
+        const std::uintptr_t aligned = (begin + HugePageSize - 1) & ~(std::uintptr_t{HugePageSize} - 1);
+        if (aligned != begin) {
+            munmap(reserved,aligned - begin);
+        }
+        if (const std::uintptr_t tail = begin + size + HugePageSize - (aligned + size); tail != 0) {
+            munmap(reinterpret_cast<void*>(aligned + size),tail);
+        }
+        AdviseHugePages(reinterpret_cast<void*>(aligned),size);
+        return reinterpret_cast<void*>(aligned);
+#elif defined(_WIN32)
+        //large pages can't be reserved without being committed (nor without the lock pages privilege), so they
+        //aren't used
+        (void)hugePages;
+        return VirtualAlloc(nullptr,size,MEM_RESERVE,PAGE_NOACCESS);
+#else
+        (void)hugePages;
+        return operator new[](size,std::align_val_t{PageSize()},std::nothrow);
+#endif
+    }
+
+    bool VirtualMemory::AdviseHugePages(void* address,const std::size_t size) noexcept {
+#if WL_POSIX && defined(MADV_HUGEPAGE)
+        return address != nullptr && madvise(address,size,MADV_HUGEPAGE) == 0;
+#else
+        (void)address;
+        (void)size;
+        return false;
+#endif
+    }
+
+    bool VirtualMemory::Commit(void* address,const std::size_t size) noexcept {
+#if WL_POSIX
+        return mprotect(address,size,PROT_READ | PROT_WRITE) == 0;
+#elif defined(_WIN32)
+        return VirtualAlloc(address,size,MEM_COMMIT,PAGE_READWRITE) != nullptr;
+#else
+        (void)address;
+        (void)size;
+        return true;
+#endif
+    }
+
+    void VirtualMemory::Release(void* address,const std::size_t size) noexcept {
+        if (address == nullptr) {
+            return;
+        }
+#if WL_POSIX
+        munmap(address,size);
+#elif defined(_WIN32)
+        (void)size;
+        VirtualFree(address,0,MEM_RELEASE);
+#else
+        (void)size;
+        operator delete[](address,std::align_val_t{PageSize()},std::nothrow);
+#endif
+    }
+}
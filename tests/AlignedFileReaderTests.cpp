@@ -342,4 +342,39 @@ namespace WideLips::Tests {
         // Verify memory alignment
         EXPECT_EQ(reinterpret_cast<std::uintptr_t>(result.get()) % 32, 0);
     }
+
+    // Mapped reads copy only the last partial page, sizes around page boundaries must read the same as a copy
+    TEST_F(AlignedFileReaderTest, ReadMappedMatchesCopy) {
+        for (const std::size_t size : {std::size_t{1}, std::size_t{4095}, std::size_t{4096}, std::size_t{3 * 4096},
+            std::size_t{3 * 4096 + 17}, std::size_t{65536 - 1}}) {
+            std::string content(size, ' ');
+            for (std::size_t i = 0; i < size; ++i) {
+                content[i] = static_cast<char>('a' + i % 26);
+            }
+            const auto filePath = CreateTextFileWithExactContent("mapped_" + std::to_string(size) + ".lisp", content);
+            for (const auto mode : {FileReadMode::Copy, FileReadMode::Map, FileReadMode::MapPopulated}) {
+                const auto result = AlignedFileReader::Read(filePath, mode);
+                ASSERT_NE(result, nullptr);
+                EXPECT_EQ(reinterpret_cast<std::uintptr_t>(result.get()) % AlignedFileReader::Alignment, 0);
+                EXPECT_EQ(std::string(result.get(), size), content) << "size " << size;
+                EXPECT_EQ(std::string(result.get() + size, PaddingSize), std::string(PaddingSize, EOF)) << "size " << size;
+                EXPECT_EQ(result.get()[size + PaddingSize], '\0') << "size " << size;
+            }
+        }
+    }
+
+    // The text size is carried with the block, a null character in the file doesn't cut it short
+    TEST_F(AlignedFileReaderTest, TextOfKeepsEmbeddedNulls) {
+        std::string content = "(a \"b";
+        content += '\0';
+        content += "\") (c)";
+        const auto filePath = CreateTextFileWithExactContent("embedded_null.lisp", content);
+        for (const auto mode : {FileReadMode::Copy, FileReadMode::Map, FileReadMode::MapPopulated}) {
+            const auto result = AlignedFileReader::Read(filePath, mode);
+            ASSERT_NE(result, nullptr);
+            EXPECT_EQ(AlignedFileReader::TextOf(result), content + std::string(PaddingSize, EOF));
+        }
+        const auto empty = AlignedFileReader::Read(CreateTextFileWithExactContent("empty_text.lisp", ""));
+        EXPECT_EQ(AlignedFileReader::TextOf(empty), std::string(PaddingSize, EOF));
+    }
 }
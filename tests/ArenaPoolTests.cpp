@@ -0,0 +1,163 @@
+﻿#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <thread>
+#include <vector>
+#include "ArenaPool.h"
+#include "LispLexer.h"
+#include "LispParser.h"
+#include "LispParseTree.h"
+#include "VirtualBumpVector.h"
+#include "VirtualMemory.h"
+
+using namespace WideLips;
+using namespace testing;
+
+namespace WideLips::Tests {
+
+    class ArenaPoolTest : public Test {};
+
+    TEST_F(ArenaPoolTest, SizeClassesArePowersOfTwoPages) {
+        const std::size_t pageSize = VirtualMemory::PageSize();
+        EXPECT_EQ(ArenaPool::SizeClassOf(1), pageSize);
+        EXPECT_EQ(ArenaPool::SizeClassOf(pageSize), pageSize);
+        EXPECT_EQ(ArenaPool::SizeClassOf(pageSize + 1), pageSize * 2);
+        EXPECT_EQ(ArenaPool::SizeClassOf(pageSize * 5), pageSize * 8);
+    }
+
+    TEST_F(ArenaPoolTest, ReleasedRangesAreRecycledWithTheirPages) {
+        ArenaPool pool;
+        const std::size_t pageSize = VirtualMemory::PageSize();
+        ArenaPool::Range range = pool.Acquire(pageSize * 3);
+        ASSERT_NE(range.Address, nullptr);
+        EXPECT_EQ(range.Size, pageSize * 4);
+        EXPECT_EQ(range.Committed, 0u);
+        ASSERT_TRUE(VirtualMemory::Commit(range.Address, pageSize * 2));
+        std::memset(range.Address, 0x5A, pageSize * 2);
+        range.Committed = pageSize * 2;
+
+        pool.Release(range);
+        EXPECT_EQ(pool.GetRetainedSize(), pageSize * 2);
+
+        // Another size class doesn't get it
+        const ArenaPool::Range other = pool.Acquire(pageSize * 16);
+        EXPECT_NE(other.Address, range.Address);
+        pool.Release(other);
+
+        const ArenaPool::Range recycled = pool.Acquire(pageSize * 4);
+        EXPECT_EQ(recycled.Address, range.Address);
+        EXPECT_EQ(recycled.Committed, pageSize * 2);
+        EXPECT_EQ(static_cast<unsigned char*>(recycled.Address)[pageSize * 2 - 1], 0x5A);
+        EXPECT_EQ(pool.GetRetainedSize(), 0u);
+        pool.Release(recycled);
+    }
+
+    TEST_F(ArenaPoolTest, RetainsUpToItsLimit) {
+        const std::size_t pageSize = VirtualMemory::PageSize();
+        ArenaPool pool(pageSize * 2);
+        ArenaPool::Range first = pool.Acquire(pageSize * 2);
+        ArenaPool::Range second = pool.Acquire(pageSize * 2);
+        ASSERT_TRUE(VirtualMemory::Commit(first.Address, first.Size));
+        ASSERT_TRUE(VirtualMemory::Commit(second.Address, second.Size));
+        first.Committed = first.Size;
+        second.Committed = second.Size;
+        pool.Release(first);
+        pool.Release(second); // past the limit, unmapped
+        EXPECT_EQ(pool.GetRetainedSize(), pageSize * 2);
+        EXPECT_EQ(pool.Acquire(pageSize * 2).Address, first.Address);
+    }
+
+    TEST_F(ArenaPoolTest, WarmedRangesAreCommittedUpfront) {
+        const std::size_t pageSize = VirtualMemory::PageSize();
+        ArenaPool pool(pageSize * 8);
+        EXPECT_EQ(pool.Warm(pageSize * 3, 3), 2u); // the third is past the limit
+        EXPECT_EQ(pool.GetRetainedSize(), pageSize * 8);
+
+        const ArenaPool::Range range = pool.Acquire(pageSize * 4);
+        ASSERT_NE(range.Address, nullptr);
+        EXPECT_EQ(range.Committed, range.Size);
+        static_cast<unsigned char*>(range.Address)[range.Size - 1] = 0x5A;
+        EXPECT_EQ(pool.GetRetainedSize(), pageSize * 4);
+        pool.Release(range);
+    }
+
+    TEST_F(ArenaPoolTest, HugePageRangesAreKeptApart) {
+        ArenaPool pool;
+        const std::size_t pageSize = VirtualMemory::PageSize();
+        EXPECT_EQ(ArenaPool::SizeClassOf(pageSize, true), VirtualMemory::HugePageSize);
+        const ArenaPool::Range huge = pool.Acquire(pageSize, true);
+        ASSERT_NE(huge.Address, nullptr);
+        EXPECT_TRUE(huge.HugePages);
+        EXPECT_EQ(huge.Size, VirtualMemory::HugePageSize);
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(huge.Address) % VirtualMemory::HugePageSize, 0u);
+        pool.Release(huge);
+
+        // A regular range of the same size class doesn't get it
+        const ArenaPool::Range regular = pool.Acquire(VirtualMemory::HugePageSize);
+        EXPECT_NE(regular.Address, huge.Address);
+        EXPECT_FALSE(regular.HugePages);
+        pool.Release(regular);
+
+        const ArenaPool::Range recycled = pool.Acquire(VirtualMemory::HugePageSize, true);
+        EXPECT_EQ(recycled.Address, huge.Address);
+        pool.Release(recycled);
+    }
+
+    TEST_F(ArenaPoolTest, VectorsHandTheirArenasBack) {
+        ArenaPool pool;
+        const int* arena = nullptr;
+        {
+            VirtualBumpVector<int> vec(1 << 16, &pool);
+            for (int i = 0; i < 20000; ++i) {
+                vec.EmplaceBack(int{i});
+            }
+            arena = vec.begin();
+        }
+        EXPECT_GT(pool.GetRetainedSize(), 0u);
+        VirtualBumpVector<int> vec(1 << 16, &pool);
+        EXPECT_EQ(vec.begin(), arena);
+        EXPECT_GT(vec.CommittedSize(), 0u);
+        vec.EmplaceBack(7);
+        EXPECT_EQ(vec.Back(), 7);
+    }
+
+    TEST_F(ArenaPoolTest, ResourceBacksMonotonicBuffers) {
+        ArenaPool pool;
+        {
+            std::pmr::monotonic_buffer_resource buffer(1 << 14, pool.GetResource());
+            std::pmr::vector<int> values(&buffer);
+            for (int i = 0; i < 100000; ++i) {
+                values.push_back(i);
+            }
+            EXPECT_EQ(values.back(), 99999);
+        }
+        EXPECT_GT(pool.GetRetainedSize(), 0u);
+        EXPECT_TRUE(pool.GetResource()->is_equal(*pool.GetResource()));
+    }
+
+    TEST_F(ArenaPoolTest, ConcurrentLexersShareAPool) {
+        ArenaPool pool;
+        const auto program = LispParseTree::MakeParserFriendlyString("(defvar x 1) (foo (bar 2.5 \"s\") ; c\n baz)");
+        std::vector<std::thread> threads;
+        std::atomic<int> failures = 0;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&] {
+                for (int i = 0; i < 50; ++i) {
+                    LispParser parser(program.GetUnderlyingString(), false, {.Pool = &pool});
+                    const auto* root = parser.Parse();
+                    if (root == nullptr || root->Kind != LispParseNodeKind::SExpr || !parser.GetDiagnostics().Empty()) {
+                        ++failures;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        EXPECT_EQ(failures, 0);
+        EXPECT_GT(pool.GetRetainedSize(), 0u);
+    }
+}
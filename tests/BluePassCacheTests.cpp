@@ -0,0 +1,224 @@
+﻿#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "BluePassCache.h"
+#include "LispLexer.h"
+#include "LispParser.h"
+#include "LispParseTree.h"
+
+using namespace WideLips;
+using namespace testing;
+
+namespace WideLips::Tests {
+    class BluePassCacheTest : public Test {
+    protected:
+        std::filesystem::path cacheDir;
+    protected:
+        void SetUp() override {
+            cacheDir = std::filesystem::temp_directory_path() / "BluePassCacheTest";
+            std::filesystem::remove_all(cacheDir);
+        }
+
+        void TearDown() override {
+            std::filesystem::remove_all(cacheDir);
+        }
+
+        // what a lexer reports for a text, every token of every top level S-expression with its location
+        struct Snapshot {
+            bool Success = false;
+            std::vector<std::tuple<LispTokenKind, std::string, std::uint32_t, std::uint32_t>> Tokens;
+            std::vector<std::wstring> Diagnostics;
+
+            bool operator==(const Snapshot&) const = default;
+        };
+
+        static void Collect(LispLexer& lexer, const LispToken* begin, const LispToken* end, Snapshot& snapshot) {
+            const auto emit = [&](const LispToken* token) {
+                const SourceLocation location = lexer.GetSourceLocation(token);
+                snapshot.Tokens.emplace_back(token->Kind,
+                    std::string(lexer.GetTokenText(token)),
+                    location.Line,
+                    location.ColumnChar);
+            };
+            emit(begin);
+            if (const auto region = lexer.TokenizeSExpr(begin, true); region.has_value()) {
+                for (const LispToken* current = region->first; current <= region->second; ++current) {
+                    if (current->Kind == LispTokenKind::LeftParenthesis) {
+                        Collect(lexer, current, current + 1, snapshot);
+                        ++current;
+                    }
+                    else {
+                        emit(current);
+                    }
+                }
+            }
+            emit(end);
+        }
+
+        static Snapshot Tokenize(const std::string& text,
+            const LispLexerOptions& options,
+            const std::wstring_view filePath = L"memory") {
+            const auto lexer = LispLexer::Make(text, false, options);
+            lexer->Reset(text, filePath);
+            Snapshot snapshot;
+            snapshot.Success = lexer->Tokenize();
+            if (snapshot.Success) {
+                auto region = lexer->TokenizeFirstSExpr();
+                const LispToken* begin = region.has_value() ? region->first : nullptr;
+                const LispToken* end = region.has_value() ? region->second : nullptr;
+                while (begin != nullptr) {
+                    Collect(*lexer, begin, end, snapshot);
+                    const auto next = lexer->TokenizeNext(begin);
+                    begin = next.has_value() ? next->first : nullptr;
+                    end = next.has_value() ? next->second : nullptr;
+                }
+            }
+            for (const auto& diagnostic : lexer->GetDiagnostics()) {
+                snapshot.Diagnostics.emplace_back(diagnostic.GetFullMessage());
+            }
+            return snapshot;
+        }
+
+        static std::string Program(const std::size_t size) {
+            std::string program;
+            for (int i = 0; program.size() < size; ++i) {
+                program += "(defun f" + std::to_string(i) + " (x y) ; adds\n  (+ x y \"a (b\" 'q #\\a 1.5))\n";
+            }
+            return program + std::string(PaddingSize, EOF);
+        }
+
+        NODISCARD std::vector<std::filesystem::path> CacheFiles() const {
+            std::vector<std::filesystem::path> files;
+            for (const auto& entry : std::filesystem::directory_iterator(cacheDir)) {
+                files.push_back(entry.path());
+            }
+            return files;
+        }
+    };
+
+    TEST_F(BluePassCacheTest, ContentHashMatchesXXH64) {
+        EXPECT_EQ(ContentHash(""), 0xEF46DB3751D8E999ULL);
+        EXPECT_EQ(ContentHash("a"), 0xD24EC4F1A98C6E5BULL);
+        EXPECT_EQ(ContentHash("abc"), 0x44BC2CF5AD770999ULL);
+        EXPECT_EQ(ContentHash("Nobody inspects the spammish repetition"), 0xFBCEA83C8A378BF1ULL);
+        EXPECT_NE(ContentHash("abc", 1), ContentHash("abc"));
+    }
+
+    TEST_F(BluePassCacheTest, HitsTokenizeLikeMisses) {
+        const std::string program = Program(100000);
+        for (const bool keepBlocks : {false, true}) {
+            for (const BluePassEngine engine : {BluePassEngine::Sequential, BluePassEngine::Parallel, BluePassEngine::Fused}) {
+                for (const SourceLocations locations : {SourceLocations::Eager, SourceLocations::Lazy}) {
+                    std::filesystem::remove_all(cacheDir);
+                    BluePassCache cache(cacheDir, keepBlocks);
+                    LispLexerOptions options{.Threads = 4, .BlueEngine = engine, .Locations = locations};
+                    const Snapshot expected = Tokenize(program, options);
+                    ASSERT_TRUE(expected.Success);
+                    options.Cache = &cache;
+                    EXPECT_EQ(Tokenize(program, options), expected);
+                    EXPECT_EQ(cache.GetHits(), 0u);
+                    EXPECT_EQ(cache.GetMisses(), 1u);
+                    EXPECT_EQ(CacheFiles().size(), 1u);
+                    EXPECT_EQ(Tokenize(program, options), expected);
+                    EXPECT_EQ(cache.GetHits(), 1u);
+                    EXPECT_EQ(cache.GetMisses(), 1u);
+                }
+            }
+        }
+    }
+
+    TEST_F(BluePassCacheTest, HitsKeepTheDiagnostics) {
+        const std::string program = "(a \"b)\n (c)) ) (d" + std::string(PaddingSize, EOF);
+        BluePassCache cache(cacheDir);
+        const Snapshot expected = Tokenize(program, {});
+        ASSERT_FALSE(expected.Success);
+        ASSERT_FALSE(expected.Diagnostics.empty());
+        EXPECT_EQ(Tokenize(program, {.Cache = &cache}), expected);
+        EXPECT_EQ(Tokenize(program, {.Cache = &cache}), expected);
+        EXPECT_EQ(cache.GetHits(), 1u);
+    }
+
+    TEST_F(BluePassCacheTest, OtherTextsPathsAndOptionsMiss) {
+        const std::string program = Program(4000);
+        std::string changed = program;
+        changed[changed.find("f7")] = 'g';
+        BluePassCache cache(cacheDir);
+        (void)Tokenize(program, {.Cache = &cache});
+        (void)Tokenize(changed, {.Cache = &cache});
+        (void)Tokenize(program, {.Cache = &cache}, L"other.lisp");
+        EXPECT_EQ(cache.GetHits(), 0u);
+        EXPECT_EQ(CacheFiles().size(), 3u);
+        // the file of a text is written over by lexers made with other options, it's the same file name
+        (void)Tokenize(program, {.Locations = SourceLocations::Lazy, .Cache = &cache});
+        EXPECT_EQ(cache.GetHits(), 0u);
+        EXPECT_EQ(cache.GetMisses(), 4u);
+        EXPECT_EQ(CacheFiles().size(), 3u);
+        (void)Tokenize(program, {.Locations = SourceLocations::Lazy, .Cache = &cache});
+        EXPECT_EQ(cache.GetHits(), 1u);
+    }
+
+    TEST_F(BluePassCacheTest, DamagedFilesMissAndAreWrittenOver) {
+        const std::string program = Program(20000);
+        const Snapshot expected = Tokenize(program, {});
+        BluePassCache cache(cacheDir);
+        (void)Tokenize(program, {.Cache = &cache});
+        const auto files = CacheFiles();
+        ASSERT_EQ(files.size(), 1u);
+        const auto size = std::filesystem::file_size(files[0]);
+        std::filesystem::resize_file(files[0], size / 2);
+        EXPECT_EQ(Tokenize(program, {.Cache = &cache}), expected);
+        EXPECT_EQ(cache.GetHits(), 0u);
+        EXPECT_EQ(std::filesystem::file_size(files[0]), size);
+        {
+            std::ofstream file(files[0], std::ios::binary | std::ios::in | std::ios::out);
+            file.write("garbage!", 8);
+        }
+        EXPECT_EQ(Tokenize(program, {.Cache = &cache}), expected);
+        EXPECT_EQ(cache.GetHits(), 0u);
+        EXPECT_EQ(Tokenize(program, {.Cache = &cache}), expected);
+        EXPECT_EQ(cache.GetHits(), 1u);
+    }
+
+    TEST_F(BluePassCacheTest, FailedStoresTokenizeLikeMisses) {
+        const std::string program = Program(20000);
+        const Snapshot expected = Tokenize(program, {});
+        std::ofstream(cacheDir) << "not a directory";
+        BluePassCache cache(cacheDir);
+        EXPECT_EQ(Tokenize(program, {.Cache = &cache}), expected);
+        EXPECT_EQ(Tokenize(program, {.Cache = &cache}), expected);
+        EXPECT_EQ(cache.GetHits(), 0u);
+        EXPECT_EQ(cache.GetMisses(), 2u);
+        EXPECT_TRUE(std::filesystem::is_regular_file(cacheDir));
+    }
+
+    TEST_F(BluePassCacheTest, ParsersLoadTheBluePassFromTheCache) {
+        const std::string program = Program(20000);
+        BluePassCache cache(cacheDir);
+        const auto dump = [&] {
+            LispParser parser(std::string_view(program), false, {.Cache = &cache});
+            std::string text;
+            for (const LispParseNodeBase* form = parser.Parse();
+                form != nullptr && form->Kind != LispParseNodeKind::EndOfProgram;
+                form = form->NextNode()) {
+                const auto* list = reinterpret_cast<const LispList*>(form);
+                text += std::string(form->GetParseNodeText()) + "|";
+                for (const LispParseNodeBase* child = list->GetSubExpressions();
+                    child != nullptr && child->Kind != LispParseNodeKind::SExpr;
+                    child = child->NextNode()) {
+                    text += std::string(child->GetParseNodeText()) + "|";
+                }
+            }
+            EXPECT_TRUE(parser.GetDiagnostics().Empty());
+            return text;
+        };
+        const std::string expected = dump();
+        EXPECT_FALSE(expected.empty());
+        EXPECT_EQ(dump(), expected);
+        EXPECT_EQ(cache.GetHits(), 1u);
+        EXPECT_EQ(cache.GetMisses(), 1u);
+    }
+}
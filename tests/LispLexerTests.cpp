@@ -1,14 +1,17 @@
 ﻿#include <gtest/gtest.h>
 #include <gmock/gmock.h>
 #include "LispLexer.h"
+#include <algorithm>
 #include <sstream>
 #include <filesystem>
 #include <memory>
 #include <string>
 #include <utility>
+#include <random>
 #include <vector>
 #include <fstream> // Added for file I/O in file tests
 #include "Utilities/AlignedFileReader.h" // Added for file-based tests
+#include "Utilities/CpuFeatures.h"
 
 using namespace WideLips;
 using namespace testing;
@@ -90,6 +93,64 @@ namespace WideLips::Tests {
             result.push_back(sexprEnd);
         }
 
+        // deep lists, long whitespace runs, strings and comments holding parentheses, quotes and newlines, enough of
+        // them that chunk boundaries land within every one of those. the erroneous program also has stray closing
+        // parentheses, unrecognized chars, unclosed lists and ends within a string literal
+        static std::string GenerateStructuralProgram(const bool erroneous) {
+            std::mt19937 random(erroneous ? 7U : 3U);
+            const auto pick = [&random](const std::uint32_t bound) {
+                return std::uniform_int_distribution<std::uint32_t>(0, bound - 1)(random);
+            };
+            std::string program;
+            std::uint32_t depth = 0;
+            while (program.size() < Classifier::MinBlocksPerThread * TokenizationBlock::Width * 4 + 1000) {
+                switch (pick(erroneous ? 12 : 10)) {
+                    case 0: case 1:
+                        program += '(';
+                        ++depth;
+                        break;
+                    case 2: case 3:
+                        if (depth > 0) {
+                            program += ')';
+                            --depth;
+                        }
+                        break;
+                    case 4: case 5:
+                        program += depth > 0 ? "(add x1 2.5 <= y)" : "\n";
+                        break;
+                    case 6:
+                        program += std::string(pick(150), pick(2) ? ' ' : '\n') + std::string(pick(3), '\t');
+                        break;
+                    case 7:
+                        if (depth > 0) {
+                            program += " \"a(\\\"b)\n" + std::string(pick(130), ')') + "\\\\\" ";
+                        }
+                        break;
+                    case 8:
+                        program += "; (comment \" with \\ " + std::string(pick(100), '(') + "\n";
+                        break;
+                    case 9:
+                        if (depth > 0) {
+                            program += " sym-" + std::to_string(pick(1000)) + ' ';
+                        }
+                        break;
+                    case 10:
+                        program += ')';
+                        break;
+                    default:
+                        program += " ? ";
+                        break;
+                }
+            }
+            if (!erroneous) {
+                program += std::string(depth, ')');
+            }
+            else {
+                program += "(open \"never closed";
+            }
+            return PadString(program);
+        }
+
         // Helper to verify token stream matches expected tokens
         static void VerifyTokens(const std::string& input,
             const std::vector<ExpectedToken>& expected,
@@ -117,12 +178,12 @@ namespace WideLips::Tests {
                     << ", Got: " << TokenKindToString(flattenTokens[i]->Kind);
 
                 if (!expected[i].Text.empty()) {
-                    EXPECT_EQ(flattenTokens[i]->GetText(), expected[i].Text)
+                    EXPECT_EQ(flattenTokens[i]->GetText(lexer->GetTextData()), expected[i].Text)
                         << "Token " << i << " text mismatch";
                 }
 
                 if (expected[i].Length > 0) {
-                    EXPECT_EQ(flattenTokens[i]->Length, expected[i].Length)
+                    EXPECT_EQ(flattenTokens[i]->GetLength(), expected[i].Length)
                         << "Token " << i << " length mismatch";
                 }
             }
@@ -156,7 +217,7 @@ namespace WideLips::Tests {
             while (current <= regionTokEnd && tokenIndex < expected.size()-2) {
                 EXPECT_EQ(current->Kind, expected[tokenIndex].Kind);
                 if (!expected[tokenIndex].Text.empty()) {
-                    EXPECT_EQ(current->GetText(), expected[tokenIndex].Text);
+                    EXPECT_EQ(current->GetText(lexer->GetTextData()), expected[tokenIndex].Text);
                 }
                 ++current;
                 ++tokenIndex;
@@ -1054,6 +1115,37 @@ namespace WideLips::Tests {
         EXPECT_EQ(lexer->GetDiagnostics()[0].GetErrorCode(),DiagnosticFactory::ErrorCodeToString(ParsingErrorCode::ProgramMustStartWithSExpression));
     }
 
+    TEST_F(LispLexerTest, EdgeCase_ReuseRewindsTokens) {
+        const auto input = PadString("(define (f x) (g x \"s\" 'y))");
+        const auto lexer = CreateLexer(input);
+        for (int round = 0; round < 64; ++round) {
+            ASSERT_TRUE(lexer->Tokenize());
+            const auto root = lexer->TokenizeFirstSExpr();
+            ASSERT_TRUE(root.has_value());
+            ASSERT_TRUE(lexer->TokenizeSExpr(root->first));
+            lexer->Reuse();
+        }
+        EXPECT_EQ(lexer->GetDiagnostics().Size(), 0);
+    }
+
+    TEST_F(LispLexerTest, EdgeCase_ExhaustedArenasAreReported) {
+        using namespace Diagnostic;
+        const auto input = PadString("(define (f x) (g x \"s\" 'y))");
+        const auto lexer = CreateLexer(input);
+        ASSERT_TRUE(lexer->Tokenize());
+        const auto root = lexer->TokenizeFirstSExpr();
+        ASSERT_TRUE(root.has_value());
+        //every materialization of the same S-expression piles up tokens until the lexer is reused
+        std::size_t rounds = 0;
+        while (lexer->TokenizeSExpr(root->first)) {
+            ASSERT_LT(++rounds, 1u << 24);
+        }
+        EXPECT_GT(rounds, 0u);
+        ASSERT_EQ(lexer->GetDiagnostics().Size(), 1);
+        EXPECT_EQ(lexer->GetDiagnostics()[0].GetSeverity(),Severity::Error);
+        EXPECT_EQ(lexer->GetDiagnostics()[0].GetErrorCode(),DiagnosticFactory::ErrorCodeToString(ParsingErrorCode::ArenasExhausted));
+    }
+
     TEST_F(LispLexerTest, EdgeCase_SingleCharacterTokens) {
         VerifyTokens("(+ - * / % & | ^)", {
             {LispTokenKind::LeftParenthesis, "("},
@@ -1129,8 +1221,9 @@ namespace WideLips::Tests {
         const char* base = lexer->GetTextData();
         for (size_t i = 0; i < flattenTokens.size(); ++i) {
             const auto* tok = flattenTokens[i];
-            EXPECT_EQ(tok->Line, expectedLocs[i].Line) << "Line mismatch at token index " << i;
-            EXPECT_EQ(tok->Column, expectedLocs[i].Column) << "Column mismatch at token index " << i;
+            const SourceLocation location = lexer->GetSourceLocation(tok);
+            EXPECT_EQ(location.Line, expectedLocs[i].Line) << "Line mismatch at token index " << i;
+            EXPECT_EQ(location.ColumnChar, expectedLocs[i].Column) << "Column mismatch at token index " << i;
             EXPECT_EQ(tok->GetByteLocation(base), expectedLocs[i].Byte) << "Byte offset mismatch at token index " << i;
         }
     }
@@ -1400,6 +1493,716 @@ namespace WideLips::Tests {
         });
     }
 
+    TEST_F(LispLexerTest, Coverage_FloatDotAtLastByteOfBlock) {
+        // '.' lands on the last byte of the first block, so the mantissa starts in the next one
+        const std::string input = std::string(61, ' ') + "(1.25)";
+
+        VerifyTokens(input, {
+            {LispTokenKind::LeftParenthesis, "("},
+            {LispTokenKind::RealLiteral, "1.25"},
+            {LispTokenKind::RightParenthesis, ")"}
+        });
+    }
+
+    TEST_F(LispLexerTest, Coverage_EscapedQuoteAfterBlockEndingWithBackslash) {
+        // backslash is the last byte of the first block and escapes the double quote starting the next one
+        const std::string input = "(\"" + std::string(61, 'a') + "\\\"b\")";
+
+        VerifyTokens(input, {
+            {LispTokenKind::LeftParenthesis, "("},
+            {LispTokenKind::StringLiteral, input.substr(1, input.size() - 2)},
+            {LispTokenKind::RightParenthesis, ")"}
+        });
+    }
+
+    TEST_F(LispLexerTest, Coverage_EscapeSequenceAcrossBlocks) {
+        // a backslash ending the block followed by a regular char must not turn that char into a double quote
+        const std::string input = "(\"" + std::string(61, 'a') + "\\nb\")";
+
+        VerifyTokens(input, {
+            {LispTokenKind::LeftParenthesis, "("},
+            {LispTokenKind::StringLiteral, input.substr(1, input.size() - 2)},
+            {LispTokenKind::RightParenthesis, ")"}
+        });
+    }
+
+    TEST_F(LispLexerTest, Coverage_EscapedBackslashAcrossBlocks) {
+        // the backslash starting the second block is escaped by the one ending the first block,
+        // so the double quote right after it terminates the string
+        const std::string input = "(\"" + std::string(61, 'a') + "\\\\\" b)";
+
+        VerifyTokens(input, {
+            {LispTokenKind::LeftParenthesis, "("},
+            {LispTokenKind::StringLiteral, "\"" + std::string(61, 'a') + "\\\\\""},
+            {LispTokenKind::Identifier, "b"},
+            {LispTokenKind::RightParenthesis, ")"}
+        });
+    }
+
+    TEST_F(LispLexerTest, Coverage_CommentOnLastLineWithoutNewline) {
+        // the comment runs into the padding, it must stop there instead of running to the sentinel block
+        const auto input = PadString("(a)\n; trailing comment");
+        const auto lexer = CreateLexer(input);
+        ASSERT_TRUE(lexer->Tokenize());
+
+        const auto optRegion = lexer->TokenizeFirstSExpr();
+        ASSERT_TRUE(optRegion.has_value());
+        const auto [begin, end] = *optRegion;
+        const auto tokRegion = lexer->TokenizeSExpr(begin);
+        ASSERT_TRUE(tokRegion.has_value());
+        EXPECT_EQ(tokRegion.value().first->GetText(lexer->GetTextData()), "a");
+        EXPECT_FALSE(lexer->TokenizeNext(begin).has_value());
+    }
+
+    TEST_F(LispLexerTest, Coverage_KernelsProduceIdenticalBlocks) {
+        // every byte value once, then code hitting each char class with escapes straddling block boundaries
+        std::string input;
+        for (int c = 0; c < 256; ++c) {
+            input.push_back(static_cast<char>(c));
+        }
+        for (int i = 0; i < 16; ++i) {
+            input += "(defun f-" + std::to_string(i) + " [x] (+ x 1.5 @y `z :k ~w #t $v))\t\r\n";
+            input += "(\"" + std::string(i * 7 % 64, 'q') + "\\\\\\\"\\\" end\") ; comment\n";
+        }
+        input.resize((input.size() / TokenizationBlock::Width + 1) * TokenizationBlock::Width, ' ');
+        const std::size_t blocksCount = input.size() / TokenizationBlock::Width;
+        const auto text = reinterpret_cast<const std::uint8_t*>(input.data());
+
+        // the scalar kernel runs everywhere, so it's the oracle every SIMD kernel is checked against
+        std::vector<TokenizationBlock> reference(blocksCount);
+        const auto referenceCarry = Classifier::ClassifyScalar(text, blocksCount, reference.data(), 0);
+        for (const auto kernel : {ClassificationKernel::Sse42, ClassificationKernel::Avx2, ClassificationKernel::Avx512}) {
+            if (!LispLexer::IsKernelSupported(kernel)) {
+                continue;
+            }
+            std::vector<TokenizationBlock> blocks(blocksCount);
+            const auto carry = Classifier::Resolve(kernel)(text, blocksCount, blocks.data(), 0);
+            EXPECT_EQ(carry, referenceCarry);
+            for (std::size_t i = 0; i < blocksCount; ++i) {
+                EXPECT_EQ(blocks[i].FragmentsMask(), reference[i].FragmentsMask()) << "block " << i;
+                EXPECT_EQ(blocks[i].SExprAndOpsMask(), reference[i].SExprAndOpsMask()) << "block " << i;
+                EXPECT_EQ(blocks[i].DigitsMask(), reference[i].DigitsMask()) << "block " << i;
+                EXPECT_EQ(blocks[i].StringLiteralsMask(), reference[i].StringLiteralsMask()) << "block " << i;
+                EXPECT_EQ(blocks[i].NewLines(), reference[i].NewLines()) << "block " << i;
+                EXPECT_EQ(blocks[i].IdentifierMask(), reference[i].IdentifierMask()) << "block " << i;
+            }
+        }
+    }
+
+    TEST_F(LispLexerTest, Coverage_PackedBlocksDecodeEveryByte) {
+        // every byte value once, the planes the classes share must still decode to disjoint masks
+        alignas(TokenizationBlock::Width) std::uint8_t text[256];
+        for (std::uint32_t value = 0; value < 256; ++value) {
+            text[value] = static_cast<std::uint8_t>(value);
+        }
+        for (const auto kernel : {ClassificationKernel::Scalar, ClassificationKernel::Default}) {
+            TokenizationBlock blocks[256 / TokenizationBlock::Width];
+            (void)Classifier::Resolve(kernel)(text, std::size(blocks), blocks, 0);
+            for (std::uint32_t value = 0; value < 256; ++value) {
+                const TokenizationBlock& block = blocks[value / TokenizationBlock::Width];
+                const auto bit = [&](const TokenizationBlock::MaskType mask) {
+                    return (mask >> (value % TokenizationBlock::Width) & 1U) != 0;
+                };
+                const char c = static_cast<char>(value);
+                EXPECT_EQ(bit(block.DigitsMask()), c >= '0' && c <= '9') << value;
+                EXPECT_EQ(bit(block.NewLines()), c == '\n') << value;
+                EXPECT_EQ(bit(block.FragmentsMask()), c == ' ' || c == '\t' || c == '\n' || c == '\r') << value;
+                EXPECT_EQ(bit(block.StringLiteralsMask()), c == '\"') << value;
+                if (bit(block.DigitsMask())) {
+                    EXPECT_TRUE(bit(block.IdentifierMask())) << value;
+                }
+                if (bit(block.SExprAndOpsMask())) {
+                    EXPECT_FALSE(bit(block.FragmentsMask() | block.StringLiteralsMask() | block.DigitsMask())) << value;
+                }
+                EXPECT_EQ(bit(block.UnclassifiedMask()), !bit(block.FragmentsMask() | block.SExprAndOpsMask() |
+                    block.StringLiteralsMask() | block.IdentifierMask())) << value;
+            }
+            EXPECT_TRUE(blocks[0].SExprAndOpsMask() >> '(' & 1U);
+            EXPECT_TRUE(blocks[0].SExprAndOpsMask() >> ')' & 1U);
+        }
+    }
+
+    TEST_F(LispLexerTest, Coverage_PrefixXorSpansQuotes) {
+        static_assert(PrefixXor(0b100100u) == 0b011100u, "the constant evaluated prefix XOR must match the runtime one");
+        EXPECT_EQ(PrefixXor(0), 0u);
+        EXPECT_EQ(PrefixXor(0b100100u), 0b011100u);
+        EXPECT_EQ(PrefixXor(1), ~std::uint64_t{0});
+        EXPECT_EQ(PrefixXor(std::uint64_t{1} << 63 | 1), ~(std::uint64_t{1} << 63));
+        std::mt19937_64 random(5);
+        for (int i = 0; i < 100; ++i) {
+            const std::uint64_t mask = random();
+            std::uint64_t expected = 0;
+            std::uint64_t parity = 0;
+            for (std::uint32_t bit = 0; bit < 64; ++bit) {
+                parity ^= mask >> bit & 1U;
+                expected |= parity << bit;
+            }
+            ASSERT_EQ(PrefixXor(mask), expected);
+        }
+    }
+
+    TEST_F(LispLexerTest, Coverage_PrefixXorClmulMatchesLadder) {
+        EXPECT_EQ(Classifier::ResolvePrefixXor(ClassificationKernel::Scalar), &Classifier::PrefixXorLadder);
+        if (!CpuFeatures::Host().Pclmul) {
+            GTEST_SKIP() << "the host has no carry-less multiplication";
+        }
+        EXPECT_EQ(Classifier::ResolvePrefixXor(ClassificationKernel::Default), &Classifier::PrefixXorClmul);
+        for (const std::uint64_t mask : {std::uint64_t{0}, ~std::uint64_t{0}, std::uint64_t{1}, std::uint64_t{1} << 63}) {
+            EXPECT_EQ(Classifier::PrefixXorClmul(mask), Classifier::PrefixXorLadder(mask));
+        }
+        std::mt19937_64 random(11);
+        for (int i = 0; i < 10000; ++i) {
+            const std::uint64_t mask = random();
+            ASSERT_EQ(Classifier::PrefixXorClmul(mask), Classifier::PrefixXorLadder(mask)) << "mask " << mask;
+        }
+    }
+
+    TEST_F(LispLexerTest, Coverage_ScalarKernelTokenizes) {
+        const auto input = PadString("(defun f (x) (\"a\\\"b\" 1.5 x))");
+        const auto lexer = LispLexer::Make(input, false, LispLexerOptions{.Kernel = ClassificationKernel::Scalar});
+        ASSERT_TRUE(lexer->Tokenize());
+
+        const auto optRegion = lexer->TokenizeFirstSExpr();
+        ASSERT_TRUE(optRegion.has_value());
+        std::vector<const LispToken*> tokens;
+        CollectAllTokens(lexer.get(), optRegion->first, optRegion->second, tokens);
+        ASSERT_EQ(tokens.size(), 12u);
+        EXPECT_EQ(tokens[1]->Kind, LispTokenKind::Defun);
+        EXPECT_EQ(tokens[7]->Kind, LispTokenKind::StringLiteral);
+        EXPECT_EQ(tokens[7]->GetText(lexer->GetTextData()), "\"a\\\"b\"");
+        EXPECT_EQ(tokens[8]->Kind, LispTokenKind::RealLiteral);
+    }
+
+    TEST_F(LispLexerTest, Coverage_ParallelClassificationMatchesSequential) {
+        // long backslash runs with a period coprime with the block width, so chunk boundaries land inside them
+        std::string input;
+        const std::string unit = std::string(129, '\\') + "\"a (b) \"";
+        const std::size_t blocksCount = Classifier::MinBlocksPerThread * 4 + 3;
+        while (input.size() < blocksCount * TokenizationBlock::Width) {
+            input += unit;
+        }
+        const auto text = reinterpret_cast<const std::uint8_t*>(input.data());
+        const auto kernel = Classifier::Resolve(ClassificationKernel::Default);
+
+        std::vector<TokenizationBlock> sequential(blocksCount);
+        const auto sequentialCarry = kernel(text, blocksCount, sequential.data(), 0);
+        for (const std::uint32_t threads : {2U, 3U, 4U}) {
+            std::vector<TokenizationBlock> parallel(blocksCount);
+            const auto parallelCarry = Classifier::ClassifyParallel(kernel, text, blocksCount, parallel.data(), threads);
+            EXPECT_EQ(parallelCarry, sequentialCarry);
+            for (std::size_t i = 0; i < blocksCount; ++i) {
+                ASSERT_EQ(parallel[i].StringLiteralsMask(), sequential[i].StringLiteralsMask())
+                    << "block " << i << " with " << threads << " threads";
+                ASSERT_EQ(parallel[i].SExprAndOpsMask(), sequential[i].SExprAndOpsMask())
+                    << "block " << i << " with " << threads << " threads";
+            }
+        }
+    }
+
+    TEST_F(LispLexerTest, Coverage_ParallelBluePassMatchesSequential) {
+        for (const auto [erroneous, engine] : {std::pair{false, BluePassEngine::Parallel},
+            std::pair{true, BluePassEngine::Parallel},
+            std::pair{false, BluePassEngine::Fused},
+            std::pair{true, BluePassEngine::Fused}}) {
+            const auto input = GenerateStructuralProgram(erroneous);
+            const auto sequential = LispLexer::Make(input, false, {.BlueEngine = BluePassEngine::Sequential});
+            const auto parallel = LispLexer::Make(input, false, {.Threads = 4, .BlueEngine = engine});
+            EXPECT_EQ(parallel->Tokenize(), sequential->Tokenize());
+
+            auto& expectedDiagnostics = sequential->GetDiagnostics();
+            auto& diagnostics = parallel->GetDiagnostics();
+            ASSERT_EQ(diagnostics.Size(), expectedDiagnostics.Size());
+            EXPECT_EQ(diagnostics.Empty(), !erroneous);
+            for (std::size_t i = 0; i < diagnostics.Size(); ++i) {
+                EXPECT_EQ(diagnostics[i].GetFullMessage(), expectedDiagnostics[i].GetFullMessage()) << "diagnostic " << i;
+            }
+            if (erroneous) {
+                continue;
+            }
+
+            // regions of optionals can't be reassigned, so the S-expressions are walked by their opening parentheses
+            const auto firstExpected = sequential->TokenizeFirstSExpr();
+            const auto first = parallel->TokenizeFirstSExpr();
+            ASSERT_TRUE(firstExpected.has_value() && first.has_value());
+            std::pair<const LispToken*, const LispToken*> expectedRegion{firstExpected->first, firstExpected->second};
+            std::pair<const LispToken*, const LispToken*> region{first->first, first->second};
+            std::size_t sexprs = 0;
+            while (true) {
+                std::vector<const LispToken*> expectedTokens;
+                std::vector<const LispToken*> tokens;
+                CollectAllTokens(sequential.get(), expectedRegion.first, expectedRegion.second, expectedTokens, true);
+                CollectAllTokens(parallel.get(), region.first, region.second, tokens, true);
+                ASSERT_EQ(tokens.size(), expectedTokens.size()) << "S-expression " << sexprs;
+                for (std::size_t i = 0; i < tokens.size(); ++i) {
+                    ASSERT_EQ(tokens[i]->Kind, expectedTokens[i]->Kind) << "S-expression " << sexprs << " token " << i;
+                    ASSERT_EQ(tokens[i]->GetText(parallel->GetTextData()),
+                        expectedTokens[i]->GetText(sequential->GetTextData())) << "S-expression " << sexprs << " token " << i;
+                    const SourceLocation location = parallel->GetSourceLocation(tokens[i]);
+                    const SourceLocation expectedLocation = sequential->GetSourceLocation(expectedTokens[i]);
+                    ASSERT_EQ(location.Line, expectedLocation.Line) << "S-expression " << sexprs << " token " << i;
+                    ASSERT_EQ(location.ColumnChar, expectedLocation.ColumnChar) << "S-expression " << sexprs << " token " << i;
+                }
+                ++sexprs;
+                const auto nextExpected = sequential->TokenizeNext(expectedRegion.first);
+                const auto next = parallel->TokenizeNext(region.first);
+                ASSERT_EQ(next.has_value(), nextExpected.has_value()) << "S-expression " << sexprs;
+                if (!next.has_value()) {
+                    break;
+                }
+                expectedRegion = {nextExpected->first, nextExpected->second};
+                region = {next->first, next->second};
+            }
+            EXPECT_GT(sexprs, 1u);
+        }
+    }
+
+    TEST_F(LispLexerTest, Coverage_FusedBluePassTilesMatchSequential) {
+        // a string literal and a comment straddling the first tile boundary, then texts shorter than a block
+        const std::size_t tileSize = 512 * TokenizationBlock::Width;
+        std::string straddling = "(a";
+        while (straddling.size() < tileSize - 40) {
+            straddling += " (b \"c(\") 12)";
+        }
+        straddling += " \"spans ( the \\\" boundary\n between\" tiles ; and ( a comment " +
+            std::string(80, ' ') + "\n (d))";
+        for (const std::string& input : {straddling, std::string("(a (b \"c\") ;x\n d)"), std::string("(a"),
+            std::string("a)"), std::string("(\"open"), std::string("(x ? y)")}) {
+            const auto paddedInput = PadString(input);
+            const auto sequential = LispLexer::Make(paddedInput, false, {.BlueEngine = BluePassEngine::Sequential});
+            const bool tokenized = sequential->Tokenize();
+            std::vector<const LispToken*> expectedTokens;
+            if (tokenized) {
+                const auto first = sequential->TokenizeFirstSExpr();
+                ASSERT_TRUE(first.has_value());
+                CollectAllTokens(sequential.get(), first->first, first->second, expectedTokens, true);
+            }
+            for (const auto locations : {SourceLocations::Eager, SourceLocations::Lazy}) {
+                const auto fused = LispLexer::Make(paddedInput, false,
+                    {.BlueEngine = BluePassEngine::Fused, .Locations = locations});
+                EXPECT_EQ(fused->Tokenize(), tokenized) << input.substr(0, 20);
+                auto& expectedDiagnostics = sequential->GetDiagnostics();
+                auto& diagnostics = fused->GetDiagnostics();
+                ASSERT_EQ(diagnostics.Size(), expectedDiagnostics.Size()) << input.substr(0, 20);
+                for (std::size_t i = 0; i < diagnostics.Size(); ++i) {
+                    EXPECT_EQ(diagnostics[i].GetFullMessage(), expectedDiagnostics[i].GetFullMessage());
+                }
+                if (!diagnostics.Empty()) {
+                    continue;
+                }
+                const auto first = fused->TokenizeFirstSExpr();
+                ASSERT_TRUE(first.has_value());
+                std::vector<const LispToken*> tokens;
+                CollectAllTokens(fused.get(), first->first, first->second, tokens, true);
+                ASSERT_EQ(tokens.size(), expectedTokens.size());
+                for (std::size_t i = 0; i < tokens.size(); ++i) {
+                    ASSERT_EQ(tokens[i]->GetText(fused->GetTextData()),
+                        expectedTokens[i]->GetText(sequential->GetTextData())) << "token " << i;
+                    const SourceLocation location = fused->GetSourceLocation(tokens[i]);
+                    const SourceLocation expectedLocation = sequential->GetSourceLocation(expectedTokens[i]);
+                    ASSERT_EQ(location.Line, expectedLocation.Line) << "token " << i;
+                    ASSERT_EQ(location.ColumnChar, expectedLocation.ColumnChar) << "token " << i;
+                }
+            }
+        }
+    }
+
+    TEST_F(LispLexerTest, Coverage_LazySourceLocationsMatchEager) {
+        for (const bool erroneous : {false, true}) {
+            for (const auto engine : {BluePassEngine::Sequential, BluePassEngine::Parallel, BluePassEngine::Fused}) {
+                const auto input = GenerateStructuralProgram(erroneous);
+                const auto eager = LispLexer::Make(input, false, {.Threads = 4, .BlueEngine = engine});
+                const auto lazy = LispLexer::Make(input, false,
+                    {.Threads = 4, .BlueEngine = engine, .Locations = SourceLocations::Lazy});
+                EXPECT_EQ(lazy->Tokenize(), eager->Tokenize());
+
+                auto& expectedDiagnostics = eager->GetDiagnostics();
+                auto& diagnostics = lazy->GetDiagnostics();
+                ASSERT_EQ(diagnostics.Size(), expectedDiagnostics.Size());
+                for (std::size_t i = 0; i < diagnostics.Size(); ++i) {
+                    EXPECT_EQ(diagnostics[i].GetFullMessage(), expectedDiagnostics[i].GetFullMessage()) << "diagnostic " << i;
+                }
+                if (erroneous) {
+                    continue;
+                }
+
+                const auto firstExpected = eager->TokenizeFirstSExpr();
+                const auto first = lazy->TokenizeFirstSExpr();
+                ASSERT_TRUE(firstExpected.has_value() && first.has_value());
+                std::pair<const LispToken*, const LispToken*> expectedRegion{firstExpected->first, firstExpected->second};
+                std::pair<const LispToken*, const LispToken*> region{first->first, first->second};
+                std::size_t sexprs = 0;
+                while (true) {
+                    std::vector<const LispToken*> expectedTokens;
+                    std::vector<const LispToken*> tokens;
+                    CollectAllTokens(eager.get(), expectedRegion.first, expectedRegion.second, expectedTokens, true);
+                    CollectAllTokens(lazy.get(), region.first, region.second, tokens, true);
+                    ASSERT_EQ(tokens.size(), expectedTokens.size()) << "S-expression " << sexprs;
+                    for (std::size_t i = 0; i < tokens.size(); ++i) {
+                        ASSERT_EQ(tokens[i]->GetText(lazy->GetTextData()),
+                            expectedTokens[i]->GetText(eager->GetTextData())) << "S-expression " << sexprs << " token " << i;
+                        const SourceLocation location = lazy->GetSourceLocation(tokens[i]);
+                        const SourceLocation expectedLocation = eager->GetSourceLocation(expectedTokens[i]);
+                        ASSERT_EQ(location.Line, expectedLocation.Line) << "S-expression " << sexprs << " token " << i;
+                        ASSERT_EQ(location.ColumnChar, expectedLocation.ColumnChar) << "S-expression " << sexprs << " token " << i;
+                    }
+                    ++sexprs;
+                    const auto nextExpected = eager->TokenizeNext(expectedRegion.first);
+                    const auto next = lazy->TokenizeNext(region.first);
+                    ASSERT_EQ(next.has_value(), nextExpected.has_value()) << "S-expression " << sexprs;
+                    if (!next.has_value()) {
+                        break;
+                    }
+                    expectedRegion = {nextExpected->first, nextExpected->second};
+                    region = {next->first, next->second};
+                }
+                EXPECT_GT(sexprs, 1u);
+            }
+        }
+    }
+
+    // locations are always lazy with the compact layout, so its S-expression indices leave lines and columns out
+    TEST_F(LispLexerTest, Coverage_SExprIndexSize) {
+#ifdef WL_COMPACT_TOKENS
+        EXPECT_EQ(sizeof(SExprIndex), 3 * sizeof(std::uint32_t));
+#else
+        EXPECT_EQ(sizeof(SExprIndex), 7 * sizeof(std::uint32_t));
+#endif
+    }
+
+    TEST_F(LispLexerTest, Coverage_FindByteKernelsMatchScalar) {
+        std::mt19937 random(11);
+        std::vector<std::uint8_t> bytes(300);
+        for (auto& byte : bytes) {
+            byte = static_cast<std::uint8_t>(random() % 6);
+        }
+        for (const auto kernel : {ClassificationKernel::Scalar, ClassificationKernel::Sse42, ClassificationKernel::Avx2, ClassificationKernel::Avx512}) {
+            if (!LispLexer::IsKernelSupported(kernel)) {
+                continue;
+            }
+            const auto find = Classifier::ResolveFinder(kernel);
+            // every start and length, so both the vector loop and the tail find (or miss) the byte
+            for (std::size_t from = 0; from < 70; ++from) {
+                for (std::size_t count = 0; from + count <= bytes.size(); count += 7) {
+                    for (const std::uint8_t value : {0, 5, 6}) {
+                        const auto expected = static_cast<std::size_t>(
+                            std::find(bytes.begin() + from, bytes.begin() + from + count, value) - (bytes.begin() + from));
+                        ASSERT_EQ(find(bytes.data() + from, count, value), expected)
+                            << "kernel " << static_cast<int>(kernel) << " from " << from << " count " << count;
+                    }
+                }
+            }
+        }
+    }
+
+    TEST_F(LispLexerTest, Coverage_TokenColumnsMatchTokens) {
+        const auto input = GenerateStructuralProgram(false);
+        for (const auto kernel : {ClassificationKernel::Scalar, ClassificationKernel::Default}) {
+            const auto lexer = LispLexer::Make(input, false, {.Kernel = kernel, .TokenColumns = true});
+            ASSERT_TRUE(lexer->Tokenize());
+            const auto first = lexer->TokenizeFirstSExpr();
+            ASSERT_TRUE(first.has_value());
+            const LispToken* begin = first->first;
+            const LispToken* end = first->second;
+            std::vector<const LispToken*> tokens;
+            while (begin != nullptr) {
+                CollectAllTokens(lexer.get(), begin, end, tokens, true);
+                const auto next = lexer->TokenizeNext(begin);
+                begin = next.has_value() ? next->first : nullptr;
+                end = next.has_value() ? next->second : nullptr;
+            }
+
+            const LispTokenColumns* columns = lexer->GetTokenColumns();
+            ASSERT_NE(columns, nullptr);
+            ASSERT_GE(columns->Size(), tokens.size());
+            for (std::size_t i = 0; i < columns->Size(); ++i) {
+                const LispToken* token = lexer->GetToken(i);
+                ASSERT_EQ(columns->GetKinds()[i], token->Kind) << "token " << i;
+                ASSERT_EQ(columns->GetOffsets()[i], token->GetByteLocation(lexer->GetTextData())) << "token " << i;
+                ASSERT_EQ(columns->GetLengths()[i], token->GetLength()) << "token " << i;
+                ASSERT_EQ(columns->GetAuxiliaryIndices()[i], token->AuxiliaryIndex) << "token " << i;
+                ASSERT_EQ(columns->GetAuxiliaryLengths()[i], token->AuxiliaryLength) << "token " << i;
+            }
+            for (const auto kind : {LispTokenKind::LeftParenthesis, LispTokenKind::Identifier, LispTokenKind::Defun}) {
+                std::vector<std::size_t> expected;
+                for (std::size_t i = 0; i < columns->Size(); ++i) {
+                    if (lexer->GetToken(i)->Kind == kind) {
+                        expected.push_back(i);
+                    }
+                }
+                std::vector<std::size_t> found;
+                for (std::size_t i = columns->FindNext(kind, 0); i < columns->Size(); i = columns->FindNext(kind, i + 1)) {
+                    found.push_back(i);
+                }
+                if (kind == LispTokenKind::LeftParenthesis) {
+                    EXPECT_FALSE(expected.empty());
+                }
+                EXPECT_EQ(found, expected);
+            }
+        }
+        EXPECT_EQ(LispLexer::Make(input)->GetTokenColumns(), nullptr);
+    }
+
+    TEST_F(LispLexerTest, Coverage_SampledArenaCapacities) {
+        // Short texts are classified entirely, so the estimates cover what tokenizing them produces
+        const std::string input = "(defun f (x y) ; adds\n  (+ x y \"a (b\"))\n(f 1 2)\n";
+        const auto paddedInput = PadString(input);
+        const auto lexer = LispLexer::Make(paddedInput, false, {.SampleArenas = true});
+        const ArenaCapacities& capacities = lexer->GetArenaCapacities();
+        ASSERT_TRUE(lexer->Tokenize());
+        std::vector<const LispToken*> tokens;
+        const auto first = lexer->TokenizeFirstSExpr();
+        ASSERT_TRUE(first.has_value());
+        const LispToken* begin = first->first;
+        const LispToken* end = first->second;
+        while (begin != nullptr) {
+            CollectAllTokens(lexer.get(), begin, end, tokens, true);
+            const auto next = lexer->TokenizeNext(begin);
+            begin = next.has_value() ? next->first : nullptr;
+            end = next.has_value() ? next->second : nullptr;
+        }
+        EXPECT_GE(capacities.Tokens, tokens.size());
+        EXPECT_GE(capacities.SExprIndices, 4u);
+        EXPECT_LE(capacities.Tokens, paddedInput.size() + PaddingSize);
+        EXPECT_EQ(LispLexer::Make(paddedInput)->GetArenaCapacities().Tokens, 0u);
+
+        // Denser texts of the same size get larger estimates
+        std::string dense;
+        std::string sparse;
+        while (dense.size() < 200000) {
+            dense += "(a(b c)d)";
+            sparse += "(abcdefgh         ; comment\n)";
+        }
+        dense.resize(200000);
+        sparse.resize(200000);
+        for (const auto kernel : {ClassificationKernel::Scalar, ClassificationKernel::Default}) {
+            const ArenaCapacities denseCapacities = SampleArenaCapacities(dense, kernel);
+            const ArenaCapacities sparseCapacities = SampleArenaCapacities(sparse, kernel);
+            EXPECT_GT(denseCapacities.Tokens, sparseCapacities.Tokens * 2);
+            EXPECT_GT(denseCapacities.SExprIndices, sparseCapacities.SExprIndices);
+            EXPECT_GE(denseCapacities.Tokens, dense.size() * 7 / 9);
+            EXPECT_GE(denseCapacities.SExprIndices, dense.size() * 2 / 9);
+        }
+    }
+
+    TEST_F(LispLexerTest, Coverage_HugePagesTokenizeAlike) {
+        std::string input;
+        while (input.size() < 300000) {
+            input += "(defun f (x y) ; adds\n  (+ x y \"a (b\" 'q #\\a))\n";
+        }
+        const auto paddedInput = PadString(input);
+        const auto tokenize = [&](const bool hugePages) {
+            const auto lexer = LispLexer::Make(paddedInput, false, {
+                .Locations = SourceLocations::Lazy,
+                .TokenColumns = true,
+                .HugePages = hugePages
+            });
+            std::vector<std::pair<LispTokenKind, std::string>> tokens;
+            EXPECT_TRUE(lexer->Tokenize());
+            const auto first = lexer->TokenizeFirstSExpr();
+            const LispToken* begin = first.has_value() ? first->first : nullptr;
+            const LispToken* end = first.has_value() ? first->second : nullptr;
+            while (begin != nullptr) {
+                std::vector<const LispToken*> region;
+                CollectAllTokens(lexer.get(), begin, end, region, true);
+                for (const LispToken* token : region) {
+                    tokens.emplace_back(token->Kind, std::string(lexer->GetTokenText(token)));
+                }
+                const auto next = lexer->TokenizeNext(begin);
+                begin = next.has_value() ? next->first : nullptr;
+                end = next.has_value() ? next->second : nullptr;
+            }
+            EXPECT_EQ(lexer->GetTokenColumns()->Size(), tokens.size());
+            return tokens;
+        };
+        const auto expected = tokenize(false);
+        EXPECT_FALSE(expected.empty());
+        EXPECT_EQ(tokenize(true), expected);
+    }
+
+    TEST_F(LispLexerTest, Coverage_ApplyEditMatchesFreshLexer) {
+        // every edit is checked against a lexer made for the edited text, a token materialized past an edit is
+        // checked to have moved along with the text when the edit kept the tokens
+        std::string program;
+        for (int i = 0; i < 80; ++i) {
+            program += "(defun f" + std::to_string(i) + " (x) ; adds\n  (+ x \"a (b\" 1.5))\n";
+        }
+        const auto at = [](const std::string& text, const std::string& what) {
+            return static_cast<std::uint32_t>(text.find(what));
+        };
+        struct Edit {
+            std::string Anchor;
+            std::uint32_t Removed;
+            std::string Inserted;
+            std::uint32_t RemovedForms; // top level forms the edit overlaps when it's applied piecewise
+            std::uint32_t InsertedForms;
+        };
+        // the anchor is searched in the text as it is before the edit, which lands on its first occurrence. edits
+        // following one that didn't tokenize cleanly, and the one outgrowing the arenas, are tokenized over again
+        const std::vector<Edit> edits{
+            {"(+ x \"a (b\" 1.5))\n(defun f11", 4, "(* x x", 1, 1},
+            {"(defun f20", 42, "", 1, 0},
+            {"(defun f0 ", 0, "(a)\n(b (c)) ; new\n", 0, 2},
+            {"1.5))\n(defun f40", 3, "2.5", 1, 1},
+            {"(defun f50 (x)", 0, "(", 0, 0},
+            {"((defun f50 (x)", 1, "", 0, 0},
+            {"(defun f60", 0, "; ", 0, 0},
+            {"; (defun f60", 2, "", 0, 0},
+            {"(defun f70", 0, "\\", 0, 0},
+            {"\\(defun f70", 1, "", 0, 0},
+            {"(defun f79", 0, std::string(3000, ' ') + "(long\n" + std::string(3000, 'x') + ")\n", 0, 0},
+            {"(a)\n", 4, "", 1, 0},
+            {"(defun f3 ", 0, "\"", 0, 0},
+            {"\"(defun f3 ", 1, "", 0, 0}};
+        for (const auto engine : {BluePassEngine::Sequential, BluePassEngine::Parallel, BluePassEngine::Fused}) {
+            for (const auto locations : {SourceLocations::Eager, SourceLocations::Lazy}) {
+                const auto padded = PadString(program);
+                const auto lexer = LispLexer::Make(padded, false,
+                    {.Threads = 4, .BlueEngine = engine, .Locations = locations});
+                ASSERT_TRUE(lexer->Tokenize());
+                std::string text = program;
+                bool kept = false;
+                bool wellFormed = true;
+                for (const Edit& edit : edits) {
+                    // the string literal of the last form is materialized before the edit
+                    std::vector<const LispToken*> tokens;
+                    const auto first = wellFormed ? lexer->TokenizeFirstSExpr() : std::nullopt;
+                    const LispToken* begin = first.has_value() ? first->first : nullptr;
+                    const LispToken* end = first.has_value() ? first->second : nullptr;
+                    while (begin != nullptr) {
+                        tokens.clear();
+                        CollectAllTokens(lexer.get(), begin, end, tokens, true);
+                        const auto next = lexer->TokenizeNext(begin);
+                        begin = next.has_value() ? next->first : nullptr;
+                        end = next.has_value() ? next->second : nullptr;
+                    }
+                    const LispToken* literal = nullptr;
+                    for (const LispToken* token : tokens) {
+                        literal = token->Kind == LispTokenKind::StringLiteral ? token : literal;
+                    }
+
+                    const std::uint32_t offset = at(text, edit.Anchor);
+                    ASSERT_NE(offset, static_cast<std::uint32_t>(std::string::npos)) << edit.Anchor;
+                    const LispEdit result = lexer->ApplyEdit(offset, edit.Removed, edit.Inserted);
+                    text.replace(offset, edit.Removed, edit.Inserted);
+                    EXPECT_EQ(lexer->GetFileSize(), text.size());
+                    kept |= result.KeptTokens;
+                    if (wellFormed && result.Success) {
+                        EXPECT_EQ(result.RemovedForms, edit.RemovedForms) << edit.Anchor;
+                        EXPECT_EQ(result.InsertedForms, edit.InsertedForms) << edit.Anchor;
+                    }
+                    wellFormed = result.Success;
+
+                    const auto paddedText = PadString(text);
+                    const auto fresh = LispLexer::Make(paddedText, false,
+                        {.Threads = 4, .BlueEngine = engine, .Locations = locations});
+                    ASSERT_EQ(result.Success, fresh->Tokenize()) << edit.Anchor;
+                    auto& expectedDiagnostics = fresh->GetDiagnostics();
+                    auto& diagnostics = lexer->GetDiagnostics();
+                    ASSERT_EQ(diagnostics.Size(), expectedDiagnostics.Size()) << edit.Anchor;
+                    for (std::size_t i = 0; i < diagnostics.Size(); ++i) {
+                        EXPECT_EQ(diagnostics[i].GetFullMessage(), expectedDiagnostics[i].GetFullMessage())
+                            << edit.Anchor;
+                    }
+                    if (!result.Success) {
+                        continue;
+                    }
+                    if (result.KeptTokens && literal != nullptr) {
+                        const auto moved = static_cast<std::uint32_t>(text.rfind("\"a (b\""));
+                        EXPECT_EQ(lexer->GetTokenText(literal), "\"a (b\"") << edit.Anchor;
+                        EXPECT_EQ(literal->GetByteLocation(lexer->GetTextData()), moved) << edit.Anchor;
+                    }
+
+                    const auto expectedFirst = fresh->TokenizeFirstSExpr();
+                    const auto editedFirst = lexer->TokenizeFirstSExpr();
+                    ASSERT_TRUE(expectedFirst.has_value() && editedFirst.has_value());
+                    std::pair<const LispToken*, const LispToken*> expectedRegion{expectedFirst->first, expectedFirst->second};
+                    std::pair<const LispToken*, const LispToken*> region{editedFirst->first, editedFirst->second};
+                    while (true) {
+                        std::vector<const LispToken*> expectedTokens;
+                        std::vector<const LispToken*> editedTokens;
+                        CollectAllTokens(fresh.get(), expectedRegion.first, expectedRegion.second, expectedTokens, true);
+                        CollectAllTokens(lexer.get(), region.first, region.second, editedTokens, true);
+                        ASSERT_EQ(editedTokens.size(), expectedTokens.size()) << edit.Anchor;
+                        for (std::size_t i = 0; i < editedTokens.size(); ++i) {
+                            ASSERT_EQ(lexer->GetTokenText(editedTokens[i]), fresh->GetTokenText(expectedTokens[i]))
+                                << edit.Anchor << " token " << i;
+                            const SourceLocation location = lexer->GetSourceLocation(editedTokens[i]);
+                            const SourceLocation expectedLocation = fresh->GetSourceLocation(expectedTokens[i]);
+                            ASSERT_EQ(location.Line, expectedLocation.Line) << edit.Anchor << " token " << i;
+                            ASSERT_EQ(location.ColumnChar, expectedLocation.ColumnChar) << edit.Anchor << " token " << i;
+                        }
+                        const auto expectedAuxiliary = fresh->GetTokenAuxiliary(expectedRegion.first);
+                        const auto auxiliary = lexer->GetTokenAuxiliary(region.first);
+                        ASSERT_EQ(auxiliary.has_value(), expectedAuxiliary.has_value()) << edit.Anchor;
+                        if (auxiliary.has_value()) {
+                            EXPECT_EQ(lexer->GetTokenText(auxiliary->first), fresh->GetTokenText(expectedAuxiliary->first));
+                        }
+                        const auto nextExpected = fresh->TokenizeNext(expectedRegion.first);
+                        const auto next = lexer->TokenizeNext(region.first);
+                        ASSERT_EQ(next.has_value(), nextExpected.has_value()) << edit.Anchor;
+                        if (!next.has_value()) {
+                            break;
+                        }
+                        expectedRegion = {nextExpected->first, nextExpected->second};
+                        region = {next->first, next->second};
+                    }
+                }
+                EXPECT_TRUE(kept);
+            }
+        }
+    }
+
+    TEST_F(LispLexerTest, Coverage_ApplyEditMovesTokensMaterializedInOrder) {
+        // forms materialized one after the other, with no trivia between them, stay in text order across edits, so
+        // only the tokens past each edit are visited. every token outside the edited forms must still hold its text
+        std::string program;
+        for (int i = 0; i < 40; ++i) {
+            program += "(f" + std::to_string(i) + " x" + std::to_string(i) + " \"s\" (g 1))";
+        }
+        for (const auto locations : {SourceLocations::Eager, SourceLocations::Lazy}) {
+            const auto padded = PadString(program);
+            const auto lexer = LispLexer::Make(padded, false, {.Locations = locations});
+            ASSERT_TRUE(lexer->Tokenize());
+            // the first edit makes the lexer own a copy of the text, tokens only outlive the edits of that copy
+            ASSERT_TRUE(lexer->ApplyEdit(0, 0, "").Success);
+            std::string text = program;
+            std::vector<std::pair<const LispToken*, std::string>> tokens;
+            const auto first = lexer->TokenizeFirstSExpr();
+            ASSERT_TRUE(first.has_value());
+            const LispToken* begin = first->first;
+            const LispToken* end = first->second;
+            while (begin != nullptr) {
+                std::vector<const LispToken*> formTokens;
+                CollectAllTokens(lexer.get(), begin, end, formTokens, true);
+                for (const LispToken* token : formTokens) {
+                    tokens.emplace_back(token, std::string(lexer->GetTokenText(token)));
+                }
+                const auto next = lexer->TokenizeNext(begin);
+                begin = next.has_value() ? next->first : nullptr;
+                end = next.has_value() ? next->second : nullptr;
+            }
+            for (const std::string anchor : {"x10 ", "x30 ", "x5 ", "x39 "}) {
+                const auto offset = static_cast<std::uint32_t>(text.find(anchor));
+                const LispEdit result = lexer->ApplyEdit(offset, 1, "xyz");
+                text.replace(offset, 1, "xyz");
+                ASSERT_TRUE(result.Success) << anchor;
+                ASSERT_TRUE(result.KeptTokens) << anchor;
+                const auto formStart = static_cast<std::uint32_t>(text.rfind("(f", offset));
+                const auto formEnd = static_cast<std::uint32_t>(text.find("))", offset) + 2);
+                for (auto& [token, expected] : tokens) {
+                    const std::uint32_t location = token->GetByteLocation(lexer->GetTextData());
+                    if (location >= formStart && location < formEnd) {
+                        expected = "";
+                    }
+                    if (!expected.empty()) {
+                        ASSERT_EQ(lexer->GetTokenText(token), expected) << anchor;
+                        ASSERT_EQ(text.compare(location, expected.size(), expected), 0) << anchor;
+                    }
+                }
+            }
+        }
+    }
+
     TEST_F(LispLexerTest, FetchFragment_LineCount_SingleNewline) {
         // Single newline - tests line increment in early return
         const std::string input = "(\n+)";
@@ -1411,11 +2214,11 @@ namespace WideLips::Tests {
         ASSERT_TRUE(optRegion.has_value());
         const auto [begin, end] = *optRegion;
 
-        EXPECT_EQ(begin->Line, 1u);
+        EXPECT_EQ(lexer->GetSourceLocation(begin).Line, 1u);
         const auto tokRegion = lexer->TokenizeSExpr(begin);
         EXPECT_TRUE(tokRegion.has_value());
-        EXPECT_EQ(tokRegion.value().first->Line, 2u); // '+' token
-        EXPECT_EQ(end->Line, 2u);  // Closing paren on line 2
+        EXPECT_EQ(lexer->GetSourceLocation(tokRegion.value().first).Line, 2u); // '+' token
+        EXPECT_EQ(lexer->GetSourceLocation(end).Line, 2u);  // Closing paren on line 2
     }
 
     TEST_F(LispLexerTest, FetchFragment_LineCount_MultipleNewlines) {
@@ -1431,7 +2234,7 @@ namespace WideLips::Tests {
         ASSERT_TRUE(tokRegion.has_value());
 
         const auto [tokBegin, tokEnd] = *tokRegion;
-        EXPECT_EQ(tokBegin->Line, 4u);  // Plus token on line 4
+        EXPECT_EQ(lexer->GetSourceLocation(tokBegin).Line, 4u);  // Plus token on line 4
     }
 
     TEST_F(LispLexerTest, FetchFragment_LineCount_MixedNewlinesAndSpaces) {
@@ -1447,7 +2250,7 @@ namespace WideLips::Tests {
         ASSERT_TRUE(tokRegion.has_value());
 
         const auto [tokBegin, tokEnd] = *tokRegion;
-        EXPECT_EQ(tokBegin->Line, 3u);  // Plus token on line 3
+        EXPECT_EQ(lexer->GetSourceLocation(tokBegin).Line, 3u);  // Plus token on line 3
     }
 
     TEST_F(LispLexerTest, FetchFragment_LineCount_CommentWithNewline) {
@@ -1459,7 +2262,7 @@ namespace WideLips::Tests {
 
         const auto optRegion = lexer->TokenizeFirstSExpr();
         ASSERT_TRUE(optRegion.has_value());
-        EXPECT_EQ(optRegion->first->Line, 2u);  // First token on line 2
+        EXPECT_EQ(lexer->GetSourceLocation(optRegion->first).Line, 2u);  // First token on line 2
     }
 
     TEST_F(LispLexerTest, FetchFragment_LineCount_MultilineComment) {
@@ -1471,7 +2274,7 @@ namespace WideLips::Tests {
 
         const auto optRegion = lexer->TokenizeFirstSExpr();
         ASSERT_TRUE(optRegion.has_value());
-        EXPECT_EQ(optRegion->first->Line, 4u);  // First token on line 4
+        EXPECT_EQ(lexer->GetSourceLocation(optRegion->first).Line, 4u);  // First token on line 4
     }
 
     // ============================================================================
@@ -1619,7 +2422,7 @@ namespace WideLips::Tests {
         ASSERT_TRUE(tokRegion.has_value());
 
         const auto [tokBegin, tokEnd] = *tokRegion;
-        EXPECT_EQ(tokBegin->Line, 51u);  // Plus token on line 51
+        EXPECT_EQ(lexer->GetSourceLocation(tokBegin).Line, 51u);  // Plus token on line 51
     }
 
     TEST_F(LispLexerTest, FetchFragment_MultiBlock_NewlinesWithSpaces) {
@@ -1639,7 +2442,7 @@ namespace WideLips::Tests {
         ASSERT_TRUE(tokRegion.has_value());
 
         const auto [tokBegin, tokEnd] = *tokRegion;
-        EXPECT_EQ(tokBegin->Line, 31u);  // 30 newlines + line 1
+        EXPECT_EQ(lexer->GetSourceLocation(tokBegin).Line, 31u);  // 30 newlines + line 1
     }
 
     TEST_F(LispLexerTest, FetchFragment_MultiBlock_AlternatingNewlines) {
@@ -1659,7 +2462,7 @@ namespace WideLips::Tests {
         ASSERT_TRUE(tokRegion.has_value());
 
         const auto [tokBegin, tokEnd] = *tokRegion;
-        EXPECT_EQ(tokBegin->Line, 41u);  // 40 newlines + line 1
+        EXPECT_EQ(lexer->GetSourceLocation(tokBegin).Line, 41u);  // 40 newlines + line 1
     }
 
     TEST_F(LispLexerTest, FetchFragment_MultiBlock_CommentsWithNewlines) {
@@ -1675,7 +2478,7 @@ namespace WideLips::Tests {
 
         const auto optRegion = lexer->TokenizeFirstSExpr();
         ASSERT_TRUE(optRegion.has_value());
-        EXPECT_EQ(optRegion->first->Line, 21u);  // 20 comment lines + line 1
+        EXPECT_EQ(lexer->GetSourceLocation(optRegion->first).Line, 21u);  // 20 comment lines + line 1
     }
 
     // ============================================================================
@@ -1696,7 +2499,7 @@ namespace WideLips::Tests {
 
         const auto optRegion = lexer->TokenizeFirstSExpr();
         ASSERT_TRUE(optRegion.has_value());
-        EXPECT_EQ(optRegion->first->Line, 2u);  // First token on line 2
+        EXPECT_EQ(lexer->GetSourceLocation(optRegion->first).Line, 2u);  // First token on line 2
     }
 
     TEST_F(LispLexerTest, FetchFragment_Complex_HeavilyCommented) {
@@ -1715,7 +2518,7 @@ namespace WideLips::Tests {
 
         const auto optRegion = lexer->TokenizeFirstSExpr();
         ASSERT_TRUE(optRegion.has_value());
-        EXPECT_EQ(optRegion->first->Line, 5u);  // First s-expr on line 5
+        EXPECT_EQ(lexer->GetSourceLocation(optRegion->first).Line, 5u);  // First s-expr on line 5
     }
 
     TEST_F(LispLexerTest, FetchFragment_Complex_DeepIndentation) {
@@ -1807,7 +2610,7 @@ namespace WideLips::Tests {
         ASSERT_TRUE(tokRegion.has_value());
 
         const auto [tokBegin, tokEnd] = *tokRegion;
-        EXPECT_EQ(tokBegin->Line, 2u);  // Plus on line 2
+        EXPECT_EQ(lexer->GetSourceLocation(tokBegin).Line, 2u);  // Plus on line 2
     }
 
     // ============================================================================
@@ -1880,15 +2683,15 @@ namespace WideLips::Tests {
 
         const auto optRegion = lexer->TokenizeFirstSExpr();
         ASSERT_TRUE(optRegion.has_value());
-        EXPECT_EQ(optRegion->first->Line, 1u);
+        EXPECT_EQ(lexer->GetSourceLocation(optRegion->first).Line, 1u);
 
         const auto secondRegion = lexer->TokenizeNext(optRegion->first);
         ASSERT_TRUE(secondRegion.has_value());
-        EXPECT_EQ(secondRegion->first->Line, 4u);
+        EXPECT_EQ(lexer->GetSourceLocation(secondRegion->first).Line, 4u);
 
         const auto thirdRegion = lexer->TokenizeNext(secondRegion->first);
         ASSERT_TRUE(thirdRegion.has_value());
-        EXPECT_EQ(thirdRegion->first->Line, 7u);
+        EXPECT_EQ(lexer->GetSourceLocation(thirdRegion->first).Line, 7u);
     }
 
     // ============================================================================
@@ -1962,7 +2765,7 @@ namespace WideLips::Tests {
         ASSERT_TRUE(tokRegion.has_value());
 
         const auto [tokBegin, tokEnd] = *tokRegion;
-        EXPECT_EQ(tokBegin->Line, 6u);
+        EXPECT_EQ(lexer->GetSourceLocation(tokBegin).Line, 6u);
     }
 
     TEST_F(LispLexerTest, FetchFragment_Regression_OnlyWhitespace) {
@@ -2005,7 +2808,7 @@ namespace WideLips::Tests {
 
         const auto optRegion = lexer->TokenizeFirstSExpr();
         ASSERT_TRUE(optRegion.has_value());
-        EXPECT_EQ(optRegion->first->Line, 7u);
+        EXPECT_EQ(lexer->GetSourceLocation(optRegion->first).Line, 7u);
     }
 
     TEST_F(LispLexerTest, FetchFragment_Regression_WhitespaceBeforeEOF) {
@@ -2081,10 +2884,10 @@ namespace WideLips::Tests {
 
         // Verify line counting worked across different positions
         const auto [tokBegin, tokEnd] = *tokRegion;
-        EXPECT_EQ(tokBegin->Line, 1U);
-        EXPECT_EQ((tokBegin+1)->Line, 2U);
-        EXPECT_EQ((tokBegin+2)->Line, 4U);
-        EXPECT_EQ((tokBegin+3)->Line, 5U);
+        EXPECT_EQ(lexer->GetSourceLocation(tokBegin).Line, 1U);
+        EXPECT_EQ(lexer->GetSourceLocation(tokBegin+1).Line, 2U);
+        EXPECT_EQ(lexer->GetSourceLocation(tokBegin+2).Line, 4U);
+        EXPECT_EQ(lexer->GetSourceLocation(tokBegin+3).Line, 5U);
     }
 
     // ============================================================================
@@ -2166,7 +2969,7 @@ namespace WideLips::Tests {
         ASSERT_EQ(flattenTokens.size(), expected.size());
         for (size_t i = 0; i < flattenTokens.size(); ++i) {
             EXPECT_EQ(flattenTokens[i]->Kind, expected[i].Kind);
-            EXPECT_EQ(flattenTokens[i]->GetText(), expected[i].Text);
+            EXPECT_EQ(flattenTokens[i]->GetText(lexer->GetTextData()), expected[i].Text);
         }
     }
 
@@ -2268,8 +3071,8 @@ namespace WideLips::Tests {
         // Check the trivia content
         // The span is from index 0 to the '('
         std::string expectedTrivia = "  ; leading comment\n   \n ";
-        EXPECT_EQ(auxBegin->GetText(), expectedTrivia);
-        EXPECT_EQ(auxBegin->Length, expectedTrivia.length());
+        EXPECT_EQ(auxBegin->GetText(lexer->GetTextData()), expectedTrivia);
+        EXPECT_EQ(auxBegin->GetLength(), expectedTrivia.length());
     }
 
     TEST_F(LispLexerTest, Trivia_BetweenTopLevel) {
@@ -2302,8 +3105,8 @@ namespace WideLips::Tests {
 
         // Check the trivia content
         std::string expectedTrivia = "  \n\n ; comment \n  ";
-        EXPECT_EQ(auxBegin->GetText(), expectedTrivia);
-        EXPECT_EQ(auxBegin->Length, expectedTrivia.length());
+        EXPECT_EQ(auxBegin->GetText(lexer->GetTextData()), expectedTrivia);
+        EXPECT_EQ(auxBegin->GetLength(), expectedTrivia.length());
     }
 
     TEST_F(LispLexerTest, Trivia_InsideSExpr) {
@@ -2323,8 +3126,8 @@ namespace WideLips::Tests {
 
         // tokBegin is 'atom1'
         // tokEnd is 'atom2'
-        ASSERT_EQ(tokBegin->GetText(), "atom1");
-        ASSERT_EQ(tokEnd->GetText(), "atom2");
+        ASSERT_EQ(tokBegin->GetText(lexer->GetTextData()), "atom1");
+        ASSERT_EQ(tokEnd->GetText(lexer->GetTextData()), "atom2");
 
         // Check trivia on 'atom1'
         // Trivia: " ", "; c1 \n", " "
@@ -2332,9 +3135,9 @@ namespace WideLips::Tests {
         auto aux1Opt = lexer->GetTokenAuxiliary(tokBegin);
         ASSERT_TRUE(aux1Opt.has_value());
         auto [aux1Begin, aux1End] = *aux1Opt;
-        EXPECT_EQ(aux1Begin->GetText(), " ");
-        EXPECT_EQ((aux1Begin+1)->GetText(), "; c1 \n");
-        EXPECT_EQ((aux1Begin+2)->GetText(), " ");
+        EXPECT_EQ(aux1Begin->GetText(lexer->GetTextData()), " ");
+        EXPECT_EQ((aux1Begin+1)->GetText(lexer->GetTextData()), "; c1 \n");
+        EXPECT_EQ((aux1Begin+2)->GetText(lexer->GetTextData()), " ");
         EXPECT_EQ(aux1End, aux1Begin+2);
 
         // Check trivia on 'atom2'
@@ -2343,11 +3146,11 @@ namespace WideLips::Tests {
         auto aux2Opt = lexer->GetTokenAuxiliary(tokEnd);
         ASSERT_TRUE(aux2Opt.has_value());
         auto [aux2Begin, aux2End] = *aux2Opt;
-        EXPECT_EQ(aux2Begin->GetText(), " \n ");
-        EXPECT_EQ((aux2Begin+1)->GetText(), "; c2 \n");
-        EXPECT_EQ((aux2Begin+2)->GetText(), " ");
-        EXPECT_EQ((aux2Begin+3)->GetText(), ";another c2\n");
-        EXPECT_EQ((aux2Begin+4)->GetText(), " ");
+        EXPECT_EQ(aux2Begin->GetText(lexer->GetTextData()), " \n ");
+        EXPECT_EQ((aux2Begin+1)->GetText(lexer->GetTextData()), "; c2 \n");
+        EXPECT_EQ((aux2Begin+2)->GetText(lexer->GetTextData()), " ");
+        EXPECT_EQ((aux2Begin+3)->GetText(lexer->GetTextData()), ";another c2\n");
+        EXPECT_EQ((aux2Begin+4)->GetText(lexer->GetTextData()), " ");
         EXPECT_EQ(aux2End, aux2Begin+4);
 
         // Check trivia on closing ')'
@@ -2357,9 +3160,9 @@ namespace WideLips::Tests {
         auto aux3Opt = lexer->GetTokenAuxiliary(end);
         ASSERT_TRUE(aux3Opt.has_value());
         auto [aux3Begin, aux3End] = *aux3Opt;
-        EXPECT_EQ(aux3Begin->GetText(), " \n ");
-        EXPECT_EQ((aux3Begin+1)->GetText(), ";c3 \n");
-        EXPECT_EQ((aux3Begin+2)->GetText(), " ");
+        EXPECT_EQ(aux3Begin->GetText(lexer->GetTextData()), " \n ");
+        EXPECT_EQ((aux3Begin+1)->GetText(lexer->GetTextData()), ";c3 \n");
+        EXPECT_EQ((aux3Begin+2)->GetText(lexer->GetTextData()), " ");
         EXPECT_EQ(aux3End, aux3Begin+2);
     }
 } // namespace WideLips::Tests
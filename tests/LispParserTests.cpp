@@ -1,11 +1,16 @@
 ﻿#include <gtest/gtest.h>
 #include <gmock/gmock.h>
 #include "LispParseTree.h"
+#include "LispParseTreeVisitor.h"
+#include <algorithm>
+#include <map>
+#include <tuple>
 #include <vector>
 #include <string>
 #include <memory>
 #include <fstream>      // Added for file I/O
 #include <filesystem>   // Added for file paths
+#include <mutex>
 
 using namespace WideLips;
 using namespace testing;
@@ -591,6 +596,289 @@ namespace WideLips::Tests {
         EXPECT_GT(lines.size(), 0u);
     }
 
+    TEST_F(LispParseTreeTest, SourceLocationLazy) {
+        const auto program = LispParseTree::MakeParserFriendlyString("(" + std::string{FuncKeyword} + " foo ()\n  (* 2 \"a\nb\" 3))");
+        LispParser parser(program.GetUnderlyingString(), false, {.Locations = SourceLocations::Lazy});
+        const auto* root = reinterpret_cast<const LispList*>(parser.Parse());
+        ASSERT_NE(root, nullptr);
+        EXPECT_EQ(root->GetSourceLocation().Line, 1u);
+        EXPECT_EQ(root->GetSourceLocation().ColumnChar, 1u);
+
+        const auto* current = root->GetSubExpressions();
+        while (current != nullptr && (current->Kind != LispParseNodeKind::SExpr || current->GetParseNodeText() == "(")) {
+            current = current->NextNode();
+        }
+        ASSERT_NE(current, nullptr);
+        EXPECT_EQ(current->GetSourceLocation().Line, 2u);
+        EXPECT_EQ(current->GetSourceLocation().ColumnChar, 3u);
+
+        // the string literal spans two lines but the blue pass doesn't count its newline
+        const auto* last = reinterpret_cast<const LispList*>(current)->GetSubExpressions();
+        while (last->NextNode() != nullptr && last->NextNode()->Kind != LispParseNodeKind::EndOfProgram) {
+            last = last->NextNode();
+        }
+        EXPECT_EQ(last->GetParseNodeText(), "3");
+        EXPECT_EQ(last->GetSourceLocation().Line, 2u);
+        EXPECT_EQ(last->GetSourceLocation().ColumnChar, 14u);
+    }
+
+    TEST_F(LispParseTreeTest, ResetParsesAnotherProgram) {
+        const auto first = LispParseTree::MakeParserFriendlyString("(foo 1 2)");
+        LispParser parser(first.GetUnderlyingString(), false);
+        const auto* root = reinterpret_cast<const LispList*>(parser.Parse());
+        ASSERT_NE(root, nullptr);
+        EXPECT_EQ(root->GetSubExpressions()->GetParseNodeText(), "foo");
+
+        // An erroneous program leaves diagnostics behind, the next reset clears them
+        const auto erroneous = LispParseTree::MakeParserFriendlyString("(bar (baz)");
+        parser.Reset(erroneous.GetUnderlyingString());
+        (void)parser.Parse();
+        EXPECT_FALSE(parser.GetDiagnostics().Empty());
+
+        // A program much larger than the first one makes the arenas grow
+        std::string large;
+        for (int i = 0; i < 20000; ++i) {
+            large += "(item " + std::to_string(i) + " (nested \"s\")) ";
+        }
+        const auto second = LispParseTree::MakeParserFriendlyString(large);
+        parser.Reset(second.GetUnderlyingString());
+        root = reinterpret_cast<const LispList*>(parser.Parse());
+        ASSERT_NE(root, nullptr);
+        EXPECT_TRUE(parser.GetDiagnostics().Empty());
+        EXPECT_EQ(root->GetSubExpressions()->GetParseNodeText(), "item");
+        std::size_t forms = 0;
+        for (const LispParseNodeBase* form = root; form != nullptr && form->Kind != LispParseNodeKind::EndOfProgram;
+            form = form->NextNode()) {
+            ++forms;
+        }
+        EXPECT_EQ(forms, 20000u);
+
+        const auto file = CreateTempFile("(defvar answer 42)");
+        parser.Reset(file);
+        root = reinterpret_cast<const LispList*>(parser.Parse());
+        ASSERT_NE(root, nullptr);
+        EXPECT_TRUE(parser.GetDiagnostics().Empty());
+        EXPECT_EQ(root->GetSubExpressions()->NextNode()->GetParseNodeText(), "answer");
+        EXPECT_EQ(root->GetSourceLocation().Line, 1u);
+    }
+
+    TEST_F(LispParseTreeTest, ApplyEditKeepsUntouchedForms) {
+        std::string text;
+        for (int i = 0; i < 30; ++i) {
+            text += "(item " + std::to_string(i) + " (nested \"s\"))\n";
+        }
+        const auto program = LispParseTree::MakeParserFriendlyString(text);
+        LispParser parser(program.GetUnderlyingString(), false);
+        ASSERT_NE(parser.Parse(), nullptr);
+        // walking the tree makes every node, the top level ones are collected. the last list of a list is followed
+        // by the top level list after its parent, so lists are walked as far as their closing parenthesis
+        const auto walk = [](auto&& self, LispParseNodeBase* node, std::string& dump,
+            std::vector<LispParseNodeBase*>* forms, const char* end) -> void {
+            for (; node != nullptr && node->Kind != LispParseNodeKind::EndOfProgram &&
+                (end == nullptr || node->GetParseNodeText().data() < end); node = node->NextNode()) {
+                if (forms != nullptr) {
+                    forms->push_back(node);
+                }
+                if (node->Kind == LispParseNodeKind::SExpr) {
+                    const std::string_view list = node->GetParseNodeText();
+                    dump += "(";
+                    self(self, reinterpret_cast<LispList*>(node)->GetSubExpressions(), dump, nullptr,
+                        list.data() + list.size());
+                    dump += ")";
+                }
+                else {
+                    dump += std::string(node->GetParseNodeText()) + " ";
+                }
+                const SourceLocation location = node->GetSourceLocation();
+                dump += std::to_string(location.Line) + ":" + std::to_string(location.ColumnChar) + " ";
+            }
+        };
+        const auto expect = [&](LispParseNodeBase* root, std::vector<LispParseNodeBase*>& forms) {
+            std::string dump;
+            walk(walk, root, dump, &forms, nullptr);
+            const auto edited = LispParseTree::MakeParserFriendlyString(text);
+            LispParser fresh(edited.GetUnderlyingString(), false);
+            std::string expected;
+            walk(walk, fresh.Parse(), expected, nullptr, nullptr);
+            EXPECT_EQ(dump, expected);
+        };
+
+        // the first edit copies the text, so nothing is kept yet
+        text.insert(0, "; lead\n");
+        std::vector<LispParseNodeBase*> forms;
+        expect(parser.ApplyEdit(0, 0, "; lead\n"), forms);
+        ASSERT_EQ(forms.size(), 30u);
+        ASSERT_NE(reinterpret_cast<LispList*>(forms[0])->GetNodeAuxiliary(), nullptr);
+
+        // one form replaced by two, the nodes of the others are kept
+        const std::string replaced = "(item 10 (nested \"s\"))";
+        const auto offset = static_cast<std::uint32_t>(text.find(replaced));
+        text.replace(offset, replaced.size(), "(item ten) (extra)");
+        std::vector<LispParseNodeBase*> after;
+        expect(parser.ApplyEdit(offset, static_cast<std::uint32_t>(replaced.size()), "(item ten) (extra)"), after);
+        ASSERT_EQ(after.size(), 31u);
+        for (std::size_t i = 0; i < 30; ++i) {
+            if (i != 10) {
+                EXPECT_EQ(after[i < 10 ? i : i + 1], forms[i]) << "form " << i;
+            }
+        }
+
+        // the leading comment goes, the first form is kept but not its auxiliary
+        text.erase(0, 7);
+        std::vector<LispParseNodeBase*> unled;
+        expect(parser.ApplyEdit(0, 7, ""), unled);
+        ASSERT_EQ(unled.size(), 31u);
+        EXPECT_EQ(unled[0], forms[0]);
+        EXPECT_EQ(reinterpret_cast<LispList*>(unled[0])->GetNodeAuxiliary(), nullptr);
+        EXPECT_TRUE(parser.GetDiagnostics().Empty());
+
+        // the tree can't be consumed while an edit leaves it erroneous
+        const auto result = ParseProgram("(foo 1) (bar 2)");
+        ASSERT_TRUE(result.Success);
+        EXPECT_FALSE(result.ParseTree->ApplyEdit(8, 0, "("));
+        EXPECT_EQ(result.ParseTree->GetRoot(), nullptr);
+        EXPECT_TRUE(result.ParseTree->ApplyEdit(8, 1, ""));
+        ASSERT_NE(result.ParseTree->GetRoot(), nullptr);
+        EXPECT_EQ(result.ParseTree->GetRoot()->NextNode()->GetParseNodeText(), "(bar 2");
+    }
+
+    TEST_F(LispParseTreeTest, ConcurrentMaterializationMatchesSequential) {
+        std::string text;
+        for (int i = 0; i < 400; ++i) {
+            text += "; form " + std::to_string(i) + "\n(item " + std::to_string(i) +
+                " ; note\n (nested \"s\" (deep " + std::to_string(i * 7) + ")) (!@# 4.5))\n";
+        }
+        const auto program = LispParseTree::MakeParserFriendlyString(text);
+        // the last list of a list is followed by the top level list after its parent, so lists are walked as far as
+        // their closing parenthesis
+        const auto walk = [](auto&& self, LispParseNodeBase* node, std::string& dump, const char* end) -> void {
+            for (; node != nullptr && node->Kind != LispParseNodeKind::EndOfProgram &&
+                (end == nullptr || node->GetParseNodeText().data() < end); node = node->NextNode()) {
+                if (const LispAuxiliary* const auxiliary = node->GetNodeAuxiliary()) {
+                    dump += "[" + std::string(auxiliary->GetParseNodeText()) + "]";
+                }
+                if (node->Kind == LispParseNodeKind::SExpr) {
+                    const std::string_view list = node->GetParseNodeText();
+                    dump += "(";
+                    self(self, reinterpret_cast<LispList*>(node)->GetSubExpressions(), dump, list.data() + list.size());
+                    dump += ")";
+                }
+                else {
+                    dump += std::string(node->GetParseNodeText()) + " ";
+                }
+                const SourceLocation location = node->GetSourceLocation();
+                dump += std::to_string(location.Line) + ":" + std::to_string(location.ColumnChar) + " ";
+            }
+        };
+        const auto dumpForm = [&](LispParseNodeBase* form) {
+            std::string dump;
+            const std::string_view list = form->GetParseNodeText();
+            walk(walk, form, dump, list.data() + list.size());
+            return dump;
+        };
+        constexpr std::size_t threads = 4;
+
+        for (const SourceLocations locations : {SourceLocations::Eager, SourceLocations::Lazy}) {
+            LispParser sequential(program.GetUnderlyingString(), false, {.Locations = locations});
+            std::vector<std::string> expected;
+            for (LispParseNodeBase* form = sequential.Parse(); form->Kind != LispParseNodeKind::EndOfProgram;
+                form = form->NextNode()) {
+                expected.push_back(dumpForm(form));
+            }
+            ASSERT_EQ(expected.size(), 400u);
+
+            LispParser parser(program.GetUnderlyingString(), false, {.Locations = locations, .Concurrent = true});
+            std::vector<LispParseNodeBase*> forms;
+            for (LispParseNodeBase* form = parser.Parse(); form->Kind != LispParseNodeKind::EndOfProgram;
+                form = form->NextNode()) {
+                forms.push_back(form);
+            }
+            ASSERT_EQ(forms.size(), expected.size());
+
+            // every form is expanded by a single thread first, so each of them reports its diagnostics once
+            std::vector<std::string> dumps(forms.size());
+            ParallelFor(threads, [&](const std::size_t chunk) {
+                for (std::size_t form = chunk; form < forms.size(); form += threads) {
+                    dumps[form] = dumpForm(forms[form]);
+                }
+            });
+            EXPECT_EQ(dumps, expected);
+            EXPECT_EQ(parser.GetDiagnostics().Size(), sequential.GetDiagnostics().Size());
+
+            // every thread walks every form of a fresh tree, racing the others for the nodes none of them made yet
+            LispParser racing(program.GetUnderlyingString(), false, {.Locations = locations, .Concurrent = true});
+            forms.clear();
+            for (LispParseNodeBase* form = racing.Parse(); form->Kind != LispParseNodeKind::EndOfProgram;
+                form = form->NextNode()) {
+                forms.push_back(form);
+            }
+            std::vector<std::vector<std::string>> raced(threads, std::vector<std::string>(forms.size()));
+            ParallelFor(threads, [&](const std::size_t chunk) {
+                for (std::size_t form = 0; form < forms.size(); ++form) {
+                    const std::size_t at = (form + chunk * forms.size() / threads) % forms.size();
+                    raced[chunk][at] = dumpForm(forms[at]);
+                }
+            });
+            for (const auto& dump : raced) {
+                EXPECT_EQ(dump, expected);
+            }
+        }
+    }
+
+    TEST_F(LispParseTreeTest, ParseManyKeepsTheOrderOfFiles) {
+        const auto directory = std::filesystem::temp_directory_path() / "widelips_parse_many";
+        std::filesystem::create_directories(directory);
+        std::vector<std::filesystem::path> paths;
+        for (int i = 0; i < 12; ++i) {
+            paths.push_back(directory / ("file" + std::to_string(i) + ".lsp"));
+            std::ofstream out(paths.back());
+            // sizes vary so the largest-first order differs from the given one
+            for (int form = 0; form < (i * 7) % 12 + 1; ++form) {
+                out << "(form" << i << " " << form << " (nested \"text\"))\n";
+            }
+            if (i == 5) {
+                out << "(unclosed";
+            }
+        }
+        paths.push_back(directory / "missing.lsp");
+
+        const auto results = LispParseTree::ParseMany(paths, {.Threads = 3});
+        ASSERT_EQ(results.size(), paths.size());
+        for (std::size_t i = 0; i < paths.size(); ++i) {
+            ASSERT_NE(results[i].ParseTree, nullptr);
+            EXPECT_EQ(results[i].ParseTree->GetFilePath(), paths[i].string());
+            EXPECT_EQ(results[i].Success, i != 5 && i != 12) << paths[i];
+            if (results[i].Success) {
+                const auto* root = reinterpret_cast<const LispList*>(results[i].ParseTree->GetRoot());
+                ASSERT_NE(root, nullptr);
+                EXPECT_EQ(root->GetSubExpressions()->GetParseNodeText(), "form" + std::to_string(i));
+            }
+        }
+
+        // The callback flavour reuses a parser per worker, each file is reported once
+        std::mutex lock;
+        std::vector<int> seen(paths.size(), 0);
+        std::vector<std::string> heads(paths.size());
+        LispParseTree::ParseMany(paths, {.Threads = 4},
+            [&](const std::size_t index, LispParser&, LispParseNodeBase* root, const bool success) {
+                const std::lock_guard guard(lock);
+                ++seen[index];
+                EXPECT_EQ(success, index != 5 && index != 12) << paths[index];
+                if (success) {
+                    heads[index] = std::string(reinterpret_cast<const LispList*>(root)->GetSubExpressions()->GetParseNodeText());
+                }
+            });
+        for (std::size_t i = 0; i < paths.size(); ++i) {
+            EXPECT_EQ(seen[i], 1);
+            if (i != 5 && i != 12) {
+                EXPECT_EQ(heads[i], "form" + std::to_string(i));
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::remove_all(directory, error);
+    }
+
     // ============================================================================
     // Full Tree Traversal Tests
     // ============================================================================
@@ -920,6 +1208,90 @@ namespace WideLips::Tests {
         EXPECT_GT(visitor.atomCount + visitor.listCount, 0);
     }
 
+    // visits a single node per call, the parallel walker does the descending
+    class FormStatisticsVisitor : public LispParseTreeVisitor<FormStatisticsVisitor> {
+    public:
+        std::size_t lists = 0;
+        std::size_t errors = 0;
+        std::map<std::string, std::size_t> atoms;
+
+        void Visit(LispAtom * const atom) {
+            ++atoms[std::string(atom->GetParseNodeText())];
+        }
+
+        void Visit(LispList * const) {
+            ++lists;
+        }
+
+        void Visit(LispArguments * const) {}
+
+        void Visit(LispParseError * const) {
+            ++errors;
+        }
+
+        static void Merge(FormStatisticsVisitor& into, FormStatisticsVisitor&& from) {
+            into.lists += from.lists;
+            into.errors += from.errors;
+            for (const auto& [text, count] : from.atoms) {
+                into.atoms[text] += count;
+            }
+        }
+    };
+
+    TEST_F(LispParseTreeTest, ParallelWalkerVisitsEveryForm) {
+        constexpr std::size_t formsCount = 1000;
+        std::string text = "; leading\n";
+        for (std::size_t i = 0; i < formsCount; ++i) {
+            text += "(item " + std::to_string(i % 10) + " ; note\n (nested \"s\" (deep " + std::to_string(i % 3) +
+                ")) (!@# 4.5))\n";
+        }
+        const auto program = LispParseTree::MakeParserFriendlyString(text);
+        const auto walk = [&](const bool concurrent, const std::uint32_t workers) {
+            LispParser parser(program.GetUnderlyingString(), false, {.Concurrent = concurrent});
+            EXPECT_NE(parser.Parse(), nullptr);
+            const auto visitor = ParallelLispParseTreeWalker<FormStatisticsVisitor>::Walk(parser, workers,
+                [] { return FormStatisticsVisitor{}; }, FormStatisticsVisitor::Merge);
+            return std::make_tuple(visitor.lists, visitor.errors, visitor.atoms, parser.GetDiagnostics().Size());
+        };
+
+        // without a concurrent lexer every form is walked on the calling thread. whatever '#' parses as in this
+        // dialect, the errors and diagnostics of every walk must agree with those of this one
+        const auto sequential = walk(false, 4);
+        const auto& lists = std::get<0>(sequential);
+        const auto& atoms = std::get<2>(sequential);
+        EXPECT_EQ(lists, formsCount * 4);
+        EXPECT_EQ(atoms.at("item"), formsCount);
+        EXPECT_EQ(atoms.at("\"s\""), formsCount);
+        EXPECT_EQ(atoms.at("4.5"), formsCount);
+        EXPECT_EQ(atoms.at("7"), formsCount / 10);
+
+        for (const std::uint32_t workers : {1u, 3u, 8u}) {
+            EXPECT_EQ(walk(true, workers), sequential) << workers << " workers";
+        }
+    }
+
+    TEST_F(LispParseTreeTest, ParallelWalkerStopsAtUnclosedForms) {
+        for (const std::string text : {"(a (b)", "(a) (b", "(a) (b (c)", "(a"}) {
+            const auto program = LispParseTree::MakeParserFriendlyString(text);
+            for (const bool concurrent : {false, true}) {
+                const auto lexer = LispLexer::Make(program.GetUnderlyingString(), false, {.Concurrent = concurrent});
+                (void)lexer->Tokenize();
+                const auto forms = lexer->GetTopLevelSExprIndices();
+                EXPECT_TRUE(std::ranges::is_sorted(forms)) << text;
+                EXPECT_TRUE(std::ranges::adjacent_find(forms) == forms.end()) << text;
+                for (const std::uint32_t form : forms) {
+                    (void)lexer->TokenizeAfter(form);
+                }
+
+                LispParser parser(program.GetUnderlyingString(), false, {.Concurrent = concurrent});
+                (void)parser.Parse();
+                const auto visitor = ParallelLispParseTreeWalker<FormStatisticsVisitor>::Walk(parser, 2,
+                    [] { return FormStatisticsVisitor{}; }, FormStatisticsVisitor::Merge);
+                EXPECT_GE(visitor.lists + visitor.errors, 1u) << text;
+            }
+        }
+    }
+
     // ============================================================================
     // Error Handling Tests
     // ============================================================================
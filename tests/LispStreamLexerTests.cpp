@@ -0,0 +1,155 @@
+﻿#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "LispStreamLexer.h"
+
+using namespace testing;
+namespace WideLips::Tests {
+    class LispStreamLexerTest : public Test {
+    protected:
+        //every token of a form as 'kind:text@line:column', lines made relative to the whole text
+        static void CollectForm(LispLexer& lexer,
+            const LispToken* begin,
+            const LispToken* end,
+            const std::uint64_t firstLine,
+            std::vector<std::string>& result) {
+            const auto describe = [&](const LispToken* token) {
+                result.push_back(std::to_string(static_cast<int>(token->Kind)) + ":" + std::string(token->GetText()) +
+                    "@" + std::to_string(firstLine + token->Line - 1) + ":" + std::to_string(token->Column));
+            };
+            describe(begin);
+            if (const auto children = lexer.TokenizeSExpr(begin,true); children.has_value()) {
+                for (const LispToken* current = children->first; current <= children->second; ++current) {
+                    if (current->Kind == LispTokenKind::LeftParenthesis) {
+                        CollectForm(lexer,current,current + 1,firstLine,result);
+                        ++current;
+                        continue;
+                    }
+                    describe(current);
+                }
+            }
+            describe(end);
+        }
+
+        static std::vector<std::string> LexWhole(const std::string& program) {
+            const std::string padded = program + std::string(PaddingSize,EOF);
+            const auto lexer = LispLexer::Make(padded);
+            std::vector<std::string> result;
+            EXPECT_TRUE(lexer->Tokenize());
+            const auto first = lexer->TokenizeFirstSExpr();
+            const LispToken* begin = first.has_value() ? first->first : nullptr;
+            const LispToken* end = first.has_value() ? first->second : nullptr;
+            while (begin != nullptr) {
+                CollectForm(*lexer,begin,end,1,result);
+                const auto next = lexer->TokenizeNext(begin);
+                begin = next.has_value() ? next->first : nullptr;
+                end = next.has_value() ? next->second : nullptr;
+            }
+            return result;
+        }
+
+        static std::vector<std::string> LexStream(const std::string& program,
+            const std::size_t windowSize,
+            const LispLexerOptions& options = {}) {
+            std::istringstream input(program);
+            LispStreamLexer lexer(input,LispStreamLexerOptions{windowSize,options});
+            std::vector<std::string> result;
+            EXPECT_TRUE(lexer.Run([&](LispLexer& windowLexer,
+                const LispToken* begin,
+                const LispToken* end,
+                const StreamWindow& window) {
+                EXPECT_EQ(program.compare(window.Offset,begin->TextPtr - windowLexer.GetTextData(),
+                    windowLexer.GetTextData(),begin->TextPtr - windowLexer.GetTextData()),0);
+                CollectForm(windowLexer,begin,end,window.Line,result);
+                return true;
+            }));
+            return result;
+        }
+
+        static std::string MakeProgram(const std::size_t forms,const std::size_t largeFormAtoms) {
+            std::mt19937 random(7);
+            std::string program;
+            for (std::size_t form = 0; form < forms; ++form) {
+                program += "(defun f" + std::to_string(form) + " (x)";
+                const std::size_t atoms = form == forms / 2 ? largeFormAtoms : random() % 8;
+                for (std::size_t atom = 0; atom < atoms; ++atom) {
+                    switch (random() % 6) {
+                        case 0:
+                            program += "\n  (g x \"a ) \\\" (\n b\")";
+                            break;
+                        case 1:
+                            program += " ; ) (\n";
+                            break;
+                        case 2:
+                            program += " 1.5";
+                            break;
+                        default:
+                            program += " (h (k " + std::to_string(atom) + "))";
+                            break;
+                    }
+                }
+                program += random() % 2 ? ")\n" : ") ";
+                if (random() % 4 == 0) {
+                    program += "; top-level ) comment\n";
+                }
+            }
+            return program;
+        }
+    };
+
+    TEST_F(LispStreamLexerTest, WindowsMatchWholeText) {
+        //the form in the middle is larger than the window, making it grow
+        const std::string program = MakeProgram(400,200);
+        const auto expected = LexWhole(program);
+        ASSERT_FALSE(expected.empty());
+        EXPECT_EQ(LexStream(program,256),expected);
+        EXPECT_EQ(LexStream(program,program.size() * 2),expected);
+    }
+
+    //windows are cut from the blocks they are classified into, whichever engine then matches them
+    TEST_F(LispStreamLexerTest, WindowsMatchWholeTextForEveryEngine) {
+        const std::string program = MakeProgram(400,200);
+        const auto expected = LexWhole(program);
+        for (const BluePassEngine engine : {BluePassEngine::Sequential,BluePassEngine::Parallel,BluePassEngine::Fused}) {
+            for (const std::size_t windowSize : {std::size_t{64},std::size_t{200},std::size_t{4096}}) {
+                EXPECT_EQ(LexStream(program,windowSize,{.Threads = 2,.BlueEngine = engine}),expected)
+                    << static_cast<int>(engine) << " " << windowSize;
+            }
+        }
+    }
+
+    TEST_F(LispStreamLexerTest, EmptyStream) {
+        std::istringstream input;
+        LispStreamLexer lexer(input);
+        EXPECT_TRUE(lexer.Run([](LispLexer&,const LispToken*,const LispToken*,const StreamWindow&) {
+            ADD_FAILURE() << "no form expected";
+            return true;
+        }));
+        EXPECT_EQ(lexer.GetDiagnostics(),nullptr);
+    }
+
+    TEST_F(LispStreamLexerTest, CallbackStopsTheStream) {
+        std::istringstream input(MakeProgram(100,0));
+        LispStreamLexer lexer(input,LispStreamLexerOptions{128});
+        std::size_t forms = 0;
+        EXPECT_FALSE(lexer.Run([&](LispLexer&,const LispToken*,const LispToken*,const StreamWindow&) {
+            return ++forms < 3;
+        }));
+        EXPECT_EQ(forms,3);
+    }
+
+    TEST_F(LispStreamLexerTest, UnclosedFormIsReported) {
+        std::istringstream input("(a b)\n(c d)\n(e (f)\n");
+        LispStreamLexer lexer(input,LispStreamLexerOptions{8});
+        std::size_t forms = 0;
+        EXPECT_FALSE(lexer.Run([&](LispLexer&,const LispToken*,const LispToken*,const StreamWindow&) {
+            ++forms;
+            return true;
+        }));
+        EXPECT_EQ(forms,2);
+        ASSERT_NE(lexer.GetDiagnostics(),nullptr);
+        EXPECT_FALSE(lexer.GetDiagnostics()->Empty());
+    }
+}
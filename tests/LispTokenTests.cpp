@@ -306,6 +306,18 @@ namespace WideLips::Tests {
         EXPECT_EQ(location, 6);
     }
 
+    TEST_F(LispTokenTest, TextThroughTextStream) {
+        const auto text = "(hello world)";
+
+        const LispToken token{text + 7, 1, 5, 0, 8, 0, LispTokenKind::Identifier, 0};
+        const LispToken parenthesis{text, 1, 1, 0, 1, 3, LispTokenKind::LeftParenthesis, 0};
+
+        EXPECT_EQ(token.GetText(text), "world");
+        EXPECT_EQ(token.GetLength(), 5);
+        EXPECT_EQ(parenthesis.GetText(text), "(");
+        EXPECT_EQ(parenthesis.GetLength(), 1);
+    }
+
     TEST_F(LispTokenTest, MemberAccess) {
         const auto text = "test";
         const LispToken token{text, 5, 4, 2, 10, 3, LispTokenKind::Identifier, 1};
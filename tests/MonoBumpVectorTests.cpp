@@ -77,4 +77,21 @@ namespace WideLips::Tests {
         EXPECT_EQ(vec.Back().a, 42);
         EXPECT_EQ(vec.Back().b, 1764);
     }
+
+    TEST_F(MonoBumpVectorTest, PreserveRange) {
+        MonoBumpVector<TrivialPOD> vec(16);
+        vec.EmplaceBack({1, 1});
+        auto* range = vec.Preserve(3);
+        ASSERT_EQ(range, vec.At(1));
+        EXPECT_EQ(vec.Size(), 4u);
+        for (int i = 0; i < 3; ++i) {
+            range[i] = TrivialPOD{i, -i};
+        }
+        EXPECT_EQ(vec.Back().a, 2);
+        EXPECT_EQ(vec.Back().b, -2);
+
+        // Preserving nothing leaves the vector untouched
+        EXPECT_EQ(vec.Preserve(0), vec.end());
+        EXPECT_EQ(vec.Size(), 4u);
+    }
 }
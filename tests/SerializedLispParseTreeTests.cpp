@@ -0,0 +1,192 @@
+﻿#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include "LispParser.h"
+#include "LispParseTree.h"
+#include "SerializedLispParseTree.h"
+
+using namespace WideLips;
+using namespace testing;
+
+namespace WideLips::Tests {
+    // dumps every node under the ones it's handed along with its text, location and auxiliary, written once against
+    // 'TNodes' so live and serialized trees are dumped by the very same code
+    template<typename TNodes>
+    class DumpVisitor final : public ImmutableLispParseTreeVisitor<DumpVisitor<TNodes>, TNodes> {
+    private:
+        std::string& _dump;
+    public:
+        explicit DumpVisitor(std::string& dump) : _dump(dump) {}
+
+        void Visit(const typename TNodes::Atom* atom) const {
+            Emit("atom", atom);
+            _dump += std::to_string(static_cast<int>(atom->GetUnderlyingKind())) + "\n";
+        }
+
+        void Visit(const typename TNodes::List* list) const {
+            Emit("list", list);
+            _dump += "\n";
+            VisitChildren(list, list->GetSubExpressions(true));
+        }
+
+        void Visit(const typename TNodes::Arguments* arguments) const {
+            Emit("arguments", arguments);
+            _dump += "\n";
+            VisitChildren(arguments, arguments->GetArguments());
+        }
+
+        void Visit(const typename TNodes::Error* error) const {
+            Emit("error", error);
+            _dump += "\n";
+        }
+    private:
+        template<typename TNode>
+        void Emit(const char* kind, const TNode* node) const {
+            const SourceLocation location = node->GetSourceLocation();
+            _dump += std::string(kind) + " " + std::to_string(static_cast<int>(node->Kind)) + " '" +
+                std::string(node->GetParseNodeText()) + "' " + std::to_string(location.Line) + ":" +
+                std::to_string(location.ColumnChar);
+            if (const auto* auxiliary = node->GetNodeAuxiliary()) {
+                const SourceLocation auxiliaryLocation = auxiliary->GetSourceLocation();
+                _dump += " aux '" + std::string(auxiliary->GetParseNodeText()) + "' " +
+                    std::to_string(auxiliaryLocation.Line) + ":" + std::to_string(auxiliaryLocation.ColumnChar);
+            }
+            _dump += " ";
+        }
+
+        // the last sub-expression of a live list is followed by whatever S-expression comes after it in the text,
+        // sub-expressions are told apart by lying within their parent
+        template<typename TParent, typename TChild>
+        void VisitChildren(const TParent* parent, const TChild* child) const {
+            const std::string_view text = parent->GetParseNodeText();
+            for (; child != nullptr && child->Kind != LispParseNodeKind::EndOfProgram &&
+                child->GetParseNodeText().data() < text.data() + text.size();
+                child = child->NextNode()) {
+                child->Accept(this);
+            }
+            _dump += "end\n";
+        }
+    };
+
+    class SerializedLispParseTreeTest : public Test {
+    protected:
+        std::filesystem::path filePath;
+    protected:
+        void SetUp() override {
+            filePath = std::filesystem::temp_directory_path() / "SerializedLispParseTreeTest.wlt";
+            std::filesystem::remove(filePath);
+        }
+
+        void TearDown() override {
+            std::filesystem::remove(filePath);
+        }
+
+        static std::string Program(const std::size_t size) {
+            std::string program = "; leads\n";
+            for (int i = 0; program.size() < size; ++i) {
+                program += "(defun f" + std::to_string(i) + " (x y) ; adds\n  (+ x y \"a (b\" 'q ((g) 2) 1.5) ())\n";
+            }
+            return program + std::string(PaddingSize, EOF);
+        }
+
+        static std::string DumpLive(const LispParseNodeBase* root) {
+            std::string dump;
+            const DumpVisitor<LispParseNodes> visitor(dump);
+            for (const LispParseNodeBase* form = root;
+                form != nullptr && form->Kind != LispParseNodeKind::EndOfProgram;
+                form = form->NextNode()) {
+                form->Accept(&visitor);
+            }
+            return dump;
+        }
+
+        static std::string DumpSerialized(const SerializedLispParseTree& tree) {
+            std::string dump;
+            const DumpVisitor<SerializedLispParseNodes> visitor(dump);
+            for (const SerializedLispParseNode* form = tree.GetRoot(); form != nullptr; form = form->NextNode()) {
+                form->Accept(&visitor);
+            }
+            return dump;
+        }
+    };
+
+    TEST_F(SerializedLispParseTreeTest, MappedTreesVisitLikeTheLiveTree) {
+        const std::string program = Program(20000);
+        for (const SourceLocations locations : {SourceLocations::Eager, SourceLocations::Lazy}) {
+            LispParser parser(std::string_view(program), false, {.Locations = locations});
+            LispParseNodeBase* root = parser.Parse();
+            ASSERT_TRUE(SerializedLispParseTree::Write(filePath, root));
+            const std::string expected = DumpLive(root);
+            ASSERT_THAT(expected, HasSubstr("; adds"));
+
+            const auto tree = SerializedLispParseTree::Map(filePath);
+            ASSERT_NE(tree, nullptr);
+            EXPECT_TRUE(tree->Verify());
+            EXPECT_EQ(tree->GetProgram(), std::string_view(program).substr(0, program.size() - PaddingSize));
+            EXPECT_EQ(DumpSerialized(*tree), expected);
+        }
+    }
+
+    TEST_F(SerializedLispParseTreeTest, ViewsReadTheSerializedBytesInPlace) {
+        const std::string program = Program(2000);
+        LispParser parser(std::string_view(program), false);
+        LispParseNodeBase* root = parser.Parse();
+        const std::string bytes = SerializedLispParseTree::Serialize(root);
+        const auto tree = SerializedLispParseTree::View(bytes);
+        ASSERT_NE(tree, nullptr);
+        EXPECT_TRUE(tree->Verify());
+        EXPECT_EQ(DumpSerialized(*tree), DumpLive(root));
+        EXPECT_EQ(tree->GetRoot()->GetParseNodeText().data(), tree->GetProgram().data() + program.find('('));
+
+        // a form's sub-expressions come right after it and its next node comes after all of them
+        std::size_t nodes = 0;
+        for (const SerializedLispParseNode* form = tree->GetRoot(); form != nullptr; form = form->NextNode()) {
+            ++nodes;
+            const auto* list = reinterpret_cast<const SerializedLispList*>(form);
+            ASSERT_EQ(list->Kind, LispParseNodeKind::SExpr);
+            EXPECT_EQ(list->GetSubExpressions(), form + 1);
+        }
+        EXPECT_EQ(nodes, static_cast<std::size_t>(std::ranges::count(program, '\n') / 2));
+    }
+
+    TEST_F(SerializedLispParseTreeTest, EmptyTreesHaveNoRoot) {
+        const std::string empty = "; nothing\n" + std::string(PaddingSize, EOF);
+        for (const std::string& bytes : {SerializedLispParseTree::Serialize(nullptr),
+            SerializedLispParseTree::Serialize(LispParser(std::string_view(empty), false).Parse())}) {
+            const auto tree = SerializedLispParseTree::View(bytes);
+            ASSERT_NE(tree, nullptr);
+            EXPECT_EQ(tree->GetRoot(), nullptr);
+            EXPECT_EQ(tree->GetNodesCount(), 0u);
+            EXPECT_TRUE(tree->Verify());
+        }
+    }
+
+    TEST_F(SerializedLispParseTreeTest, DamagedBytesAreRejected) {
+        EXPECT_EQ(SerializedLispParseTree::Map(filePath), nullptr);
+        const std::string program = Program(2000);
+        LispParser parser(std::string_view(program), false);
+        LispParseNodeBase* root = parser.Parse();
+        ASSERT_TRUE(SerializedLispParseTree::Write(filePath, root));
+        const auto size = std::filesystem::file_size(filePath);
+        std::filesystem::resize_file(filePath, size - 1);
+        EXPECT_EQ(SerializedLispParseTree::Map(filePath), nullptr);
+        std::filesystem::resize_file(filePath, size);
+        EXPECT_NE(SerializedLispParseTree::Map(filePath), nullptr);
+        {
+            std::ofstream file(filePath, std::ios::binary | std::ios::in | std::ios::out);
+            file.write("garbage!", 8);
+        }
+        EXPECT_EQ(SerializedLispParseTree::Map(filePath), nullptr);
+
+        const std::string bytes = SerializedLispParseTree::Serialize(root);
+        const auto misaligned = std::make_unique<char[]>(bytes.size() + 1);
+        std::memcpy(misaligned.get() + 1, bytes.data(), bytes.size());
+        EXPECT_EQ(SerializedLispParseTree::View(std::string_view(misaligned.get() + 1, bytes.size())), nullptr);
+        EXPECT_EQ(SerializedLispParseTree::View(std::string_view(bytes).substr(0, 16)), nullptr);
+    }
+}
@@ -0,0 +1,125 @@
+﻿#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <cstdint>
+#include "VirtualBumpVector.h"
+
+using namespace WideLips;
+using namespace testing;
+
+namespace WideLips::Tests {
+
+    struct WidePOD { std::uint64_t a; std::uint64_t b; std::uint32_t c; };
+
+    class VirtualBumpVectorTest : public Test {};
+
+    TEST_F(VirtualBumpVectorTest, ReservesWithoutCommitting) {
+        VirtualBumpVector<int> vec(1 << 20);
+        EXPECT_TRUE(vec.Empty());
+        EXPECT_EQ(vec.Size(), 0u);
+        EXPECT_GE(vec.Capacity(), 1u << 20);
+        EXPECT_EQ(vec.CommittedSize(), 0u);
+
+        vec.EmplaceBack(7);
+        EXPECT_EQ(vec.Back(), 7);
+        EXPECT_GT(vec.CommittedSize(), 0u);
+        EXPECT_LT(vec.CommittedSize(), vec.Capacity() * sizeof(int));
+    }
+
+    TEST_F(VirtualBumpVectorTest, GrowsInPlaceAcrossCommits) {
+        constexpr std::size_t count = 100000; //several commits worth of elements
+        VirtualBumpVector<WidePOD> vec(count);
+        const WidePOD* first = vec.EmplaceBack({0, 0, 0});
+        for (std::size_t i = 1; i < count; ++i) {
+            vec.EmplaceBack({i, i * 2, static_cast<std::uint32_t>(i)});
+        }
+        ASSERT_EQ(vec.Size(), count);
+        EXPECT_EQ(vec.begin(), first);
+        for (std::size_t i = 0; i < count; ++i) {
+            ASSERT_EQ(vec[i].a, i);
+            ASSERT_EQ(vec[i].b, i * 2);
+            ASSERT_EQ(vec[i].c, static_cast<std::uint32_t>(i));
+        }
+        EXPECT_GE(vec.CommittedSize(), count * sizeof(WidePOD));
+    }
+
+    TEST_F(VirtualBumpVectorTest, PreserveSpanningUncommittedPages) {
+        VirtualBumpVector<std::uint64_t> vec(1 << 20);
+        vec.EmplaceBack(1);
+        const std::size_t committed = vec.CommittedSize();
+        const std::size_t span = committed / sizeof(std::uint64_t) * 3;
+        auto* range = vec.Preserve(span);
+        ASSERT_EQ(range, vec.At(1));
+        EXPECT_EQ(vec.Size(), span + 1);
+        EXPECT_GE(vec.CommittedSize(), (span + 1) * sizeof(std::uint64_t));
+        for (std::size_t i = 0; i < span; ++i) {
+            range[i] = i;
+        }
+        EXPECT_EQ(vec.Back(), span - 1);
+
+        // Preserving nothing leaves the vector untouched
+        EXPECT_EQ(vec.Preserve(0), vec.end());
+        EXPECT_EQ(vec.Size(), span + 1);
+    }
+
+    TEST_F(VirtualBumpVectorTest, ReuseKeepsCommittedPages) {
+        VirtualBumpVector<int> vec(1 << 16);
+        for (int i = 0; i < 30000; ++i) {
+            vec.EmplaceBack(int{i});
+        }
+        const std::size_t committed = vec.CommittedSize();
+        const int* arena = vec.begin();
+
+        vec.Reuse();
+        EXPECT_TRUE(vec.Empty());
+        EXPECT_EQ(vec.CommittedSize(), committed);
+
+        vec.EmplaceBack(42);
+        EXPECT_EQ(vec.begin(), arena);
+        EXPECT_EQ(vec.Size(), 1u);
+        EXPECT_EQ(vec.Back(), 42);
+        vec.PopBack();
+        EXPECT_TRUE(vec.Empty());
+    }
+
+    TEST_F(VirtualBumpVectorTest, MoveTransfersReservation) {
+        VirtualBumpVector<int> source(1024);
+        source.EmplaceBack(3);
+        source.EmplaceBack(4);
+        const int* arena = source.begin();
+
+        VirtualBumpVector<int> target(std::move(source));
+        EXPECT_EQ(target.begin(), arena);
+        EXPECT_EQ(target.Size(), 2u);
+        EXPECT_EQ(target.Back(), 4);
+
+        VirtualBumpVector<int> other(16);
+        other = std::move(target);
+        EXPECT_EQ(other.begin(), arena);
+        other.EmplaceBack(5);
+        EXPECT_EQ(other.Size(), 3u);
+    }
+
+    TEST_F(VirtualBumpVectorTest, HugePagesCommitInWholeHugePages) {
+        constexpr std::size_t count = 1 << 20;
+        VirtualBumpVector<std::uint64_t> vec(count, nullptr, true);
+        EXPECT_EQ(vec.Capacity() * sizeof(std::uint64_t) % VirtualMemory::HugePageSize, 0u);
+#if WL_POSIX
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(vec.begin()) % VirtualMemory::HugePageSize, 0u);
+#endif
+        for (std::size_t i = 0; i < count; ++i) {
+            vec.EmplaceBack(std::uint64_t{i});
+            ASSERT_EQ(vec.CommittedSize() % VirtualMemory::HugePageSize, 0u);
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            ASSERT_EQ(vec[i], i);
+        }
+
+        // A larger reservation stays backed by huge pages
+        vec.Reserve(count * 4);
+#if WL_POSIX
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(vec.begin()) % VirtualMemory::HugePageSize, 0u);
+#endif
+        vec.CommitFor(1);
+        EXPECT_EQ(vec.CommittedSize(), VirtualMemory::HugePageSize);
+    }
+}